@@ -0,0 +1,337 @@
+#include "receive_backend.hpp"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+#include "adaptive_wait.hpp"
+#include "logging.hpp"
+#include "stats.hpp"
+#include "timing.hpp"
+
+// Receive scheduler that picks its own strategy from the load: a blocking
+// wakeup per burst read one datagram at a time when it is quiet, batched
+// reads whose size follows the queue depth when it is busy, and busy
+// polling without wakeups when even that falls behind.  Every --adapt-ms
+// window it looks at the arrival rate and at how deep the queue was, steps
+// up as soon as either says so, and only steps down after --adapt-hold
+// windows in a row below half the rate that took it up.
+
+namespace
+{
+
+enum class RxMode
+{
+    blocking,
+    batched,
+    busy_poll,
+};
+
+auto rx_mode_to_str(RxMode m) -> char const*
+{
+    switch (m)
+    {
+        case RxMode::blocking:
+            return "blocking";
+        case RxMode::batched:
+            return "batched";
+        case RxMode::busy_poll:
+            return "busy-poll";
+    }
+    return "?";
+}
+
+class AdaptiveBackend : public ReceiveBackend
+{
+public:
+    AdaptiveBackend(int sock_fd, Options const& opts)
+        : sock_fd_(sock_fd),
+          buffer_size_(static_cast<std::size_t>(opts.get_int("buffer-size", 2048))),
+          min_batch_(static_cast<std::size_t>(std::max(1LL, opts.get_int("adapt-min-batch", 4)))),
+          max_batch_(std::max(
+              min_batch_, static_cast<std::size_t>(opts.get_int("adapt-max-batch", 256)))),
+          window_ns_(static_cast<std::uint64_t>(opts.get_double("adapt-ms", 10.0) * 1e6)),
+          batch_rate_(opts.get_double("adapt-batch-rate", 20000.0)),
+          busy_rate_(opts.get_double("adapt-busy-rate", 200000.0)),
+          hold_(static_cast<unsigned>(std::max(1LL, opts.get_int("adapt-hold", 3)))),
+          busy_ns_(static_cast<std::uint64_t>(opts.get_double("adapt-busy-us", 50.0) * 1e3)),
+          batch_(min_batch_),
+          buffers_(max_batch_ * buffer_size_)
+#ifdef __linux__
+          ,
+          iovs_(max_batch_),
+          msgs_(max_batch_)
+#endif
+    {
+#ifdef __linux__
+        for (std::size_t i = 0; i < max_batch_; ++i)
+        {
+            iovs_[i].iov_base = buffers_.data() + i * buffer_size_;
+            iovs_[i].iov_len  = buffer_size_;
+            std::memset(&msgs_[i], 0, sizeof(msgs_[i]));
+            msgs_[i].msg_hdr.msg_iov    = &iovs_[i];
+            msgs_[i].msg_hdr.msg_iovlen = 1;
+        }
+#endif
+        window_start_ = now_ns();
+        mode_since_   = window_start_;
+    }
+    ~AdaptiveBackend() override { ::close(sock_fd_); }
+
+    auto name() const -> char const* override { return "adaptive"; }
+
+    auto poll(DatagramHandler const& handler, int timeout_ms) -> int override
+    {
+        // However busy, the caller gets control back once per window
+        auto const phase_end = now_ns() + window_ns_;
+        auto count           = 0;
+        if (mode_ == RxMode::busy_poll)
+        {
+            // Spin on non-blocking reads, back to the caller after a quiet spell
+            auto now        = now_ns();
+            auto idle_since = now;
+            while (now - idle_since < busy_ns_ && now < phase_end)
+            {
+                auto const n = read_batch(handler, batch_);
+                now          = now_ns();
+                if (n > 0)
+                {
+                    count += n;
+                    note_depth(static_cast<std::size_t>(n));
+                    idle_since = now;
+                    grow_batch(static_cast<std::size_t>(n));
+                }
+                else
+                {
+                    cpu_relax();
+                }
+            }
+        }
+        else if (wait_readable(timeout_ms))
+        {
+            // Drain what the wakeup found, one datagram or one batch per call
+            auto const per_read = mode_ == RxMode::blocking ? 1 : batch_;
+            for (;;)
+            {
+                auto const n = read_batch(handler, per_read);
+                count += n;
+                if (mode_ == RxMode::batched)
+                {
+                    grow_batch(static_cast<std::size_t>(n));
+                }
+                if (static_cast<std::size_t>(n) < per_read || now_ns() >= phase_end)
+                {
+                    break;
+                }
+            }
+            note_depth(static_cast<std::size_t>(count));
+        }
+        datagrams_ += static_cast<std::uint64_t>(count);
+        evaluate();
+        return count;
+    }
+
+    auto status() const -> std::string override
+    {
+        std::stringstream ss;
+        ss << rx_mode_to_str(mode_) << ", batch " << batch_ << ", "
+           << format_rate(last_rate_);
+        return ss.str();
+    }
+
+    auto report() -> std::string override
+    {
+        switch_to(mode_, now_ns()); // closes the current stretch
+        std::stringstream ss;
+        ss << transitions_ << " mode changes; time blocking " << format_ns(time_in_[0])
+           << ", batched " << format_ns(time_in_[1]) << ", busy-poll " << format_ns(time_in_[2])
+           << "; ended " << status();
+        return ss.str();
+    }
+
+private:
+    auto wait_readable(int timeout_ms) -> bool
+    {
+        pollfd pfd{sock_fd_, POLLIN, 0};
+        auto const n = ::poll(&pfd, 1, timeout_ms);
+        exit_on_error(n < 0 && errno != EINTR ? -1 : 0, Component::client, "poll");
+        return n > 0;
+    }
+
+    /// Up to `max` datagrams without blocking
+    auto read_batch(DatagramHandler const& handler, std::size_t max) -> int
+    {
+#ifdef __linux__
+        if (max > 1)
+        {
+            // clang-format off
+            auto const n = ::recvmmsg(
+                sock_fd_,
+                msgs_.data(),
+                static_cast<unsigned>(max),
+                MSG_DONTWAIT,
+                nullptr
+            );
+            // clang-format on
+            if (n < 0)
+            {
+                check_errno("recvmmsg");
+                return 0;
+            }
+            auto const rx_ns = now_ns();
+            for (int i = 0; i < n; ++i)
+            {
+                handler(Datagram{
+                    static_cast<char const*>(iovs_[i].iov_base), msgs_[i].msg_len, rx_ns});
+            }
+            return n;
+        }
+#endif
+        auto count = 0;
+        for (; static_cast<std::size_t>(count) < max; ++count)
+        {
+            auto const n = ::recv(sock_fd_, buffers_.data(), buffer_size_, MSG_DONTWAIT);
+            if (n < 0)
+            {
+                check_errno("recv");
+                break;
+            }
+            handler(Datagram{buffers_.data(), static_cast<std::size_t>(n), now_ns()});
+        }
+        return count;
+    }
+
+    auto check_errno(char const* what) -> void
+    {
+        exit_on_errno(
+            errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1,
+            Component::client,
+            what);
+    }
+
+    auto note_depth(std::size_t n) -> void { window_depth_ = std::max(window_depth_, n); }
+
+    /// A read that filled the batch left more behind: twice as many next time
+    auto grow_batch(std::size_t n) -> void
+    {
+        if (n == batch_)
+        {
+            batch_ = std::min(batch_ * 2, max_batch_);
+        }
+    }
+
+    /// Once per window: where rate and depth say we should be, with the
+    /// step down delayed by hysteresis
+    auto evaluate() -> void
+    {
+        auto const now = now_ns();
+        if (now - window_start_ < window_ns_)
+        {
+            return;
+        }
+        // Smoothed, so one window lost to the scheduler does not decide anything
+        auto const elapsed = static_cast<double>(now - window_start_);
+        auto const rate    = static_cast<double>(datagrams_) * 1e9 / elapsed;
+        last_rate_         = last_rate_ == 0.0 ? rate : 0.75 * last_rate_ + 0.25 * rate;
+        auto const depth   = window_depth_;
+        window_start_      = now;
+        window_depth_      = 0;
+        datagrams_         = 0;
+
+        // A queue of more than a batch means the reads are not keeping up
+        auto const up = mode_ == RxMode::blocking
+                            ? last_rate_ >= batch_rate_ || depth >= min_batch_
+                            : mode_ == RxMode::batched && (last_rate_ >= busy_rate_ ||
+                                                           depth >= max_batch_);
+        // and stepping down waits for the reads to stop coming back full
+        auto const down = mode_ == RxMode::busy_poll
+                              ? last_rate_ < down_rate_ && depth < batch_
+                          : mode_ == RxMode::batched
+                              ? last_rate_ < down_rate_ && depth < min_batch_
+                              : false;
+        if (up)
+        {
+            quiet_windows_ = 0;
+            switch_to(static_cast<RxMode>(static_cast<int>(mode_) + 1), now, depth);
+            return;
+        }
+        quiet_windows_ = down ? quiet_windows_ + 1 : 0;
+        if (quiet_windows_ >= hold_)
+        {
+            quiet_windows_ = 0;
+            switch_to(static_cast<RxMode>(static_cast<int>(mode_) - 1), now, depth);
+            return;
+        }
+        if (mode_ == RxMode::batched && depth * 4 < batch_)
+        {
+            // Batches mostly empty: smaller ones cost less per wakeup
+            batch_ = std::max(batch_ / 2, min_batch_);
+        }
+    }
+
+    auto switch_to(RxMode mode, std::uint64_t now, std::size_t depth = 0) -> void
+    {
+        time_in_[static_cast<int>(mode_)] += now - mode_since_;
+        mode_since_ = now;
+        if (mode == mode_)
+        {
+            return;
+        }
+        std::stringstream ss;
+        ss << "adaptive: " << rx_mode_to_str(mode_) << " -> " << rx_mode_to_str(mode) << " at "
+           << format_rate(last_rate_) << ", queue depth " << depth << ", batch " << batch_;
+        info(Component::client, ss.str());
+        // A step up on depth alone happened below the configured rate, and
+        // only a drop below half of that rate says the load has gone again
+        auto const threshold = mode == RxMode::batched ? batch_rate_ : busy_rate_;
+        down_rate_ = (mode > mode_ ? std::min(threshold, last_rate_) : threshold) / 2;
+        mode_      = mode;
+        ++transitions_;
+        if (mode_ == RxMode::batched)
+        {
+            batch_ = std::max(batch_, min_batch_);
+        }
+    }
+
+    int sock_fd_;
+    std::size_t buffer_size_;
+    std::size_t min_batch_;
+    std::size_t max_batch_;
+    std::uint64_t window_ns_;
+    double batch_rate_; ///< into batched at this rate (or on queue depth)
+    double busy_rate_;  ///< into busy polling at this rate (or on queue depth)
+    unsigned hold_;     ///< windows below the threshold before stepping down
+    std::uint64_t busy_ns_;
+
+    RxMode mode_{RxMode::blocking};
+    std::size_t batch_;
+    std::uint64_t window_start_{0};
+    std::size_t window_depth_{0};
+    std::uint64_t datagrams_{0};
+    double last_rate_{0.0};
+    double down_rate_{0.0}; ///< below this the current mode starts counting quiet windows
+    unsigned quiet_windows_{0};
+    std::uint64_t mode_since_{0};
+    std::array<std::uint64_t, 3> time_in_{};
+    std::uint64_t transitions_{0};
+
+    std::vector<char> buffers_;
+#ifdef __linux__
+    std::vector<iovec> iovs_;
+    std::vector<mmsghdr> msgs_;
+#endif
+};
+
+} // namespace
+
+auto make_adaptive_backend(int sock_fd, Options const& opts) -> std::unique_ptr<ReceiveBackend>
+{
+    return std::make_unique<AdaptiveBackend>(sock_fd, opts);
+}
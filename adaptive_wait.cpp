@@ -0,0 +1,74 @@
+#include "adaptive_wait.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+
+#ifdef __linux__
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <ctime>
+#endif
+
+#include <thread>
+
+using namespace std::chrono_literals;
+
+auto AdaptiveWaiter::notify_one() -> void
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleepers_.load(std::memory_order_relaxed) != 0)
+    {
+        wake(1);
+    }
+}
+
+auto AdaptiveWaiter::notify_all() -> void
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (sleepers_.load(std::memory_order_relaxed) != 0)
+    {
+        wake(INT_MAX);
+    }
+}
+
+auto AdaptiveWaiter::sleep(std::uint32_t const key, std::uint64_t const max_ns) -> void
+{
+    sleeps_.fetch_add(1, std::memory_order_relaxed);
+#ifdef __linux__
+    // Bounded so a missed shutdown flag can't park a worker forever
+    auto const ns = std::min<std::uint64_t>(max_ns, 10 * 1000 * 1000);
+    timespec const timeout{0, static_cast<long>(ns)};
+    ::syscall(
+        SYS_futex,
+        reinterpret_cast<std::uint32_t*>(&epoch_),
+        FUTEX_WAIT_PRIVATE,
+        key,
+        &timeout,
+        nullptr,
+        0);
+#else
+    (void)key;
+    std::this_thread::sleep_for(std::min<std::chrono::nanoseconds>(
+        50us, std::chrono::nanoseconds(static_cast<std::int64_t>(max_ns))));
+#endif
+}
+
+auto AdaptiveWaiter::wake(int const count) -> void
+{
+    epoch_.fetch_add(1, std::memory_order_seq_cst);
+#ifdef __linux__
+    ::syscall(
+        SYS_futex,
+        reinterpret_cast<std::uint32_t*>(&epoch_),
+        FUTEX_WAKE_PRIVATE,
+        count,
+        nullptr,
+        nullptr,
+        0);
+#else
+    (void)count;
+#endif
+}
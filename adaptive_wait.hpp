@@ -0,0 +1,111 @@
+#ifndef ADAPTIVE_WAIT_HPP_T0KFQ6VB
+#define ADAPTIVE_WAIT_HPP_T0KFQ6VB
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include "timing.hpp"
+#include "types.hpp"
+
+inline auto cpu_relax() -> void
+{
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield" ::: "memory");
+#endif
+}
+
+/// Lets consumers of a lock-free queue wait for work without a mutex.  A
+/// waiter spins for a while, then yields, and only then sleeps on a futex
+/// (QNX: a short sleep).  Producers pay one relaxed load per notify unless
+/// somebody actually sleeps.
+class AdaptiveWaiter
+{
+public:
+    static unsigned constexpr spin_limit       = 256;
+    static unsigned constexpr yield_limit      = 64;
+    static std::uint64_t constexpr no_deadline = UINT64_MAX;
+
+    /// Returns once `ready()` is true.  `ready` should also check for
+    /// shutdown; sleeps are bounded so shutdown is noticed within a few ms.
+    template <typename Pred> auto wait(Pred&& ready) -> void { wait_until(no_deadline, ready); }
+
+    /// Like wait(), but gives up at `deadline_ns` (now_ns() time): the last
+    /// sleep is cut to what is left, not a whole futex timeout.  Returns
+    /// whether `ready()` became true.
+    template <typename Pred> auto wait_until(std::uint64_t deadline_ns, Pred&& ready) -> bool;
+
+    auto notify_one() -> void;
+    auto notify_all() -> void;
+
+    /// How often waiters had to go all the way to the kernel
+    auto sleeps() const -> std::uint64_t { return sleeps_.load(std::memory_order_relaxed); }
+
+private:
+    /// Sleeps until woken, but at most `max_ns`
+    auto sleep(std::uint32_t key, std::uint64_t max_ns) -> void;
+    auto wake(int count) -> void;
+
+    alignas(cache_line_size) std::atomic<std::uint32_t> epoch_{0};
+    std::atomic<std::uint32_t> sleepers_{0};
+    std::atomic<std::uint64_t> sleeps_{0};
+};
+
+template <typename Pred>
+auto AdaptiveWaiter::wait_until(std::uint64_t const deadline_ns, Pred&& ready) -> bool
+{
+    // Only bounded waits read the clock
+    auto const expired = [deadline_ns] {
+        return deadline_ns != no_deadline && now_ns() >= deadline_ns;
+    };
+    for (unsigned i = 0; i < spin_limit; ++i)
+    {
+        if (ready())
+        {
+            return true;
+        }
+        if (expired())
+        {
+            return false;
+        }
+        cpu_relax();
+    }
+    for (unsigned i = 0; i < yield_limit; ++i)
+    {
+        if (ready())
+        {
+            return true;
+        }
+        if (expired())
+        {
+            return false;
+        }
+        std::this_thread::yield();
+    }
+    for (;;)
+    {
+        sleepers_.fetch_add(1, std::memory_order_seq_cst);
+        auto const key = epoch_.load(std::memory_order_seq_cst);
+        if (ready())
+        {
+            sleepers_.fetch_sub(1, std::memory_order_relaxed);
+            return true;
+        }
+        auto const now = deadline_ns == no_deadline ? 0 : now_ns();
+        if (now >= deadline_ns)
+        {
+            sleepers_.fetch_sub(1, std::memory_order_relaxed);
+            return false;
+        }
+        sleep(key, deadline_ns - now);
+        sleepers_.fetch_sub(1, std::memory_order_relaxed);
+        if (ready())
+        {
+            return true;
+        }
+    }
+}
+
+#endif /* end of include guard: ADAPTIVE_WAIT_HPP_T0KFQ6VB */
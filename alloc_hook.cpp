@@ -0,0 +1,146 @@
+#include "alloc_hook.hpp"
+
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+
+std::atomic<std::uint64_t> allocations{0};
+std::atomic<std::uint64_t> violations{0};
+std::atomic<std::uint64_t> first_violation{0};
+std::atomic<int> armed_threads{0}; ///< threads with the guard armed
+thread_local int armed  = 0;       ///< this thread's nested arm_alloc_guard() calls
+thread_local bool fatal = false;
+
+#ifdef BIND_TEST_EMBEDDED
+[[noreturn]] auto out_of_memory() -> void
+{
+#ifdef __cpp_exceptions
+    throw std::bad_alloc{};
+#else
+    std::abort();
+#endif
+}
+
+auto count(std::size_t size) -> void
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (armed == 0)
+    {
+        return;
+    }
+    if (violations.fetch_add(1, std::memory_order_relaxed) == 0)
+    {
+        first_violation.store(size, std::memory_order_relaxed);
+    }
+    if (fatal)
+    {
+        // Nothing that could allocate again: no logging, no iostream
+        static char const msg[] = "bind-test: heap allocation after initialization\n";
+        ::write(STDERR_FILENO, msg, sizeof(msg) - 1);
+        std::abort();
+    }
+}
+
+auto allocate(std::size_t size) -> void*
+{
+    count(size);
+    if (auto* p = std::malloc(size == 0 ? 1 : size))
+    {
+        return p;
+    }
+    out_of_memory();
+}
+
+auto allocate(std::size_t size, std::align_val_t align) -> void*
+{
+    count(size);
+    auto const a = std::max(static_cast<std::size_t>(align), sizeof(void*));
+    void* p      = nullptr;
+    if (::posix_memalign(&p, a, size == 0 ? 1 : size) == 0)
+    {
+        return p;
+    }
+    out_of_memory();
+}
+#endif
+
+} // namespace
+
+#ifdef BIND_TEST_EMBEDDED
+// clang-format off
+auto operator new(std::size_t size) -> void* { return allocate(size); }
+auto operator new[](std::size_t size) -> void* { return allocate(size); }
+auto operator new(std::size_t size, std::align_val_t a) -> void* { return allocate(size, a); }
+auto operator new[](std::size_t size, std::align_val_t a) -> void* { return allocate(size, a); }
+
+auto operator new(std::size_t size, std::nothrow_t const&) noexcept -> void*
+{
+    count(size);
+    return std::malloc(size == 0 ? 1 : size);
+}
+auto operator new[](std::size_t size, std::nothrow_t const&) noexcept -> void*
+{
+    count(size);
+    return std::malloc(size == 0 ? 1 : size);
+}
+
+auto operator delete(void* p) noexcept -> void { std::free(p); }
+auto operator delete[](void* p) noexcept -> void { std::free(p); }
+auto operator delete(void* p, std::size_t) noexcept -> void { std::free(p); }
+auto operator delete[](void* p, std::size_t) noexcept -> void { std::free(p); }
+auto operator delete(void* p, std::align_val_t) noexcept -> void { std::free(p); }
+auto operator delete[](void* p, std::align_val_t) noexcept -> void { std::free(p); }
+auto operator delete(void* p, std::size_t, std::align_val_t) noexcept -> void { std::free(p); }
+auto operator delete[](void* p, std::size_t, std::align_val_t) noexcept -> void { std::free(p); }
+auto operator delete(void* p, std::nothrow_t const&) noexcept -> void { std::free(p); }
+auto operator delete[](void* p, std::nothrow_t const&) noexcept -> void { std::free(p); }
+// clang-format on
+#endif
+
+auto alloc_hook_enabled() -> bool
+{
+#ifdef BIND_TEST_EMBEDDED
+    return true;
+#else
+    return false;
+#endif
+}
+
+auto allocation_count() -> std::uint64_t
+{
+    return allocations.load(std::memory_order_relaxed);
+}
+
+auto arm_alloc_guard(bool abort_on_alloc) -> void
+{
+    if (armed++ == 0 && armed_threads.fetch_add(1, std::memory_order_relaxed) == 0)
+    {
+        violations.store(0, std::memory_order_relaxed);
+    }
+    fatal = fatal || abort_on_alloc;
+}
+
+auto disarm_alloc_guard() -> void
+{
+    if (--armed == 0)
+    {
+        armed_threads.fetch_sub(1, std::memory_order_relaxed);
+        fatal = false;
+    }
+}
+
+auto allocations_after_init() -> std::uint64_t
+{
+    return violations.load(std::memory_order_relaxed);
+}
+
+auto first_allocation_after_init() -> std::uint64_t
+{
+    return first_violation.load(std::memory_order_relaxed);
+}
@@ -0,0 +1,29 @@
+#ifndef ALLOC_HOOK_HPP_Z5PK7GUA
+#define ALLOC_HOOK_HPP_Z5PK7GUA
+
+#include <cstdint>
+
+// Counting replacement of the global operator new/delete, compiled in with
+// BIND_TEST_EMBEDDED.  Startup may allocate as it likes; once the data path
+// is set up, arm_alloc_guard() marks the end of initialization and every
+// allocation after it is counted (or aborts, for a core dump showing where).
+// Without the hook the functions below are no-ops reporting zero.
+
+/// True when operator new is replaced and the counters mean something
+auto alloc_hook_enabled() -> bool;
+
+/// Allocations (calls to operator new) since the process started
+auto allocation_count() -> std::uint64_t;
+
+/// Starts counting allocations as violations; `abort_on_alloc` makes the
+/// first one fatal instead.  The guard is per thread, so one thread's setup is
+/// not charged to another already in its data path; it nests, and the count
+/// restarts only when no thread has it armed.
+auto arm_alloc_guard(bool abort_on_alloc = false) -> void;
+auto disarm_alloc_guard() -> void;
+
+/// Allocations while armed, and the size of the first of them
+auto allocations_after_init() -> std::uint64_t;
+auto first_allocation_after_init() -> std::uint64_t;
+
+#endif /* end of include guard: ALLOC_HOOK_HPP_Z5PK7GUA */
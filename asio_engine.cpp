@@ -0,0 +1,316 @@
+#include "flow_engine.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/error.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/udp.hpp>
+#include <boost/asio/steady_timer.hpp>
+
+#include "logging.hpp"
+#include "realtime.hpp"
+
+// The flow table on Asio.  Nothing here is Linux specific, so this is the
+// comparison point wherever the newer receive backends are not available.
+
+namespace
+{
+
+/// Where one flow's handlers live.  A flow never has more than one
+/// operation outstanding and Asio frees an operation's memory before
+/// calling its handler, so the block is always free again by the time the
+/// next operation is started.
+class HandlerMemory
+{
+public:
+    static std::size_t constexpr size = 512;
+
+    HandlerMemory()                                        = default;
+    HandlerMemory(HandlerMemory const&)                    = delete;
+    auto operator=(HandlerMemory const&) -> HandlerMemory& = delete;
+
+    auto allocate(std::size_t bytes) -> void*
+    {
+        if (!in_use_ && bytes <= size)
+        {
+            in_use_ = true;
+            ++recycled_;
+            return storage_;
+        }
+        // Larger than expected or a second operation: still works, shows in the report
+        ++heap_;
+        return ::operator new(bytes);
+    }
+
+    auto deallocate(void* p) -> void
+    {
+        if (p == storage_)
+        {
+            in_use_ = false;
+            return;
+        }
+        ::operator delete(p);
+    }
+
+    auto recycled() const -> std::uint64_t { return recycled_; }
+    auto heap() const -> std::uint64_t { return heap_; }
+
+private:
+    alignas(std::max_align_t) unsigned char storage_[size];
+    bool in_use_{false};
+    std::uint64_t recycled_{0};
+    std::uint64_t heap_{0};
+};
+
+/// Allocator Asio finds through the handler's get_allocator()
+template <typename T> class HandlerAllocator
+{
+public:
+    using value_type = T;
+
+    explicit HandlerAllocator(HandlerMemory& memory) : memory_(&memory) {}
+    template <typename U>
+    HandlerAllocator(HandlerAllocator<U> const& other) noexcept : memory_(other.memory_)
+    {
+    }
+
+    auto allocate(std::size_t n) const -> T*
+    {
+        return static_cast<T*>(memory_->allocate(sizeof(T) * n));
+    }
+    auto deallocate(T* p, std::size_t) const -> void { memory_->deallocate(p); }
+
+    auto operator==(HandlerAllocator const& other) const -> bool
+    {
+        return memory_ == other.memory_;
+    }
+    auto operator!=(HandlerAllocator const& other) const -> bool
+    {
+        return memory_ != other.memory_;
+    }
+
+private:
+    template <typename> friend class HandlerAllocator;
+    HandlerMemory* memory_;
+};
+
+/// Wraps a completion handler so its operation is allocated from `memory`
+template <typename Handler> class RecyclingHandler
+{
+public:
+    using allocator_type = HandlerAllocator<Handler>;
+
+    RecyclingHandler(HandlerMemory& memory, Handler handler)
+        : memory_(memory), handler_(std::move(handler))
+    {
+    }
+
+    auto get_allocator() const noexcept -> allocator_type { return allocator_type(memory_); }
+
+    template <typename... Args> auto operator()(Args&&... args) -> void
+    {
+        handler_(std::forward<Args>(args)...);
+    }
+
+private:
+    HandlerMemory& memory_;
+    Handler handler_;
+};
+
+template <typename Handler>
+auto recycling(HandlerMemory& memory, Handler handler) -> RecyclingHandler<Handler>
+{
+    return RecyclingHandler<Handler>(memory, std::move(handler));
+}
+
+struct AsioFlow
+{
+    AsioFlow(boost::asio::io_context& io, int fd, std::size_t buffer_size)
+        : socket(io, boost::asio::ip::udp::v4(), fd), timer(io), buffer(buffer_size, 0)
+    {
+    }
+
+    boost::asio::ip::udp::socket socket;
+    boost::asio::steady_timer timer;
+    std::vector<char> buffer;
+    std::chrono::steady_clock::duration period{};
+    HandlerMemory memory;
+};
+
+class AsioEngine : public FlowEngine
+{
+public:
+    AsioEngine(
+        FlowTable const& flows,
+        std::vector<int> const& fds,
+        std::vector<FlowCounters>& counters,
+        Options const& opts)
+        : flows_(flows),
+          counters_(counters),
+          threads_(static_cast<std::size_t>(std::max(1LL, opts.get_int("asio-threads", 1)))),
+          io_(static_cast<int>(threads_))
+    {
+        // One allocation per flow up front: AsioFlow holds the handler
+        // memory, so it must not move once operations are started
+        for (std::size_t i = 0; i < flows_.size(); ++i)
+        {
+            auto const size = flows_[i].role == FlowRole::send
+                                  ? std::max<std::size_t>(flows_[i].payload, sizeof(std::uint64_t))
+                                  : 65536;
+            asio_flows_.push_back(std::make_unique<AsioFlow>(io_, fds[i], size));
+        }
+
+        auto const now = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < flows_.size(); ++i)
+        {
+            if (flows_[i].role == FlowRole::receive)
+            {
+                start_receive(i);
+            }
+            else if (flows_[i].rate > 0)
+            {
+                auto& flow  = *asio_flows_[i];
+                flow.period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>(1.0 / flows_[i].rate));
+                flow.timer.expires_at(now);
+                start_wait(i);
+            }
+        }
+
+        auto const tuning = thread_tuning_from_options(opts, "client");
+        for (std::size_t t = 0; t < threads_; ++t)
+        {
+            pool_.emplace_back([this, tuning] {
+                apply_thread_tuning(Component::client, tuning);
+                io_.run();
+            });
+        }
+    }
+
+    ~AsioEngine() override { stop(); }
+
+    auto stop() -> void override
+    {
+        stopping_ = true;
+        io_.stop();
+        for (auto& t : pool_)
+        {
+            if (t.joinable())
+            {
+                t.join();
+            }
+        }
+        // The descriptors go back to run_flows(), which closes them.  Then
+        // the aborted operations are run down here, while their memory exists.
+        for (auto& flow : asio_flows_)
+        {
+            boost::system::error_code ec;
+            flow->timer.cancel();
+            flow->socket.release(ec);
+        }
+        io_.restart();
+        io_.run();
+    }
+
+    auto report() const -> std::string override
+    {
+        std::uint64_t recycled = 0;
+        std::uint64_t heap     = 0;
+        for (auto const& flow : asio_flows_)
+        {
+            recycled += flow->memory.recycled();
+            heap += flow->memory.heap();
+        }
+        std::stringstream ss;
+        ss << threads_ << " io_context threads, " << recycled
+           << " handler allocations recycled, " << heap << " from the heap";
+        return ss.str();
+    }
+
+private:
+    auto start_receive(std::size_t i) -> void
+    {
+        auto& flow = *asio_flows_[i];
+        flow.socket.async_receive(
+            boost::asio::buffer(flow.buffer),
+            recycling(flow.memory, [this, i](boost::system::error_code ec, std::size_t n) {
+                if (stopping_ || ec == boost::asio::error::operation_aborted)
+                {
+                    return;
+                }
+                if (!ec)
+                {
+                    count_received(counters_[i], asio_flows_[i]->buffer.data(), n);
+                }
+                start_receive(i);
+            }));
+    }
+
+    auto start_wait(std::size_t i) -> void
+    {
+        auto& flow = *asio_flows_[i];
+        flow.timer.async_wait(recycling(flow.memory, [this, i](boost::system::error_code ec) {
+            if (stopping_ || ec == boost::asio::error::operation_aborted)
+            {
+                return;
+            }
+            start_send(i);
+        }));
+    }
+
+    auto start_send(std::size_t i) -> void
+    {
+        auto& flow    = *asio_flows_[i];
+        auto& counter = counters_[i];
+        std::memcpy(flow.buffer.data(), &counter.next_seq, sizeof(counter.next_seq));
+        flow.socket.async_send(
+            boost::asio::buffer(flow.buffer),
+            recycling(flow.memory, [this, i](boost::system::error_code ec, std::size_t n) {
+                auto& flow    = *asio_flows_[i];
+                auto& counter = counters_[i];
+                if (stopping_ || ec == boost::asio::error::operation_aborted)
+                {
+                    return;
+                }
+                if (ec)
+                {
+                    counter.lost.fetch_add(1, std::memory_order_relaxed);
+                }
+                else
+                {
+                    ++counter.next_seq;
+                    counter.datagrams.fetch_add(1, std::memory_order_relaxed);
+                    counter.bytes.fetch_add(n, std::memory_order_relaxed);
+                }
+                // Paced from the schedule, not from when the send completed
+                flow.timer.expires_at(flow.timer.expiry() + flow.period);
+                start_wait(i);
+            }));
+    }
+
+    FlowTable const& flows_;
+    std::vector<FlowCounters>& counters_;
+    std::size_t threads_;
+    boost::asio::io_context io_;
+    std::vector<std::unique_ptr<AsioFlow>> asio_flows_;
+    std::vector<std::thread> pool_;
+    std::atomic<bool> stopping_{false};
+};
+
+} // namespace
+
+auto start_asio_engine(
+    FlowTable const& flows,
+    std::vector<int> const& fds,
+    std::vector<FlowCounters>& counters,
+    Options const& opts) -> std::unique_ptr<FlowEngine>
+{
+    return std::make_unique<AsioEngine>(flows, fds, counters, opts);
+}
@@ -1,5 +1,7 @@
 #include "binding_functions.hpp"
 
+#include <ifaddrs.h>
+#include <net/if.h>
 #include <sys/socket.h>
 
 #ifdef __QNX__
@@ -15,6 +17,8 @@
 
 #include <boost/asio/ip/address.hpp>
 
+#include "logging.hpp"
+
 
 auto address2in_addr(boost::asio::ip::address const& addr, in_addr& dest) -> void
 {
@@ -39,6 +43,51 @@ auto ip_mreq2str(IP_REQ const& req) -> std::string
     return rss.str();
 }
 
+auto make_ip_req(
+    boost::asio::ip::address const& mc_addr,
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name) -> IP_REQ
+{
+    IP_REQ req;
+    std::memset(&req, 0, sizeof(req));
+    address2in_addr(mc_addr, req.imr_multiaddr);
+#ifdef __QNX__
+    (void)if_name;
+    address2in_addr(if_addr, req.imr_interface); // required
+#else
+    (void)if_addr;
+    // TODO arguably this shouldn't be set here
+    // req.imr_ifindex = 0; // ANY interface!
+    req.imr_ifindex = get_ifindex(if_name);
+#endif
+    return req;
+}
+
+auto bind_to_device(int sock_fd, std::string const& if_name) -> int
+{
+    // clang-format off
+#ifdef __QNX__
+    ifreq req;
+    std::strcpy(req.ifr_name, if_name.c_str());
+    return ::setsockopt(
+        sock_fd,
+        SOL_SOCKET,
+        SO_BINDTODEVICE,
+        &req,
+        static_cast<socklen_t>(sizeof(req))
+    );
+#else
+    return ::setsockopt(
+        sock_fd,
+        SOL_SOCKET,
+        SO_BINDTODEVICE,
+        if_name.c_str(),
+        static_cast<socklen_t>(if_name.size())
+    );
+#endif
+    // clang-format on
+}
+
 auto set_mc_bound_2(
     int /* sock_fd */,
     boost::asio::ip::address const& /* mc_addr */,
@@ -157,6 +206,371 @@ auto set_mc_bound_2(
     return 0;
 }
 
+auto bind_multicast_receiver(
+    int sock_fd,
+    Component c,
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port) -> sockaddr_in
+{
+    sockaddr_in mcast_group;
+    std::memset(&mcast_group, 0, sizeof(mcast_group));
+
+    {
+        // QNX seems to require that I set these separately
+        int const opt = 1; // Positive value for re-use
+        // clang-format off
+        auto const err1 = ::setsockopt(sock_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+        exit_on_error(err1, c, "setsockopt could not specify REUSEADDR");
+        auto const err2 = ::setsockopt(sock_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
+        exit_on_error(err2, c, "setsockopt could not specify REUSEPORT");
+        // clang-format on
+    }
+
+    {
+        std::stringstream ss;
+        auto const err = bind_to_device(sock_fd, if_name);
+        ss << "Could not bind multicast to \"" << if_name;
+        ss << "\": errno=" << std::to_string(errno) << ":" << strerror(errno);
+        exit_on_error(err, c, ss.str());
+        ss.str("");
+
+        ss << "Bound to interface (SO_BINDTODEVICE) \"" << if_name << "\"";
+        info(c, ss.str());
+    }
+
+    {
+        in_addr mc_if_addr;
+        address2in_addr(if_addr, mc_if_addr);
+
+        // clang-format off
+        auto const err = ::setsockopt(
+            sock_fd,
+            IPPROTO_IP,
+            IP_MULTICAST_IF,
+            &mc_if_addr,
+            sizeof(mc_if_addr)
+        );
+        // clang-format on
+
+        std::stringstream ss;
+        ss << "Could not specify " << ::inet_ntoa(mc_if_addr)
+           << " as the associated address.  Error: " << strerror(errno);
+        exit_on_error(err, c, ss.str());
+        ss.str("");
+
+        ss << "Associated with interface (IP_MULTICAST_IF) req=" << ::inet_ntoa(mc_if_addr);
+        info(c, ss.str());
+    }
+
+    {
+        // Preparatios for using multicast
+        auto const req = make_ip_req(mc_addr, if_addr, if_name);
+
+        // clang-format off
+        auto const err = setsockopt(
+            sock_fd,
+            IPPROTO_IP,
+            IP_ADD_MEMBERSHIP,
+            &req,
+            sizeof(req)
+        );
+        // clang-format on
+        exit_on_error(err, c, "Add membership error");
+
+        std::stringstream ss;
+        ss << "Added to multicast group (IP_ADD_MEMBERSHIP) " << ::inet_ntoa(req.imr_multiaddr) << " on";
+#ifdef __QNX__
+        ss << " interface with IP " << ::inet_ntoa(req.imr_interface);
+#else
+        ss << " interface " << get_ifname(req);
+#endif
+        info(c, ss.str());
+    }
+
+    {
+        mcast_group.sin_family = AF_INET;
+        address2in_addr(mc_addr, mcast_group.sin_addr);
+        mcast_group.sin_port = htons(port);
+
+        // clang-format off
+        auto const err = ::bind(
+            sock_fd,
+            reinterpret_cast<struct sockaddr*>(&mcast_group),
+            sizeof(mcast_group)
+        );
+        // clang-format on
+        auto const errno_b = errno;
+
+        std::stringstream ss;
+        ss << "Could not bind to " << ::inet_ntoa(mcast_group.sin_addr)
+           << " : Error: " << strerror(errno_b);
+        exit_on_error(err, c, ss.str());
+        ss.str("");
+
+        ss << "Bound (::bind) to " << ::inet_ntoa(mcast_group.sin_addr) << ":"
+           << ntohs(mcast_group.sin_port);
+        info(c, ss.str());
+    }
+
+    return mcast_group;
+}
+
+auto bind_multicast_sender(
+    int sock_fd,
+    Component c,
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    bool verbose) -> sockaddr_in
+{
+    sockaddr_in serv_addr;
+    std::memset(&serv_addr, 0, sizeof(serv_addr));
+
+    {
+        // QNX seems to require that I set these separately
+        int const opt = 1; // Positive value for re-use
+        // clang-format off
+        auto const err1 = ::setsockopt(sock_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+        exit_on_error(err1, c, "setsockopt could not specify REUSEADDR");
+        auto const err2 = ::setsockopt(sock_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
+        exit_on_error(err2, c, "setsockopt could not specify REUSEPORT");
+        // clang-format on
+    }
+
+    {
+        auto const req = make_ip_req(mc_addr, if_addr, if_name);
+
+        // clang-format off
+        auto const err = setsockopt(
+            sock_fd,
+            IPPROTO_IP,
+            IP_ADD_MEMBERSHIP,
+            &req,
+            sizeof(req)
+        );
+        // clang-format on
+        exit_on_error(err, c, "Add membership error");
+
+        std::stringstream ss;
+        ss << "Added to multicast group (IP_ADD_MEMBERSHIP) " << ::inet_ntoa(req.imr_multiaddr) << " on";
+#ifdef __QNX__
+        ss << " interface with IP " << ::inet_ntoa(req.imr_interface);
+#else
+        ss << " interface " << get_ifname(req);
+#endif
+        if (verbose)
+        {
+            info(c, ss.str());
+        }
+    }
+
+    {
+        // Bind to device.  Right now the effect is that the client won't
+        // receive messages.
+        std::stringstream ss;
+        auto const err = bind_to_device(sock_fd, if_name);
+        ss << "Could not bind multicast to \"" << if_name;
+        ss << "\": errno=" << std::to_string(errno) << ":" << strerror(errno);
+        exit_on_error(err, c, ss.str());
+        ss.str("");
+
+        ss << "Bound to interface (SO_BINDTODEVICE) \"" << if_name << "\"";
+        if (verbose)
+        {
+            info(c, ss.str());
+        }
+    }
+
+    {
+        in_addr mc_if_addr;
+        address2in_addr(if_addr, mc_if_addr);
+
+        // clang-format off
+        auto const err = ::setsockopt(
+            sock_fd,
+            IPPROTO_IP,
+            IP_MULTICAST_IF,
+            &mc_if_addr,
+            sizeof(mc_if_addr)
+        );
+        // clang-format on
+        auto const errno_b = errno;
+
+        std::stringstream ss;
+        ss << "Could not specify " << ::inet_ntoa(mc_if_addr)
+           << " as the associated address.  Error: " << strerror(errno_b);
+        exit_on_error(err, c, ss.str());
+        ss.str("");
+
+        ss << "Associated with interface (IP_MULTICAST_IF) req=" << ::inet_ntoa(mc_if_addr);
+        if (verbose)
+        {
+            info(c, ss.str());
+        }
+    }
+
+    // bind socket
+    {
+        serv_addr.sin_family = AF_INET;
+        address2in_addr(mc_addr, serv_addr.sin_addr);
+        serv_addr.sin_port = htons(port);
+
+        // clang-format off
+        auto const err = ::bind(
+            sock_fd,
+            reinterpret_cast<struct sockaddr*>(&serv_addr),
+            sizeof(serv_addr)
+        );
+        // clang-format on
+        auto const errno_b = errno;
+
+        std::stringstream ss;
+        ss << "Could not bind to " << ::inet_ntoa(serv_addr.sin_addr)
+           << " : Error: " << strerror(errno_b);
+        exit_on_error(err, c, ss.str());
+        ss.str("");
+
+        ss << "Bound (::bind) to " << ::inet_ntoa(serv_addr.sin_addr) << ":" << ntohs(serv_addr.sin_port);
+        if (verbose)
+        {
+            info(c, ss.str());
+        }
+    }
+
+    return serv_addr;
+}
+
+auto bind_unicast(
+    int sock_fd,
+    Component c,
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    short unsigned int port) -> sockaddr_in
+{
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+
+    {
+        int const opt  = 1;
+        auto const err = ::setsockopt(sock_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+        exit_on_error(err, c, "setsockopt could not specify REUSEADDR");
+    }
+
+    {
+        std::stringstream ss;
+        auto const err = bind_to_device(sock_fd, if_name);
+        ss << "Could not bind to \"" << if_name;
+        ss << "\": errno=" << std::to_string(errno) << ":" << strerror(errno);
+        exit_on_error(err, c, ss.str());
+    }
+
+    {
+        addr.sin_family = AF_INET;
+        address2in_addr(if_addr, addr.sin_addr);
+        addr.sin_port = htons(port);
+
+        // clang-format off
+        auto const err = ::bind(
+            sock_fd,
+            reinterpret_cast<struct sockaddr*>(&addr),
+            sizeof(addr)
+        );
+        // clang-format on
+        auto const errno_b = errno;
+
+        std::stringstream ss;
+        ss << "Could not bind to " << ::inet_ntoa(addr.sin_addr) << ":" << port
+           << " : Error: " << strerror(errno_b);
+        exit_on_error(err, c, ss.str());
+    }
+
+    auto len = static_cast<socklen_t>(sizeof(addr));
+    ::getsockname(sock_fd, reinterpret_cast<struct sockaddr*>(&addr), &len);
+
+    std::stringstream ss;
+    ss << "Bound (::bind) to " << ::inet_ntoa(addr.sin_addr) << ":" << ntohs(addr.sin_port)
+       << " on \"" << if_name << "\"";
+    info(c, ss.str());
+
+    return addr;
+}
+
+auto set_qos(int sock_fd, Component c, int priority, int dscp) -> void
+{
+    // IP_TOS first: Linux derives the socket priority from it
+    std::stringstream ss;
+    if (dscp != 0)
+    {
+        int const tos  = dscp << 2;
+        auto const err = ::setsockopt(sock_fd, IPPROTO_IP, IP_TOS, &tos, sizeof(tos));
+        ss << "Could not set IP_TOS " << tos << " : Error: " << strerror(errno);
+        exit_on_error(err, c, ss.str());
+        ss.str("");
+    }
+    if (priority != 0)
+    {
+#ifdef __linux__
+        auto const err =
+            ::setsockopt(sock_fd, SOL_SOCKET, SO_PRIORITY, &priority, sizeof(priority));
+        ss << "Could not set SO_PRIORITY " << priority << " : Error: " << strerror(errno);
+        exit_on_error(err, c, ss.str());
+#else
+        warn(c, "SO_PRIORITY is Linux only, use dscp");
+#endif
+    }
+}
+
+auto connect_to(int sock_fd, Component c, sockaddr_in const& peer, bool verbose) -> void
+{
+    // clang-format off
+    auto const err = ::connect(
+        sock_fd,
+        reinterpret_cast<struct sockaddr const*>(&peer),
+        sizeof(peer)
+    );
+    // clang-format on
+
+    std::stringstream ss;
+    ss << "Could not connect to " << ::inet_ntoa(peer.sin_addr) << ":" << ntohs(peer.sin_port)
+       << " : Error: " << strerror(errno);
+    exit_on_error(err, c, ss.str());
+    ss.str("");
+
+    if (verbose)
+    {
+        ss << "Connected to " << ::inet_ntoa(peer.sin_addr) << ":" << ntohs(peer.sin_port);
+        info(c, ss.str());
+    }
+}
+
+auto list_ipv4_interfaces() -> std::vector<InterfaceInfo>
+{
+    ifaddrs* addrs = nullptr;
+    auto const err = ::getifaddrs(&addrs);
+    exit_on_errno(err, Component::main, "getifaddrs");
+
+    std::vector<InterfaceInfo> found;
+    for (auto const* a = addrs; a != nullptr; a = a->ifa_next)
+    {
+        if (a->ifa_addr == nullptr || a->ifa_addr->sa_family != AF_INET ||
+            (a->ifa_flags & IFF_UP) == 0)
+        {
+            continue;
+        }
+        InterfaceInfo entry;
+        entry.name  = a->ifa_name;
+        entry.addr  = reinterpret_cast<sockaddr_in const*>(a->ifa_addr)->sin_addr;
+        entry.index = ::if_nametoindex(a->ifa_name);
+        entry.flags = a->ifa_flags;
+        found.push_back(entry);
+    }
+    ::freeifaddrs(addrs);
+    return found;
+}
+
 auto get_bound_device(int sock_fd) -> std::string
 {
     std::array<char, 10> dev_name;
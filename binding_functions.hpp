@@ -2,7 +2,9 @@
 #define BINDING_FUNCTIONS_HPP_PDKYFOSL
 
 #include <string>
+#include <vector>
 
+#include "components.hpp"
 #include "types.hpp"
 
 namespace boost::asio::ip
@@ -14,6 +16,65 @@ auto address2in_addr(boost::asio::ip::address const& addr, in_addr& dest) -> voi
 
 auto ip_mreq2str(IP_REQ const& req) -> std::string;
 
+auto make_ip_req(
+    boost::asio::ip::address const& mc_addr,
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name) -> IP_REQ;
+
+/// SO_BINDTODEVICE, with the QNX ifreq variant.  Returns the setsockopt result.
+auto bind_to_device(int sockfd, std::string const& if_name) -> int;
+
+/// Receiver setup sequence used by multicast_client: SO_REUSE*, SO_BINDTODEVICE,
+/// IP_MULTICAST_IF, IP_ADD_MEMBERSHIP then bind to the group.  Exits on error.
+auto bind_multicast_receiver(
+    int sockfd,
+    Component c,
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port) -> sockaddr_in;
+
+/// Sender setup sequence used by multicast_server: SO_REUSE*, IP_ADD_MEMBERSHIP,
+/// SO_BINDTODEVICE, IP_MULTICAST_IF then bind to the group.  Returns the
+/// destination address.  Exits on error.  `verbose` logs every step.
+auto bind_multicast_sender(
+    int sockfd,
+    Component c,
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    bool verbose = true) -> sockaddr_in;
+
+/// Unicast setup: SO_REUSEADDR, SO_BINDTODEVICE then bind to if_addr:port
+/// (port 0 picks an ephemeral one).  Returns the bound address.  Exits on error.
+auto bind_unicast(
+    int sockfd,
+    Component c,
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    short unsigned int port) -> sockaddr_in;
+
+/// SO_PRIORITY (Linux only, picks the mqprio/prio band) and IP_TOS with `dscp`
+/// in its upper six bits.  Zero leaves either at the kernel default.  Exits
+/// on error.
+auto set_qos(int sockfd, Component c, int priority, int dscp) -> void;
+
+/// connect() a UDP socket so the kernel filters on and routes to `peer` once,
+/// rather than per sendto()/recvfrom().  Exits on error.
+auto connect_to(int sockfd, Component c, sockaddr_in const& peer, bool verbose = true) -> void;
+
+struct InterfaceInfo
+{
+    std::string name;
+    in_addr addr;
+    unsigned int index;
+    unsigned int flags; ///< IFF_*
+};
+
+/// Interfaces that are up and have an IPv4 address, from getifaddrs()
+auto list_ipv4_interfaces() -> std::vector<InterfaceInfo>;
+
 auto set_mc_bound_2(
     int sockfd,
     boost::asio::ip::address const& mc_addr,
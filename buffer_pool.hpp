@@ -0,0 +1,59 @@
+#ifndef BUFFER_POOL_HPP_C6WJ2MHS
+#define BUFFER_POOL_HPP_C6WJ2MHS
+
+#include <cstddef>
+#include <cstdint>
+
+#include "mpmc_queue.hpp"
+#include "realtime.hpp"
+#include "types.hpp"
+
+/// What travels between the receive thread and the workers: a handle into a
+/// BufferPool plus what the receiver learnt about the datagram.
+struct PacketDesc
+{
+    std::uint32_t handle;
+    std::uint32_t len;
+    std::uint64_t rx_ns;
+};
+
+/// Fixed set of equally sized, cache-line aligned packet buffers handed out
+/// by index.  Allocated and pre-faulted once up front (optionally on huge
+/// pages); acquire/release are lock-free and can be called from any thread.
+class BufferPool
+{
+public:
+    BufferPool(std::size_t count, std::size_t buffer_size, bool huge_pages = false)
+        : count_(count),
+          buffer_size_((buffer_size + cache_line_size - 1) / cache_line_size * cache_line_size),
+          huge_pages_(huge_pages),
+          storage_(static_cast<char*>(alloc_prefaulted(count_ * buffer_size_, huge_pages_))),
+          free_(count)
+    {
+        for (std::uint32_t i = 0; i < count_; ++i)
+        {
+            free_.try_push(i);
+        }
+    }
+
+    BufferPool(BufferPool const&)                    = delete;
+    auto operator=(BufferPool const&) -> BufferPool& = delete;
+
+    ~BufferPool() { free_prefaulted(storage_, count_ * buffer_size_, huge_pages_); }
+
+    auto acquire(std::uint32_t& handle) -> bool { return free_.try_pop(handle); }
+    auto release(std::uint32_t handle) -> void { free_.try_push(handle); }
+
+    auto data(std::uint32_t handle) const -> char* { return storage_ + handle * buffer_size_; }
+    auto buffer_size() const -> std::size_t { return buffer_size_; }
+    auto count() const -> std::size_t { return count_; }
+
+private:
+    std::size_t count_;
+    std::size_t buffer_size_;
+    bool huge_pages_;
+    char* storage_;
+    MpmcQueue<std::uint32_t> free_;
+};
+
+#endif /* end of include guard: BUFFER_POOL_HPP_C6WJ2MHS */
@@ -0,0 +1,344 @@
+#include "components.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <ctime>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/ip/address.hpp>
+
+#include "binding_functions.hpp"
+#include "capture_file.hpp"
+#include "logging.hpp"
+#include "stats.hpp"
+#include "timing.hpp"
+
+// Field traffic in the lab: `capture` records what arrives on the bound
+// group with kernel timestamps and interface index, `replay` sends a capture
+// back out on the bound interface with the original spacing, or scaled.
+
+using namespace std::chrono_literals;
+
+namespace
+{
+
+#ifdef __linux__
+using Message = mmsghdr;
+#else
+struct Message
+{
+    msghdr msg_hdr;
+    unsigned int msg_len;
+};
+#endif
+
+auto realtime_ns() -> std::uint64_t
+{
+    timespec ts;
+    ::clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<std::uint64_t>(ts.tv_sec) * 1000000000 +
+           static_cast<std::uint64_t>(ts.tv_nsec);
+}
+
+auto enable(int fd, int level, int name, char const* what) -> void
+{
+    int const on = 1;
+    if (::setsockopt(fd, level, name, &on, sizeof(on)) < 0)
+    {
+        warn(Component::client, std::string{"No "} + what + ": " + strerror(errno));
+    }
+}
+
+/// recvmmsg() on Linux, one recvmsg() elsewhere
+auto receive_batch(int fd, std::vector<Message>& msgs) -> int
+{
+#ifdef __linux__
+    return ::recvmmsg(fd, msgs.data(), static_cast<unsigned>(msgs.size()), MSG_DONTWAIT, nullptr);
+#else
+    auto const n = ::recvmsg(fd, &msgs[0].msg_hdr, MSG_DONTWAIT);
+    if (n < 0)
+    {
+        return -1;
+    }
+    msgs[0].msg_len = static_cast<unsigned int>(n);
+    return 1;
+#endif
+}
+
+/// Time of each record since the first one.  The stamps are CLOCK_REALTIME,
+/// so a record stamped before its predecessor (the clock was stepped back)
+/// gets the predecessor's offset instead of wrapping, and the spacing goes
+/// on from there.
+class CaptureOffset
+{
+public:
+    auto next(std::uint64_t ts_ns) -> std::uint64_t
+    {
+        offset_ += prev_ != 0 && ts_ns > prev_ ? ts_ns - prev_ : 0;
+        prev_ = ts_ns;
+        return offset_;
+    }
+
+private:
+    std::uint64_t prev_{0};
+    std::uint64_t offset_{0};
+};
+
+} // namespace
+
+auto capture(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void
+{
+    auto const output     = opts.get("output", "/tmp/bind-test.cap");
+    auto const duration   = opts.get_double("duration", 10.0);
+    auto const max_count  = static_cast<std::uint64_t>(opts.get_int("count", 0));
+    auto const block_size = static_cast<std::size_t>(opts.get_int("capture-block-kb", 4096))
+                            << 10;
+    auto const blocks     = static_cast<std::size_t>(opts.get_int("capture-blocks", 16));
+#ifdef __linux__
+    auto const batch = static_cast<std::size_t>(std::max(1LL, opts.get_int("batch", 32)));
+#else
+    std::size_t const batch = 1;
+#endif
+
+    auto const sock_fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    exit_on_error(sock_fd, Component::client, "socket");
+    if (opts.has("rcvbuf"))
+    {
+        int const rcvbuf = static_cast<int>(opts.get_int("rcvbuf", 0));
+        exit_on_error(
+            ::setsockopt(sock_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)),
+            Component::client,
+            "SO_RCVBUF");
+    }
+    bind_multicast_receiver(sock_fd, Component::client, if_addr, if_name, mc_addr, port);
+#ifdef SO_TIMESTAMPNS
+    enable(sock_fd, SOL_SOCKET, SO_TIMESTAMPNS, "SO_TIMESTAMPNS");
+#endif
+#ifdef IP_PKTINFO
+    enable(sock_fd, IPPROTO_IP, IP_PKTINFO, "IP_PKTINFO");
+#endif
+#ifdef SO_RXQ_OVFL
+    enable(sock_fd, SOL_SOCKET, SO_RXQ_OVFL, "SO_RXQ_OVFL");
+#endif
+
+    CaptureFileHeader header{};
+    in_addr group;
+    address2in_addr(mc_addr, group);
+    header.group    = group.s_addr;
+    header.port     = port;
+    header.start_ns = realtime_ns();
+    CaptureWriter writer(output, header, block_size, blocks);
+
+    // Every slot takes the largest datagram, nothing is ever truncated
+    std::vector<char> buffers(batch * 65536);
+    std::vector<std::array<char, 256>> controls(batch);
+    std::vector<sockaddr_in> sources(batch);
+    std::vector<iovec> iovs(batch);
+    std::vector<Message> msgs(batch);
+    for (std::size_t i = 0; i < batch; ++i)
+    {
+        iovs[i].iov_base = buffers.data() + i * 65536;
+        iovs[i].iov_len  = 65536;
+    }
+
+    {
+        std::stringstream ss;
+        ss << "Capturing " << mc_addr.to_string() << ":" << port << " on " << if_name << " into "
+           << output << " (" << blocks << " blocks of " << (block_size >> 10) << " KB)";
+        info(Component::client, ss.str());
+    }
+
+    std::uint32_t kernel_drops = 0;
+    std::uint64_t bytes        = 0;
+    auto const start           = now_ns();
+    auto const end             = start + static_cast<std::uint64_t>(duration * 1e9);
+    auto next_report           = start + 1000000000;
+    auto last_records          = writer.records();
+    while ((duration <= 0 || now_ns() < end) && (max_count == 0 || writer.records() < max_count))
+    {
+        pollfd pfd{sock_fd, POLLIN, 0};
+        auto const ready = ::poll(&pfd, 1, 100);
+        exit_on_error(ready < 0 && errno != EINTR ? -1 : 0, Component::client, "poll");
+
+        for (auto n = static_cast<int>(batch); ready > 0 && n == static_cast<int>(batch);)
+        {
+            for (std::size_t i = 0; i < batch; ++i)
+            {
+                std::memset(&msgs[i], 0, sizeof(msgs[i]));
+                msgs[i].msg_hdr.msg_name       = &sources[i];
+                msgs[i].msg_hdr.msg_namelen    = sizeof(sources[i]);
+                msgs[i].msg_hdr.msg_iov        = &iovs[i];
+                msgs[i].msg_hdr.msg_iovlen     = 1;
+                msgs[i].msg_hdr.msg_control    = controls[i].data();
+                msgs[i].msg_hdr.msg_controllen = controls[i].size();
+            }
+            n = receive_batch(sock_fd, msgs);
+            if (n < 0)
+            {
+                exit_on_errno(
+                    errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1,
+                    Component::client,
+                    "recvmmsg");
+                break;
+            }
+
+            auto const fallback_ns = realtime_ns();
+            for (std::size_t i = 0; i < static_cast<std::size_t>(n); ++i)
+            {
+                auto& msg = msgs[i].msg_hdr;
+                CaptureRecord record{};
+                record.ts_ns    = fallback_ns;
+                record.len      = msgs[i].msg_len;
+                record.src_addr = sources[i].sin_addr.s_addr;
+                record.src_port = ntohs(sources[i].sin_port);
+                for (auto* c = CMSG_FIRSTHDR(&msg); c != nullptr; c = CMSG_NXTHDR(&msg, c))
+                {
+#ifdef SO_TIMESTAMPNS
+                    if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS)
+                    {
+                        timespec ts;
+                        std::memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+                        record.ts_ns = static_cast<std::uint64_t>(ts.tv_sec) * 1000000000 +
+                                       static_cast<std::uint64_t>(ts.tv_nsec);
+                    }
+#endif
+#ifdef IP_PKTINFO
+                    if (c->cmsg_level == IPPROTO_IP && c->cmsg_type == IP_PKTINFO)
+                    {
+                        in_pktinfo pktinfo;
+                        std::memcpy(&pktinfo, CMSG_DATA(c), sizeof(pktinfo));
+                        record.ifindex = static_cast<std::uint32_t>(pktinfo.ipi_ifindex);
+                    }
+#endif
+#ifdef SO_RXQ_OVFL
+                    if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SO_RXQ_OVFL)
+                    {
+                        std::memcpy(&kernel_drops, CMSG_DATA(c), sizeof(kernel_drops));
+                    }
+#endif
+                }
+                writer.append(record, static_cast<char const*>(iovs[i].iov_base));
+                bytes += record.len;
+            }
+        }
+
+        auto const now = now_ns();
+        if (now >= next_report)
+        {
+            // Also bounds how long a quiet feed's records sit in memory
+            writer.flush();
+            next_report += 1000000000;
+            std::stringstream ss;
+            ss << "captured " << format_rate(static_cast<double>(writer.records() - last_records))
+               << ", " << writer.written() << " bytes written, " << writer.dropped()
+               << " dropped (writer behind), " << kernel_drops << " dropped by the kernel";
+            info(Component::client, ss.str());
+            last_records = writer.records();
+        }
+    }
+    writer.close();
+    ::close(sock_fd);
+
+    std::stringstream ss;
+    ss << "Captured " << writer.records() << " datagrams, " << bytes << " bytes into " << output
+       << ", " << writer.dropped() << " dropped (writer behind), " << kernel_drops
+       << " dropped by the kernel";
+    info(Component::client, ss.str());
+}
+
+auto replay(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void
+{
+    auto const input = opts.get("input", "/tmp/bind-test.cap");
+    auto const speed = opts.get_double("speed", 1.0);
+    auto const loops = std::max(1LL, opts.get_int("loops", 1));
+
+    CaptureReader const reader(input);
+    CaptureOffset span;
+    std::uint64_t span_ns = 0;
+    auto const records    = reader.for_each(
+        [&](CaptureRecord const& r, char const*) { span_ns = span.next(r.ts_ns); });
+    {
+        in_addr group{reader.header().group};
+        std::stringstream ss;
+        ss << input << ": " << records << " datagrams captured from " << ::inet_ntoa(group) << ":"
+           << reader.header().port << " over " << format_ns(span_ns)
+           << ", replaying to " << mc_addr.to_string() << ":" << port << " at "
+           << (speed > 0 ? std::to_string(speed) + "x" : std::string{"full speed"});
+        info(Component::server, ss.str());
+    }
+    exit_on_error(records == 0 ? -1 : 0, Component::server, input + " holds no datagrams");
+
+    auto const sock_fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    exit_on_error(sock_fd, Component::server, "socket");
+    auto const dest =
+        bind_multicast_sender(sock_fd, Component::server, if_addr, if_name, mc_addr, port);
+    connect_to(sock_fd, Component::server, dest);
+
+    LatencyHistogram lateness;
+    std::uint64_t sent   = 0;
+    std::uint64_t bytes  = 0;
+    std::uint64_t errors = 0;
+    auto const start     = now_ns();
+    for (long long loop = 0; loop < loops; ++loop)
+    {
+        // Each pass keeps the original spacing, scaled by --speed
+        auto const base = now_ns() + 1000000;
+        CaptureOffset since_first;
+        reader.for_each([&](CaptureRecord const& r, char const* payload) {
+            auto const offset_ns = since_first.next(r.ts_ns);
+            if (speed > 0)
+            {
+                auto const offset = static_cast<double>(offset_ns) / speed;
+                auto const due    = base + static_cast<std::uint64_t>(offset);
+                auto now = now_ns();
+                if (due > now + 100000)
+                {
+                    std::this_thread::sleep_for(std::chrono::nanoseconds(due - now - 50000));
+                }
+                while ((now = now_ns()) < due)
+                {
+                }
+                lateness.record(now - due);
+            }
+            if (::send(sock_fd, payload, r.len, 0) < 0)
+            {
+                ++errors;
+                return;
+            }
+            ++sent;
+            bytes += r.len;
+        });
+    }
+    auto const elapsed = now_ns() - start;
+    ::close(sock_fd);
+
+    std::stringstream ss;
+    ss << "Replayed " << sent << " datagrams, " << bytes << " bytes in " << format_ns(elapsed)
+       << " (" << format_rate(static_cast<double>(sent) * 1e9 / static_cast<double>(elapsed))
+       << "), " << errors << " send errors";
+    if (speed > 0)
+    {
+        ss << ", lateness " << lateness.summary();
+    }
+    info(Component::server, ss.str());
+}
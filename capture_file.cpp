@@ -0,0 +1,177 @@
+#include "capture_file.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "logging.hpp"
+
+using namespace std::chrono_literals;
+
+namespace
+{
+
+char constexpr capture_magic[8] = {'B', 'T', 'C', 'A', 'P', 0, 0, 0};
+
+auto write_all(int fd, char const* data, std::size_t len) -> void
+{
+    while (len > 0)
+    {
+        auto const n = ::write(fd, data, len);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        exit_on_errno(static_cast<int>(n), Component::consumer, "write");
+        data += n;
+        len -= static_cast<std::size_t>(n);
+    }
+}
+
+} // namespace
+
+CaptureWriter::CaptureWriter(
+    std::string const& path,
+    CaptureFileHeader const& header,
+    std::size_t block_size,
+    std::size_t blocks)
+    : pool_(blocks, block_size), full_(blocks)
+{
+    exit_on_error(
+        block_size < capture_record_size(65536) ? -1 : 0,
+        Component::consumer,
+        "Capture blocks must hold a 64 KB datagram");
+
+    fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    exit_on_error(fd_, Component::consumer, "Could not create " + path);
+
+    auto h = header;
+    std::memcpy(h.magic, capture_magic, sizeof(h.magic));
+    h.version     = capture_version;
+    h.header_size = sizeof(h);
+    write_all(fd_, reinterpret_cast<char const*>(&h), sizeof(h));
+
+    writer_ = std::thread([this] { write_loop(); });
+}
+
+CaptureWriter::~CaptureWriter()
+{
+    close();
+}
+
+auto CaptureWriter::append(CaptureRecord const& record, char const* payload) -> bool
+{
+    auto const size = capture_record_size(record.len);
+    if (have_block_ && used_ + size > pool_.buffer_size())
+    {
+        flush();
+    }
+    if (!have_block_)
+    {
+        if (!pool_.acquire(block_))
+        {
+            ++dropped_;
+            return false;
+        }
+        have_block_ = true;
+        used_       = 0;
+    }
+
+    auto* const out = pool_.data(block_) + used_;
+    std::memcpy(out, &record, sizeof(record));
+    std::memcpy(out + sizeof(record), payload, record.len);
+    std::memset(out + sizeof(record) + record.len, 0, size - sizeof(record) - record.len);
+    used_ += size;
+    ++records_;
+    return true;
+}
+
+auto CaptureWriter::flush() -> void
+{
+    if (!have_block_)
+    {
+        return;
+    }
+    if (used_ == 0)
+    {
+        pool_.release(block_);
+    }
+    else
+    {
+        // There are as many queue slots as blocks, this can't fail
+        full_.try_push(PacketDesc{block_, static_cast<std::uint32_t>(used_), 0});
+    }
+    have_block_ = false;
+}
+
+auto CaptureWriter::close() -> void
+{
+    if (fd_ < 0)
+    {
+        return;
+    }
+    flush();
+    stopping_ = true;
+    writer_.join();
+    ::fsync(fd_);
+    ::close(fd_);
+    fd_ = -1;
+}
+
+auto CaptureWriter::write_loop() -> void
+{
+    PacketDesc desc;
+    for (;;)
+    {
+        // Read before popping: every block pushed before close() is then seen
+        auto const stopping = stopping_.load(std::memory_order_acquire);
+        if (full_.try_pop(desc))
+        {
+            write_all(fd_, pool_.data(desc.handle), desc.len);
+            written_.fetch_add(desc.len, std::memory_order_relaxed);
+            pool_.release(desc.handle);
+            continue;
+        }
+        if (stopping)
+        {
+            return;
+        }
+        // Blocks are megabytes, there is no hurry
+        std::this_thread::sleep_for(1ms);
+    }
+}
+
+CaptureReader::CaptureReader(std::string const& path)
+{
+    fd_ = ::open(path.c_str(), O_RDONLY);
+    exit_on_error(fd_, Component::server, "Could not open " + path);
+    struct stat st;
+    exit_on_error(::fstat(fd_, &st), Component::server, "fstat " + path);
+    size_ = static_cast<std::size_t>(st.st_size);
+    exit_on_error(
+        size_ < sizeof(header_) ? -1 : 0, Component::server, path + " is not a capture file");
+
+    auto* const map = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+    exit_on_error(map == MAP_FAILED ? -1 : 0, Component::server, "mmap " + path);
+    data_ = static_cast<char const*>(map);
+    ::madvise(const_cast<char*>(data_), size_, MADV_SEQUENTIAL);
+
+    std::memcpy(&header_, data_, sizeof(header_));
+    exit_on_error(
+        std::memcmp(header_.magic, capture_magic, sizeof(capture_magic)) == 0 &&
+                header_.version == capture_version && header_.header_size <= size_
+            ? 0
+            : -1,
+        Component::server,
+        path + " is not a capture file");
+}
+
+CaptureReader::~CaptureReader()
+{
+    ::munmap(const_cast<char*>(data_), size_);
+    ::close(fd_);
+}
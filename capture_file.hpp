@@ -0,0 +1,135 @@
+#ifndef CAPTURE_FILE_HPP_M4QD8ZNB
+#define CAPTURE_FILE_HPP_M4QD8ZNB
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+
+#include "buffer_pool.hpp"
+#include "spsc_queue.hpp"
+
+/// Capture files are a header followed by records, each record 8-byte
+/// aligned so a reader can walk an mmapped file in place.  Host byte order,
+/// append only: a crash loses at most the unwritten tail.
+struct CaptureFileHeader
+{
+    char magic[8]; ///< "BTCAP" NUL NUL NUL
+    std::uint32_t version;
+    std::uint32_t header_size;
+    std::uint32_t group; ///< network order, what was captured
+    std::uint16_t port;
+    std::uint16_t reserved;
+    std::uint64_t start_ns; ///< CLOCK_REALTIME when capture started
+};
+
+struct CaptureRecord
+{
+    std::uint64_t ts_ns;    ///< kernel receive timestamp, CLOCK_REALTIME
+    std::uint32_t ifindex;  ///< interface it arrived on
+    std::uint32_t len;      ///< payload bytes following the record
+    std::uint32_t src_addr; ///< network order
+    std::uint16_t src_port; ///< host order
+    std::uint16_t reserved;
+};
+
+static std::uint32_t constexpr capture_version = 1;
+
+/// Record plus payload, rounded up to the record alignment
+inline auto capture_record_size(std::size_t len) -> std::size_t
+{
+    return (sizeof(CaptureRecord) + len + 7) & ~std::size_t{7};
+}
+
+/// Streams records to a file off the receive thread.  append() copies into
+/// a preallocated block; full blocks go through an SPSC queue to a writer
+/// thread doing large write()s.  When the writer falls behind and no block
+/// is free the record is dropped and counted, the receiver never blocks.
+class CaptureWriter
+{
+public:
+    CaptureWriter(
+        std::string const& path,
+        CaptureFileHeader const& header,
+        std::size_t block_size,
+        std::size_t blocks);
+    ~CaptureWriter();
+
+    CaptureWriter(CaptureWriter const&)                    = delete;
+    auto operator=(CaptureWriter const&) -> CaptureWriter& = delete;
+
+    /// Receive thread only
+    auto append(CaptureRecord const& record, char const* payload) -> bool;
+
+    /// Hands the partly filled block to the writer, receive thread only
+    auto flush() -> void;
+
+    /// Flushes and waits for the writer, also done by the destructor
+    auto close() -> void;
+
+    auto records() const -> std::uint64_t { return records_; }
+    auto dropped() const -> std::uint64_t { return dropped_; }
+    auto written() const -> std::uint64_t { return written_.load(std::memory_order_relaxed); }
+
+private:
+    auto write_loop() -> void;
+
+    int fd_{-1};
+    BufferPool pool_;
+    SpscQueue<PacketDesc> full_;
+    std::thread writer_;
+    std::atomic<bool> stopping_{false};
+
+    // Receive thread
+    std::uint32_t block_{0};
+    std::size_t used_{0};
+    bool have_block_{false};
+    std::uint64_t records_{0};
+    std::uint64_t dropped_{0};
+
+    // Writer thread
+    std::atomic<std::uint64_t> written_{0};
+};
+
+/// Read only mapping of a capture file
+class CaptureReader
+{
+public:
+    explicit CaptureReader(std::string const& path);
+    ~CaptureReader();
+
+    CaptureReader(CaptureReader const&)                    = delete;
+    auto operator=(CaptureReader const&) -> CaptureReader& = delete;
+
+    auto header() const -> CaptureFileHeader const& { return header_; }
+
+    /// Calls `f(record, payload)` for every complete record in file order
+    template <typename F> auto for_each(F&& f) const -> std::uint64_t
+    {
+        std::uint64_t count = 0;
+        auto offset         = static_cast<std::size_t>(header_.header_size);
+        while (offset + sizeof(CaptureRecord) <= size_)
+        {
+            CaptureRecord record;
+            std::memcpy(&record, data_ + offset, sizeof(record));
+            if (offset + sizeof(record) + record.len > size_)
+            {
+                break;
+            }
+            f(record, data_ + offset + sizeof(record));
+            offset += capture_record_size(record.len);
+            ++count;
+        }
+        return count;
+    }
+
+private:
+    int fd_{-1};
+    std::size_t size_{0};
+    char const* data_{nullptr};
+    CaptureFileHeader header_{};
+};
+
+#endif /* end of include guard: CAPTURE_FILE_HPP_M4QD8ZNB */
@@ -0,0 +1,470 @@
+#include "components.hpp"
+
+#include <net/if.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/ip/address.hpp>
+
+#include "binding_functions.hpp"
+#include "flow_config.hpp"
+#include "logging.hpp"
+#include "realtime.hpp"
+#include "stats.hpp"
+#include "timing.hpp"
+
+// Membership churn: every churn thread owns --groups sockets and keeps
+// joining and dropping one group per socket, rotating over --interfaces.
+// A sender in the same process feeds the churned groups and one live group
+// (the configured one) that is never touched, so we see both how quickly
+// traffic starts after a join and whether churn disturbs a steady stream.
+
+using namespace std::chrono_literals;
+
+namespace
+{
+
+struct Slot
+{
+    int fd{-1};
+    std::uint32_t group{0}; ///< network order
+    int ifindex{0};
+    std::atomic<std::size_t>* route{nullptr}; ///< --interfaces entry the feeder sends it on
+    bool joined{false};
+    bool awaiting_traffic{false};
+    std::uint64_t join_ns{0};
+};
+
+struct alignas(cache_line_size) ChurnStats
+{
+    LatencyHistogram join;
+    LatencyHistogram leave;
+    LatencyHistogram first_datagram;
+    std::uint64_t no_traffic{0}; ///< left after the timeout without a datagram
+    std::uint64_t failures{0};
+    std::uint64_t sys_ns{0};
+    std::atomic<std::uint64_t> ops{0};
+};
+
+auto thread_sys_ns() -> std::uint64_t
+{
+    rusage usage;
+#ifdef RUSAGE_THREAD
+    ::getrusage(RUSAGE_THREAD, &usage);
+#else
+    ::getrusage(RUSAGE_SELF, &usage);
+#endif
+    return static_cast<std::uint64_t>(usage.ru_stime.tv_sec) * 1000000000 +
+           static_cast<std::uint64_t>(usage.ru_stime.tv_usec) * 1000;
+}
+
+/// IP_ADD/DROP_MEMBERSHIP, or the protocol independent MCAST_JOIN/LEAVE_GROUP
+auto change_membership(Slot const& slot, bool join, bool mcast_api) -> int
+{
+#ifdef MCAST_JOIN_GROUP
+    if (mcast_api)
+    {
+        group_req req;
+        std::memset(&req, 0, sizeof(req));
+        req.gr_interface       = static_cast<std::uint32_t>(slot.ifindex);
+        auto* group            = reinterpret_cast<sockaddr_in*>(&req.gr_group);
+        group->sin_family      = AF_INET;
+        group->sin_addr.s_addr = slot.group;
+        auto const opt         = join ? MCAST_JOIN_GROUP : MCAST_LEAVE_GROUP;
+        return ::setsockopt(slot.fd, IPPROTO_IP, opt, &req, sizeof(req));
+    }
+#else
+    exit_on_error(mcast_api ? -1 : 0, Component::client, "No MCAST_JOIN_GROUP here");
+#endif
+
+    IP_REQ req;
+    std::memset(&req, 0, sizeof(req));
+    req.imr_multiaddr.s_addr = slot.group;
+#ifdef __QNX__
+    // QNX picks the interface by address, the slots rotate by index only
+    req.imr_interface.s_addr = htonl(INADDR_ANY);
+#else
+    req.imr_ifindex = slot.ifindex;
+#endif
+    auto const opt = join ? IP_ADD_MEMBERSHIP : IP_DROP_MEMBERSHIP;
+    return ::setsockopt(slot.fd, IPPROTO_IP, opt, &req, sizeof(req));
+}
+
+auto open_slot(short unsigned int port) -> int
+{
+    auto const fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    exit_on_error(fd, Component::client, "socket");
+
+    int const opt = 1;
+    auto err      = ::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    exit_on_error(err, Component::client, "setsockopt could not specify REUSEADDR");
+    err = ::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
+    exit_on_error(err, Component::client, "setsockopt could not specify REUSEPORT");
+#ifdef IP_MULTICAST_ALL
+    // Bound to INADDR_ANY, so without this Linux would deliver every group
+    // joined by any socket on the host and first-datagram times are meaningless
+    int const off = 0;
+    err           = ::setsockopt(fd, IPPROTO_IP, IP_MULTICAST_ALL, &off, sizeof(off));
+    exit_on_error(err, Component::client, "IP_MULTICAST_ALL");
+#endif
+
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port        = htons(port);
+    err                  = ::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    exit_on_errno(err, Component::client, "bind");
+    return fd;
+}
+
+auto churn_thread(
+    std::vector<Slot>& slots,
+    std::vector<int> const& ifindexes,
+    bool mcast_api,
+    std::uint64_t hold_ns,
+    std::uint64_t traffic_timeout_ns,
+    std::atomic<bool> const& running,
+    ChurnStats& stats) -> void
+{
+    std::vector<pollfd> pfds(slots.size());
+    std::array<char, 2048> buffer;
+    std::uint64_t round  = 0;
+    auto const sys_start = thread_sys_ns();
+
+    while (running.load(std::memory_order_relaxed))
+    {
+        for (std::size_t i = 0; i < slots.size(); ++i)
+        {
+            auto& slot     = slots[i];
+            auto const now = now_ns();
+            // Held until its first datagram too, or the histogram would only
+            // have the joins that happened to get traffic within the hold
+            auto const held = now - slot.join_ns;
+            if (slot.joined && (held < hold_ns ||
+                                (slot.awaiting_traffic && held < traffic_timeout_ns)))
+            {
+                continue;
+            }
+            if (!slot.joined)
+            {
+                auto const iface = (i + round) % ifindexes.size();
+                slot.ifindex     = ifindexes[iface];
+                // Fed on the new interface from now on, before the join
+                slot.route->store(iface, std::memory_order_relaxed);
+            }
+
+            auto const before = now_ns();
+            auto const err    = change_membership(slot, !slot.joined, mcast_api);
+            auto const after  = now_ns();
+            if (err < 0)
+            {
+                ++stats.failures;
+                continue;
+            }
+            if (slot.joined)
+            {
+                stats.leave.record(after - before);
+                stats.no_traffic += slot.awaiting_traffic ? 1 : 0;
+                slot.awaiting_traffic = false;
+            }
+            else
+            {
+                stats.join.record(after - before);
+                slot.join_ns          = after;
+                slot.awaiting_traffic = true;
+            }
+            slot.joined = !slot.joined;
+            stats.ops.fetch_add(1, std::memory_order_relaxed);
+        }
+        ++round;
+
+        // First datagram after each join, then throw the rest away
+        for (std::size_t i = 0; i < slots.size(); ++i)
+        {
+            pfds[i] = pollfd{slots[i].fd, POLLIN, 0};
+        }
+        auto const ready = ::poll(pfds.data(), pfds.size(), hold_ns == 0 ? 0 : 1);
+        auto const rx_ns = now_ns();
+        for (std::size_t i = 0; ready > 0 && i < slots.size(); ++i)
+        {
+            if ((pfds[i].revents & POLLIN) == 0)
+            {
+                continue;
+            }
+            if (slots[i].awaiting_traffic)
+            {
+                stats.first_datagram.record(rx_ns - slots[i].join_ns);
+                slots[i].awaiting_traffic = false;
+            }
+            while (::recv(slots[i].fd, buffer.data(), buffer.size(), MSG_DONTWAIT) > 0)
+            {
+            }
+        }
+    }
+
+    stats.sys_ns = thread_sys_ns() - sys_start;
+    for (auto& slot : slots)
+    {
+        ::close(slot.fd);
+    }
+}
+
+/// One bound sender per churned interface
+struct Sender
+{
+    int fd{-1};
+    sockaddr_in dest{};
+};
+
+/// Each tick sends one datagram to the live group on the first interface and
+/// one to the next churned group on the interface it was last joined on.
+/// Live datagrams carry a sequence number for gap counting.
+auto feed_groups(
+    std::vector<Sender> const& senders,
+    std::atomic<std::size_t> const* routes,
+    std::uint32_t first,
+    std::uint32_t count,
+    double rate,
+    std::atomic<bool> const& running) -> void
+{
+    auto dest         = senders.front().dest;
+    auto const live   = dest.sin_addr.s_addr;
+    auto const period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1.0 / rate));
+    auto next         = std::chrono::steady_clock::now();
+    std::uint64_t seq = 0;
+    std::uint32_t i   = 0;
+    while (running.load(std::memory_order_relaxed))
+    {
+        std::this_thread::sleep_until(next);
+        next += period;
+
+        dest.sin_addr.s_addr = live;
+        // clang-format off
+        ::sendto(
+            senders.front().fd,
+            &seq,
+            sizeof(seq),
+            0,
+            reinterpret_cast<struct sockaddr const*>(&dest),
+            sizeof(dest)
+        );
+        // clang-format on
+
+        auto const group     = i++ % count;
+        auto const& sender   = senders[routes[group].load(std::memory_order_relaxed)];
+        dest.sin_addr.s_addr = htonl(first + group);
+        // clang-format off
+        ::sendto(
+            sender.fd,
+            &seq,
+            sizeof(seq),
+            0,
+            reinterpret_cast<struct sockaddr const*>(&dest),
+            sizeof(dest)
+        );
+        // clang-format on
+        ++seq;
+    }
+}
+
+} // namespace
+
+auto membership_churn(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void
+{
+    auto const threads   = static_cast<std::size_t>(std::max(1LL, opts.get_int("threads", 2)));
+    auto const groups    = static_cast<std::size_t>(std::max(1LL, opts.get_int("groups", 64)));
+    auto const hold_ns   = static_cast<std::uint64_t>(opts.get_double("hold-ms", 10.0) * 1e6);
+    auto const timeout_ns =
+        static_cast<std::uint64_t>(opts.get_double("traffic-timeout-ms", 1000.0) * 1e6);
+    auto const rate      = opts.get_double("rate", 10000.0);
+    auto const mcast_api = opts.get("api", "ip") == "mcast";
+    auto const duration  = std::chrono::duration<double>(opts.get_double("duration", 10.0));
+    auto const tuning    = thread_tuning_from_options(opts, "worker");
+
+    // Every churned interface gets its own sender, the first one also feeds
+    // the live group
+    std::vector<int> ifindexes;
+    std::vector<Sender> senders;
+    {
+        std::stringstream list{opts.get("interfaces", if_name)};
+        std::string item;
+        while (std::getline(list, item, ','))
+        {
+            auto const index = ::if_nametoindex(item.c_str());
+            exit_on_error(index == 0 ? -1 : 0, Component::main, "Unknown interface " + item);
+            ifindexes.push_back(static_cast<int>(index));
+
+            auto const address =
+                item == if_name ? if_addr
+                                : boost::asio::ip::address{boost::asio::ip::address_v4(
+                                      ntohl(interface_address(item).s_addr))};
+            Sender sender;
+            sender.fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+            exit_on_error(sender.fd, Component::server, "socket");
+            sender.dest = bind_multicast_sender(
+                sender.fd, Component::server, address, item, mc_addr, port, false);
+            senders.push_back(sender);
+        }
+    }
+
+    // The configured group stays joined, churned groups are the ones after it
+    auto const first   = mc_addr.to_v4().to_uint() + 1;
+    auto const churned = static_cast<std::uint32_t>(threads * groups);
+
+    auto const routes = std::make_unique<std::atomic<std::size_t>[]>(churned);
+    std::vector<std::vector<Slot>> slots(threads);
+    for (std::size_t t = 0; t < threads; ++t)
+    {
+        for (std::size_t g = 0; g < groups; ++g)
+        {
+            Slot slot;
+            slot.fd    = open_slot(port);
+            slot.group = htonl(first + static_cast<std::uint32_t>(t * groups + g));
+            slot.route = &routes[t * groups + g];
+            slot.route->store(0, std::memory_order_relaxed);
+            slots[t].push_back(slot);
+        }
+    }
+
+    auto const live_fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    exit_on_error(live_fd, Component::client, "socket");
+    bind_multicast_receiver(live_fd, Component::client, if_addr, if_name, mc_addr, port);
+    {
+        timeval tv{0, 100000};
+        auto const err = ::setsockopt(live_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        exit_on_error(err, Component::client, "Cannot set timeout");
+    }
+
+    {
+        std::stringstream ss;
+        ss << "Churning " << churned << " groups from " << threads << " threads over "
+           << ifindexes.size() << " interfaces with "
+           << (mcast_api ? "MCAST_JOIN_GROUP" : "IP_ADD_MEMBERSHIP") << ", hold "
+           << format_ns(hold_ns) << " and until traffic (at most " << format_ns(timeout_ns)
+           << "), feeding " << rate << " datagrams/s";
+        info(Component::main, ss.str());
+    }
+
+    std::atomic<bool> running{true};
+    std::uint64_t live_received = 0;
+    std::uint64_t live_lost     = 0;
+
+    auto live = std::thread([&] {
+        std::uint64_t expected = 0;
+        std::uint64_t seq      = 0;
+        while (running.load(std::memory_order_relaxed))
+        {
+            if (::recv(live_fd, &seq, sizeof(seq), 0) != static_cast<ssize_t>(sizeof(seq)))
+            {
+                continue;
+            }
+            if (live_received > 0 && seq > expected)
+            {
+                live_lost += seq - expected;
+            }
+            expected = seq + 1;
+            ++live_received;
+        }
+    });
+    auto feeder = std::thread([&] {
+        if (rate > 0)
+        {
+            feed_groups(senders, routes.get(), first, churned, rate, running);
+        }
+    });
+
+    std::vector<std::unique_ptr<ChurnStats>> stats;
+    std::vector<std::thread> workers;
+    for (std::size_t t = 0; t < threads; ++t)
+    {
+        stats.push_back(std::make_unique<ChurnStats>());
+        workers.emplace_back([&, t] {
+            apply_thread_tuning(Component::client, tuning);
+            churn_thread(
+                slots[t], ifindexes, mcast_api, hold_ns, timeout_ns, running, *stats[t]);
+        });
+    }
+
+    auto const total_ops = [&stats] {
+        std::uint64_t sum = 0;
+        for (auto const& s : stats)
+        {
+            sum += s->ops.load(std::memory_order_relaxed);
+        }
+        return sum;
+    };
+
+    auto const start = std::chrono::steady_clock::now();
+    auto last        = total_ops();
+    while (std::chrono::steady_clock::now() - start < duration)
+    {
+        std::this_thread::sleep_for(1s);
+        auto const now = total_ops();
+        info(Component::main, "join+leave " + format_rate(static_cast<double>(now - last)));
+        last = now;
+    }
+    running = false;
+    for (auto& w : workers)
+    {
+        w.join();
+    }
+    feeder.join();
+    live.join();
+    auto const elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+    ChurnStats all;
+    for (auto const& s : stats)
+    {
+        all.join.merge(s->join);
+        all.leave.merge(s->leave);
+        all.first_datagram.merge(s->first_datagram);
+        all.no_traffic += s->no_traffic;
+        all.failures += s->failures;
+        all.sys_ns += s->sys_ns;
+    }
+    auto const ops = total_ops();
+
+    std::stringstream ss;
+    ss << ops << " membership changes, " << format_rate(static_cast<double>(ops) / elapsed.count())
+       << ", " << all.failures << " failed";
+    if (ops > 0)
+    {
+        // Includes the polling for first datagrams, small next to the joins
+        ss << ", system CPU " << format_ns(all.sys_ns / ops) << "/change";
+    }
+    info(Component::main, ss.str());
+    info(Component::main, "Join           " + all.join.summary());
+    info(Component::main, "Leave          " + all.leave.summary());
+    ss.str("");
+    ss << "First datagram " << all.first_datagram.summary() << "; " << all.no_traffic
+       << " joins without traffic within " << format_ns(timeout_ns);
+    info(Component::main, ss.str());
+    ss.str("");
+    ss << "Live group: " << live_received << " received, " << live_lost << " lost";
+    info(Component::main, ss.str());
+
+    for (auto const& sender : senders)
+    {
+        ::close(sender.fd);
+    }
+    ::close(live_fd);
+}
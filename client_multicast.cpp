@@ -2,15 +2,23 @@
 
 #include <cstring>
 
+#include <algorithm>
 #include <array>
 #include <condition_variable>
 #include <sstream>
+#include <optional>
 #include <thread>
+#include <vector>
 
-#include <boost/asio/ip/address.hpp>
-
-#include "binding_functions.hpp"
+#include "alloc_hook.hpp"
+#include "crc32c.hpp"
+#include "fixed_format.hpp"
+#include "integrity.hpp"
 #include "logging.hpp"
+#include "reorder_buffer.hpp"
+#include "stats.hpp"
+#include "timing.hpp"
+#include "transport.hpp"
 #include "types.hpp"
 
 // Playing with code from:
@@ -18,156 +26,143 @@
 
 using namespace std::chrono_literals;
 
-auto multicast_client(
-    boost::asio::ip::address const& if_addr,
-    std::string const& if_name,
-    boost::asio::ip::address const& mc_addr,
-    short unsigned int port,
-    std::mutex& component_ready,
-    bool const& server_ready,
-    std::condition_variable& server_ready_cv,
-    bool& client_ready,
-    std::condition_variable& client_ready_cv) -> void
+namespace
 {
-    // http://www.cs.tau.ac.il/~eddiea/samples/Multicast/multicast-listen.c.html
-    int sock_fd = 0;
-    struct sockaddr_in mcast_group;
 
-    std::memset(&mcast_group, 0, sizeof(mcast_group));
+auto reorder_summary(ReorderBuffer const& reorder) -> std::string
+{
+    auto const& s = reorder.stats();
+    std::stringstream ss;
+    ss << "Reorder: " << s.delivered << " delivered, " << s.reordered << " out of order, "
+       << s.skipped << " skipped, " << s.late << " late, " << s.duplicates << " duplicates, "
+       << s.forced << " forced; held up to " << s.max_held << " datagrams for "
+       << format_ns(s.hold_ns.max()) << " (p99 " << format_ns(s.hold_ns.percentile(99.0))
+       << ") in " << reorder.memory_bytes() / 1024 << " KiB";
+    return ss.str();
+}
 
+/// Checks everything that arrives until the server has been quiet for a
+/// while.  With --reorder intact datagrams go through a ReorderBuffer first
+/// and the missing count is taken from what it delivers.
+auto receive_checked(Transport& transport, Options const& opts) -> void
+{
+    std::vector<char> buffer(65536);
+    std::uint64_t good     = 0;
+    std::uint64_t damaged  = 0;
+    std::uint64_t next_seq = 0;
+    std::uint64_t gaps     = 0;
+    auto const deliver     = [&](std::uint64_t seq, char const*, std::size_t) {
+        gaps += seq > next_seq ? seq - next_seq : 0;
+        next_seq = seq + 1;
+    };
+
+    std::optional<ReorderBuffer> reorder;
+    if (opts.has("reorder"))
     {
-        sock_fd = ::socket(AF_INET, SOCK_DGRAM, 0);
-        exit_on_error(sock_fd, Component::client, "Couldn't create socket");
+        reorder.emplace(
+            static_cast<std::size_t>(opts.get_int("reorder-slots", 1024)),
+            static_cast<std::size_t>(opts.get_int("reorder-slot-size", 2048)),
+            static_cast<std::uint64_t>(opts.get_int("reorder-delay-us", 5000)) * 1000);
     }
 
+    // Set up: the loop below must not allocate, a BIND_TEST_EMBEDDED build checks
+    FixedString<256> line;
+    arm_alloc_guard(opts.has("alloc-abort"));
+    for (;;)
     {
-        std::unique_lock<std::mutex> lk(component_ready);
-        server_ready_cv.wait(lk, [&server_ready] { return server_ready; });
-        info(Component::client, "Server started");
+        // Wake up for the oldest held datagram's deadline, rounded up
+        auto timeout_ms          = 400;
+        auto const held_deadline = reorder && reorder->held() > 0;
+        if (held_deadline)
+        {
+            auto const now      = now_ns();
+            auto const deadline = reorder->next_deadline();
+            auto const wait_ms  = deadline > now ? (deadline - now + 999999) / 1000000 : 0;
+            timeout_ms          = static_cast<int>(std::min<std::uint64_t>(wait_ms, 400));
+        }
+        auto const n = transport.receive(buffer.data(), buffer.size(), timeout_ms);
+        if (reorder)
+        {
+            reorder->release(now_ns(), deliver);
+        }
+        if (n < 0)
+        {
+            if (held_deadline)
+            {
+                continue;
+            }
+            break;
+        }
+        std::uint64_t seq = 0;
+        auto const result = integrity_check(buffer.data(), static_cast<std::size_t>(n), seq);
+        line.clear();
+        line << "Read " << n << " bytes: seq " << seq << ", " << integrity_result_to_str(result);
+        if (result == IntegrityResult::ok)
+        {
+            ++good;
+            info(Component::client, line.view());
+            if (!reorder)
+            {
+                deliver(seq, buffer.data(), static_cast<std::size_t>(n));
+            }
+            else if (!reorder->insert(
+                         seq, buffer.data(), static_cast<std::size_t>(n), now_ns(), deliver))
+            {
+                line.clear();
+                line << "Reorder dropped seq " << seq << ", next expected " << reorder->next_seq();
+                warn(Component::client, line.view());
+            }
+            else
+            {
+                reorder->release(now_ns(), deliver);
+            }
+        }
+        else
+        {
+            ++damaged;
+            if (static_cast<std::size_t>(n) > sizeof(IntegrityHeader))
+            {
+                auto const body = static_cast<std::size_t>(n) - sizeof(IntegrityHeader);
+                line << ", first bad byte of the body at "
+                     << verify_pattern(buffer.data() + sizeof(IntegrityHeader), body, seq);
+            }
+            warn(Component::client, line.view());
+        }
     }
 
+    if (reorder)
     {
-        // QNX seems to require that I set these separately
-        int const opt = 1; // Positive value for re-use
-        // clang-format off
-        auto const err1 = ::setsockopt(sock_fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-        exit_on_error(err1, Component::client, "setsockopt could not specify REUSEADDR");
-        auto const err2 = ::setsockopt(sock_fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
-        exit_on_error(err2, Component::client, "setsockopt could not specify REUSEPORT");
-        // clang-format on
+        reorder->flush(now_ns(), deliver);
     }
-
+    disarm_alloc_guard();
+    if (reorder)
     {
-        std::stringstream ss;
-        // clang-format off
-#ifdef __QNX__
-        ifreq req;
-        std::strcpy(req.ifr_name, if_name.c_str());
-        auto const err = setsockopt(
-            sock_fd,
-            SOL_SOCKET,
-            SO_BINDTODEVICE,
-            &req,
-            static_cast<socklen_t>(sizeof(req))
-        );
-        ss << "Could not bind multicast to \"" << req.ifr_name;
-#else
-        auto const err = setsockopt(
-            sock_fd,
-            SOL_SOCKET,
-            SO_BINDTODEVICE,
-            if_name.c_str(),
-            static_cast<socklen_t>(if_name.size())
-        );
-        ss << "Could not bind multicast to \"" << if_name;
-#endif
-        // clang-format on
-        ss << "\": errno=" << std::to_string(errno) << ":" << strerror(errno);
-        exit_on_error(err, Component::client, ss.str());
-        ss.str("");
-
-        ss << "Bound to interface (SO_BINDTODEVICE) \"" << if_name << "\"";
-        info(Component::client, ss.str());
+        info(Component::client, reorder_summary(*reorder));
     }
 
-    {
-        in_addr mc_if_addr;
-        address2in_addr(if_addr, mc_if_addr);
-
-        // clang-format off
-        auto const err = ::setsockopt(
-            sock_fd,
-            IPPROTO_IP,
-            IP_MULTICAST_IF,
-            &mc_if_addr,
-            sizeof(mc_if_addr)
-        );
-        // clang-format on
-
-        std::stringstream ss;
-        ss << "Could not specify " << ::inet_ntoa(mc_if_addr)
-           << " as the associated address.  Error: " << strerror(errno);
-        exit_on_error(err, Component::client, ss.str());
-        ss.str("");
-
-        ss << "Associated with interface (IP_MULTICAST_IF) req=" << ::inet_ntoa(mc_if_addr);
-        info(Component::client, ss.str());
-    }
+    std::stringstream ss;
+    ss << good << " intact, " << damaged << " damaged, " << gaps << " missing (CRC32C "
+       << crc32c_implementation() << ")";
+    exit_on_error(good == 0 || damaged > 0 ? -1 : 0, Component::client, ss.str());
+    info(Component::client, ss.str());
+}
 
-    {
-        // Preparatios for using multicast
-        IP_REQ req;
-        address2in_addr(mc_addr, req.imr_multiaddr);
-#ifdef __QNX__
-        address2in_addr(if_addr, req.imr_interface); // required
-#else
-        req.imr_ifindex = get_ifindex(if_name);
-#endif
-
-        // clang-format off
-        auto const err = setsockopt(
-            sock_fd,
-            IPPROTO_IP,
-            IP_ADD_MEMBERSHIP,
-            &req,
-            sizeof(req)
-        );
-        // clang-format on
-        exit_on_error(err, Component::client, "Add membership error");
-
-        std::stringstream ss;
-        ss << "Added to multicast group (IP_ADD_MEMBERSHIP) " << ::inet_ntoa(req.imr_multiaddr) << " on";
-#ifdef __QNX__
-        ss << " interface with IP " << ::inet_ntoa(req.imr_interface);
-#else
-        ss << " interface " << get_ifname(req);
-#endif
-        info(Component::client, ss.str());
-    }
+} // namespace
 
+auto multicast_client(
+    Transport& transport,
+    Options const& opts,
+    std::mutex& component_ready,
+    bool const& server_ready,
+    std::condition_variable& server_ready_cv,
+    bool& client_ready,
+    std::condition_variable& client_ready_cv) -> void
+{
+    // http://www.cs.tau.ac.il/~eddiea/samples/Multicast/multicast-listen.c.html
     {
-        mcast_group.sin_family = AF_INET;
-        address2in_addr(mc_addr, mcast_group.sin_addr);
-        mcast_group.sin_port = htons(port);
-
-        // clang-format off
-        auto const err = ::bind(
-            sock_fd,
-            reinterpret_cast<struct sockaddr*>(&mcast_group),
-            sizeof(mcast_group)
-        );
-        // clang-format on
-        auto const errno_b = errno;
-
-        std::stringstream ss;
-        ss << "Could not bind to " << ::inet_ntoa(mcast_group.sin_addr)
-           << " : Error: " << strerror(errno_b);
-        exit_on_error(err, Component::client, ss.str());
-        ss.str("");
-
-        ss << "Bound (::bind) to " << ::inet_ntoa(mcast_group.sin_addr) << ":"
-           << ntohs(mcast_group.sin_port);
-        info(Component::client, ss.str());
+        std::unique_lock<std::mutex> lk(component_ready);
+        server_ready_cv.wait(lk, [&server_ready] { return server_ready; });
+        info(Component::client, "Server started");
     }
 
     // {
@@ -195,47 +190,36 @@ auto multicast_client(
         std::this_thread::sleep_for(500ms);
     }
 
+    exit_on_error(
+        opts.has("reorder") && !opts.has("integrity") ? -1 : 0,
+        Component::client,
+        "--reorder needs the sequence numbers of --integrity");
+    if (opts.has("integrity"))
     {
-        // Set a timeout?
-        struct timeval tv;
-        tv.tv_sec      = 0;
-        tv.tv_usec     = 0.4e6;
-        auto const err = setsockopt(sock_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
-        exit_on_error(err, Component::client, "Cannot set timeout");
+        receive_checked(transport, opts);
     }
-
+    else
     {
         std::array<char, 1024> buffer = {0};
-        auto len = static_cast<socklen_t>(buffer.size());
+        FixedString<1100> line;
 
-        // clang-format off
         // Getting "Resource temporarily unavailable"
-        auto const n = ::recvfrom(
-            sock_fd,
-            buffer.data(),
-            buffer.size()-1,
-            MSG_WAITALL,
-            reinterpret_cast<struct sockaddr *>(&mcast_group),
-            &len
-        );
-        // clang-format on
-        auto const errno_b                                  = errno;
-        buffer[static_cast<typename decltype(buffer)::size_type>(n)] = '\0';
+        arm_alloc_guard(opts.has("alloc-abort"));
+        auto const n       = transport.receive(buffer.data(), buffer.size() - 1, 400);
+        auto const errno_b = errno;
 
         if (n > 0)
         {
-            std::stringstream ss;
-            ss << "Read: " << buffer.data();
-            info(Component::client, ss.str());
+            line << "Read: " << buffer.data();
+            info(Component::client, line.view());
         }
         else
         {
-            std::stringstream ss;
-            ss << "Never received data.  error=" << strerror(errno_b);
-            exit_on_error(n, Component::client, ss.str());
+            line << "Never received data.  error=" << strerror(errno_b);
+            exit_on_error(n, Component::client, line.view());
         }
+        disarm_alloc_guard();
     }
 
     info(Component::client, "Closing");
-    close(sock_fd);
 }
@@ -1,77 +1,220 @@
 #include "components.hpp"
 
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
 #include <condition_variable>
+#include <cstring>
 #include <sstream>
+#include <vector>
 
 #include <boost/asio/ip/address.hpp>
 
-#include "logging.hpp"
 #include "binding_functions.hpp"
+#include "logging.hpp"
+#include "ping_pong.hpp"
+#include "stats.hpp"
+#include "timing.hpp"
 
 // Playing with code from:
 // https://www.geeksforgeeks.org/udp-server-client-implementation-c/
 
+using namespace std::chrono_literals;
+
+namespace
+{
+
+struct InFlight
+{
+    std::uint64_t id{0};
+    std::uint64_t send_ns{0};
+    bool pending{false};
+};
+
+auto is_transient(int err) -> bool
+{
+    // ECONNREFUSED is the ICMP port unreachable of an earlier datagram on a
+    // connected socket, e.g. while the server is restarting
+    return err == EAGAIN || err == EWOULDBLOCK || err == EINTR || err == ECONNREFUSED;
+}
+
+} // namespace
 
-// TODO re-test this.. The git history should have a working version
-auto client_unicast(
+auto unicast_client(
     boost::asio::ip::address const& if_addr,
     std::string const& if_name,
     boost::asio::ip::address const& mc_addr,
-    int port) -> int
+    short unsigned int port,
+    std::string const& transport,
+    Options const& opts,
+    std::mutex& component_ready,
+    bool const& server_ready,
+    std::condition_variable& server_ready_cv) -> void
 {
-    int sock_fd = 0;
-    struct sockaddr_in serv_addr
+    auto const multicast  = transport == "multicast";
+    auto const depth      = static_cast<std::size_t>(std::max(1LL, opts.get_int("depth", 1)));
+    auto const payload    = std::max<std::size_t>(
+        sizeof(PingPongHeader), static_cast<std::size_t>(opts.get_int("payload", 64)));
+    auto const timeout_ms = static_cast<int>(opts.get_int("timeout-ms", 200));
+    auto const duration   = std::chrono::duration<double>(opts.get_double("duration", 10.0));
+
     {
-        0
-    }, client_addr{0};
+        std::unique_lock<std::mutex> lk(component_ready);
+        server_ready_cv.wait(lk, [&server_ready] { return server_ready; });
+    }
 
+    // Mirror image of unicast_server: requests to the group at `port`,
+    // replies from the group at `port + 1`
+    int tx_fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    exit_on_error(tx_fd, Component::client, "socket");
+    int rx_fd = tx_fd;
+    if (multicast)
     {
-        sock_fd = ::socket(AF_INET, SOCK_DGRAM, 0);
-        exit_on_error(sock_fd, Component::client, "Couldn't create socket");
+        auto const group = bind_multicast_sender(
+            tx_fd, Component::client, if_addr, if_name, mc_addr, port);
+        connect_to(tx_fd, Component::client, group);
+
+        rx_fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+        exit_on_error(rx_fd, Component::client, "socket");
+        bind_multicast_receiver(rx_fd, Component::client, if_addr, if_name, mc_addr, port + 1);
     }
+    else
+    {
+        bind_unicast(tx_fd, Component::client, if_addr, if_name, 0);
+
+        auto const peer = boost::asio::ip::make_address(opts.get("peer", if_addr.to_string()));
+        sockaddr_in server_addr;
+        std::memset(&server_addr, 0, sizeof(server_addr));
+        server_addr.sin_family = AF_INET;
+        address2in_addr(peer, server_addr.sin_addr);
+        server_addr.sin_port = htons(port);
+        connect_to(tx_fd, Component::client, server_addr);
+    }
+
+    std::vector<char> request(payload, 0);
+    std::vector<char> reply(65536);
+    auto const send_request = [&](std::uint64_t id, std::uint32_t flags) {
+        PingPongHeader const hdr{id, now_ns(), flags, 0};
+        std::memcpy(request.data(), &hdr, sizeof(hdr));
+        auto const n = ::send(tx_fd, request.data(), request.size(), 0);
+        exit_on_errno(n < 0 && !is_transient(errno) ? -1 : 0, Component::client, "send");
+        return hdr.send_ns;
+    };
 
-    serv_addr.sin_family = AF_INET;
-    address2in_addr(if_addr, serv_addr.sin_addr.s_addr);
-    serv_addr.sin_port = htons(port);
+    // Up to `depth` requests in flight.  Request `id` lives in slot
+    // id % depth, so a slot still pending when its id comes round again
+    // was never answered.
+    std::vector<InFlight> window(depth);
+    std::uint64_t next_id   = 0;
+    std::uint64_t completed = 0;
+    std::uint64_t lost      = 0;
+    std::uint64_t stale     = 0;
+    auto const issue        = [&] {
+        auto& slot = window[next_id % depth];
+        if (slot.pending)
+        {
+            ++lost;
+        }
+        slot.id      = next_id;
+        slot.send_ns = send_request(next_id, 0);
+        slot.pending = true;
+        ++next_id;
+    };
 
+    LatencyHistogram rtt;
+    LatencyHistogram interval;
+    for (std::size_t i = 0; i < depth; ++i)
     {
-        std::string hello;
-        hello = "hello from client (1)";
-        // clang-format off
-        auto const err = ::sendto(
-            sock_fd,
-            hello.c_str(),
-            hello.size(),
-            MSG_CONFIRM,
-            reinterpret_cast<const struct sockaddr *>(&serv_addr),
-            sizeof(serv_addr)
-        );
-        // clang-format on
-        exit_on_error(err, Component::client, "Could not send hello message");
-        info(Component::client, "Hello message sent");
-        std::this_thread::sleep_for(500ms);
+        issue();
     }
 
-    auto len = static_cast<socklen_t>(sizeof(client_addr));
+    auto const start = std::chrono::steady_clock::now();
+    auto next_report = start + 1s;
+    auto last_done   = completed;
+    while (std::chrono::steady_clock::now() - start < duration)
     {
-        std::array<char, 1024> buffer = {0};
-        // clang-format off
-        auto const n = ::recvfrom(
-            sock_fd,
-            reinterpret_cast<char *>(buffer.data()),
-            buffer.size()-1,
-            MSG_WAITALL,
-            reinterpret_cast<struct sockaddr *>(&serv_addr),
-            reinterpret_cast<socklen_t*>(&len)
-        );
-        // clang-format on
-        buffer[n] = '\0';
-
-        std::stringstream ss;
-        ss << "Read: " << buffer.data();
-        info(Component::client, ss.str());
+        pollfd pfd{rx_fd, POLLIN, 0};
+        auto const ready = ::poll(&pfd, 1, timeout_ms);
+        exit_on_error(ready < 0 && errno != EINTR ? -1 : 0, Component::client, "poll");
+        if (ready == 0)
+        {
+            // Nothing came back at all: write off the window and refill it
+            for (auto& slot : window)
+            {
+                lost += slot.pending ? 1 : 0;
+                slot.pending = false;
+            }
+            for (std::size_t i = 0; i < depth; ++i)
+            {
+                issue();
+            }
+        }
+
+        for (;;)
+        {
+            auto const n = ::recv(rx_fd, reply.data(), reply.size(), MSG_DONTWAIT);
+            if (n < 0)
+            {
+                exit_on_errno(is_transient(errno) ? 0 : -1, Component::client, "recv");
+                break;
+            }
+            auto const rx_ns = now_ns();
+
+            PingPongHeader hdr;
+            if (static_cast<std::size_t>(n) < sizeof(hdr))
+            {
+                ++stale;
+                continue;
+            }
+            std::memcpy(&hdr, reply.data(), sizeof(hdr));
+            auto& slot = window[hdr.id % depth];
+            if (!slot.pending || slot.id != hdr.id)
+            {
+                // Late reply to a request already written off
+                ++stale;
+                continue;
+            }
+            slot.pending = false;
+            rtt.record(rx_ns - slot.send_ns);
+            interval.record(rx_ns - slot.send_ns);
+            ++completed;
+            issue();
+        }
+
+        if (std::chrono::steady_clock::now() >= next_report)
+        {
+            next_report += 1s;
+            std::stringstream ss;
+            ss << transport << ": " << format_rate(static_cast<double>(completed - last_done))
+               << " p50=" << format_ns(interval.percentile(50))
+               << " p99=" << format_ns(interval.percentile(99));
+            info(Component::client, ss.str());
+            last_done = completed;
+            interval.reset();
+        }
     }
+    auto const elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
 
-    info(Component::client, "Closing");
-    return 0;
+    // Best effort, the server also gives up after --server-idle seconds
+    for (int i = 0; i < 3; ++i)
+    {
+        send_request(next_id++, ping_pong_stop);
+    }
+
+    std::stringstream ss;
+    ss << transport << " depth=" << depth << " payload=" << payload << ": " << completed
+       << " transactions, " << format_rate(static_cast<double>(completed) / elapsed.count())
+       << ", lost " << lost << ", stale " << stale;
+    info(Component::client, ss.str());
+    info(Component::client, transport + " RTT " + rtt.summary());
+
+    if (rx_fd != tx_fd)
+    {
+        ::close(rx_fd);
+    }
+    ::close(tx_fd);
 }
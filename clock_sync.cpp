@@ -0,0 +1,96 @@
+#include "clock_sync.hpp"
+
+#include <algorithm>
+#include <sstream>
+
+#include "stats.hpp"
+
+ClockSync::ClockSync(std::size_t const filter_size, std::size_t const drift_size)
+    : filter_size_(std::max<std::size_t>(1, filter_size)),
+      drift_size_(std::max<std::size_t>(2, drift_size))
+{
+}
+
+auto ClockSync::add(TimeProbe const& probe, std::uint64_t const t4) -> void
+{
+    // Time spent inside the service doesn't count towards the path delay
+    auto const total   = static_cast<std::int64_t>(t4 - probe.t1);
+    auto const service = static_cast<std::int64_t>(probe.t3 - probe.t2);
+    if (total < service)
+    {
+        return; // clock stepped on one of the ends
+    }
+    auto const offset = (static_cast<double>(static_cast<std::int64_t>(probe.t2 - probe.t1)) +
+                         static_cast<double>(static_cast<std::int64_t>(probe.t3 - t4))) /
+                        2;
+
+    raw_.push_back(Sample{probe.t1 + (t4 - probe.t1) / 2, offset,
+                          static_cast<std::uint64_t>(total - service)});
+    if (raw_.size() > filter_size_)
+    {
+        raw_.pop_front();
+    }
+    ++samples_;
+
+    auto const best = *std::min_element(raw_.begin(), raw_.end(), [](auto const& a, auto const& b) {
+        return a.rtt < b.rtt;
+    });
+    best_rtt_ = best.rtt;
+    // The same probe stays the minimum for several rounds, fit it only once
+    if (filtered_.empty() || filtered_.back().local_ns != best.local_ns)
+    {
+        filtered_.push_back(best);
+        if (filtered_.size() > drift_size_)
+        {
+            filtered_.pop_front();
+        }
+        fit();
+    }
+}
+
+auto ClockSync::fit() -> void
+{
+    // Relative to the oldest point so the doubles keep ns precision, the
+    // clocks of two hosts can easily be days apart
+    origin_      = filtered_.front().local_ns;
+    base_offset_ = filtered_.front().offset;
+    if (filtered_.size() < 2)
+    {
+        intercept_ = 0;
+        slope_     = 0;
+        return;
+    }
+
+    auto const n = static_cast<double>(filtered_.size());
+    double sx    = 0;
+    double sy    = 0;
+    double sxx   = 0;
+    double sxy   = 0;
+    for (auto const& s : filtered_)
+    {
+        auto const x = static_cast<double>(s.local_ns - origin_);
+        auto const y = s.offset - base_offset_;
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+    }
+    auto const denom = n * sxx - sx * sx;
+    slope_           = denom > 0 ? (n * sxy - sx * sy) / denom : 0;
+    intercept_       = (sy - slope_ * sx) / n;
+}
+
+auto ClockSync::offset_at(std::uint64_t const local_ns) const -> double
+{
+    auto const x = static_cast<double>(static_cast<std::int64_t>(local_ns - origin_));
+    return base_offset_ + intercept_ + slope_ * x;
+}
+
+auto ClockSync::summary() const -> std::string
+{
+    std::stringstream ss;
+    auto const offset = ready() ? offset_at(filtered_.back().local_ns) : 0.0;
+    ss << "offset=" << static_cast<long long>(offset) << "ns drift=" << drift_ppm()
+       << "ppm rtt=" << format_ns(best_rtt_) << " samples=" << samples_;
+    return ss.str();
+}
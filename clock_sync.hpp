@@ -0,0 +1,78 @@
+#ifndef CLOCK_SYNC_HPP_N5HW3QZC
+#define CLOCK_SYNC_HPP_N5HW3QZC
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <string>
+
+/// Probe of the NTP style exchange between latency_receiver (client) and
+/// the time service of latency_sender.  t1 is set by the client, t2/t3 by
+/// the service when the probe arrived and when the reply left.
+struct TimeProbe
+{
+    std::uint64_t t1;
+    std::uint64_t t2;
+    std::uint64_t t3;
+};
+
+/// Estimates `remote clock - local clock` from two-way probes.  Each probe
+/// gives an offset ((t2 - t1) + (t3 - t4)) / 2 that is wrong by at most half
+/// the path asymmetry, which is smallest for the probes that were quickest
+/// overall.  So only the minimum-RTT probe of the last `filter_size` is
+/// used, and a least squares line through those filtered offsets over the
+/// last `drift_size` probes gives the drift.  Not thread safe.
+class ClockSync
+{
+public:
+    explicit ClockSync(std::size_t filter_size = 8, std::size_t drift_size = 64);
+
+    /// t4 is the local time the reply arrived
+    auto add(TimeProbe const& probe, std::uint64_t t4) -> void;
+
+    auto ready() const -> bool { return !filtered_.empty(); }
+
+    /// remote - local in ns at local time `local_ns`, extrapolated with the drift
+    auto offset_at(std::uint64_t local_ns) const -> double;
+
+    /// Converts a remote timestamp to the local clock
+    auto to_local(std::uint64_t remote_ns, std::uint64_t local_now) const -> std::uint64_t
+    {
+        auto const offset = static_cast<std::int64_t>(offset_at(local_now));
+        return remote_ns - static_cast<std::uint64_t>(offset);
+    }
+
+    /// Rate of the remote clock relative to ours, in parts per million
+    auto drift_ppm() const -> double { return slope_ * 1e6; }
+
+    /// Round trip of the probe currently used for the offset
+    auto best_rtt() const -> std::uint64_t { return best_rtt_; }
+
+    auto samples() const -> std::uint64_t { return samples_; }
+
+    /// "offset=... drift=...ppm rtt=... samples=..."
+    auto summary() const -> std::string;
+
+private:
+    struct Sample
+    {
+        std::uint64_t local_ns; ///< midpoint of t1 and t4
+        double offset;
+        std::uint64_t rtt;
+    };
+
+    auto fit() -> void;
+
+    std::size_t filter_size_;
+    std::size_t drift_size_;
+    std::deque<Sample> raw_;
+    std::deque<Sample> filtered_;
+    std::uint64_t samples_{0};
+    std::uint64_t best_rtt_{0};
+    std::uint64_t origin_{0};
+    double base_offset_{0};
+    double intercept_{0};
+    double slope_{0};
+};
+
+#endif /* end of include guard: CLOCK_SYNC_HPP_N5HW3QZC */
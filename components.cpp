@@ -1,31 +1,25 @@
 #include "components.hpp"
 #include "logging.hpp"
 
-#include <sstream>
 #include <string>
 
-auto component_to_str(Component c, bool const decorate) -> std::string
+auto component_name(Component c, bool const decorate) -> char const*
 {
-    std::stringstream ss;
     switch (c)
     {
         case Component::main:
-            ss << "main";
-            break;
+            return "main";
         case Component::server:
-            if (decorate)
-                ss << ANSI_MAGENTA;
-            ss << "service";
-            if (decorate)
-                ss << ANSI_CLEAR;
-            break;
+            return decorate ? ANSI_MAGENTA "service" ANSI_CLEAR : "service";
         case Component::client:
-            if (decorate)
-                ss << ANSI_GREEN;
-            ss << "client";
-            if (decorate)
-                ss << ANSI_CLEAR;
-            break;
+            return decorate ? ANSI_GREEN "client" ANSI_CLEAR : "client";
+        case Component::consumer:
+            return decorate ? ANSI_YELLOW "consumer" ANSI_CLEAR : "consumer";
     }
-    return ss.str();
+    return "";
+}
+
+auto component_to_str(Component c, bool const decorate) -> std::string
+{
+    return component_name(c, decorate);
 }
@@ -6,6 +6,7 @@
 #include <string>
 #include <iostream>
 
+#include "options.hpp"
 
 namespace boost::asio::ip
 {
@@ -16,51 +17,279 @@ enum class Component
 {
     main = 0,
     server,
-    client
+    client,
+    consumer
 };
 
 auto component_to_str(Component c, bool decorate = false) -> std::string;
+/// Same without allocating, for the embedded logging path
+auto component_name(Component c, bool decorate = false) -> char const*;
 
+class Transport;
+
+/// `transport` is the sender end of make_transport(), bound by the caller.
+/// With --integrity the hellos become --count (5) --payload byte pattern
+/// datagrams with a CRC32C (integrity.hpp), --swap-every pairs out of order.
 auto multicast_server(
-    boost::asio::ip::address const& if_addr,
-    std::string const& if_name,
-    boost::asio::ip::address const& mc_addr,
-    short unsigned int port,
+    Transport& transport,
+    Options const& opts,
     std::mutex& component_ready,
     bool& server_ready,
     std::condition_variable& server_ready_cv,
     bool const& client_ready,
     std::condition_variable& client_ready_cv) -> void;
 
-// auto unicast_server(
-//     boost::asio::ip::address const& if_addr,
-//     std::string const& if_name,
-//     boost::asio::ip::address const& mc_addr,
-//     short unsigned int,
-//     bool& server_ready,
-//     std::mutex& component_ready,
-//     std::condition_variable& server_ready_cv) -> void;
-
-// auto client_unicast(
-//     boost::asio::ip::address const& if_addr,
-//     std::string const& if_name,
-//     boost::asio::ip::address const& mc_addr,
-//     short unsigned int,
-//     std::mutex& component_ready,
-//     bool const& server_ready,
-//     std::condition_variable& server_ready_cv,
-//     bool const& client_ready,
-//     std::condition_variable& client_ready_cv) -> int;
-
+/// `transport` is the receiver end of make_transport().  With --integrity
+/// every datagram is checked and any damage fails the run; --reorder puts
+/// them back in order through a ReorderBuffer.
 auto multicast_client(
+    Transport& transport,
+    Options const& opts,
+    std::mutex& component_ready,
+    bool const& server_ready,
+    std::condition_variable& server_ready_cv,
+    bool& client_ready,
+    std::condition_variable& client_ready_cv) -> void;
+
+/// Echo side of the ping-pong benchmark.  `transport` is "unicast" (requests
+/// on if_addr:port) or "multicast" (requests on the group at port, replies to
+/// the group at port + 1).  Returns after the client's stop request or
+/// --server-idle seconds without traffic.
+auto unicast_server(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    std::string const& transport,
+    Options const& opts,
+    std::mutex& component_ready,
+    bool& server_ready,
+    std::condition_variable& server_ready_cv) -> void;
+
+/// Keeps --depth requests of --payload bytes in flight for --duration seconds
+/// against unicast_server (or --peer) and reports RTT percentiles and
+/// transactions/s
+auto unicast_client(
     boost::asio::ip::address const& if_addr,
     std::string const& if_name,
     boost::asio::ip::address const& mc_addr,
     short unsigned int port,
+    std::string const& transport,
+    Options const& opts,
     std::mutex& component_ready,
     bool const& server_ready,
-    std::condition_variable& server_ready_cv,
-    bool& client_ready,
-    std::condition_variable& client_ready_cv) -> void;
+    std::condition_variable& server_ready_cv) -> void;
+
+/// Streams sequence numbered, timestamped datagrams to the group at --rate
+/// for --duration seconds and answers clock probes on --sync-port (port + 2)
+auto latency_sender(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void;
+
+/// Receives latency_sender's stream and probes its time service at --peer
+/// every --probe-ms to report one-way latency corrected for clock offset and
+/// drift
+auto latency_receiver(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void;
+
+/// --clients non-blocking subscribers over --groups groups, resumed by
+/// --threads epoll loops.  Reports setup time and memory per client and CPU
+/// per delivered datagram; --rate sends to the groups from the same process.
+auto virtual_clients(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void;
+
+/// --threads threads each join and drop --groups groups as fast as --hold-ms
+/// and the first datagram (or --traffic-timeout-ms) allow, rotating over
+/// --interfaces, with IP_ADD_MEMBERSHIP or
+/// MCAST_JOIN_GROUP (--api=ip|mcast).  Reports join/leave latency, time to the
+/// first datagram after a join, CPU per change and losses on a live group.
+auto membership_churn(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void;
+
+/// Tries every combination of SO_BINDTODEVICE, sender IP_MULTICAST_IF,
+/// membership interface and bind address (group/interface/any) on every
+/// multicast interface at once and prints which ones deliver traffic
+auto binding_probe(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void;
+
+/// Sends and receives every flow of --flows=<file> / --flow="...;..." from one
+/// process, whatever interface each is on.  Flows default to the command line
+/// interface/group/port, --role, --rate and --payload.  --engine=asio runs
+/// them on Boost.Asio instead of raw threads (flow_engine.hpp).
+auto run_flows(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void;
+
+/// Shards the send flows over 1, 2, 4... threads (--threads=1,2,4), each with
+/// its own sockets and buffers, and reports aggregate and per-thread rates.
+auto tx_scale(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void;
+
+/// mmaps --file (or a --size MB scratch file) and multicasts it in --chunk
+/// byte chunks, then repeats whatever receivers NACK on --repair-port
+/// (port + 3) until a round ends without NACKs
+auto file_sender(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void;
+
+/// Receives file_sender's chunks into a preallocated, mmapped --output file,
+/// tracks them in a bitmap and NACKs the holes to --peer after every round
+auto file_receiver(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void;
+
+/// Runs a critical flow (--critical-prio/-dscp, default 6/46) next to
+/// --bulk-flows flat out ones (--bulk-prio/-dscp), or the --flow(s) table,
+/// each on its own thread, and reports latency per SO_PRIORITY/DSCP class
+auto qos_contention(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void;
+
+/// Records what arrives on the group, with kernel timestamps and interface
+/// index, into the --output capture file (see capture_file.hpp) for
+/// --duration seconds or --count datagrams; a writer thread does the I/O
+auto capture(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void;
+
+/// Sends the --input capture to the group with its original spacing scaled
+/// by --speed (0 = back to back), --loops times
+auto replay(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void;
+
+/// Long running service (until SIGINT/SIGTERM or --duration): one thread per
+/// --flow(s) entry, or one receiving the group, each publishing packets,
+/// bytes, drops, gaps and latency to shared memory (--stats-shm) and a Unix
+/// socket (--stats-socket) that the stats mode and monitoring agents query
+auto stats_daemon(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void;
+
+/// Prints a running daemon's statistics, --format=text|json, over its socket
+/// or straight from shared memory (--source=shm)
+auto stats_client(Options const& opts) -> void;
+
+/// Binary size, RSS and startup time, plus a --duration send/receive loop on
+/// the group (--rate, --payload, --buffers) that, in a BIND_TEST_EMBEDDED
+/// build, fails if it allocates (--alloc-abort aborts at the allocation)
+auto footprint(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void;
+
+/// The same send/receive loop (--count, --payload, --batch) over
+/// --transport=socket, memory or both, reporting CPU per datagram on each
+/// side; the memory run is the userspace cost alone
+auto transport_bench(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void;
+
+/// Receiver failover between --groups groups on each of --interfaces from a
+/// SocketPool (socket_pool.hpp): all joined up front, joined at the switch,
+/// or set up from scratch per switch (--strategy).  Reports switch time,
+/// syscalls per switch and the traffic lost each way.
+auto socket_failover(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void;
+
+/// Overloads the group sender on purpose (--rate, --payload, --sndbuf) with a
+/// non-blocking socket that backs off, sheds or adapts its rate (--tx-policy)
+/// when the send queue or the qdisc fill up, instead of exiting.
+auto tx_pressure(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void;
+
+/// Receives the group like multicast_client, but straight into a shared memory
+/// ring (--shm-name, --shm-slots, --shm-slot-size) that local consumers read.
+auto shm_publisher(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void;
+
+/// Attaches to a ring created by shm_publisher and reads it with its own cursor.
+auto shm_consumer(Options const& opts) -> void;
+
+/// Receives the group and hands buffers to --workers threads through a
+/// lock-free SPSC/MPMC queue (--queue, --queue-depth, --buffers, --work-ns).
+auto receive_pipeline(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void;
+
+/// In-process throughput/latency benchmark of the handoff queues
+auto queue_bench(Options const& opts) -> void;
+
+/// Periodic wakeup jitter with default settings vs. --jitter-cpus,
+/// --jitter-sched, --jitter-prio, --mlock and pre-faulted (--huge-pages) memory
+auto jitter_test(Options const& opts) -> void;
+
+/// Receive rate and CPU cost per datagram of one
+/// --backend=socket|adaptive|recvmmsg|tpacket|xdp
+auto rx_bench(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void;
 
 #endif /* end of include guard: COMPONENTS_HPP_S0EML3DC */
@@ -0,0 +1,16 @@
+#ifndef CRC32C_HPP_W3TB6MRX
+#define CRC32C_HPP_W3TB6MRX
+
+#include <cstddef>
+#include <cstdint>
+
+/// CRC32C (Castagnoli, as in iSCSI/SCTP/ext4) of `len` bytes, continuing
+/// from `crc` so a buffer can be done in pieces.  Uses the SSE4.2 or ARMv8
+/// CRC instructions when the CPU has them, picked once at first use, and a
+/// slice-by-8 table otherwise.
+auto crc32c(void const* data, std::size_t len, std::uint32_t crc = 0) -> std::uint32_t;
+
+/// "sse4.2", "armv8" or "slice-by-8", whatever crc32c() ended up using
+auto crc32c_implementation() -> char const*;
+
+#endif /* end of include guard: CRC32C_HPP_W3TB6MRX */
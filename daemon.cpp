@@ -0,0 +1,350 @@
+#include "components.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <boost/asio/ip/address.hpp>
+
+#include "binding_functions.hpp"
+#include "flow_config.hpp"
+#include "live_stats.hpp"
+#include "logging.hpp"
+#include "ping_pong.hpp"
+#include "realtime.hpp"
+#include "timing.hpp"
+#include "tx_backpressure.hpp"
+
+// Long running service: every flow runs on its own thread and publishes its
+// counters through LiveStats, which monitoring reads from shared memory or
+// over the stats socket while the daemon keeps going.
+
+using namespace std::chrono_literals;
+
+namespace
+{
+
+std::atomic<bool> stop_requested{false};
+
+auto on_stop_signal(int) -> void
+{
+    stop_requested.store(true, std::memory_order_relaxed);
+}
+
+auto running() -> bool
+{
+    return !stop_requested.load(std::memory_order_relaxed);
+}
+
+auto to_address(in_addr const a) -> boost::asio::ip::address
+{
+    return boost::asio::ip::address_v4(ntohl(a.s_addr));
+}
+
+/// Paced PingPongHeader stream, so receivers see sequence gaps and latency.
+/// With --tx-policy a full queue means backing off or shedding, not a drop.
+auto send_flow(Flow const& flow, Options const& opts, LiveThreadStats& stats) -> void
+{
+    auto const fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    exit_on_error(fd, Component::server, "socket");
+    auto const dest = bind_multicast_sender(
+        fd,
+        Component::server,
+        to_address(flow.if_addr),
+        flow.if_name,
+        to_address(flow.group),
+        flow.port,
+        false);
+    set_qos(fd, Component::server, flow.priority, flow.dscp);
+    connect_to(fd, Component::server, dest, false);
+    std::unique_ptr<TxBackpressure> pressure;
+    if (opts.has("tx-policy"))
+    {
+        pressure = std::make_unique<TxBackpressure>(fd, Component::server, flow.if_name, opts);
+    }
+
+    std::vector<char> buffer(std::max<std::size_t>(flow.payload, sizeof(PingPongHeader)), 0);
+    auto const period = flow.rate > 0 ? 1000000000 / flow.rate : 0;
+    auto next         = now_ns();
+    std::uint64_t seq = 0;
+    while (running())
+    {
+        if (period > 0)
+        {
+            auto const now = now_ns();
+            if (next > now)
+            {
+                std::this_thread::sleep_for(std::chrono::nanoseconds(next - now));
+            }
+            next += period;
+        }
+
+        PingPongHeader const hdr{seq++, now_ns(), 0, 0};
+        std::memcpy(buffer.data(), &hdr, sizeof(hdr));
+        auto const sent = pressure ? pressure->send(buffer.data(), buffer.size())
+                                   : ::send(fd, buffer.data(), buffer.size(), 0) >= 0;
+        if (!sent)
+        {
+            // Counted as a drop: the datagram never left
+            stats.add_drops(1);
+            continue;
+        }
+        stats.add_packet(buffer.size());
+    }
+    if (pressure)
+    {
+        info(Component::server, flow_to_str(flow) + ": " + pressure->summary());
+        pressure.reset();
+    }
+    ::close(fd);
+}
+
+/// Gaps from the sequence number every sender here puts in the first 8
+/// bytes, drops from SO_RXQ_OVFL, latency when a PingPongHeader stamp is
+/// plausible (same host or synchronized clocks)
+auto receive_flow(Flow const& flow, LiveThreadStats& stats) -> void
+{
+    auto const fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    exit_on_error(fd, Component::client, "socket");
+    bind_multicast_receiver(
+        fd,
+        Component::client,
+        to_address(flow.if_addr),
+        flow.if_name,
+        to_address(flow.group),
+        flow.port);
+#ifdef SO_RXQ_OVFL
+    int const on = 1;
+    if (::setsockopt(fd, SOL_SOCKET, SO_RXQ_OVFL, &on, sizeof(on)) < 0)
+    {
+        warn(Component::client, std::string{"No SO_RXQ_OVFL: "} + strerror(errno));
+    }
+#endif
+
+    std::vector<char> buffer(65536);
+    std::array<char, 64> control;
+    std::uint32_t kernel_drops = 0;
+    std::uint64_t next_seq     = 0;
+    bool started               = false;
+    while (running())
+    {
+        pollfd pfd{fd, POLLIN, 0};
+        auto const ready = ::poll(&pfd, 1, 100);
+        exit_on_error(ready < 0 && errno != EINTR ? -1 : 0, Component::client, "poll");
+        while (ready > 0)
+        {
+            iovec iov{buffer.data(), buffer.size()};
+            msghdr msg{};
+            msg.msg_iov        = &iov;
+            msg.msg_iovlen     = 1;
+            msg.msg_control    = control.data();
+            msg.msg_controllen = control.size();
+            auto const n       = ::recvmsg(fd, &msg, MSG_DONTWAIT);
+            if (n < 0)
+            {
+                break;
+            }
+            auto const rx_ns = now_ns();
+            stats.add_packet(static_cast<std::uint64_t>(n));
+
+#ifdef SO_RXQ_OVFL
+            for (auto* c = CMSG_FIRSTHDR(&msg); c != nullptr; c = CMSG_NXTHDR(&msg, c))
+            {
+                if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SO_RXQ_OVFL)
+                {
+                    std::uint32_t total;
+                    std::memcpy(&total, CMSG_DATA(c), sizeof(total));
+                    stats.add_drops(total - kernel_drops);
+                    kernel_drops = total;
+                }
+            }
+#endif
+
+            if (static_cast<std::size_t>(n) < sizeof(std::uint64_t))
+            {
+                continue;
+            }
+            PingPongHeader hdr{};
+            std::memcpy(&hdr, buffer.data(), std::min(sizeof(hdr), static_cast<std::size_t>(n)));
+            if (started && hdr.id > next_seq)
+            {
+                stats.add_gaps(hdr.id - next_seq);
+            }
+            started  = true;
+            next_seq = hdr.id + 1;
+            if (hdr.send_ns != 0 && hdr.send_ns <= rx_ns && rx_ns - hdr.send_ns < 10000000000)
+            {
+                stats.add_latency(rx_ns - hdr.send_ns);
+            }
+        }
+    }
+    ::close(fd);
+}
+
+auto log_stats(std::vector<LiveSnapshot> const& threads, std::uint64_t uptime_ns) -> void
+{
+    std::stringstream ss(live_stats_text(threads, uptime_ns));
+    for (std::string line; std::getline(ss, line);)
+    {
+        info(Component::main, std::move(line));
+    }
+}
+
+auto query_socket(std::string const& path, std::string const& format) -> std::string
+{
+    sockaddr_un addr{};
+    exit_on_error(
+        path.size() < sizeof(addr.sun_path) ? 0 : -1,
+        Component::main,
+        "Socket path too long: " + path);
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    auto const fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    exit_on_error(fd, Component::main, "socket");
+    // clang-format off
+    auto const err = ::connect(fd,
+                               reinterpret_cast<sockaddr const*>(&addr),
+                               sizeof(addr));
+    // clang-format on
+    exit_on_error(err, Component::main, "Could not connect to " + path);
+    exit_on_error(
+        static_cast<int>(::send(fd, format.data(), format.size(), MSG_NOSIGNAL)),
+        Component::main,
+        "send");
+
+    std::string reply;
+    std::array<char, 4096> chunk;
+    for (;;)
+    {
+        auto const n = ::recv(fd, chunk.data(), chunk.size(), 0);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            break;
+        }
+        reply.append(chunk.data(), static_cast<std::size_t>(n));
+    }
+    ::close(fd);
+    return reply;
+}
+
+} // namespace
+
+auto stats_daemon(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void
+{
+    auto const duration  = opts.get_double("duration", 0.0);
+    auto const report_ns = static_cast<std::uint64_t>(opts.get_double("report-s", 0.0) * 1e9);
+
+    Flow defaults;
+    std::memset(&defaults, 0, sizeof(defaults));
+    address2in_addr(if_addr, defaults.if_addr);
+    address2in_addr(mc_addr, defaults.group);
+    defaults.port     = port;
+    defaults.rate     = static_cast<std::uint32_t>(opts.get_int("rate", 1000));
+    defaults.payload  = static_cast<std::uint16_t>(opts.get_int("payload", 64));
+    defaults.role     = parse_role(opts.get("role", "receive"), "--role");
+    defaults.priority = static_cast<std::uint8_t>(opts.get_int("priority", 0));
+    defaults.dscp     = static_cast<std::uint8_t>(opts.get_int("dscp", 0));
+    std::strncpy(defaults.if_name, if_name.c_str(), sizeof(defaults.if_name) - 1);
+    auto const flows = load_flows(opts, defaults);
+
+    auto stats = LiveStats::create(
+        opts.get("stats-shm", "bind-test-stats"), static_cast<std::uint32_t>(flows.size()));
+    LiveStatsServer const server(stats, opts.get("stats-socket", "/tmp/bind-test.stats"));
+
+    std::signal(SIGINT, on_stop_signal);
+    std::signal(SIGTERM, on_stop_signal);
+
+    auto const server_tuning = thread_tuning_from_options(opts, "server");
+    auto const client_tuning = thread_tuning_from_options(opts, "client");
+    std::vector<std::thread> threads;
+    for (std::size_t i = 0; i < flows.size(); ++i)
+    {
+        info(Component::main, "flow " + std::to_string(i) + ": " + flow_to_str(flows[i]));
+        auto const send = flows[i].role == FlowRole::send;
+        auto& slot = stats.claim(std::to_string(i) + (send ? " send " : " receive ") +
+                                 ::inet_ntoa(flows[i].group) + ":" + std::to_string(flows[i].port));
+        threads.emplace_back([&, i, send] {
+            if (send)
+            {
+                apply_thread_tuning(Component::server, server_tuning);
+                send_flow(flows[i], opts, slot);
+            }
+            else
+            {
+                apply_thread_tuning(Component::client, client_tuning);
+                receive_flow(flows[i], slot);
+            }
+        });
+    }
+
+    auto const start = now_ns();
+    auto next_report = start + report_ns;
+    std::vector<LiveSnapshot> reported;
+    std::uint64_t reported_ns = 0;
+    while (running() && (duration <= 0 || now_ns() - start < duration * 1e9))
+    {
+        std::this_thread::sleep_for(100ms);
+        if (report_ns > 0 && now_ns() >= next_report)
+        {
+            next_report += report_ns;
+            auto threads   = stats.snapshot();
+            auto const now = stats.uptime_ns();
+            live_stats_rates(threads, reported, now - reported_ns);
+            log_stats(threads, now);
+            reported    = std::move(threads);
+            reported_ns = now;
+        }
+    }
+    stop_requested = true;
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+
+    log_stats(stats.snapshot(), stats.uptime_ns());
+}
+
+auto stats_client(Options const& opts) -> void
+{
+    auto const format = opts.get("format", "text");
+    exit_on_error(
+        format == "text" || format == "json" ? 0 : -1,
+        Component::main,
+        "Unknown format " + format);
+
+    if (opts.get("source", "socket") == "shm")
+    {
+        // Straight from the segment: no rates, those need two samples
+        auto const stats   = LiveStats::attach(opts.get("stats-shm", "bind-test-stats"));
+        auto const threads = stats.snapshot();
+        std::cout << (format == "json" ? live_stats_json(threads, stats.uptime_ns())
+                                       : live_stats_text(threads, stats.uptime_ns()));
+        return;
+    }
+    std::cout << query_socket(opts.get("stats-socket", "/tmp/bind-test.stats"), format);
+}
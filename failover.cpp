@@ -0,0 +1,341 @@
+#include "components.hpp"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/ip/address.hpp>
+
+#include "binding_functions.hpp"
+#include "flow_config.hpp"
+#include "logging.hpp"
+#include "socket_pool.hpp"
+#include "stats.hpp"
+#include "timing.hpp"
+
+// Interface/group failover: one receiver keeps switching between --groups
+// groups on each of --interfaces while a sender feeds all of them, first
+// with every socket of a SocketPool joined up front, then joining only at
+// the switch, then building each socket from scratch the way a receiver
+// without a pool would.  What a switch costs and how much traffic it loses
+// is measured for each.
+
+using namespace std::chrono_literals;
+
+namespace
+{
+
+auto target_to_str(PoolTarget const& t) -> std::string
+{
+    return t.group.to_string() + ":" + std::to_string(t.port) + " on " + t.if_name;
+}
+
+struct Stamp
+{
+    std::uint64_t seq;
+    std::uint64_t send_ns;
+};
+
+struct SendTarget
+{
+    int fd;
+    sockaddr_in dest;
+};
+
+/// What the receive thread saw of the switches
+struct ReceiveStats
+{
+    LatencyHistogram to_traffic; ///< switch decision to the first new datagram
+    std::uint64_t missed{0};     ///< sent after the decision, never received
+    std::uint64_t backlog{0};    ///< queued before the decision, discarded
+    std::uint64_t silent{0};     ///< switched away before anything arrived
+};
+
+/// Shared between the control thread, the receiver and the sender
+struct SwitchState
+{
+    std::atomic<bool> running{true};
+    std::atomic<std::uint64_t> next_seq{0};
+    // Written before SocketPool::activate(), read after active() returns the socket
+    std::atomic<std::uint64_t> decision_ns{0};
+    std::atomic<std::uint64_t> expected_seq{0};
+    std::atomic<PooledSocket const*> observed{nullptr};
+};
+
+/// One datagram per target per tick, all carrying the same sequence number
+auto feed_targets(std::vector<SendTarget> const& targets, double rate, SwitchState& state)
+    -> void
+{
+    auto const period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1.0 / rate));
+    auto next = std::chrono::steady_clock::now();
+    while (state.running.load(std::memory_order_relaxed))
+    {
+        std::this_thread::sleep_until(next);
+        next += period;
+
+        Stamp const stamp{state.next_seq.load(std::memory_order_relaxed), now_ns()};
+        for (auto const& t : targets)
+        {
+            // clang-format off
+            ::sendto(
+                t.fd,
+                &stamp,
+                sizeof(stamp),
+                0,
+                reinterpret_cast<struct sockaddr const*>(&t.dest),
+                sizeof(t.dest)
+            );
+            // clang-format on
+        }
+        state.next_seq.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+/// Follows the pool's active socket; datagrams from before a switch
+/// decision are backlog, the first from after it ends the switch
+auto receive_active(SocketPool const& pool, SwitchState& state, ReceiveStats& stats) -> void
+{
+    PooledSocket const* current = nullptr;
+    bool awaiting               = false;
+    std::uint64_t expected      = 0;
+    std::uint64_t decision_ns   = 0;
+    while (state.running.load(std::memory_order_relaxed))
+    {
+        auto const* active = pool.active();
+        if (active != current)
+        {
+            stats.silent += awaiting ? 1 : 0;
+            current     = active;
+            awaiting    = true;
+            expected    = state.expected_seq.load(std::memory_order_relaxed);
+            decision_ns = state.decision_ns.load(std::memory_order_relaxed);
+            state.observed.store(current, std::memory_order_release);
+        }
+        if (current == nullptr)
+        {
+            std::this_thread::sleep_for(1ms);
+            continue;
+        }
+
+        pollfd pfd{current->fd, POLLIN, 0};
+        if (::poll(&pfd, 1, 1) <= 0)
+        {
+            continue;
+        }
+        Stamp stamp;
+        while (::recv(current->fd, &stamp, sizeof(stamp), MSG_DONTWAIT) ==
+               static_cast<ssize_t>(sizeof(stamp)))
+        {
+            if (stamp.seq < expected)
+            {
+                ++stats.backlog;
+            }
+            else if (awaiting)
+            {
+                awaiting = false;
+                stats.to_traffic.record(now_ns() - decision_ns);
+                stats.missed += stamp.seq - expected;
+            }
+        }
+    }
+}
+
+auto run_strategy(
+    std::string const& strategy,
+    std::vector<PoolTarget> const& targets,
+    std::vector<SendTarget> const& senders,
+    Options const& opts) -> void
+{
+    auto const rate     = opts.get_double("rate", 1000.0);
+    auto const interval = std::chrono::milliseconds(opts.get_int("switch-ms", 100));
+    auto const duration = std::chrono::duration<double>(opts.get_double("duration", 3.0));
+
+    auto const prewarm_start = now_ns();
+    SocketPool pool(targets);
+    auto const prewarm_ns = now_ns() - prewarm_start;
+
+    std::uint32_t prewarm_syscalls = 0;
+    std::size_t unusable           = 0;
+    for (std::size_t i = 0; i < pool.size(); ++i)
+    {
+        prewarm_syscalls += pool[i].syscalls;
+        if (!pool[i].error.empty())
+        {
+            ++unusable;
+            warn(Component::client, target_to_str(pool[i].target) + ": " + pool[i].error);
+        }
+    }
+    std::stringstream ss;
+    ss << strategy << ": " << pool.size() << " sockets prepared in " << format_ns(prewarm_ns)
+       << ", " << prewarm_syscalls / pool.size() << " syscalls each, " << unusable
+       << " unusable";
+    if (strategy == "cold")
+    {
+        // No pool: every switch starts from nothing
+        for (std::size_t s = 0; s < pool.size(); ++s)
+        {
+            pool.close(s);
+        }
+        ss.str("");
+        ss << strategy << ": no pool, each switch sets its socket up from scratch";
+    }
+    else if (strategy == "joined")
+    {
+        auto const start    = now_ns();
+        auto const failures = pool.join_all();
+        ss << "; batch join of " << pool.size() - unusable << " groups in "
+           << format_ns(now_ns() - start) << ", " << failures << " failed";
+    }
+    info(Component::main, ss.str());
+
+    SwitchState state;
+    ReceiveStats received;
+    auto sender   = std::thread([&] { feed_targets(senders, rate, state); });
+    auto receiver = std::thread([&] { receive_active(pool, state, received); });
+
+    LatencyHistogram cost;
+    std::uint64_t syscalls      = 0;
+    std::uint64_t switches      = 0;
+    std::uint64_t failed        = 0;
+    std::size_t i               = pool.size() - 1;
+    PooledSocket const* current = nullptr;
+    auto const start            = std::chrono::steady_clock::now();
+    auto next                   = start;
+    while (std::chrono::steady_clock::now() - start < duration)
+    {
+        std::this_thread::sleep_until(next);
+        next += interval;
+        i = (i + 1) % pool.size();
+        if (strategy != "cold" && pool[i].fd < 0)
+        {
+            ++failed;
+            continue;
+        }
+
+        // The switch proper: from the decision until the receiver can use it
+        auto const decision = now_ns();
+        state.decision_ns.store(decision, std::memory_order_relaxed);
+        state.expected_seq.store(
+            state.next_seq.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        auto const before = pool[i].syscalls;
+        auto const ok     = strategy == "joined" ? true
+                            : strategy == "bound" ? pool[i].joined || pool.join(i) == 0
+                                                  : (pool.rebuild(i), pool[i].error.empty());
+        if (!ok)
+        {
+            ++failed;
+            warn(Component::client, target_to_str(pool[i].target) + ": " + pool[i].error);
+            continue;
+        }
+        auto const* previous = pool.activate(i);
+        cost.record(now_ns() - decision);
+        syscalls += strategy == "cold" ? pool[i].syscalls : pool[i].syscalls - before;
+        ++switches;
+        current = &pool[i];
+
+        // Tidy up the old one off the clock, once the receiver has let go of it
+        while (state.observed.load(std::memory_order_acquire) != current)
+        {
+            std::this_thread::sleep_for(100us);
+        }
+        if (previous != nullptr && previous != current)
+        {
+            auto const p = pool.index_of(previous);
+            if (strategy == "bound")
+            {
+                pool.leave(p);
+            }
+            else if (strategy == "cold")
+            {
+                pool.close(p);
+            }
+        }
+    }
+    state.running = false;
+    sender.join();
+    receiver.join();
+
+    ss.str("");
+    ss << strategy << ": " << switches << " switches, " << failed << " failed; switch "
+       << format_ns(cost.percentile(50.0)) << " p50, " << format_ns(cost.max()) << " max, "
+       << (switches == 0 ? 0 : syscalls / switches) << " syscalls; first datagram after "
+       << format_ns(received.to_traffic.percentile(50.0)) << " p50, "
+       << format_ns(received.to_traffic.percentile(99.0)) << " p99; " << received.missed
+       << " missed, " << received.backlog << " stale discarded, " << received.silent
+       << " without traffic";
+    info(Component::main, ss.str());
+}
+
+} // namespace
+
+auto socket_failover(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void
+{
+    auto const groups = static_cast<std::uint32_t>(std::max(1LL, opts.get_int("groups", 2)));
+    auto const rcvbuf = static_cast<int>(opts.get_int("rcvbuf", 0));
+
+    std::vector<PoolTarget> targets;
+    std::vector<SendTarget> senders;
+    std::stringstream list{opts.get("interfaces", if_name)};
+    std::string name;
+    while (std::getline(list, name, ','))
+    {
+        auto const address = name == if_name ? if_addr
+                                             : boost::asio::ip::address{boost::asio::ip::address_v4(
+                                                   ntohl(interface_address(name).s_addr))};
+
+        // One sender per interface, sending to each group in turn
+        auto const fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+        exit_on_error(fd, Component::server, "socket");
+        auto dest =
+            bind_multicast_sender(fd, Component::server, address, name, mc_addr, port, false);
+        for (std::uint32_t g = 0; g < groups; ++g)
+        {
+            auto const group = boost::asio::ip::address_v4(mc_addr.to_v4().to_uint() + g);
+            targets.push_back(PoolTarget{name, address, group, port, rcvbuf});
+            address2in_addr(group, dest.sin_addr);
+            senders.push_back(SendTarget{fd, dest});
+        }
+    }
+
+    exit_on_error(
+        targets.size() < 2 ? -1 : 0,
+        Component::main,
+        "Nothing to switch between, needs --groups or --interfaces for two targets");
+
+    std::stringstream items{opts.get("strategy", "joined,bound,cold")};
+    std::string strategy;
+    while (std::getline(items, strategy, ','))
+    {
+        exit_on_error(
+            strategy == "joined" || strategy == "bound" || strategy == "cold" ? 0 : -1,
+            Component::main,
+            "Unknown --strategy " + strategy + ", expected joined, bound or cold");
+        run_strategy(strategy, targets, senders, opts);
+    }
+
+    // Several targets share each interface's sender
+    std::vector<int> fds;
+    for (auto const& s : senders)
+    {
+        fds.push_back(s.fd);
+    }
+    std::sort(fds.begin(), fds.end());
+    fds.erase(std::unique(fds.begin(), fds.end()), fds.end());
+    for (auto const fd : fds)
+    {
+        ::close(fd);
+    }
+}
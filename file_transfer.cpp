@@ -0,0 +1,675 @@
+#include "components.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/ip/address.hpp>
+
+#include "binding_functions.hpp"
+#include "logging.hpp"
+#include "receive_backend.hpp"
+#include "stats.hpp"
+#include "timing.hpp"
+
+// Bulk file distribution over the group.  The sender mmaps the file and
+// streams it in sequenced chunks, the datagram iovecs point straight into
+// the mapping.  Receivers copy every chunk to its offset in a preallocated,
+// mmapped output file and keep a bitmap of what they have.  After each round
+// the sender announces the end; receivers NACK their holes over unicast to
+// --repair-port and the sender multicasts the union of the holes as the next
+// round, until a round ends without any NACK.
+
+using namespace std::chrono_literals;
+
+namespace
+{
+
+std::uint32_t constexpr chunk_magic = 0x46494c45; // "FILE"
+std::uint32_t constexpr nack_magic  = 0x4e41434b; // "NACK"
+
+enum ChunkFlags : std::uint16_t
+{
+    chunk_data      = 0,
+    chunk_round_end = 1, ///< No more chunks this round, NACK now
+    chunk_done      = 2  ///< The sender has stopped for good
+};
+
+struct ChunkHeader
+{
+    std::uint32_t magic;
+    std::uint32_t transfer_id;
+    std::uint64_t file_size;
+    std::uint32_t index;
+    std::uint32_t count;
+    std::uint32_t round;
+    std::uint16_t chunk_size; ///< Of every chunk but the last
+    std::uint16_t flags;
+};
+
+struct NackRange
+{
+    std::uint32_t first;
+    std::uint32_t count;
+};
+
+std::size_t constexpr max_nack_ranges = 160;
+
+struct Nack
+{
+    std::uint32_t magic;
+    std::uint32_t transfer_id;
+    std::uint32_t round;
+    std::uint32_t ranges;
+    std::array<NackRange, max_nack_ranges> range;
+};
+
+/// One bit per chunk
+class ChunkBitmap
+{
+public:
+    explicit ChunkBitmap(std::size_t bits = 0) : bits_(bits), words_((bits + 63) / 64, 0) {}
+
+    auto size() const -> std::size_t { return bits_; }
+    auto count() const -> std::size_t { return count_; }
+    auto test(std::size_t i) const -> bool { return (words_[i / 64] >> (i % 64)) & 1; }
+
+    /// Returns true if the bit was clear
+    auto set(std::size_t i) -> bool
+    {
+        auto const mask = std::uint64_t{1} << (i % 64);
+        if ((words_[i / 64] & mask) != 0)
+        {
+            return false;
+        }
+        words_[i / 64] |= mask;
+        ++count_;
+        return true;
+    }
+
+    auto clear() -> void
+    {
+        std::fill(words_.begin(), words_.end(), 0);
+        count_ = 0;
+    }
+
+    /// Runs of clear bits, at most `max` of them
+    auto holes(std::size_t max) const -> std::vector<NackRange>
+    {
+        std::vector<NackRange> out;
+        std::size_t i = 0;
+        while (i < bits_ && out.size() < max)
+        {
+            if (words_[i / 64] == ~std::uint64_t{0})
+            {
+                i += 64;
+                continue;
+            }
+            if (test(i))
+            {
+                ++i;
+                continue;
+            }
+            auto const first = i;
+            while (i < bits_ && !test(i))
+            {
+                ++i;
+            }
+            out.push_back(
+                {static_cast<std::uint32_t>(first), static_cast<std::uint32_t>(i - first)});
+        }
+        return out;
+    }
+
+private:
+    std::size_t bits_;
+    std::size_t count_{0};
+    std::vector<std::uint64_t> words_;
+};
+
+auto repair_port(short unsigned int port, Options const& opts) -> short unsigned int
+{
+    return static_cast<short unsigned int>(opts.get_int("repair-port", port + 3));
+}
+
+auto format_gbps(std::uint64_t bytes, std::uint64_t ns) -> std::string
+{
+    std::stringstream ss;
+    ss.precision(3);
+    ss << (ns == 0 ? 0.0 : static_cast<double>(bytes) / static_cast<double>(ns)) << " GB/s";
+    return ss.str();
+}
+
+/// Read only mapping of the file to send.  Without --file a --size MB file
+/// of a known pattern is made in /tmp first.
+class SourceFile
+{
+public:
+    explicit SourceFile(Options const& opts)
+    {
+        auto path = opts.get("file");
+        if (path.empty())
+        {
+            path = "/tmp/bind-test-file-transfer.src";
+            auto const size = static_cast<std::size_t>(opts.get_int("size", 256)) << 20;
+            auto const fd   = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+            exit_on_error(fd, Component::server, "Could not create " + path);
+            std::vector<std::uint32_t> block(1 << 16);
+            for (std::size_t done = 0; done < size;)
+            {
+                for (std::size_t i = 0; i < block.size(); ++i)
+                {
+                    block[i] = static_cast<std::uint32_t>((done / 4 + i) * 2654435761U);
+                }
+                auto const len = std::min(size - done, block.size() * sizeof(block[0]));
+                exit_on_error(
+                    static_cast<int>(::write(fd, block.data(), len)),
+                    Component::server,
+                    "write " + path);
+                done += len;
+            }
+            ::close(fd);
+        }
+
+        fd_ = ::open(path.c_str(), O_RDONLY);
+        exit_on_error(fd_, Component::server, "Could not open " + path);
+        struct stat st;
+        exit_on_error(::fstat(fd_, &st), Component::server, "fstat " + path);
+        size_ = static_cast<std::size_t>(st.st_size);
+        exit_on_error(size_ == 0 ? -1 : 0, Component::server, path + " is empty");
+
+        auto* const map = ::mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd_, 0);
+        exit_on_error(map == MAP_FAILED ? -1 : 0, Component::server, "mmap " + path);
+        data_ = static_cast<char const*>(map);
+        ::madvise(const_cast<char*>(data_), size_, MADV_SEQUENTIAL);
+        path_ = path;
+    }
+
+    ~SourceFile()
+    {
+        ::munmap(const_cast<char*>(data_), size_);
+        ::close(fd_);
+    }
+
+    SourceFile(SourceFile const&)                    = delete;
+    auto operator=(SourceFile const&) -> SourceFile& = delete;
+
+    auto data() const -> char const* { return data_; }
+    auto size() const -> std::size_t { return size_; }
+    auto path() const -> std::string const& { return path_; }
+
+private:
+    int fd_{-1};
+    std::size_t size_{0};
+    char const* data_{nullptr};
+    std::string path_;
+};
+
+/// Writable mapping of the received file, sized by the first chunk seen
+class TargetFile
+{
+public:
+    TargetFile(std::string const& path, std::size_t size) : size_(size)
+    {
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+        exit_on_error(fd_, Component::client, "Could not create " + path);
+        exit_on_error(
+            ::ftruncate(fd_, static_cast<off_t>(size_)), Component::client, "ftruncate " + path);
+        auto* const map = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        exit_on_error(map == MAP_FAILED ? -1 : 0, Component::client, "mmap " + path);
+        data_ = static_cast<char*>(map);
+    }
+
+    ~TargetFile()
+    {
+        ::msync(data_, size_, MS_SYNC);
+        ::munmap(data_, size_);
+        ::close(fd_);
+    }
+
+    TargetFile(TargetFile const&)                    = delete;
+    auto operator=(TargetFile const&) -> TargetFile& = delete;
+
+    auto data() -> char* { return data_; }
+    auto size() const -> std::size_t { return size_; }
+
+private:
+    int fd_{-1};
+    std::size_t size_;
+    char* data_{nullptr};
+};
+
+/// Sends chunks through sendmmsg() batches, header and file data as two
+/// iovecs so the payload is never copied in user space
+class ChunkSender
+{
+public:
+    ChunkSender(int fd, SourceFile const& file, std::size_t chunk, std::size_t batch, double rate)
+        : fd_(fd),
+          file_(file),
+          chunk_(chunk),
+          count_(static_cast<std::uint32_t>((file.size() + chunk - 1) / chunk)),
+          headers_(batch),
+          iovs_(2 * batch),
+#ifdef __linux__
+          msgs_(batch),
+#endif
+          ns_per_byte_(rate > 0 ? 1e9 / (rate * 1e6) : 0)
+    {
+        for (std::size_t i = 0; i < batch; ++i)
+        {
+            iovs_[2 * i].iov_base = &headers_[i];
+            iovs_[2 * i].iov_len  = sizeof(ChunkHeader);
+#ifdef __linux__
+            std::memset(&msgs_[i], 0, sizeof(msgs_[i]));
+            msgs_[i].msg_hdr.msg_iov    = &iovs_[2 * i];
+            msgs_[i].msg_hdr.msg_iovlen = 2;
+#endif
+        }
+        transfer_id_ = static_cast<std::uint32_t>(now_ns());
+        next_ns_     = now_ns();
+    }
+
+    auto count() const -> std::uint32_t { return count_; }
+    auto wire_bytes() const -> std::uint64_t { return wire_bytes_; }
+    auto transfer_id() const -> std::uint32_t { return transfer_id_; }
+
+    /// Queues chunk `index` and sends when the batch is full
+    auto add(std::uint32_t index, std::uint32_t round) -> void
+    {
+        auto const offset = static_cast<std::size_t>(index) * chunk_;
+        auto const len    = std::min(chunk_, file_.size() - offset);
+        headers_[used_]   = ChunkHeader{chunk_magic,
+                                      transfer_id_,
+                                      file_.size(),
+                                      index,
+                                      count_,
+                                      round,
+                                      static_cast<std::uint16_t>(chunk_),
+                                      chunk_data};
+        iovs_[2 * used_ + 1].iov_base = const_cast<char*>(file_.data() + offset);
+        iovs_[2 * used_ + 1].iov_len  = len;
+        if (++used_ == headers_.size())
+        {
+            flush();
+        }
+    }
+
+    /// Sends a header only control datagram
+    auto signal(std::uint32_t round, std::uint16_t flags) -> void
+    {
+        flush();
+        headers_[0] = ChunkHeader{chunk_magic,
+                                  transfer_id_,
+                                  file_.size(),
+                                  0,
+                                  count_,
+                                  round,
+                                  static_cast<std::uint16_t>(chunk_),
+                                  flags};
+        iovs_[1].iov_len = 0;
+        used_            = 1;
+        flush();
+    }
+
+    auto flush() -> void
+    {
+        std::size_t sent = 0;
+        while (sent < used_)
+        {
+#ifdef __linux__
+            // clang-format off
+            auto const n = ::sendmmsg(
+                fd_,
+                msgs_.data() + sent,
+                static_cast<unsigned>(used_ - sent),
+                0
+            );
+            // clang-format on
+#else
+            auto const n = ::writev(fd_, &iovs_[2 * sent], 2) < 0 ? -1 : 1;
+#endif
+            if (n < 0)
+            {
+                // A full device queue, give it a moment rather than losing data
+                exit_on_errno(
+                    errno == ENOBUFS || errno == EAGAIN || errno == EINTR ? 0 : -1,
+                    Component::server,
+                    "send");
+                std::this_thread::sleep_for(50us);
+                continue;
+            }
+            for (auto i = sent; i < sent + static_cast<std::size_t>(n); ++i)
+            {
+                wire_bytes_ += sizeof(ChunkHeader) + iovs_[2 * i + 1].iov_len;
+                next_ns_ += static_cast<std::uint64_t>(
+                    ns_per_byte_ * static_cast<double>(iovs_[2 * i + 1].iov_len));
+            }
+            sent += static_cast<std::size_t>(n);
+        }
+        used_ = 0;
+
+        // --rate in MB/s, paced per batch
+        if (ns_per_byte_ > 0)
+        {
+            auto const now = now_ns();
+            if (next_ns_ > now)
+            {
+                std::this_thread::sleep_for(std::chrono::nanoseconds(next_ns_ - now));
+            }
+            else if (now - next_ns_ > 10000000)
+            {
+                next_ns_ = now;
+            }
+        }
+    }
+
+private:
+    int fd_;
+    SourceFile const& file_;
+    std::size_t chunk_;
+    std::uint32_t count_;
+    std::uint32_t transfer_id_{0};
+    std::vector<ChunkHeader> headers_;
+    std::vector<iovec> iovs_;
+#ifdef __linux__
+    std::vector<mmsghdr> msgs_;
+#endif
+    std::size_t used_{0};
+    std::uint64_t wire_bytes_{0};
+    double ns_per_byte_;
+    std::uint64_t next_ns_{0};
+};
+
+} // namespace
+
+auto file_sender(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void
+{
+    auto const chunk      = static_cast<std::size_t>(opts.get_int("chunk", 1440));
+    auto const batch      = static_cast<std::size_t>(std::max(1LL, opts.get_int("batch", 32)));
+    auto const repair_ms  = static_cast<int>(opts.get_int("repair-ms", 200));
+    auto const max_rounds = static_cast<std::uint32_t>(opts.get_int("max-rounds", 16));
+    exit_on_error(
+        chunk == 0 || chunk > 65507 - sizeof(ChunkHeader) ? -1 : 0,
+        Component::server,
+        "--chunk must fit a datagram");
+
+    SourceFile const file(opts);
+
+    auto const repair_fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    exit_on_error(repair_fd, Component::server, "socket");
+    bind_unicast(repair_fd, Component::server, if_addr, if_name, repair_port(port, opts));
+
+    auto const sock_fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    exit_on_error(sock_fd, Component::server, "socket");
+    auto const group =
+        bind_multicast_sender(sock_fd, Component::server, if_addr, if_name, mc_addr, port);
+    connect_to(sock_fd, Component::server, group);
+
+    ChunkSender sender(sock_fd, file, chunk, batch, opts.get_double("rate", 0));
+    {
+        std::stringstream ss;
+        ss << "Sending " << file.path() << ": " << file.size() << " bytes in " << sender.count()
+           << " chunks of " << chunk << ", NACKs on port " << repair_port(port, opts);
+        info(Component::server, ss.str());
+    }
+
+    // Give receivers on other threads/hosts the time to join
+    std::this_thread::sleep_for(std::chrono::milliseconds(opts.get_int("start-delay-ms", 500)));
+
+    ChunkBitmap wanted(sender.count());
+    std::uint64_t repaired = 0;
+    std::uint64_t first_ns = 0;
+    auto const start       = now_ns();
+    std::uint32_t round    = 0;
+    for (; round < max_rounds; ++round)
+    {
+        for (std::uint32_t i = 0; i < sender.count(); ++i)
+        {
+            if (round == 0 || wanted.test(i))
+            {
+                sender.add(i, round);
+            }
+        }
+        sender.flush();
+        if (round == 0)
+        {
+            first_ns = now_ns() - start;
+        }
+        else
+        {
+            repaired += wanted.count();
+        }
+
+        // Announce the end of the round a few times over the repair window
+        // and collect the union of everybody's holes
+        wanted.clear();
+        std::uint64_t nacks = 0;
+        for (int announce = 0; announce < 3; ++announce)
+        {
+            sender.signal(round, chunk_round_end);
+            auto const until = now_ns() + static_cast<std::uint64_t>(repair_ms) * 1000000 / 3;
+            for (auto now = now_ns(); now < until; now = now_ns())
+            {
+                pollfd pfd{repair_fd, POLLIN, 0};
+                if (::poll(&pfd, 1, static_cast<int>((until - now) / 1000000) + 1) <= 0)
+                {
+                    continue;
+                }
+                Nack nack;
+                auto const n = ::recv(repair_fd, &nack, sizeof(nack), MSG_DONTWAIT);
+                if (n < static_cast<ssize_t>(offsetof(Nack, range)) || nack.magic != nack_magic ||
+                    nack.transfer_id != sender.transfer_id() || nack.round != round)
+                {
+                    continue;
+                }
+                ++nacks;
+                auto const ranges = std::min<std::uint32_t>(nack.ranges, max_nack_ranges);
+                for (std::uint32_t r = 0; r < ranges; ++r)
+                {
+                    auto const& range = nack.range[r];
+                    auto const end    = std::min(range.first + range.count, sender.count());
+                    for (auto i = range.first; i < end; ++i)
+                    {
+                        wanted.set(i);
+                    }
+                }
+            }
+        }
+
+        std::stringstream ss;
+        ss << "Round " << round << ": " << nacks << " NACKs for " << wanted.count() << " chunks";
+        info(Component::server, ss.str());
+        if (nacks == 0)
+        {
+            break;
+        }
+    }
+    auto const total_ns = now_ns() - start;
+    for (int i = 0; i < 3; ++i)
+    {
+        sender.signal(round, chunk_done);
+    }
+
+    std::stringstream ss;
+    ss << "Sent " << file.size() << " bytes in " << round + 1 << " rounds, first round "
+       << format_gbps(file.size(), first_ns) << ", with repairs "
+       << format_gbps(file.size(), total_ns) << " (" << format_ns(total_ns) << "), " << repaired
+       << " chunks repaired, " << sender.wire_bytes() << " bytes on the wire for any number of "
+       << "receivers";
+    info(Component::server, ss.str());
+
+    ::close(sock_fd);
+    ::close(repair_fd);
+}
+
+auto file_receiver(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void
+{
+    auto const output     = opts.get("output", "/tmp/bind-test-file-transfer.out");
+    auto const timeout_ns = static_cast<std::uint64_t>(opts.get_int("timeout-ms", 5000)) * 1000000;
+    auto const kind       = opts.get("backend", "recvmmsg");
+    auto const peer       = boost::asio::ip::make_address(opts.get("peer", if_addr.to_string()));
+
+    auto backend = make_receive_backend(kind, if_addr, if_name, mc_addr, port, opts);
+
+    auto const nack_fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    exit_on_error(nack_fd, Component::client, "socket");
+    sockaddr_in repair{};
+    repair.sin_family = AF_INET;
+    repair.sin_port   = htons(repair_port(port, opts));
+    address2in_addr(peer, repair.sin_addr);
+    connect_to(nack_fd, Component::client, repair);
+
+    std::unique_ptr<TargetFile> target;
+    ChunkBitmap have;
+    ChunkHeader info_hdr{};
+    std::uint64_t first_ns   = 0;
+    std::uint64_t last_ns    = now_ns();
+    std::uint64_t duplicates = 0;
+    std::uint64_t truncated  = 0;
+    std::uint64_t foreign    = 0;
+    std::uint32_t nacks_sent = 0;
+    bool done                = false;
+
+    auto const send_nacks = [&](std::uint32_t round) {
+        Nack nack;
+        nack.magic       = nack_magic;
+        nack.transfer_id = info_hdr.transfer_id;
+        nack.round       = round;
+        auto const holes = have.holes(64 * max_nack_ranges);
+        for (std::size_t i = 0; i < holes.size(); i += max_nack_ranges)
+        {
+            auto const n = std::min(max_nack_ranges, holes.size() - i);
+            std::copy(holes.begin() + static_cast<long>(i),
+                      holes.begin() + static_cast<long>(i + n),
+                      nack.range.begin());
+            nack.ranges = static_cast<std::uint32_t>(n);
+            ::send(nack_fd, &nack, offsetof(Nack, range) + n * sizeof(NackRange), 0);
+        }
+        ++nacks_sent;
+    };
+
+    // Chunk offsets come from the accepted header only, anything else on the
+    // group (a stale transfer or a second sender) is counted and dropped
+    auto const accepted = [&](ChunkHeader const& hdr) {
+        if (!target)
+        {
+            return hdr.chunk_size > 0 &&
+                   hdr.count == (hdr.file_size + hdr.chunk_size - 1) / hdr.chunk_size;
+        }
+        return hdr.transfer_id == info_hdr.transfer_id && hdr.file_size == info_hdr.file_size &&
+               hdr.chunk_size == info_hdr.chunk_size && hdr.count == info_hdr.count;
+    };
+
+    auto const handler = [&](Datagram const& d) {
+        ChunkHeader hdr;
+        if (d.len < sizeof(hdr))
+        {
+            return;
+        }
+        std::memcpy(&hdr, d.data, sizeof(hdr));
+        if (hdr.magic != chunk_magic)
+        {
+            return;
+        }
+        if (!accepted(hdr))
+        {
+            ++foreign;
+            return;
+        }
+        last_ns = d.rx_ns;
+        if (!target)
+        {
+            info_hdr = hdr;
+            target   = std::make_unique<TargetFile>(output, hdr.file_size);
+            have     = ChunkBitmap(hdr.count);
+            first_ns = d.rx_ns;
+            std::stringstream ss;
+            ss << "Receiving " << hdr.file_size << " bytes in " << hdr.count << " chunks into "
+               << output;
+            info(Component::client, ss.str());
+        }
+
+        if (hdr.flags == chunk_done)
+        {
+            done = true;
+        }
+        else if (hdr.flags == chunk_round_end)
+        {
+            if (have.count() < have.size())
+            {
+                send_nacks(hdr.round);
+            }
+        }
+        else if (hdr.index < have.size())
+        {
+            auto const offset = static_cast<std::size_t>(hdr.index) * info_hdr.chunk_size;
+            auto const left   = offset < target->size() ? target->size() - offset : 0;
+            auto const len    = std::min<std::size_t>(info_hdr.chunk_size, left);
+            if (len == 0 || d.len != sizeof(hdr) + len)
+            {
+                ++truncated;
+            }
+            else if (have.set(hdr.index))
+            {
+                std::memcpy(target->data() + offset, d.data + sizeof(hdr), len);
+            }
+            else
+            {
+                ++duplicates;
+            }
+        }
+    };
+
+    info(Component::client, "Waiting for a transfer on " + mc_addr.to_string());
+    while (!done && (!target || have.count() < have.size()))
+    {
+        backend->poll(handler, 100);
+        if (now_ns() - last_ns > timeout_ns)
+        {
+            warn(Component::client, "No data for --timeout-ms, giving up");
+            break;
+        }
+    }
+    auto const elapsed = (target ? now_ns() : first_ns) - first_ns;
+
+    std::stringstream ss;
+    if (target && have.count() == have.size())
+    {
+        ss << "Received " << info_hdr.file_size << " bytes complete in " << format_ns(elapsed)
+           << ", " << format_gbps(info_hdr.file_size, elapsed) << ", " << nacks_sent
+           << " NACKs, " << duplicates << " duplicates, " << foreign << " foreign";
+        info(Component::client, ss.str());
+    }
+    else
+    {
+        ss << "Incomplete: " << have.count() << " of " << have.size() << " chunks, "
+           << truncated << " truncated (--buffer-size?), " << foreign << " foreign";
+        warn(Component::client, ss.str());
+    }
+    target.reset();
+    ::close(nack_fd);
+}
@@ -0,0 +1,70 @@
+#ifndef FIXED_FORMAT_HPP_R8WN2KCE
+#define FIXED_FORMAT_HPP_R8WN2KCE
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+#include <string_view>
+#include <type_traits>
+
+/// Fixed capacity text buffer for building messages without touching the
+/// heap: integers go through std::to_chars, everything else is copied in.
+/// What doesn't fit is cut off, a log line is never worth an allocation.
+template <std::size_t Capacity> class FixedString
+{
+public:
+    auto operator<<(std::string_view s) -> FixedString&
+    {
+        auto const n = std::min(s.size(), Capacity - 1 - size_);
+        std::memcpy(data_.data() + size_, s.data(), n);
+        size_ += n;
+        data_[size_] = '\0';
+        return *this;
+    }
+
+    auto operator<<(char const* s) -> FixedString& { return *this << std::string_view{s}; }
+
+    auto operator<<(char c) -> FixedString& { return *this << std::string_view{&c, 1}; }
+
+    template <typename T, std::enable_if_t<std::is_integral_v<T>, int> = 0>
+    auto operator<<(T value) -> FixedString&
+    {
+        return number(value, 10);
+    }
+
+    /// `value` in base 16, no prefix
+    template <typename T, std::enable_if_t<std::is_integral_v<T>, int> = 0>
+    auto hex(T value) -> FixedString&
+    {
+        return number(value, 16);
+    }
+
+    auto view() const -> std::string_view { return {data_.data(), size_}; }
+    auto c_str() const -> char const* { return data_.data(); }
+    auto size() const -> std::size_t { return size_; }
+    auto clear() -> void
+    {
+        size_    = 0;
+        data_[0] = '\0';
+    }
+
+private:
+    template <typename T> auto number(T value, int base) -> FixedString&
+    {
+        auto const result =
+            std::to_chars(data_.data() + size_, data_.data() + Capacity - 1, value, base);
+        if (result.ec == std::errc{})
+        {
+            size_ = static_cast<std::size_t>(result.ptr - data_.data());
+        }
+        data_[size_] = '\0';
+        return *this;
+    }
+
+    std::array<char, Capacity> data_{};
+    std::size_t size_{0};
+};
+
+#endif /* end of include guard: FIXED_FORMAT_HPP_R8WN2KCE */
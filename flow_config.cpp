@@ -0,0 +1,193 @@
+#include "flow_config.hpp"
+
+#include <arpa/inet.h>
+
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include "binding_functions.hpp"
+#include "logging.hpp"
+
+namespace
+{
+
+auto parse_address(std::string const& text, std::string const& what) -> in_addr
+{
+    in_addr addr;
+    auto const ok = ::inet_pton(AF_INET, text.c_str(), &addr);
+    exit_on_error(ok == 1 ? 0 : -1, Component::main, "Bad " + what + " address " + text);
+    return addr;
+}
+
+auto parse_number(std::string const& text, std::string const& key, unsigned long max)
+    -> unsigned long
+{
+    char* end    = nullptr;
+    auto const v = std::strtoul(text.c_str(), &end, 0);
+    exit_on_error(
+        *end == '\0' && v <= max ? 0 : -1, Component::main, "Bad " + key + "=" + text);
+    return v;
+}
+
+} // namespace
+
+auto interface_address(std::string const& if_name) -> in_addr
+{
+    for (auto const& iface : list_ipv4_interfaces())
+    {
+        if (iface.name == if_name)
+        {
+            return iface.addr;
+        }
+    }
+    exit_on_error(-1, Component::main, "No IPv4 address on interface " + if_name);
+    return in_addr{};
+}
+
+auto parse_flow(std::string const& text, Flow const& defaults) -> Flow
+{
+    auto flow   = defaults;
+    auto has_ip = false;
+    auto has_if = false;
+
+    std::stringstream tokens{text};
+    std::string token;
+    while (tokens >> token)
+    {
+        auto const eq = token.find('=');
+        exit_on_error(
+            eq == std::string::npos ? -1 : 0, Component::main, "Expected key=value: " + token);
+        auto const key   = token.substr(0, eq);
+        auto const value = token.substr(eq + 1);
+
+        if (key == "if")
+        {
+            exit_on_error(
+                value.size() < IFNAMSIZ ? 0 : -1,
+                Component::main,
+                "Interface name too long " + value);
+            std::memset(flow.if_name, 0, sizeof(flow.if_name));
+            std::memcpy(flow.if_name, value.data(), value.size());
+            has_if = true;
+        }
+        else if (key == "ip")
+        {
+            flow.if_addr = parse_address(value, "interface");
+            has_ip       = true;
+        }
+        else if (key == "group")
+        {
+            flow.group = parse_address(value, "group");
+        }
+        else if (key == "port")
+        {
+            flow.port = static_cast<std::uint16_t>(parse_number(value, key, 65535));
+        }
+        else if (key == "rate")
+        {
+            flow.rate = static_cast<std::uint32_t>(parse_number(value, key, 100000000));
+        }
+        else if (key == "payload")
+        {
+            flow.payload = static_cast<std::uint16_t>(parse_number(value, key, 65507));
+        }
+        else if (key == "prio")
+        {
+            flow.priority = static_cast<std::uint8_t>(parse_number(value, key, 255));
+        }
+        else if (key == "dscp")
+        {
+            flow.dscp = static_cast<std::uint8_t>(parse_number(value, key, 63));
+        }
+        else if (key == "role")
+        {
+            flow.role = parse_role(value, key);
+        }
+        else
+        {
+            exit_on_error(-1, Component::main, "Unknown flow key " + key);
+        }
+    }
+
+    if (has_if && !has_ip)
+    {
+        flow.if_addr = interface_address(flow.if_name);
+    }
+    return flow;
+}
+
+auto parse_role(std::string const& value, std::string const& name) -> FlowRole
+{
+    exit_on_error(
+        value == "send" || value == "receive" ? 0 : -1,
+        Component::main,
+        name + " is send or receive, not " + value);
+    return value == "send" ? FlowRole::send : FlowRole::receive;
+}
+
+auto load_flows(Options const& opts, Flow const& defaults) -> FlowTable
+{
+    FlowTable flows;
+
+    if (opts.has("flows"))
+    {
+        auto const path = opts.get("flows");
+        std::ifstream file{path};
+        exit_on_error(file ? 0 : -1, Component::main, "Cannot read " + path);
+
+        std::string line;
+        while (std::getline(file, line))
+        {
+            line = line.substr(0, line.find('#'));
+            if (line.find_first_not_of(" \t\r") != std::string::npos)
+            {
+                flows.push_back(parse_flow(line, defaults));
+            }
+        }
+    }
+
+    if (opts.has("flow"))
+    {
+        std::stringstream list{opts.get("flow")};
+        std::string item;
+        while (std::getline(list, item, ';'))
+        {
+            if (item.find_first_not_of(' ') != std::string::npos)
+            {
+                flows.push_back(parse_flow(item, defaults));
+            }
+        }
+    }
+
+    if (flows.empty())
+    {
+        flows.push_back(defaults);
+    }
+    flows.shrink_to_fit();
+    return flows;
+}
+
+auto flow_to_str(Flow const& flow) -> std::string
+{
+    std::array<char, INET_ADDRSTRLEN> ip{};
+    std::array<char, INET_ADDRSTRLEN> group{};
+    ::inet_ntop(AF_INET, &flow.if_addr, ip.data(), ip.size());
+    ::inet_ntop(AF_INET, &flow.group, group.data(), group.size());
+
+    std::stringstream ss;
+    ss << (flow.role == FlowRole::send ? "send " : "receive ") << group.data() << ":" << flow.port
+       << " on " << flow.if_name << " (" << ip.data() << ")";
+    if (flow.role == FlowRole::send)
+    {
+        ss << " " << flow.rate << "/s x " << flow.payload << " B";
+        if (flow.priority != 0 || flow.dscp != 0)
+        {
+            ss << " prio " << static_cast<int>(flow.priority) << " dscp "
+               << static_cast<int>(flow.dscp);
+        }
+    }
+    return ss.str();
+}
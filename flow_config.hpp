@@ -0,0 +1,56 @@
+#ifndef FLOW_CONFIG_HPP_W8LJ2CUE
+#define FLOW_CONFIG_HPP_W8LJ2CUE
+
+#include <net/if.h>
+#include <netinet/in.h>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "options.hpp"
+
+enum class FlowRole : std::uint8_t
+{
+    send,
+    receive,
+};
+
+/// One flow: which interface, group and port, in which direction and how
+/// much.  Plain data in network order where the socket API wants it, so
+/// the engines never parse or look anything up after startup and a table of
+/// a few hundred flows fits in L1/L2.
+struct Flow
+{
+    in_addr if_addr;
+    in_addr group;
+    std::uint32_t rate; ///< datagrams/s, send flows
+    std::uint16_t port; ///< host order
+    std::uint16_t payload;
+    FlowRole role;
+    std::uint8_t priority; ///< SO_PRIORITY of send flows, 0 = default
+    std::uint8_t dscp;     ///< DSCP of send flows (IP_TOS >> 2), 0 = default
+    char if_name[IFNAMSIZ];
+};
+
+using FlowTable = std::vector<Flow>;
+
+/// Parses one flow, e.g. "if=eth0 group=224.2.127.254 port=30512 role=send
+/// rate=1000 payload=64 prio=6 dscp=46".  Missing keys come from `defaults`; `ip` is looked
+/// up from `if` when only the name is given.  Exits on error.
+auto parse_flow(std::string const& text, Flow const& defaults) -> Flow;
+
+/// "send" or "receive", from a flow's role= or a --role option named `name`.
+/// Exits on anything else.
+auto parse_role(std::string const& value, std::string const& name) -> FlowRole;
+
+/// Flows of --flows=<file> (one per line, # comments) followed by those of
+/// --flow="...;..." (';' separated).  Just `defaults` when neither is given.
+auto load_flows(Options const& opts, Flow const& defaults) -> FlowTable;
+
+auto flow_to_str(Flow const& flow) -> std::string;
+
+/// IPv4 address of `if_name`, exits when it has none
+auto interface_address(std::string const& if_name) -> in_addr;
+
+#endif /* end of include guard: FLOW_CONFIG_HPP_W8LJ2CUE */
@@ -0,0 +1,309 @@
+#include "components.hpp"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/ip/address.hpp>
+
+#include "binding_functions.hpp"
+#include "flow_config.hpp"
+#include "flow_engine.hpp"
+#include "logging.hpp"
+#include "realtime.hpp"
+#include "stats.hpp"
+#include "tx_backpressure.hpp"
+#include "types.hpp"
+
+// Runs a whole flow table in one process: one thread paces every send flow,
+// one thread polls every receive flow, whatever interface each is on.  The
+// asio engine (asio_engine.cpp) can take the place of both threads.
+
+using namespace std::chrono_literals;
+
+auto count_received(FlowCounters& counter, char const* data, std::size_t n) -> void
+{
+    std::uint64_t seq = 0;
+    if (n >= sizeof(seq))
+    {
+        std::memcpy(&seq, data, sizeof(seq));
+        auto const gap =
+            counter.datagrams.load(std::memory_order_relaxed) > 0 && seq > counter.next_seq
+                ? seq - counter.next_seq
+                : 0;
+        counter.lost.fetch_add(gap, std::memory_order_relaxed);
+        counter.next_seq = seq + 1;
+    }
+    counter.datagrams.fetch_add(1, std::memory_order_relaxed);
+    counter.bytes.fetch_add(static_cast<std::uint64_t>(n), std::memory_order_relaxed);
+}
+
+namespace
+{
+
+auto to_address(in_addr const a) -> boost::asio::ip::address
+{
+    return boost::asio::ip::address_v4(ntohl(a.s_addr));
+}
+
+auto open_flow(Flow const& flow) -> int
+{
+    auto const c  = flow.role == FlowRole::send ? Component::server : Component::client;
+    auto const fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    exit_on_error(fd, c, "socket");
+
+    auto const if_addr = to_address(flow.if_addr);
+    auto const group   = to_address(flow.group);
+    if (flow.role == FlowRole::send)
+    {
+        auto const dest = bind_multicast_sender(fd, c, if_addr, flow.if_name, group, flow.port);
+        set_qos(fd, c, flow.priority, flow.dscp);
+        connect_to(fd, c, dest);
+    }
+    else
+    {
+        bind_multicast_receiver(fd, c, if_addr, flow.if_name, group, flow.port);
+    }
+    return fd;
+}
+
+/// Earliest deadline first over all send flows.  Flows with a `pressure`
+/// entry (--tx-policy) back off or shed through it, a shed datagram counts
+/// as a send error.
+auto send_flows(
+    FlowTable const& flows,
+    std::vector<int> const& fds,
+    std::vector<std::unique_ptr<TxBackpressure>> const& pressure,
+    std::vector<FlowCounters>& counters,
+    std::atomic<bool> const& running) -> void
+{
+    using clock = std::chrono::steady_clock;
+
+    std::vector<std::size_t> active;
+    std::vector<clock::duration> period(flows.size());
+    std::vector<clock::time_point> due(flows.size(), clock::now());
+    std::size_t largest = sizeof(std::uint64_t);
+    for (std::size_t i = 0; i < flows.size(); ++i)
+    {
+        if (flows[i].role == FlowRole::send && flows[i].rate > 0)
+        {
+            active.push_back(i);
+            period[i] = std::chrono::duration_cast<clock::duration>(
+                std::chrono::duration<double>(1.0 / flows[i].rate));
+            largest = std::max<std::size_t>(largest, flows[i].payload);
+        }
+    }
+    if (active.empty())
+    {
+        return;
+    }
+
+    std::vector<char> buffer(largest, 0);
+    while (running.load(std::memory_order_relaxed))
+    {
+        auto const i = *std::min_element(active.begin(), active.end(), [&due](auto a, auto b) {
+            return due[a] < due[b];
+        });
+        std::this_thread::sleep_until(due[i]);
+        due[i] += period[i];
+
+        auto& counter = counters[i];
+        std::memcpy(buffer.data(), &counter.next_seq, sizeof(counter.next_seq));
+        auto const size = std::max<std::size_t>(flows[i].payload, sizeof(std::uint64_t));
+        ssize_t n       = -1;
+        if (!pressure[i])
+        {
+            n = ::send(fds[i], buffer.data(), size, 0);
+        }
+        else if (pressure[i]->send(buffer.data(), size))
+        {
+            n = static_cast<ssize_t>(size);
+        }
+        if (n < 0)
+        {
+            counter.lost.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        ++counter.next_seq;
+        counter.datagrams.fetch_add(1, std::memory_order_relaxed);
+        counter.bytes.fetch_add(static_cast<std::uint64_t>(n), std::memory_order_relaxed);
+    }
+}
+
+/// One poll() over every receive flow
+auto receive_flows(
+    FlowTable const& flows,
+    std::vector<int> const& fds,
+    std::vector<FlowCounters>& counters,
+    std::atomic<bool> const& running) -> void
+{
+    std::vector<pollfd> pfds;
+    std::vector<std::size_t> index;
+    for (std::size_t i = 0; i < flows.size(); ++i)
+    {
+        if (flows[i].role == FlowRole::receive)
+        {
+            pfds.push_back(pollfd{fds[i], POLLIN, 0});
+            index.push_back(i);
+        }
+    }
+    if (pfds.empty())
+    {
+        return;
+    }
+
+    std::vector<char> buffer(65536);
+    while (running.load(std::memory_order_relaxed))
+    {
+        auto const ready = ::poll(pfds.data(), pfds.size(), 100);
+        exit_on_error(ready < 0 && errno != EINTR ? -1 : 0, Component::client, "poll");
+        for (std::size_t p = 0; ready > 0 && p < pfds.size(); ++p)
+        {
+            if ((pfds[p].revents & POLLIN) == 0)
+            {
+                continue;
+            }
+            auto& counter = counters[index[p]];
+            for (;;)
+            {
+                auto const n = ::recv(pfds[p].fd, buffer.data(), buffer.size(), MSG_DONTWAIT);
+                if (n < 0)
+                {
+                    break;
+                }
+                count_received(counter, buffer.data(), static_cast<std::size_t>(n));
+            }
+        }
+    }
+}
+
+} // namespace
+
+auto run_flows(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void
+{
+    auto const duration = std::chrono::duration<double>(opts.get_double("duration", 10.0));
+    auto const engine   = opts.get("engine", "raw");
+    exit_on_error(
+        engine == "raw" || engine == "asio" ? 0 : -1,
+        Component::main,
+        "Unknown --engine " + engine + ", expected raw or asio");
+
+    // Command line defaults for whatever a flow doesn't specify
+    Flow defaults;
+    std::memset(&defaults, 0, sizeof(defaults));
+    address2in_addr(if_addr, defaults.if_addr);
+    address2in_addr(mc_addr, defaults.group);
+    defaults.port     = port;
+    defaults.rate     = static_cast<std::uint32_t>(opts.get_int("rate", 1000));
+    defaults.payload  = static_cast<std::uint16_t>(opts.get_int("payload", 64));
+    defaults.role     = parse_role(opts.get("role", "receive"), "--role");
+    defaults.priority = static_cast<std::uint8_t>(opts.get_int("priority", 0));
+    defaults.dscp     = static_cast<std::uint8_t>(opts.get_int("dscp", 0));
+    std::strncpy(defaults.if_name, if_name.c_str(), sizeof(defaults.if_name) - 1);
+
+    auto const flows = load_flows(opts, defaults);
+    std::vector<int> fds;
+    for (std::size_t i = 0; i < flows.size(); ++i)
+    {
+        info(Component::main, "flow " + std::to_string(i) + ": " + flow_to_str(flows[i]));
+        fds.push_back(open_flow(flows[i]));
+    }
+
+    std::vector<std::unique_ptr<TxBackpressure>> pressure(flows.size());
+    if (opts.has("tx-policy"))
+    {
+        if (engine == "asio")
+        {
+            // Its sends already wait for the socket to take them
+            warn(Component::main, "--tx-policy is for the raw engine, asio ignores it");
+        }
+        for (std::size_t i = 0; engine == "raw" && i < flows.size(); ++i)
+        {
+            if (flows[i].role == FlowRole::send)
+            {
+                pressure[i] = std::make_unique<TxBackpressure>(
+                    fds[i], Component::server, flows[i].if_name, opts);
+            }
+        }
+    }
+
+    std::vector<FlowCounters> counters(flows.size());
+    std::atomic<bool> running{true};
+    auto const server_tuning = thread_tuning_from_options(opts, "server");
+    auto const client_tuning = thread_tuning_from_options(opts, "client");
+
+    std::unique_ptr<FlowEngine> asio;
+    std::thread sender;
+    std::thread receiver;
+    if (engine == "asio")
+    {
+        asio = start_asio_engine(flows, fds, counters, opts);
+    }
+    else
+    {
+        sender = std::thread([&] {
+            apply_thread_tuning(Component::server, server_tuning);
+            send_flows(flows, fds, pressure, counters, running);
+        });
+        receiver = std::thread([&] {
+            apply_thread_tuning(Component::client, client_tuning);
+            receive_flows(flows, fds, counters, running);
+        });
+    }
+
+    std::vector<std::uint64_t> last(flows.size(), 0);
+    auto const start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < duration)
+    {
+        std::this_thread::sleep_for(1s);
+        std::stringstream ss;
+        for (std::size_t i = 0; i < flows.size(); ++i)
+        {
+            auto const now = counters[i].datagrams.load(std::memory_order_relaxed);
+            ss << (i == 0 ? "" : " | ") << i << ": "
+               << format_rate(static_cast<double>(now - last[i]));
+            last[i] = now;
+        }
+        info(Component::main, ss.str());
+    }
+    running = false;
+    if (asio)
+    {
+        asio->stop();
+        info(Component::main, "asio: " + asio->report());
+    }
+    else
+    {
+        sender.join();
+        receiver.join();
+    }
+
+    for (std::size_t i = 0; i < flows.size(); ++i)
+    {
+        std::stringstream ss;
+        ss << "flow " << i << " " << (flows[i].role == FlowRole::send ? "sent " : "received ")
+           << counters[i].datagrams.load() << " datagrams, " << counters[i].bytes.load()
+           << " bytes, " << (flows[i].role == FlowRole::send ? "send errors " : "lost ")
+           << counters[i].lost.load();
+        if (pressure[i])
+        {
+            ss << "; " << pressure[i]->summary();
+        }
+        info(Component::main, ss.str());
+        pressure[i].reset();
+        ::close(fds[i]);
+    }
+}
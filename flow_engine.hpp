@@ -0,0 +1,55 @@
+#ifndef FLOW_ENGINE_HPP_V2NQ8RDK
+#define FLOW_ENGINE_HPP_V2NQ8RDK
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "flow_config.hpp"
+#include "options.hpp"
+#include "types.hpp"
+
+/// Written by the one thread that owns the flow, read by the reporter
+struct alignas(cache_line_size) FlowCounters
+{
+    std::atomic<std::uint64_t> datagrams{0};
+    std::atomic<std::uint64_t> bytes{0};
+    std::atomic<std::uint64_t> lost{0};
+    std::uint64_t next_seq{0};
+};
+
+/// Sequence gap accounting shared by the engines, for a received datagram
+/// of `n` bytes starting with the sender's sequence number
+auto count_received(FlowCounters& counter, char const* data, std::size_t n) -> void;
+
+/// The flow table run by something other than the raw send and poll()
+/// threads of run_flows(), which keep reporting from the counters
+class FlowEngine
+{
+public:
+    virtual ~FlowEngine() = default;
+
+    /// Stops sending and receiving and joins the engine's threads
+    virtual auto stop() -> void = 0;
+
+    /// Engine specific figures for the final report
+    virtual auto report() const -> std::string { return {}; }
+};
+
+/// The flow table on a boost::asio::io_context: the sockets opened by the
+/// usual binding sequence are adopted as ip::udp::sockets, receive flows
+/// keep one async_receive in flight, send flows alternate a steady_timer
+/// and async_send.  --asio-threads run the io_context (1).  Each flow has
+/// one operation outstanding at a time, so its handlers never run
+/// concurrently and reuse one block of memory instead of the heap.
+/// Starts right away; `fds` stay owned by the caller.
+auto start_asio_engine(
+    FlowTable const& flows,
+    std::vector<int> const& fds,
+    std::vector<FlowCounters>& counters,
+    Options const& opts) -> std::unique_ptr<FlowEngine>;
+
+#endif /* end of include guard: FLOW_ENGINE_HPP_V2NQ8RDK */
@@ -0,0 +1,211 @@
+#include "components.hpp"
+
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <thread>
+
+#include <boost/asio/ip/address.hpp>
+
+#include "alloc_hook.hpp"
+#include "binding_functions.hpp"
+#include "buffer_pool.hpp"
+#include "fixed_format.hpp"
+#include "logging.hpp"
+#include "stats.hpp"
+#include "timing.hpp"
+
+// What the tool costs on a constrained ECU: everything is set up front
+// (sockets, pre-faulted packet buffers), then a send/receive loop on the
+// bound group runs with the allocation guard armed, and the binary size,
+// RSS and startup time are reported.  With BIND_TEST_EMBEDDED a single heap
+// allocation in that loop fails the run.
+
+using namespace std::chrono_literals;
+
+namespace
+{
+
+/// Taken during static initialization, before main()
+auto const process_start_ns = now_ns();
+
+enum Socket : std::size_t
+{
+    sender,
+    receiver,
+    socket_count
+};
+
+/// "VmRSS:     1234 kB" -> 1234, 0 when the platform has no /proc status
+auto proc_status_kb(char const* key) -> std::uint64_t
+{
+    std::ifstream status("/proc/self/status");
+    for (std::string line; std::getline(status, line);)
+    {
+        if (line.compare(0, std::strlen(key), key) == 0 && line[std::strlen(key)] == ':')
+        {
+            return std::stoull(line.substr(std::strlen(key) + 1));
+        }
+    }
+    return 0;
+}
+
+auto binary_size() -> std::uint64_t
+{
+    struct stat st;
+#ifdef __linux__
+    if (::stat("/proc/self/exe", &st) == 0)
+#else
+    if (::stat("/proc/self/exefile", &st) == 0)
+#endif
+    {
+        return static_cast<std::uint64_t>(st.st_size);
+    }
+    return 0;
+}
+
+} // namespace
+
+auto footprint(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void
+{
+    auto const duration = opts.get_double("duration", 5.0);
+    auto const rate     = static_cast<std::uint64_t>(opts.get_int("rate", 10000));
+    auto const payload  = static_cast<std::size_t>(opts.get_int("payload", 256));
+    auto const buffers  = static_cast<std::size_t>(opts.get_int("buffers", 64));
+    exit_on_error(
+        payload >= sizeof(std::uint64_t) ? 0 : -1, Component::main, "--payload must hold a seq");
+
+    // Everything the loop touches exists before the guard is armed
+    std::array<int, socket_count> sockets{};
+    for (auto& fd : sockets)
+    {
+        fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+        exit_on_error(fd, Component::main, "socket");
+    }
+    auto const dest = bind_multicast_sender(
+        sockets[sender], Component::server, if_addr, if_name, mc_addr, port, false);
+    connect_to(sockets[sender], Component::server, dest, false);
+    bind_multicast_receiver(sockets[receiver], Component::client, if_addr, if_name, mc_addr, port);
+    BufferPool pool(buffers, payload, opts.has("huge-pages"));
+
+    auto const setup_allocations = allocation_count();
+    auto const ready_ns          = now_ns();
+    arm_alloc_guard(opts.has("alloc-abort"));
+
+    std::uint64_t sent        = 0;
+    std::uint64_t received    = 0;
+    std::uint64_t gaps        = 0;
+    std::uint64_t send_errors = 0;
+    std::uint64_t no_buffer   = 0;
+    std::uint64_t next_seq    = 0;
+    auto const period         = rate > 0 ? 1000000000 / rate : 0;
+    auto const start          = now_ns();
+    auto const end            = start + static_cast<std::uint64_t>(duration * 1e9);
+    auto next                 = start;
+    auto next_report          = start + 1000000000;
+    for (auto now = start; now < end; now = now_ns())
+    {
+        if (period > 0 && next > now)
+        {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(next - now));
+        }
+        next += period;
+
+        std::uint32_t handle;
+        if (!pool.acquire(handle))
+        {
+            ++no_buffer;
+            continue;
+        }
+        std::memcpy(pool.data(handle), &sent, sizeof(sent));
+        if (::send(sockets[sender], pool.data(handle), payload, 0) < 0)
+        {
+            ++send_errors;
+        }
+        else
+        {
+            ++sent;
+        }
+
+        // Multicast loopback: what was sent is already queued on the receiver
+        for (;;)
+        {
+            auto const n =
+                ::recv(sockets[receiver], pool.data(handle), pool.buffer_size(), MSG_DONTWAIT);
+            if (n < static_cast<ssize_t>(sizeof(std::uint64_t)))
+            {
+                break;
+            }
+            std::uint64_t seq;
+            std::memcpy(&seq, pool.data(handle), sizeof(seq));
+            gaps += seq > next_seq ? seq - next_seq : 0;
+            next_seq = seq + 1;
+            ++received;
+        }
+        pool.release(handle);
+
+        if (now >= next_report)
+        {
+            next_report += 1000000000;
+            FixedString<256> line;
+            line << "sent " << sent << ", received " << received << ", gaps " << gaps
+                 << ", allocations after init " << allocations_after_init();
+            info(Component::main, line.view());
+        }
+    }
+    auto const elapsed = now_ns() - start;
+    disarm_alloc_guard();
+
+    for (auto const fd : sockets)
+    {
+        ::close(fd);
+    }
+
+    {
+        std::stringstream ss;
+        ss << "Sent " << sent << ", received " << received << " (" << gaps << " gaps, "
+           << send_errors << " send errors, " << no_buffer << " without a buffer) in "
+           << format_ns(elapsed);
+        info(Component::main, ss.str());
+    }
+    {
+        rusage usage{};
+        ::getrusage(RUSAGE_SELF, &usage);
+        std::stringstream ss;
+        ss << "Binary " << (binary_size() >> 10) << " KB, RSS " << proc_status_kb("VmRSS")
+           << " KB, peak RSS " << proc_status_kb("VmHWM") << " KB (ru_maxrss "
+           << usage.ru_maxrss << "), ready " << format_ns(ready_ns - process_start_ns)
+           << " after start";
+        if (alloc_hook_enabled())
+        {
+            ss << ", " << setup_allocations << " allocations during startup, "
+               << allocations_after_init() << " after initialization";
+        }
+        info(Component::main, ss.str());
+    }
+
+    if (!alloc_hook_enabled())
+    {
+        warn(Component::main, "Allocations are only counted with -DBIND_TEST_EMBEDDED=ON");
+        return;
+    }
+    exit_on_error(
+        allocations_after_init() > 0 ? -1 : 0,
+        Component::main,
+        std::to_string(allocations_after_init()) +
+            " heap allocations after initialization, the first of " +
+            std::to_string(first_allocation_after_init()) +
+            " bytes (--alloc-abort stops right there)");
+}
@@ -0,0 +1,155 @@
+#include "integrity.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
+
+#include "crc32c.hpp"
+
+namespace
+{
+
+std::uint64_t constexpr pattern_step = 0x9e3779b97f4a7c15; // 2^64 / golden ratio
+
+auto pattern_base(std::uint64_t seq) -> std::uint64_t
+{
+    return (seq + 1) * 0xd6e8feb86659fd93;
+}
+
+auto pattern_word(std::uint64_t seq, std::size_t index) -> std::uint64_t
+{
+    return pattern_base(seq) + pattern_step * index;
+}
+
+} // namespace
+
+auto integrity_result_to_str(IntegrityResult r) -> char const*
+{
+    switch (r)
+    {
+        case IntegrityResult::ok:
+            return "ok";
+        case IntegrityResult::truncated:
+            return "truncated";
+        case IntegrityResult::oversized:
+            return "oversized";
+        case IntegrityResult::bad_crc:
+            return "bad CRC";
+    }
+    return "?";
+}
+
+auto fill_pattern(char* data, std::size_t len, std::uint64_t seq) -> void
+{
+    std::size_t i = 0;
+#if defined(__SSE2__)
+    auto word = _mm_set_epi64x(
+        static_cast<long long>(pattern_word(seq, 1)), static_cast<long long>(pattern_word(seq, 0)));
+    auto const step = _mm_set1_epi64x(static_cast<long long>(pattern_step * 2));
+    for (; i + 16 <= len; i += 16)
+    {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(data + i), word);
+        word = _mm_add_epi64(word, step);
+    }
+#elif defined(__aarch64__)
+    uint64_t const first[2] = {pattern_word(seq, 0), pattern_word(seq, 1)};
+    auto word               = vld1q_u64(first);
+    auto const step         = vdupq_n_u64(pattern_step * 2);
+    for (; i + 16 <= len; i += 16)
+    {
+        vst1q_u64(reinterpret_cast<uint64_t*>(data + i), word);
+        word = vaddq_u64(word, step);
+    }
+#endif
+    // Whole words the vector loop left, then the bytes of a last partial word
+    for (; i < len; i += 8)
+    {
+        auto const word = pattern_word(seq, i / 8);
+        std::memcpy(data + i, &word, std::min<std::size_t>(8, len - i));
+    }
+}
+
+auto verify_pattern(char const* data, std::size_t len, std::uint64_t seq) -> std::size_t
+{
+    std::size_t i = 0;
+#if defined(__SSE2__)
+    auto word = _mm_set_epi64x(
+        static_cast<long long>(pattern_word(seq, 1)), static_cast<long long>(pattern_word(seq, 0)));
+    auto const step = _mm_set1_epi64x(static_cast<long long>(pattern_step * 2));
+    for (; i + 16 <= len; i += 16)
+    {
+        auto const got = _mm_loadu_si128(reinterpret_cast<__m128i const*>(data + i));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(got, word)) != 0xffff)
+        {
+            break;
+        }
+        word = _mm_add_epi64(word, step);
+    }
+#elif defined(__aarch64__)
+    uint64_t const first[2] = {pattern_word(seq, 0), pattern_word(seq, 1)};
+    auto word               = vld1q_u64(first);
+    auto const step         = vdupq_n_u64(pattern_step * 2);
+    for (; i + 16 <= len; i += 16)
+    {
+        auto const got = vld1q_u64(reinterpret_cast<uint64_t const*>(data + i));
+        if (vminvq_u32(vreinterpretq_u32_u64(vceqq_u64(got, word))) == 0)
+        {
+            break;
+        }
+        word = vaddq_u64(word, step);
+    }
+#endif
+    // The vector loop stops at the first 16 bytes that differ, find the byte
+    for (; i < len; i += 8)
+    {
+        auto const word = pattern_word(seq, i / 8);
+        char expected[8];
+        std::memcpy(expected, &word, sizeof(expected));
+        for (std::size_t b = 0; b < 8 && i + b < len; ++b)
+        {
+            if (data[i + b] != expected[b])
+            {
+                return i + b;
+            }
+        }
+    }
+    return len;
+}
+
+auto integrity_fill(char* datagram, std::size_t body, std::uint64_t seq) -> void
+{
+    IntegrityHeader header{seq, static_cast<std::uint32_t>(body), 0};
+    fill_pattern(datagram + sizeof(header), body, seq);
+    header.crc = crc32c(datagram + sizeof(header), body, crc32c(&header, sizeof(header)));
+    std::memcpy(datagram, &header, sizeof(header));
+}
+
+auto integrity_check(char const* datagram, std::size_t n, std::uint64_t& seq) -> IntegrityResult
+{
+    IntegrityHeader header;
+    if (n < sizeof(header))
+    {
+        return IntegrityResult::truncated;
+    }
+    std::memcpy(&header, datagram, sizeof(header));
+    seq = header.seq;
+    if (n - sizeof(header) < header.len)
+    {
+        return IntegrityResult::truncated;
+    }
+    if (n - sizeof(header) > header.len)
+    {
+        return IntegrityResult::oversized;
+    }
+
+    auto const expected = header.crc;
+    header.crc          = 0;
+    auto const crc =
+        crc32c(datagram + sizeof(header), header.len, crc32c(&header, sizeof(header)));
+    return crc == expected ? IntegrityResult::ok : IntegrityResult::bad_crc;
+}
@@ -0,0 +1,43 @@
+#ifndef INTEGRITY_HPP_P9CJ4LVE
+#define INTEGRITY_HPP_P9CJ4LVE
+
+#include <cstddef>
+#include <cstdint>
+
+/// Start of every datagram sent with --integrity.  The body after it is a
+/// pattern derived from `seq`, and `crc` is the CRC32C of the header (with
+/// `crc` zero) and the body, so corrupted, truncated or padded datagrams
+/// are all told apart from good ones.  Host byte order.
+struct IntegrityHeader
+{
+    std::uint64_t seq;
+    std::uint32_t len; ///< body bytes
+    std::uint32_t crc;
+};
+
+enum class IntegrityResult
+{
+    ok,
+    truncated, ///< shorter than the header or its `len` says
+    oversized, ///< longer than its `len` says
+    bad_crc,
+};
+
+auto integrity_result_to_str(IntegrityResult r) -> char const*;
+
+/// Deterministic content for `seq`: consecutive 64-bit words of an
+/// arithmetic sequence seeded by `seq`, generated and compared 16 bytes at a
+/// time with SSE2/NEON
+auto fill_pattern(char* data, std::size_t len, std::uint64_t seq) -> void;
+
+/// Offset of the first byte that differs from fill_pattern(), `len` if none
+auto verify_pattern(char const* data, std::size_t len, std::uint64_t seq) -> std::size_t;
+
+/// Writes header and a `body` byte pattern into `datagram`, which must hold
+/// sizeof(IntegrityHeader) + body bytes
+auto integrity_fill(char* datagram, std::size_t body, std::uint64_t seq) -> void;
+
+/// Checks `n` received bytes; `seq` is set whenever the header was readable
+auto integrity_check(char const* datagram, std::size_t n, std::uint64_t& seq) -> IntegrityResult;
+
+#endif /* end of include guard: INTEGRITY_HPP_P9CJ4LVE */
@@ -0,0 +1,136 @@
+#include "components.hpp"
+
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sstream>
+#include <thread>
+
+#include "logging.hpp"
+#include "realtime.hpp"
+#include "stats.hpp"
+#include "timing.hpp"
+
+// Periodic loop that wakes on an absolute deadline and then writes to a page
+// it has not touched before, which is what a component thread does when it
+// starts filling a fresh buffer.  Run once as the components run today and
+// once with the requested tuning, then compare.
+
+namespace
+{
+
+struct JitterResult
+{
+    LatencyHistogram lateness;
+    long faults{0};
+};
+
+auto run_periodic(
+    ThreadTuning const& tuning,
+    bool prefault,
+    bool huge_pages,
+    std::uint64_t period_ns,
+    std::size_t iterations) -> JitterResult
+{
+    JitterResult result;
+    std::thread t([&] {
+        apply_thread_tuning(Component::main, tuning);
+
+        auto const page  = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+        auto const bytes = page * iterations;
+        char* buf        = nullptr;
+        if (prefault)
+        {
+            buf = static_cast<char*>(alloc_prefaulted(bytes, huge_pages));
+        }
+        else
+        {
+            // clang-format off
+            auto* p = ::mmap(
+                nullptr,
+                bytes,
+                PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS,
+                -1,
+                0
+            );
+            // clang-format on
+            exit_on_error(p == MAP_FAILED ? -1 : 0, Component::main, "Could not map buffer");
+            buf = static_cast<char*>(p);
+        }
+
+        auto const faults_before = page_faults();
+
+        timespec deadline;
+        ::clock_gettime(CLOCK_MONOTONIC, &deadline);
+        for (std::size_t i = 0; i < iterations; ++i)
+        {
+            deadline.tv_nsec += static_cast<long>(period_ns);
+            while (deadline.tv_nsec >= 1000000000)
+            {
+                deadline.tv_nsec -= 1000000000;
+                ++deadline.tv_sec;
+            }
+            ::clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, nullptr);
+
+            buf[i * page] = static_cast<char>(i);
+
+            timespec now;
+            ::clock_gettime(CLOCK_MONOTONIC, &now);
+            auto const late = (now.tv_sec - deadline.tv_sec) * 1000000000L +
+                              (now.tv_nsec - deadline.tv_nsec);
+            result.lateness.record(late > 0 ? static_cast<std::uint64_t>(late) : 0);
+        }
+
+        result.faults = page_faults() - faults_before;
+        if (prefault)
+        {
+            free_prefaulted(buf, bytes, huge_pages);
+        }
+        else
+        {
+            ::munmap(buf, bytes);
+        }
+    });
+    t.join();
+    return result;
+}
+
+} // namespace
+
+auto jitter_test(Options const& opts) -> void
+{
+    auto const period_ns  = static_cast<std::uint64_t>(opts.get_int("period-us", 1000)) * 1000;
+    auto const iterations = static_cast<std::size_t>(opts.get_int("iterations", 5000));
+    auto const huge_pages = opts.has("huge-pages");
+    auto const tuning     = thread_tuning_from_options(opts, "jitter");
+
+    {
+        std::stringstream ss;
+        ss << "Baseline: " << iterations << " wakeups every " << format_ns(period_ns)
+           << ", default scheduling, first touch of each page";
+        info(Component::main, ss.str());
+    }
+    auto const baseline = run_periodic(ThreadTuning{}, false, false, period_ns, iterations);
+
+    if (opts.has("mlock"))
+    {
+        lock_memory(Component::main);
+    }
+    {
+        std::stringstream ss;
+        ss << "Tuned: " << tuning.to_str() << ", pre-faulted"
+           << (huge_pages ? " huge page" : "") << " buffer"
+           << (opts.has("mlock") ? ", mlockall" : "");
+        info(Component::main, ss.str());
+    }
+    auto const tuned = run_periodic(tuning, true, huge_pages, period_ns, iterations);
+
+    std::stringstream ss;
+    ss << "baseline: faults=" << baseline.faults << " lateness " << baseline.lateness.summary();
+    info(Component::main, ss.str());
+    ss.str("");
+    ss << "tuned:    faults=" << tuned.faults << " lateness " << tuned.lateness.summary();
+    info(Component::main, ss.str());
+}
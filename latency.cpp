@@ -0,0 +1,302 @@
+#include "components.hpp"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/ip/address.hpp>
+
+#include "binding_functions.hpp"
+#include "clock_sync.hpp"
+#include "logging.hpp"
+#include "ping_pong.hpp"
+#include "stats.hpp"
+#include "timing.hpp"
+
+// One-way latency of the group across hosts.  The sender stamps every
+// datagram with its own clock; the receiver runs an NTP style exchange
+// against a unicast time service next to the sender and moves the stamps
+// onto its own clock before taking the difference.
+
+using namespace std::chrono_literals;
+
+namespace
+{
+
+auto sync_port(short unsigned int port, Options const& opts) -> short unsigned int
+{
+    return static_cast<short unsigned int>(opts.get_int("sync-port", port + 2));
+}
+
+auto is_transient(int err) -> bool
+{
+    return err == EAGAIN || err == EWOULDBLOCK || err == EINTR || err == ECONNREFUSED;
+}
+
+/// Answers TimeProbes until `running` is cleared
+auto serve_time(int fd, std::atomic<bool> const& running) -> void
+{
+    while (running.load(std::memory_order_relaxed))
+    {
+        pollfd pfd{fd, POLLIN, 0};
+        if (::poll(&pfd, 1, 100) <= 0)
+        {
+            continue;
+        }
+
+        TimeProbe probe;
+        sockaddr_in from;
+        auto len = static_cast<socklen_t>(sizeof(from));
+        // clang-format off
+        auto const n = ::recvfrom(
+            fd,
+            &probe,
+            sizeof(probe),
+            MSG_DONTWAIT,
+            reinterpret_cast<struct sockaddr*>(&from),
+            &len
+        );
+        // clang-format on
+        auto const t2 = now_ns();
+        if (n != static_cast<ssize_t>(sizeof(probe)))
+        {
+            continue;
+        }
+        probe.t2 = t2;
+        probe.t3 = now_ns();
+        // clang-format off
+        ::sendto(
+            fd,
+            &probe,
+            sizeof(probe),
+            0,
+            reinterpret_cast<struct sockaddr const*>(&from),
+            len
+        );
+        // clang-format on
+    }
+}
+
+} // namespace
+
+auto latency_sender(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void
+{
+    auto const rate     = std::max(1.0, opts.get_double("rate", 1000.0));
+    auto const payload  = std::max<std::size_t>(
+        sizeof(PingPongHeader), static_cast<std::size_t>(opts.get_int("payload", 64)));
+    auto const duration = std::chrono::duration<double>(opts.get_double("duration", 10.0));
+
+    auto const time_fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    exit_on_error(time_fd, Component::server, "socket");
+    bind_unicast(time_fd, Component::server, if_addr, if_name, sync_port(port, opts));
+    std::atomic<bool> running{true};
+    auto time_service = std::thread([&] { serve_time(time_fd, running); });
+
+    auto const sock_fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    exit_on_error(sock_fd, Component::server, "socket");
+    auto const group =
+        bind_multicast_sender(sock_fd, Component::server, if_addr, if_name, mc_addr, port);
+    connect_to(sock_fd, Component::server, group);
+
+    std::vector<char> buffer(payload, 0);
+    auto const send = [&](std::uint64_t seq, std::uint32_t flags) {
+        PingPongHeader const hdr{seq, now_ns(), flags, 0};
+        std::memcpy(buffer.data(), &hdr, sizeof(hdr));
+        auto const n = ::send(sock_fd, buffer.data(), buffer.size(), 0);
+        exit_on_errno(n < 0 && !is_transient(errno) ? -1 : 0, Component::server, "send");
+    };
+
+    std::stringstream ss;
+    ss << "Sending " << rate << " datagrams/s of " << payload << " bytes, time service on port "
+       << sync_port(port, opts);
+    info(Component::server, ss.str());
+
+    auto const period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1.0 / rate));
+    auto const start  = std::chrono::steady_clock::now();
+    auto next         = start;
+    std::uint64_t seq = 0;
+    while (next - start < duration)
+    {
+        std::this_thread::sleep_until(next);
+        send(seq++, 0);
+        next += period;
+    }
+    for (int i = 0; i < 3; ++i)
+    {
+        send(seq++, ping_pong_stop);
+    }
+
+    // Receivers may still be finishing a probe
+    std::this_thread::sleep_for(200ms);
+    running = false;
+    time_service.join();
+
+    info(Component::server, "Sent " + std::to_string(seq) + " datagrams, closing");
+    ::close(sock_fd);
+    ::close(time_fd);
+}
+
+auto latency_receiver(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void
+{
+    auto const peer  = boost::asio::ip::make_address(opts.get("peer", if_addr.to_string()));
+    auto const every = std::chrono::milliseconds(opts.get_int("probe-ms", 100));
+
+    // The sender's stop datagram normally ends the run before this
+    auto const duration = std::chrono::duration<double>(opts.get_double("duration", 10.0) + 1.0);
+
+    auto const mc_fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    exit_on_error(mc_fd, Component::client, "socket");
+    bind_multicast_receiver(mc_fd, Component::client, if_addr, if_name, mc_addr, port);
+
+    auto const probe_fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    exit_on_error(probe_fd, Component::client, "socket");
+    bind_unicast(probe_fd, Component::client, if_addr, if_name, 0);
+    {
+        sockaddr_in service;
+        std::memset(&service, 0, sizeof(service));
+        service.sin_family = AF_INET;
+        address2in_addr(peer, service.sin_addr);
+        service.sin_port = htons(sync_port(port, opts));
+        connect_to(probe_fd, Component::client, service);
+    }
+
+    ClockSync sync{
+        static_cast<std::size_t>(opts.get_int("sync-filter", 8)),
+        static_cast<std::size_t>(opts.get_int("sync-window", 64))};
+
+    // `raw` is only meaningful when both ends share a clock, it is kept to
+    // show what the correction did
+    LatencyHistogram raw;
+    LatencyHistogram corrected;
+    LatencyHistogram interval;
+    std::uint64_t received = 0;
+    std::uint64_t unsynced = 0;
+    std::uint64_t negative = 0;
+    std::uint64_t lost     = 0;
+    std::uint64_t next_seq = 0;
+    std::vector<char> buffer(65536);
+
+    auto const start   = std::chrono::steady_clock::now();
+    auto next_probe    = start;
+    auto next_report   = start + 1s;
+    auto last_received = received;
+    auto done          = false;
+    while (!done && std::chrono::steady_clock::now() - start < duration)
+    {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= next_probe)
+        {
+            TimeProbe const probe{now_ns(), 0, 0};
+            auto const n = ::send(probe_fd, &probe, sizeof(probe), 0);
+            exit_on_errno(n < 0 && !is_transient(errno) ? -1 : 0, Component::client, "probe");
+            next_probe = now + every;
+        }
+
+        std::array<pollfd, 2> pfds{{{mc_fd, POLLIN, 0}, {probe_fd, POLLIN, 0}}};
+        auto const wait_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            next_probe - std::chrono::steady_clock::now());
+        auto const ready =
+            ::poll(pfds.data(), pfds.size(), std::max(0, static_cast<int>(wait_ms.count())));
+        exit_on_error(ready < 0 && errno != EINTR ? -1 : 0, Component::client, "poll");
+
+        if ((pfds[1].revents & POLLIN) != 0)
+        {
+            TimeProbe probe;
+            auto const n  = ::recv(probe_fd, &probe, sizeof(probe), MSG_DONTWAIT);
+            auto const t4 = now_ns();
+            if (n == static_cast<ssize_t>(sizeof(probe)))
+            {
+                sync.add(probe, t4);
+            }
+        }
+
+        while ((pfds[0].revents & POLLIN) != 0)
+        {
+            auto const n     = ::recv(mc_fd, buffer.data(), buffer.size(), MSG_DONTWAIT);
+            auto const rx_ns = now_ns();
+            if (n < 0)
+            {
+                exit_on_errno(is_transient(errno) ? 0 : -1, Component::client, "recv");
+                break;
+            }
+
+            PingPongHeader hdr;
+            if (static_cast<std::size_t>(n) < sizeof(hdr))
+            {
+                continue;
+            }
+            std::memcpy(&hdr, buffer.data(), sizeof(hdr));
+            if ((hdr.flags & ping_pong_stop) != 0)
+            {
+                done = true;
+                break;
+            }
+            if (received > 0 && hdr.id > next_seq)
+            {
+                lost += hdr.id - next_seq;
+            }
+            next_seq = hdr.id + 1;
+            ++received;
+
+            raw.record(rx_ns > hdr.send_ns ? rx_ns - hdr.send_ns : 0);
+            if (!sync.ready())
+            {
+                ++unsynced;
+                continue;
+            }
+            auto const sent = sync.to_local(hdr.send_ns, rx_ns);
+            if (sent > rx_ns)
+            {
+                // Within the offset error, typically on a very short path
+                ++negative;
+                continue;
+            }
+            corrected.record(rx_ns - sent);
+            interval.record(rx_ns - sent);
+        }
+
+        now = std::chrono::steady_clock::now();
+        if (now >= next_report)
+        {
+            next_report += 1s;
+            std::stringstream ss;
+            ss << format_rate(static_cast<double>(received - last_received))
+               << " one-way p50=" << format_ns(interval.percentile(50))
+               << " p99=" << format_ns(interval.percentile(99)) << ", " << sync.summary();
+            info(Component::client, ss.str());
+            last_received = received;
+            interval.reset();
+        }
+    }
+
+    std::stringstream ss;
+    ss << "Received " << received << " datagrams, lost " << lost << ", " << unsynced
+       << " before the first clock sample, " << negative << " negative after correction";
+    info(Component::client, ss.str());
+    info(Component::client, "Clock " + sync.summary());
+    info(Component::client, "Uncorrected " + raw.summary());
+    info(Component::client, "Corrected   " + corrected.summary());
+
+    ::close(probe_fd);
+    ::close(mc_fd);
+}
@@ -0,0 +1,420 @@
+#include "live_stats.hpp"
+
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <new>
+#include <sstream>
+
+#include "logging.hpp"
+#include "shm_ring.hpp"
+#include "timing.hpp"
+
+namespace
+{
+
+auto round_up(std::size_t v, std::size_t to) -> std::size_t { return (v + to - 1) / to * to; }
+
+auto slots_offset() -> std::size_t { return round_up(sizeof(LiveStatsHeader), cache_line_size); }
+
+auto json_string(std::string const& s) -> std::string
+{
+    std::string out = "\"";
+    for (auto const c : s)
+    {
+        if (c == '"' || c == '\\')
+        {
+            out += '\\';
+        }
+        out += static_cast<unsigned char>(c) < 0x20 ? '?' : c;
+    }
+    return out + "\"";
+}
+
+/// All threads in one, for the total line
+auto total_of(std::vector<LiveSnapshot> const& threads) -> LiveSnapshot
+{
+    LiveSnapshot total;
+    total.name = "total";
+    for (auto const& t : threads)
+    {
+        total.packets += t.packets;
+        total.bytes += t.bytes;
+        total.drops += t.drops;
+        total.gaps += t.gaps;
+        total.packet_rate += t.packet_rate;
+        total.byte_rate += t.byte_rate;
+        total.latency.merge(t.latency);
+    }
+    return total;
+}
+
+auto text_line(std::stringstream& ss, LiveSnapshot const& t) -> void
+{
+    ss << std::left << std::setw(LiveThreadStats::name_size) << t.name << std::right << " "
+       << t.packets << " packets, " << t.bytes << " bytes, " << t.drops << " drops, " << t.gaps
+       << " gaps, " << format_rate(t.packet_rate) << ", " << std::fixed << std::setprecision(1)
+       << t.byte_rate * 8 / 1e6 << " Mbit/s";
+    if (t.latency.count() > 0)
+    {
+        ss << ", latency " << t.latency.summary();
+    }
+    ss << "\n";
+}
+
+auto json_object(std::stringstream& ss, LiveSnapshot const& t) -> void
+{
+    ss << "{\"name\":" << json_string(t.name) << ",\"packets\":" << t.packets
+       << ",\"bytes\":" << t.bytes << ",\"drops\":" << t.drops << ",\"gaps\":" << t.gaps
+       << ",\"packet_rate\":" << static_cast<std::uint64_t>(t.packet_rate)
+       << ",\"byte_rate\":" << static_cast<std::uint64_t>(t.byte_rate)
+       << ",\"latency_ns\":{\"count\":" << t.latency.count() << ",\"min\":" << t.latency.min()
+       << ",\"p50\":" << t.latency.percentile(50) << ",\"p90\":" << t.latency.percentile(90)
+       << ",\"p99\":" << t.latency.percentile(99) << ",\"p99.9\":" << t.latency.percentile(99.9)
+       << ",\"max\":" << t.latency.max() << "}}";
+}
+
+auto send_all(int fd, std::string const& reply) -> void
+{
+    std::size_t sent = 0;
+    while (sent < reply.size())
+    {
+        // A monitoring agent that went away must not take the daemon with it
+        auto const n = ::send(fd, reply.data() + sent, reply.size() - sent, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return;
+        }
+        sent += static_cast<std::size_t>(n);
+    }
+}
+
+} // namespace
+
+LiveStats::LiveStats(std::string name, void* base, std::size_t size, bool owner)
+    : name_(std::move(name)),
+      base_(base),
+      size_(size),
+      owner_(owner),
+      header_(static_cast<LiveStatsHeader*>(base))
+{
+}
+
+LiveStats::LiveStats(LiveStats&& other) noexcept
+    : name_(std::move(other.name_)),
+      base_(other.base_),
+      size_(other.size_),
+      owner_(other.owner_),
+      header_(other.header_)
+{
+    other.base_  = nullptr;
+    other.owner_ = false;
+}
+
+LiveStats::~LiveStats()
+{
+    if (base_ != nullptr)
+    {
+        ::munmap(base_, size_);
+    }
+    if (owner_)
+    {
+        unlink_shm_segment(name_);
+    }
+}
+
+auto LiveStats::create(std::string const& name, std::uint32_t max_threads) -> LiveStats
+{
+    auto const size = slots_offset() + sizeof(LiveThreadStats) * max_threads;
+
+    unlink_shm_segment(name);
+    auto const fd = open_shm_segment(name, O_CREAT | O_EXCL | O_RDWR);
+    exit_on_error(fd, Component::main, "Could not create shared memory " + name);
+
+    auto const err = ::ftruncate(fd, static_cast<off_t>(size));
+    exit_on_error(err, Component::main, "Could not size shared memory " + name);
+
+    auto* base = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    exit_on_error(base == MAP_FAILED ? -1 : 0, Component::main, "Could not map " + name);
+
+    // The segment is zero filled, so are all slots and their atomics
+    auto* header        = new (base) LiveStatsHeader{};
+    header->max_threads = max_threads;
+    header->slot_size   = sizeof(LiveThreadStats);
+    header->pid         = static_cast<std::uint32_t>(::getpid());
+    header->start_ns    = now_ns();
+    header->threads.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = LiveStatsHeader::magic_value;
+
+    std::stringstream ss;
+    ss << "Publishing live statistics in shared memory \"" << name << "\" (" << max_threads
+       << " threads, " << size << " bytes)";
+    info(Component::main, ss.str());
+
+    return LiveStats{name, base, size, true};
+}
+
+auto LiveStats::attach(std::string const& name) -> LiveStats
+{
+    // Readers only ever load, the mapping can be read only
+    auto const fd = open_shm_segment(name, O_RDONLY);
+    exit_on_error(fd, Component::main, "Could not open shared memory " + name);
+
+    struct stat st;
+    auto const err = ::fstat(fd, &st);
+    exit_on_error(err, Component::main, "Could not stat shared memory " + name);
+
+    auto const size = static_cast<std::size_t>(st.st_size);
+    auto* base      = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    exit_on_error(base == MAP_FAILED ? -1 : 0, Component::main, "Could not map " + name);
+
+    auto const* header = static_cast<LiveStatsHeader const*>(base);
+    exit_on_error(
+        size >= sizeof(LiveStatsHeader) && header->magic == LiveStatsHeader::magic_value &&
+                header->slot_size == sizeof(LiveThreadStats) &&
+                size >= slots_offset() + sizeof(LiveThreadStats) * header->max_threads
+            ? 0
+            : -1,
+        Component::main,
+        name + " is not a bind-test statistics segment of this build");
+
+    return LiveStats{name, base, size, false};
+}
+
+auto LiveStats::claim(std::string const& name) -> LiveThreadStats&
+{
+    auto const index = header_->threads.fetch_add(1, std::memory_order_relaxed);
+    exit_on_error(
+        index < header_->max_threads ? 0 : -1,
+        Component::main,
+        "No statistics slot left for " + name);
+
+    auto& s = slot(index);
+    std::strncpy(s.name, name.c_str(), sizeof(s.name) - 1);
+    s.active.store(1, std::memory_order_release);
+    return s;
+}
+
+auto LiveStats::snapshot() const -> std::vector<LiveSnapshot>
+{
+    std::vector<LiveSnapshot> threads;
+    auto const count =
+        std::min(header_->threads.load(std::memory_order_relaxed), header_->max_threads);
+    for (std::uint32_t i = 0; i < count; ++i)
+    {
+        auto const& s = slot(i);
+        if (s.active.load(std::memory_order_acquire) == 0)
+        {
+            continue;
+        }
+
+        // Counters are read one by one, a snapshot is consistent per counter
+        LiveSnapshot t;
+        t.name    = std::string(s.name, ::strnlen(s.name, sizeof(s.name)));
+        t.packets = s.packets.load(std::memory_order_relaxed);
+        t.bytes   = s.bytes.load(std::memory_order_relaxed);
+        t.drops   = s.drops.load(std::memory_order_relaxed);
+        t.gaps    = s.gaps.load(std::memory_order_relaxed);
+        for (std::size_t b = 0; b < LatencyHistogram::bucket_count; ++b)
+        {
+            t.latency.record(
+                LatencyHistogram::bucket_lower(b), s.latency[b].load(std::memory_order_relaxed));
+        }
+        threads.push_back(std::move(t));
+    }
+    return threads;
+}
+
+auto LiveStats::uptime_ns() const -> std::uint64_t
+{
+    return now_ns() - header_->start_ns;
+}
+
+auto LiveStats::slot(std::size_t i) const -> LiveThreadStats&
+{
+    auto* first = static_cast<char*>(base_) + slots_offset();
+    return *reinterpret_cast<LiveThreadStats*>(first + sizeof(LiveThreadStats) * i);
+}
+
+auto live_stats_rates(
+    std::vector<LiveSnapshot>& threads,
+    std::vector<LiveSnapshot> const& earlier,
+    std::uint64_t elapsed_ns) -> void
+{
+    if (elapsed_ns == 0)
+    {
+        return;
+    }
+    auto const seconds = static_cast<double>(elapsed_ns) / 1e9;
+    for (auto& t : threads)
+    {
+        auto const previous = std::find_if(earlier.begin(), earlier.end(), [&](auto const& p) {
+            return p.name == t.name;
+        });
+        if (previous != earlier.end())
+        {
+            t.packet_rate = static_cast<double>(t.packets - previous->packets) / seconds;
+            t.byte_rate   = static_cast<double>(t.bytes - previous->bytes) / seconds;
+        }
+    }
+}
+
+auto live_stats_text(std::vector<LiveSnapshot> const& threads, std::uint64_t uptime_ns)
+    -> std::string
+{
+    std::stringstream ss;
+    ss << "uptime " << format_ns(uptime_ns) << ", " << threads.size() << " threads\n";
+    for (auto const& t : threads)
+    {
+        text_line(ss, t);
+    }
+    text_line(ss, total_of(threads));
+    return ss.str();
+}
+
+auto live_stats_json(std::vector<LiveSnapshot> const& threads, std::uint64_t uptime_ns)
+    -> std::string
+{
+    std::stringstream ss;
+    ss << "{\"uptime_ns\":" << uptime_ns << ",\"threads\":[";
+    for (std::size_t i = 0; i < threads.size(); ++i)
+    {
+        ss << (i == 0 ? "" : ",");
+        json_object(ss, threads[i]);
+    }
+    ss << "],\"total\":";
+    json_object(ss, total_of(threads));
+    ss << "}\n";
+    return ss.str();
+}
+
+LiveStatsServer::LiveStatsServer(LiveStats const& stats, std::string const& path)
+    : stats_(stats), path_(path)
+{
+    static std::string const android_prefix = "android:";
+    if (path.compare(0, android_prefix.size(), android_prefix) == 0)
+    {
+        // init created and bound the service's socket, it only has to listen
+        auto const env   = "ANDROID_SOCKET_" + path.substr(android_prefix.size());
+        auto const* fd_s = std::getenv(env.c_str());
+        exit_on_error(fd_s == nullptr ? -1 : 0, Component::main, env + " is not set");
+        listen_fd_ = std::atoi(fd_s);
+    }
+    else
+    {
+        sockaddr_un addr{};
+        exit_on_error(
+            path.size() < sizeof(addr.sun_path) ? 0 : -1,
+            Component::main,
+            "Socket path too long: " + path);
+        addr.sun_family = AF_UNIX;
+        std::strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+        listen_fd_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        exit_on_error(listen_fd_, Component::main, "socket");
+        ::unlink(path.c_str());
+        // clang-format off
+        auto const err = ::bind(listen_fd_,
+                                reinterpret_cast<sockaddr const*>(&addr),
+                                sizeof(addr));
+        // clang-format on
+        exit_on_error(err, Component::main, "Could not bind " + path);
+        unlink_ = true;
+    }
+    exit_on_error(::listen(listen_fd_, 8), Component::main, "listen " + path);
+    info(Component::main, "Serving live statistics on " + path);
+
+    sample();
+    thread_ = std::thread([this] { serve(); });
+}
+
+LiveStatsServer::~LiveStatsServer()
+{
+    running_ = false;
+    thread_.join();
+    ::close(listen_fd_);
+    if (unlink_)
+    {
+        ::unlink(path_.c_str());
+    }
+}
+
+auto LiveStatsServer::serve() -> void
+{
+    auto next_sample = now_ns() + 1000000000;
+    while (running_.load(std::memory_order_relaxed))
+    {
+        pollfd pfd{listen_fd_, POLLIN, 0};
+        auto const ready = ::poll(&pfd, 1, 100);
+        if (ready > 0 && (pfd.revents & POLLIN) != 0)
+        {
+            auto const client = ::accept(listen_fd_, nullptr, nullptr);
+            if (client >= 0)
+            {
+                answer(client);
+                ::close(client);
+            }
+        }
+        if (now_ns() >= next_sample)
+        {
+            sample();
+            next_sample += 1000000000;
+        }
+    }
+}
+
+auto LiveStatsServer::answer(int client) -> void
+{
+    // The request is optional: a client that just connects and reads gets text
+    char request[16] = {};
+    pollfd pfd{client, POLLIN, 0};
+    if (::poll(&pfd, 1, 100) > 0)
+    {
+        auto const n = ::recv(client, request, sizeof(request) - 1, 0);
+        request[std::max<ssize_t>(n, 0)] = '\0';
+    }
+
+    // Fresh counters, rates from the last once a second sample
+    auto threads = stats_.snapshot();
+    for (auto& t : threads)
+    {
+        auto const sampled = std::find_if(current_.begin(), current_.end(), [&](auto const& p) {
+            return p.name == t.name;
+        });
+        if (sampled != current_.end())
+        {
+            t.packet_rate = sampled->packet_rate;
+            t.byte_rate   = sampled->byte_rate;
+        }
+    }
+    auto const uptime = stats_.uptime_ns();
+    auto const reply  = std::strncmp(request, "json", 4) == 0 ? live_stats_json(threads, uptime)
+                                                              : live_stats_text(threads, uptime);
+    send_all(client, reply);
+}
+
+auto LiveStatsServer::sample() -> void
+{
+    auto threads   = stats_.snapshot();
+    auto const now = stats_.uptime_ns();
+    live_stats_rates(threads, current_, now - sampled_ns_);
+    current_    = std::move(threads);
+    sampled_ns_ = now;
+}
@@ -0,0 +1,155 @@
+#ifndef LIVE_STATS_HPP_H3XV9TQD
+#define LIVE_STATS_HPP_H3XV9TQD
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "stats.hpp"
+#include "types.hpp"
+
+// Live statistics of a long running process, kept in a POSIX shared memory
+// segment so that they cost the data path nothing to publish.  Every data
+// path thread claims one slot and is its only writer; monitoring reads the
+// slots with relaxed loads, either by mapping the segment itself or through
+// the Unix socket of LiveStatsServer.
+
+/// Counters of one data path thread.  Updates are a plain load and store of
+/// the thread's own cache lines, no locked instructions and no sharing.
+struct alignas(cache_line_size) LiveThreadStats
+{
+    static std::size_t constexpr name_size = 32;
+
+    char name[name_size];
+    std::atomic<std::uint32_t> active;
+
+    alignas(cache_line_size) std::atomic<std::uint64_t> packets;
+    std::atomic<std::uint64_t> bytes;
+    std::atomic<std::uint64_t> drops;
+    std::atomic<std::uint64_t> gaps;
+
+    /// Same buckets as LatencyHistogram, readers rebuild one from them
+    std::array<std::atomic<std::uint64_t>, LatencyHistogram::bucket_count> latency;
+
+    auto add_packet(std::uint64_t len) -> void
+    {
+        bump(packets, 1);
+        bump(bytes, len);
+    }
+    auto add_drops(std::uint64_t n) -> void { bump(drops, n); }
+    auto add_gaps(std::uint64_t n) -> void { bump(gaps, n); }
+    auto add_latency(std::uint64_t ns) -> void
+    {
+        bump(latency[LatencyHistogram::bucket_index(ns)], 1);
+    }
+
+private:
+    static auto bump(std::atomic<std::uint64_t>& counter, std::uint64_t n) -> void
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+};
+
+struct LiveStatsHeader
+{
+    static std::uint32_t constexpr magic_value = 0x4254534c; // "BTSL"
+
+    std::uint32_t magic;
+    std::uint32_t max_threads;
+    std::uint32_t slot_size;
+    std::uint32_t pid;
+    std::uint64_t start_ns; ///< CLOCK_MONOTONIC
+    std::atomic<std::uint32_t> threads;
+};
+
+/// What a reader makes of one slot
+struct LiveSnapshot
+{
+    std::string name;
+    std::uint64_t packets{0};
+    std::uint64_t bytes{0};
+    std::uint64_t drops{0};
+    std::uint64_t gaps{0};
+    double packet_rate{0}; ///< per second, filled in by LiveStatsServer
+    double byte_rate{0};
+    LatencyHistogram latency;
+};
+
+class LiveStats
+{
+public:
+    /// Creates (owner) or attaches to (reader) the named segment.  Exits on error.
+    static auto create(std::string const& name, std::uint32_t max_threads) -> LiveStats;
+    static auto attach(std::string const& name) -> LiveStats;
+
+    LiveStats(LiveStats&& other) noexcept;
+    LiveStats(LiveStats const&)                    = delete;
+    auto operator=(LiveStats const&) -> LiveStats& = delete;
+    auto operator=(LiveStats&&) -> LiveStats&      = delete;
+    ~LiveStats();
+
+    /// Hands a fresh slot to a data path thread; exits when all are taken
+    auto claim(std::string const& name) -> LiveThreadStats&;
+
+    auto snapshot() const -> std::vector<LiveSnapshot>;
+    auto uptime_ns() const -> std::uint64_t;
+
+private:
+    LiveStats(std::string name, void* base, std::size_t size, bool owner);
+
+    auto slot(std::size_t i) const -> LiveThreadStats&;
+
+    std::string name_;
+    void* base_;
+    std::size_t size_;
+    bool owner_;
+    LiveStatsHeader* header_;
+};
+
+/// Fills in the rates of `threads` from an earlier snapshot, matched by name
+auto live_stats_rates(
+    std::vector<LiveSnapshot>& threads,
+    std::vector<LiveSnapshot> const& earlier,
+    std::uint64_t elapsed_ns) -> void;
+
+/// One line per thread plus a total
+auto live_stats_text(std::vector<LiveSnapshot> const& threads, std::uint64_t uptime_ns)
+    -> std::string;
+
+/// {"uptime_ns":..,"threads":[{"name":..,"packets":..,..,"latency_ns":{"p50":..}}]}
+auto live_stats_json(std::vector<LiveSnapshot> const& threads, std::uint64_t uptime_ns)
+    -> std::string;
+
+/// Serves snapshots on a Unix stream socket from its own thread: a client
+/// connects, writes "text" or "json" (or nothing) and reads the reply.  The
+/// thread also samples the counters once a second for the rates.  `path`
+/// "android:<name>" takes the socket init created for the service.
+class LiveStatsServer
+{
+public:
+    LiveStatsServer(LiveStats const& stats, std::string const& path);
+    ~LiveStatsServer();
+
+    LiveStatsServer(LiveStatsServer const&)                    = delete;
+    auto operator=(LiveStatsServer const&) -> LiveStatsServer& = delete;
+
+private:
+    auto serve() -> void;
+    auto answer(int client) -> void;
+    auto sample() -> void;
+
+    LiveStats const& stats_;
+    std::string path_;
+    int listen_fd_{-1};
+    bool unlink_{false};
+    std::atomic<bool> running_{true};
+    std::vector<LiveSnapshot> current_;
+    std::uint64_t sampled_ns_{0};
+    std::thread thread_;
+};
+
+#endif /* end of include guard: LIVE_STATS_HPP_H3XV9TQD */
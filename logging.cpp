@@ -1,30 +1,83 @@
-
 #include "logging.hpp"
 
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <cstdlib>
 #include <iostream>
 #include <mutex>
 #include <sstream>
 #include <string>
 
 #include "components.hpp"
+#include "fixed_format.hpp"
 
 std::mutex log_mutex;
 
-auto print_msg(std::string&& msg) -> void
+namespace
+{
+
+#ifdef BIND_TEST_EMBEDDED
+auto log_line(Component c, char const* level, char const* colour, std::string_view msg) -> void
+{
+    FixedString<1024> line;
+    line << "[" << colour << level << ANSI_CLEAR << "] " << component_name(c, true) << ": "
+         << colour << msg << ANSI_CLEAR;
+    print_msg(line.view());
+}
+#else
+auto log_line(Component c, char const* level, char const* colour, std::string_view msg) -> void
+{
+    std::stringstream ss;
+    ss << "[" << colour << level << ANSI_CLEAR << "] ";
+    ss << component_to_str(c, true);
+    ss << ": " << colour << msg << ANSI_CLEAR;
+    print_msg(ss.str());
+}
+#endif
+
+} // namespace
+
+auto print_msg(std::string_view msg) -> void
 {
     std::lock_guard<std::mutex> const lock(log_mutex);
+#ifdef BIND_TEST_EMBEDDED
+    // No iostream buffers: one write() per line, msg plus newline
+    iovec const iov[] = {{const_cast<char*>(msg.data()), msg.size()},
+                         {const_cast<char*>("\n"), 1}};
+    ::writev(STDOUT_FILENO, iov, 2);
+#else
     std::cout << msg << "\n";
+#endif
 }
 
-auto info(Component c, std::string&& msg) -> void
+auto info(Component c, std::string_view msg) -> void
 {
-    std::stringstream ss;
-    ss << "[" << ANSI_BLUE << "Info" << ANSI_CLEAR << "] ";
-    ss << component_to_str(c, true);
-    ss << ": " << ANSI_BLUE << msg << ANSI_CLEAR;
+    log_line(c, "Info", ANSI_BLUE, msg);
+#ifdef __ANDROID__
+    ALOGI("%s: %.*s", component_name(c), static_cast<int>(msg.size()), msg.data());
+#endif
+}
 
-    print_msg(ss.str());
+auto warn(Component c, std::string_view msg) -> void
+{
+    log_line(c, "Warn", ANSI_YELLOW, msg);
+#ifdef __ANDROID__
+    ALOGW("%s: %.*s", component_name(c), static_cast<int>(msg.size()), msg.data());
+#endif
+}
+
+auto exit_with_error(Component c, std::string_view msg, std::string_view detail) -> void
+{
+    FixedString<1024> text;
+    text << msg;
+    if (!detail.empty())
+    {
+        text << ": " << detail;
+    }
+    log_line(c, "Error", ANSI_RED, text.view());
 #ifdef __ANDROID__
-    ALOGI("%s: %s", component_to_str(c, false).c_str(), msg.c_str());
+    ALOGE("%s: %s", component_name(c), text.c_str());
 #endif
+    exit(1);
 }
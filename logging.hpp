@@ -1,14 +1,15 @@
 #ifndef LOGGING_HPP_EDKP8OLK
 #define LOGGING_HPP_EDKP8OLK
 
-#include <iostream>
-#include <sstream>
-#include <string>
+#include <cerrno>
+#include <cstring>
+#include <string_view>
 
 #ifdef __ANDROID__
 #include <android/log.h>
 #define LOG_TAG "bind-test"
 #define ALOGI(...) __android_log_print(ANDROID_LOG_INFO, LOG_TAG, __VA_ARGS__)
+#define ALOGW(...) __android_log_print(ANDROID_LOG_WARN, LOG_TAG, __VA_ARGS__)
 #define ALOGE(...) __android_log_print(ANDROID_LOG_ERROR, LOG_TAG, __VA_ARGS__)
 #endif
 
@@ -21,24 +22,35 @@
 #define ANSI_MAGENTA "\033[35m"
 #define ANSI_CLEAR "\033[0m"
 
-auto print_msg(std::string&& msg) -> void;
+auto print_msg(std::string_view msg) -> void;
 
-template <typename T> auto exit_on_error(T error, Component c, std::string&& msg) -> void
+/// Logs `msg` (and `detail` after a colon, when given) as an error and exits
+[[noreturn]] auto exit_with_error(Component c, std::string_view msg, std::string_view detail = {})
+    -> void;
+
+/// Exits when `error` is negative.  A literal costs nothing on the way
+/// through; where a message has to be put together, do it on the error path.
+template <typename T> auto exit_on_error(T error, Component c, std::string_view msg) -> void
 {
     if (error < 0)
     {
-        std::stringstream ss;
-        ss << "[" << ANSI_RED "Error" << ANSI_CLEAR << "] ";
-        ss << component_to_str(c, true);
-        ss << ": " << ANSI_RED << msg << ANSI_CLEAR;
-        print_msg(ss.str());
-#ifdef __ANDROID__
-        ALOGE("%s: %s", component_to_str(c, false).c_str(), msg.c_str());
-#endif
-        exit(1);
+        exit_with_error(c, msg);
+    }
+}
+
+/// exit_on_error() for failed system calls in loops: "what: strerror(errno)",
+/// formatted only when `error` is negative
+template <typename T> auto exit_on_errno(T error, Component c, std::string_view what) -> void
+{
+    if (error < 0)
+    {
+        exit_with_error(c, what, std::strerror(errno));
     }
 }
 
-auto info(Component c, std::string&& msg) -> void;
+/// Literals and temporaries alike; with BIND_TEST_EMBEDDED the line is put
+/// together in a fixed buffer and written out without allocating
+auto info(Component c, std::string_view msg) -> void;
+auto warn(Component c, std::string_view msg) -> void;
 
 #endif /* end of include guard: LOGGING_HPP_EDKP8OLK */
@@ -5,11 +5,17 @@
 #include <iostream>
 #include <sstream>
 #include <thread>
+#include <vector>
 
 #include <boost/asio/ip/address.hpp>
 
+#include "alloc_hook.hpp"
 #include "components.hpp"
+#include "flow_config.hpp"
 #include "logging.hpp"
+#include "options.hpp"
+#include "realtime.hpp"
+#include "transport.hpp"
 
 #ifndef INTERFACE_IP
 #error "Please define INTERFACE_IP"
@@ -39,12 +45,283 @@ template <class E> inline void throw_exception(E const& e)
 } // namespace boost
 #endif
 
-auto main() -> int
+namespace
 {
-    auto const if_addr = boost::asio::ip::make_address(INTERFACE_IP);
-    std::string if_name{INTERFACE_NAME};
-    auto const mc_addr                       = boost::asio::ip::make_address(MULTICAST_ADDR);
-    static short unsigned int constexpr port = PORT;
+
+/// ping-pong mode: echo server and client each on a tuned thread, once per
+/// transport so unicast and multicast are measured on the same interface
+auto run_ping_pong(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void
+{
+    auto const role      = opts.get("role", "both");
+    auto const transport = opts.get("transport", "unicast");
+    exit_on_error(
+        role == "both" || role == "server" || role == "client" ? 0 : -1,
+        Component::main,
+        "Unknown role " + role);
+    exit_on_error(
+        transport == "unicast" || transport == "multicast" || transport == "both" ? 0 : -1,
+        Component::main,
+        "Unknown transport " + transport);
+
+    auto const transports = transport == "both" ? std::vector<std::string>{"unicast", "multicast"}
+                                                : std::vector<std::string>{transport};
+    auto const server_tuning = thread_tuning_from_options(opts, "server");
+    auto const client_tuning = thread_tuning_from_options(opts, "client");
+
+    for (auto const& t : transports)
+    {
+        std::mutex component_ready;
+        auto server_ready = role == "client";
+        std::condition_variable server_ready_cv;
+
+        std::thread server_thread;
+        std::thread client_thread;
+        if (role != "client")
+        {
+            server_thread = std::thread([&] {
+                apply_thread_tuning(Component::server, server_tuning);
+                unicast_server(
+                    if_addr,
+                    if_name,
+                    mc_addr,
+                    port,
+                    t,
+                    opts,
+                    component_ready,
+                    server_ready,
+                    server_ready_cv);
+            });
+        }
+        if (role != "server")
+        {
+            client_thread = std::thread([&] {
+                apply_thread_tuning(Component::client, client_tuning);
+                unicast_client(
+                    if_addr,
+                    if_name,
+                    mc_addr,
+                    port,
+                    t,
+                    opts,
+                    component_ready,
+                    server_ready,
+                    server_ready_cv);
+            });
+        }
+
+        if (server_thread.joinable())
+        {
+            server_thread.join();
+        }
+        if (client_thread.joinable())
+        {
+            client_thread.join();
+        }
+    }
+}
+
+using ModeFunction = auto (*)(
+    boost::asio::ip::address const&,
+    std::string const&,
+    boost::asio::ip::address const&,
+    short unsigned int,
+    Options const&) -> void;
+
+/// latency and file-transfer modes: sender and receiver on tuned threads
+/// unless --role picks one
+auto run_sender_receiver(
+    ModeFunction sender_fn,
+    ModeFunction receiver_fn,
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void
+{
+    auto const role = opts.get("role", "both");
+    exit_on_error(
+        role == "both" || role == "sender" || role == "receiver" ? 0 : -1,
+        Component::main,
+        "Unknown role " + role);
+
+    auto const server_tuning = thread_tuning_from_options(opts, "server");
+    auto const client_tuning = thread_tuning_from_options(opts, "client");
+
+    std::thread sender;
+    std::thread receiver;
+    if (role != "receiver")
+    {
+        sender = std::thread([&] {
+            apply_thread_tuning(Component::server, server_tuning);
+            sender_fn(if_addr, if_name, mc_addr, port, opts);
+        });
+    }
+    if (role != "sender")
+    {
+        receiver = std::thread([&] {
+            apply_thread_tuning(Component::client, client_tuning);
+            receiver_fn(if_addr, if_name, mc_addr, port, opts);
+        });
+    }
+
+    if (sender.joinable())
+    {
+        sender.join();
+    }
+    if (receiver.joinable())
+    {
+        receiver.join();
+    }
+}
+
+} // namespace
+
+auto main(int argc, char* argv[]) -> int
+{
+    Options const opts{argc, argv};
+
+    // The build time values are only defaults
+    auto const if_name = opts.get("interface", INTERFACE_NAME);
+    auto if_ip         = opts.get("interface-ip", INTERFACE_IP);
+    if (opts.has("interface") && !opts.has("interface-ip"))
+    {
+        auto const addr = interface_address(if_name);
+        if_ip           = ::inet_ntoa(addr);
+    }
+    auto const if_addr = boost::asio::ip::make_address(if_ip);
+    auto const mc_addr = boost::asio::ip::make_address(opts.get("group", MULTICAST_ADDR));
+    auto const port    = static_cast<short unsigned int>(opts.get_int("port", PORT));
+
+    if (opts.mode() == "jitter")
+    {
+        jitter_test(opts);
+        return 0;
+    }
+
+    if (opts.has("mlock"))
+    {
+        lock_memory(Component::main);
+    }
+
+    if (opts.mode() == "shm-publish")
+    {
+        shm_publisher(if_addr, if_name, mc_addr, port, opts);
+        return 0;
+    }
+    if (opts.mode() == "shm-consume")
+    {
+        shm_consumer(opts);
+        return 0;
+    }
+    if (opts.mode() == "pipeline")
+    {
+        receive_pipeline(if_addr, if_name, mc_addr, port, opts);
+        return 0;
+    }
+    if (opts.mode() == "rx-bench")
+    {
+        rx_bench(if_addr, if_name, mc_addr, port, opts);
+        return 0;
+    }
+    if (opts.mode() == "ping-pong")
+    {
+        run_ping_pong(if_addr, if_name, mc_addr, port, opts);
+        return 0;
+    }
+    if (opts.mode() == "latency")
+    {
+        run_sender_receiver(
+            latency_sender, latency_receiver, if_addr, if_name, mc_addr, port, opts);
+        return 0;
+    }
+    if (opts.mode() == "file-transfer")
+    {
+        run_sender_receiver(file_sender, file_receiver, if_addr, if_name, mc_addr, port, opts);
+        return 0;
+    }
+    if (opts.mode() == "virtual-clients")
+    {
+        virtual_clients(if_addr, if_name, mc_addr, port, opts);
+        return 0;
+    }
+    if (opts.mode() == "churn")
+    {
+        membership_churn(if_addr, if_name, mc_addr, port, opts);
+        return 0;
+    }
+    if (opts.mode() == "probe")
+    {
+        binding_probe(if_addr, if_name, mc_addr, port, opts);
+        return 0;
+    }
+    if (opts.mode() == "flows")
+    {
+        run_flows(if_addr, if_name, mc_addr, port, opts);
+        return 0;
+    }
+    if (opts.mode() == "tx-scale")
+    {
+        tx_scale(if_addr, if_name, mc_addr, port, opts);
+        return 0;
+    }
+    if (opts.mode() == "qos")
+    {
+        qos_contention(if_addr, if_name, mc_addr, port, opts);
+        return 0;
+    }
+    if (opts.mode() == "capture")
+    {
+        capture(if_addr, if_name, mc_addr, port, opts);
+        return 0;
+    }
+    if (opts.mode() == "replay")
+    {
+        replay(if_addr, if_name, mc_addr, port, opts);
+        return 0;
+    }
+    if (opts.mode() == "daemon")
+    {
+        stats_daemon(if_addr, if_name, mc_addr, port, opts);
+        return 0;
+    }
+    if (opts.mode() == "stats")
+    {
+        stats_client(opts);
+        return 0;
+    }
+    if (opts.mode() == "footprint")
+    {
+        footprint(if_addr, if_name, mc_addr, port, opts);
+        return 0;
+    }
+    if (opts.mode() == "transport-bench")
+    {
+        transport_bench(if_addr, if_name, mc_addr, port, opts);
+        return 0;
+    }
+    if (opts.mode() == "failover")
+    {
+        socket_failover(if_addr, if_name, mc_addr, port, opts);
+        return 0;
+    }
+
+    if (opts.mode() == "tx-pressure")
+    {
+        tx_pressure(if_addr, if_name, mc_addr, port, opts);
+        return 0;
+    }
+    if (opts.mode() == "queue-bench")
+    {
+        queue_bench(opts);
+        return 0;
+    }
+    exit_on_error(
+        opts.mode() == "multicast" ? 0 : -1, Component::main, "Unknown mode " + opts.mode());
 
     std::mutex component_ready;
 
@@ -61,32 +338,52 @@ auto main() -> int
        << "maddr=" << mc_addr;
     info(Component::main, ss.str());
 
-    auto service_thread = std::thread(
-        &multicast_server,
-        if_addr,
-        if_name,
-        mc_addr,
-        port,
-        std::ref(component_ready),
-        std::ref(server_ready),
-        std::ref(server_ready_cv),
-        std::ref(client_ready),
-        std::ref(client_ready_cv));
-
-    auto client_thread = std::thread(
-        &multicast_client,
-        if_addr,
-        if_name,
-        mc_addr,
-        port,
-        std::ref(component_ready),
-        std::cref(server_ready),
-        std::ref(server_ready_cv),
-        std::ref(client_ready),
-        std::ref(client_ready_cv));
+    // Both ends are bound before either component starts
+    auto const transports =
+        make_transport(opts.get("transport", "socket"), if_addr, if_name, mc_addr, port, opts);
+
+    auto const server_tuning = thread_tuning_from_options(opts, "server");
+    auto const client_tuning = thread_tuning_from_options(opts, "client");
+
+    auto service_thread = std::thread([&] {
+        apply_thread_tuning(Component::server, server_tuning);
+        multicast_server(
+            *transports.sender,
+            opts,
+            component_ready,
+            server_ready,
+            server_ready_cv,
+            client_ready,
+            client_ready_cv);
+    });
+
+    auto client_thread = std::thread([&] {
+        apply_thread_tuning(Component::client, client_tuning);
+        multicast_client(
+            *transports.receiver,
+            opts,
+            component_ready,
+            server_ready,
+            server_ready_cv,
+            client_ready,
+            client_ready_cv);
+    });
 
     service_thread.join();
     client_thread.join();
 
+    if (alloc_hook_enabled())
+    {
+        // Both components armed the guard once set up, see alloc_hook.hpp
+        exit_on_error(
+            allocations_after_init() > 0 ? -1 : 0,
+            Component::main,
+            std::to_string(allocations_after_init()) +
+                " heap allocations after initialization, the first of " +
+                std::to_string(first_allocation_after_init()) +
+                " bytes (--alloc-abort stops right there)");
+        info(Component::main, "No heap allocations after initialization");
+    }
+
     return 0;
 }
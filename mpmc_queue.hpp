@@ -0,0 +1,111 @@
+#ifndef MPMC_QUEUE_HPP_D8UJ3PLE
+#define MPMC_QUEUE_HPP_D8UJ3PLE
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+#include "spsc_queue.hpp"
+#include "types.hpp"
+
+/// Bounded multi-producer/multi-consumer queue (Vyukov's array queue).  Each
+/// cell carries a sequence number telling producers and consumers whose turn
+/// it is, so the only contended writes are the CAS on the enqueue/dequeue
+/// positions, which sit on separate cache lines.
+template <typename T> class MpmcQueue
+{
+public:
+    /// `capacity` is rounded up to a power of two
+    explicit MpmcQueue(std::size_t capacity);
+
+    auto try_push(T const& value) -> bool;
+    auto try_pop(T& value) -> bool;
+
+    auto capacity() const -> std::size_t { return mask_ + 1; }
+    auto size_approx() const -> std::size_t
+    {
+        return enqueue_pos_.load(std::memory_order_relaxed) -
+               dequeue_pos_.load(std::memory_order_relaxed);
+    }
+
+private:
+    struct alignas(cache_line_size) Cell
+    {
+        std::atomic<std::size_t> seq;
+        T value;
+    };
+
+    std::unique_ptr<Cell[]> cells_;
+    std::size_t mask_;
+
+    alignas(cache_line_size) std::atomic<std::size_t> enqueue_pos_{0};
+    alignas(cache_line_size) std::atomic<std::size_t> dequeue_pos_{0};
+};
+
+template <typename T>
+MpmcQueue<T>::MpmcQueue(std::size_t const capacity)
+    : cells_(new Cell[round_up_pow2(capacity)]), mask_(round_up_pow2(capacity) - 1)
+{
+    for (std::size_t i = 0; i <= mask_; ++i)
+    {
+        cells_[i].seq.store(i, std::memory_order_relaxed);
+    }
+}
+
+template <typename T> auto MpmcQueue<T>::try_push(T const& value) -> bool
+{
+    auto pos = enqueue_pos_.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        auto& cell     = cells_[pos & mask_];
+        auto const seq = cell.seq.load(std::memory_order_acquire);
+        auto const dif = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos);
+        if (dif == 0)
+        {
+            if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                cell.value = value;
+                cell.seq.store(pos + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (dif < 0)
+        {
+            return false; // full
+        }
+        else
+        {
+            pos = enqueue_pos_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+template <typename T> auto MpmcQueue<T>::try_pop(T& value) -> bool
+{
+    auto pos = dequeue_pos_.load(std::memory_order_relaxed);
+    for (;;)
+    {
+        auto& cell     = cells_[pos & mask_];
+        auto const seq = cell.seq.load(std::memory_order_acquire);
+        auto const dif = static_cast<std::ptrdiff_t>(seq) - static_cast<std::ptrdiff_t>(pos + 1);
+        if (dif == 0)
+        {
+            if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+            {
+                value = cell.value;
+                cell.seq.store(pos + mask_ + 1, std::memory_order_release);
+                return true;
+            }
+        }
+        else if (dif < 0)
+        {
+            return false; // empty
+        }
+        else
+        {
+            pos = dequeue_pos_.load(std::memory_order_relaxed);
+        }
+    }
+}
+
+#endif /* end of include guard: MPMC_QUEUE_HPP_D8UJ3PLE */
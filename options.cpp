@@ -0,0 +1,67 @@
+#include "options.hpp"
+
+#include <cstdlib>
+#include <string>
+
+#include "logging.hpp"
+
+Options::Options(int const argc, char const* const* argv)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string const arg{argv[i]};
+        if (arg.rfind("--", 0) != 0)
+        {
+            exit_on_error(i == 1 ? 0 : -1, Component::main, "Unexpected argument " + arg);
+            mode_ = arg;
+            continue;
+        }
+
+        auto const eq = arg.find('=');
+        if (eq == std::string::npos)
+        {
+            values_[arg.substr(2)] = "1";
+        }
+        else
+        {
+            values_[arg.substr(2, eq - 2)] = arg.substr(eq + 1);
+        }
+    }
+}
+
+auto Options::has(std::string const& key) const -> bool
+{
+    return values_.find(key) != values_.end();
+}
+
+auto Options::get(std::string const& key, std::string const& def) const -> std::string
+{
+    auto const it = values_.find(key);
+    return it == values_.end() ? def : it->second;
+}
+
+auto Options::get_int(std::string const& key, long long const def) const -> long long
+{
+    auto const it = values_.find(key);
+    if (it == values_.end())
+    {
+        return def;
+    }
+    char* end    = nullptr;
+    auto const v = std::strtoll(it->second.c_str(), &end, 0);
+    exit_on_error(*end == '\0' ? 0 : -1, Component::main, "Bad integer for --" + key);
+    return v;
+}
+
+auto Options::get_double(std::string const& key, double const def) const -> double
+{
+    auto const it = values_.find(key);
+    if (it == values_.end())
+    {
+        return def;
+    }
+    char* end    = nullptr;
+    auto const v = std::strtod(it->second.c_str(), &end);
+    exit_on_error(*end == '\0' ? 0 : -1, Component::main, "Bad number for --" + key);
+    return v;
+}
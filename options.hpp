@@ -0,0 +1,26 @@
+#ifndef OPTIONS_HPP_QH3MZ8RT
+#define OPTIONS_HPP_QH3MZ8RT
+
+#include <map>
+#include <string>
+
+/// Command line of the form `bind-test [mode] [--key=value | --flag]...`.
+/// Without a mode the original multicast server/client pair is run.
+class Options
+{
+public:
+    Options(int argc, char const* const* argv);
+
+    auto mode() const -> std::string const& { return mode_; }
+
+    auto has(std::string const& key) const -> bool;
+    auto get(std::string const& key, std::string const& def = "") const -> std::string;
+    auto get_int(std::string const& key, long long def) const -> long long;
+    auto get_double(std::string const& key, double def) const -> double;
+
+private:
+    std::string mode_{"multicast"};
+    std::map<std::string, std::string> values_;
+};
+
+#endif /* end of include guard: OPTIONS_HPP_QH3MZ8RT */
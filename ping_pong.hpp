@@ -0,0 +1,22 @@
+#ifndef PING_PONG_HPP_T7KD2MVE
+#define PING_PONG_HPP_T7KD2MVE
+
+#include <cstdint>
+
+/// Start of every unicast/multicast ping-pong request.  The server echoes the
+/// datagram unchanged, the client matches replies to requests by `id`.
+/// Host byte order: both ends are this tool on the same architecture.
+/// latency_sender uses the same header for its timestamped stream, `id`
+/// being the sequence number.
+struct PingPongHeader
+{
+    std::uint64_t id;
+    std::uint64_t send_ns;
+    std::uint32_t flags;
+    std::uint32_t reserved;
+};
+
+/// Sent by the client (sender) when it is done, the other end stops on it
+static std::uint32_t constexpr ping_pong_stop = 1;
+
+#endif /* end of include guard: PING_PONG_HPP_T7KD2MVE */
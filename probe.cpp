@@ -0,0 +1,395 @@
+#include "components.hpp"
+
+#include <net/if.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <ctime>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+#include <boost/asio/ip/address.hpp>
+
+#include "binding_functions.hpp"
+#include "logging.hpp"
+#include "stats.hpp"
+#include "timing.hpp"
+
+// Every combination of receiver binding options the tool has ever been
+// rebuilt for, on every interface at once.  Each cell is a receiver socket on
+// its own port; a sender per interface (and one left to the routing table)
+// sends --count timestamped datagrams to each cell and we wait --timeout-ms
+// for all of them together.  Latency is taken against the kernel receive
+// timestamp where there is one, so cells read late don't look slow.
+
+namespace
+{
+
+auto realtime_ns() -> std::uint64_t
+{
+    timespec ts;
+    ::clock_gettime(CLOCK_REALTIME, &ts);
+    return static_cast<std::uint64_t>(ts.tv_sec) * 1000000000 +
+           static_cast<std::uint64_t>(ts.tv_nsec);
+}
+
+/// One datagram of a cell: its send stamp and the kernel (or our) receive time
+auto receive_stamped(int fd, std::uint64_t& sent, std::uint64_t& received) -> bool
+{
+    iovec iov{&sent, sizeof(sent)};
+    std::array<char, CMSG_SPACE(sizeof(timespec))> control;
+    msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control.data();
+    msg.msg_controllen = control.size();
+    if (::recvmsg(fd, &msg, MSG_DONTWAIT) != static_cast<ssize_t>(sizeof(sent)))
+    {
+        return false;
+    }
+
+    received = realtime_ns();
+#ifdef SO_TIMESTAMPNS
+    for (auto* c = CMSG_FIRSTHDR(&msg); c != nullptr; c = CMSG_NXTHDR(&msg, c))
+    {
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS)
+        {
+            timespec ts;
+            std::memcpy(&ts, CMSG_DATA(c), sizeof(ts));
+            received = static_cast<std::uint64_t>(ts.tv_sec) * 1000000000 +
+                       static_cast<std::uint64_t>(ts.tv_nsec);
+        }
+    }
+#endif
+    return true;
+}
+
+enum class BindTo
+{
+    group,
+    interface,
+    any,
+};
+
+auto bind_to_str(BindTo b) -> char const*
+{
+    switch (b)
+    {
+        case BindTo::group: return "group";
+        case BindTo::interface: return "iface";
+        case BindTo::any: return "any";
+    }
+    return "?";
+}
+
+struct Cell
+{
+    std::size_t iface{0};
+    bool device{false};    ///< SO_BINDTODEVICE on the receiver
+    bool sender_if{false}; ///< IP_MULTICAST_IF on the sender, else routing decides
+    bool mreq_if{false};   ///< interface in the membership, else any
+    BindTo bind{BindTo::group};
+    short unsigned int port{0};
+
+    int fd{-1};
+    std::string error;
+    int received{0};
+    LatencyHistogram latency;
+};
+
+auto setup_cell(Cell& cell, InterfaceInfo const& iface, in_addr group) -> void
+{
+    auto const fail = [&cell](char const* step) {
+        cell.error = std::string{step} + ": " + strerror(errno);
+        ::close(cell.fd);
+        cell.fd = -1;
+    };
+
+    cell.fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    if (cell.fd < 0)
+    {
+        cell.error = std::string{"socket: "} + strerror(errno);
+        return;
+    }
+#ifdef IP_MULTICAST_ALL
+    // Every cell joins the same group at once: without this a cell bound to
+    // the group or to INADDR_ANY would also get it where another cell joined
+    int const off = 0;
+    if (::setsockopt(cell.fd, IPPROTO_IP, IP_MULTICAST_ALL, &off, sizeof(off)) < 0)
+    {
+        return fail("IP_MULTICAST_ALL");
+    }
+#endif
+
+    int const opt = 1;
+    if (::setsockopt(cell.fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0)
+    {
+        return fail("SO_REUSEADDR");
+    }
+    if (cell.device && bind_to_device(cell.fd, iface.name) < 0)
+    {
+        return fail("SO_BINDTODEVICE");
+    }
+
+    IP_REQ req;
+    std::memset(&req, 0, sizeof(req));
+    req.imr_multiaddr = group;
+#ifdef __QNX__
+    req.imr_interface.s_addr = cell.mreq_if ? iface.addr.s_addr : htonl(INADDR_ANY);
+#else
+    req.imr_ifindex = cell.mreq_if ? static_cast<int>(iface.index) : 0;
+#endif
+    if (::setsockopt(cell.fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &req, sizeof(req)) < 0)
+    {
+        return fail("IP_ADD_MEMBERSHIP");
+    }
+
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port   = htons(cell.port);
+    switch (cell.bind)
+    {
+        case BindTo::group: addr.sin_addr = group; break;
+        case BindTo::interface: addr.sin_addr = iface.addr; break;
+        case BindTo::any: addr.sin_addr.s_addr = htonl(INADDR_ANY); break;
+    }
+    if (::bind(cell.fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0)
+    {
+        return fail("bind");
+    }
+
+#ifdef SO_TIMESTAMPNS
+    if (::setsockopt(cell.fd, SOL_SOCKET, SO_TIMESTAMPNS, &opt, sizeof(opt)) < 0)
+    {
+        return fail("SO_TIMESTAMPNS");
+    }
+#endif
+}
+
+/// Sender for one interface, or for whatever the routing table picks when
+/// `iface` is null
+auto open_sender(InterfaceInfo const* iface) -> int
+{
+    auto const fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    exit_on_error(fd, Component::server, "socket");
+
+    // Receivers are local, the datagrams have to loop back
+    unsigned char const loop = 1;
+    auto err = ::setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &loop, sizeof(loop));
+    exit_on_error(err, Component::server, "IP_MULTICAST_LOOP");
+    if (iface != nullptr)
+    {
+        err = ::setsockopt(fd, IPPROTO_IP, IP_MULTICAST_IF, &iface->addr, sizeof(iface->addr));
+        exit_on_error(err, Component::server, "IP_MULTICAST_IF " + iface->name);
+    }
+    return fd;
+}
+
+} // namespace
+
+auto binding_probe(
+    boost::asio::ip::address const& /* if_addr */,
+    std::string const& /* if_name */,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void
+{
+    auto const count      = static_cast<int>(std::max(1LL, opts.get_int("count", 3)));
+    auto const timeout_ms = opts.get_int("timeout-ms", 500);
+    auto const base_port  = static_cast<short unsigned int>(opts.get_int("base-port", port + 100));
+
+    // --interfaces=a,b, otherwise everything up with multicast enabled
+    auto interfaces = list_ipv4_interfaces();
+    if (opts.has("interfaces"))
+    {
+        auto const wanted = "," + opts.get("interfaces") + ",";
+        interfaces.erase(
+            std::remove_if(
+                interfaces.begin(),
+                interfaces.end(),
+                [&wanted](auto const& i) {
+                    return wanted.find("," + i.name + ",") == std::string::npos;
+                }),
+            interfaces.end());
+    }
+    else
+    {
+        interfaces.erase(
+            std::remove_if(
+                interfaces.begin(),
+                interfaces.end(),
+                [](auto const& i) { return (i.flags & IFF_MULTICAST) == 0; }),
+            interfaces.end());
+    }
+    exit_on_error(interfaces.empty() ? -1 : 0, Component::main, "No interfaces to probe");
+
+    in_addr group;
+    address2in_addr(mc_addr, group);
+
+    std::vector<Cell> cells;
+    for (std::size_t i = 0; i < interfaces.size(); ++i)
+    {
+        for (auto const device : {false, true})
+        {
+            for (auto const sender_if : {false, true})
+            {
+                for (auto const mreq_if : {false, true})
+                {
+                    for (auto const bind : {BindTo::group, BindTo::interface, BindTo::any})
+                    {
+                        Cell cell;
+                        cell.iface     = i;
+                        cell.device    = device;
+                        cell.sender_if = sender_if;
+                        cell.mreq_if   = mreq_if;
+                        cell.bind      = bind;
+                        cell.port      = static_cast<short unsigned int>(base_port + cells.size());
+                        cells.push_back(std::move(cell));
+                    }
+                }
+            }
+        }
+    }
+    for (auto& cell : cells)
+    {
+        setup_cell(cell, interfaces[cell.iface], group);
+    }
+
+    std::vector<int> senders;
+    for (auto const& iface : interfaces)
+    {
+        senders.push_back(open_sender(&iface));
+    }
+    auto const default_sender = open_sender(nullptr);
+
+    {
+        std::stringstream ss;
+        ss << "Probing " << cells.size() << " combinations on " << interfaces.size()
+           << " interfaces, ports " << base_port << "-" << base_port + cells.size() - 1;
+        info(Component::main, ss.str());
+    }
+
+    auto const send_round = [&] {
+        for (auto const& cell : cells)
+        {
+            sockaddr_in dest;
+            std::memset(&dest, 0, sizeof(dest));
+            dest.sin_family = AF_INET;
+            dest.sin_addr   = group;
+            dest.sin_port   = htons(cell.port);
+            auto const fd   = cell.sender_if ? senders[cell.iface] : default_sender;
+            auto const sent = realtime_ns();
+            // clang-format off
+            ::sendto(
+                fd,
+                &sent,
+                sizeof(sent),
+                0,
+                reinterpret_cast<struct sockaddr const*>(&dest),
+                sizeof(dest)
+            );
+            // clang-format on
+        }
+    };
+
+    std::vector<pollfd> pfds;
+    std::vector<Cell*> polled;
+    for (auto& cell : cells)
+    {
+        if (cell.fd >= 0)
+        {
+            pfds.push_back(pollfd{cell.fd, POLLIN, 0});
+            polled.push_back(&cell);
+        }
+    }
+
+    // Rounds are spread over the first half of the timeout
+    auto const start    = now_ns();
+    auto const deadline = start + static_cast<std::uint64_t>(timeout_ms) * 1000000;
+    auto const spacing  = static_cast<std::uint64_t>(timeout_ms) * 1000000 / 2 /
+                         static_cast<std::uint64_t>(count);
+    int rounds          = 0;
+    for (auto now = start; now < deadline; now = now_ns())
+    {
+        if (rounds < count && now >= start + spacing * static_cast<std::uint64_t>(rounds))
+        {
+            send_round();
+            ++rounds;
+        }
+        auto const wait_ms = rounds < count ? spacing / 1000000 : (deadline - now) / 1000000;
+        auto const ready   = ::poll(pfds.data(), pfds.size(), static_cast<int>(wait_ms) + 1);
+        if (ready <= 0)
+        {
+            continue;
+        }
+        for (std::size_t i = 0; i < pfds.size(); ++i)
+        {
+            if ((pfds[i].revents & POLLIN) == 0)
+            {
+                continue;
+            }
+            std::uint64_t sent  = 0;
+            std::uint64_t rx_ns = 0;
+            while (receive_stamped(pfds[i].fd, sent, rx_ns))
+            {
+                ++polled[i]->received;
+                polled[i]->latency.record(rx_ns > sent ? rx_ns - sent : 0);
+            }
+        }
+    }
+
+    std::stringstream header;
+    header << std::left << std::setw(12) << "interface" << std::setw(8) << "device"
+           << std::setw(11) << "sender-if" << std::setw(8) << "mreq" << std::setw(7) << "bind"
+           << std::setw(8) << "result" << "latency";
+    info(Component::main, header.str());
+
+    auto passed = 0;
+    for (auto& cell : cells)
+    {
+        std::stringstream ss;
+        ss << std::left << std::setw(12) << interfaces[cell.iface].name << std::setw(8)
+           << (cell.device ? "yes" : "no") << std::setw(11) << (cell.sender_if ? "yes" : "route")
+           << std::setw(8) << (cell.mreq_if ? "ifindex" : "any") << std::setw(7)
+           << bind_to_str(cell.bind);
+        if (!cell.error.empty())
+        {
+            ss << "error   " << cell.error;
+        }
+        else if (cell.received == 0)
+        {
+            ss << "FAIL";
+        }
+        else
+        {
+            ++passed;
+            ss << std::setw(8) << (cell.received < count ? "partial" : "pass")
+               << format_ns(cell.latency.percentile(50)) << " (" << cell.received << "/"
+               << count << ")";
+        }
+        info(Component::main, ss.str());
+
+        if (cell.fd >= 0)
+        {
+            ::close(cell.fd);
+        }
+    }
+
+    std::stringstream ss;
+    ss << passed << " of " << cells.size() << " combinations delivered traffic";
+    info(Component::main, ss.str());
+
+    for (auto const fd : senders)
+    {
+        ::close(fd);
+    }
+    ::close(default_sender);
+}
@@ -0,0 +1,288 @@
+#include "components.hpp"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <sstream>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <boost/asio/ip/address.hpp>
+
+#include "binding_functions.hpp"
+#include "flow_config.hpp"
+#include "logging.hpp"
+#include "ping_pong.hpp"
+#include "realtime.hpp"
+#include "stats.hpp"
+#include "timing.hpp"
+#include "types.hpp"
+
+// Traffic classes under contention: bulk and latency sensitive send flows run
+// at the same time, each from its own thread and socket with its own
+// SO_PRIORITY/DSCP, and the receiver keeps a latency histogram per class.
+// Whether the critical class stays flat while bulk saturates the link is up
+// to the qdisc (mqprio, prio, ...) configured on the sending interface.
+//
+// Latency is receive time minus the sender's stamp, so both ends must share a
+// clock: one host, with the receiver in a network namespace behind a veth
+// (local multicast loopback skips the qdisc), or use the latency mode.
+
+using namespace std::chrono_literals;
+
+namespace
+{
+
+struct alignas(cache_line_size) ClassCounters
+{
+    std::atomic<std::uint64_t> sent{0};
+    std::atomic<std::uint64_t> errors{0};
+};
+
+auto class_of(Flow const& flow) -> std::pair<int, int>
+{
+    return {flow.priority, flow.dscp};
+}
+
+auto class_to_str(std::pair<int, int> const& c) -> std::string
+{
+    return "prio " + std::to_string(c.first) + " dscp " + std::to_string(c.second);
+}
+
+/// The built in scenario: one critical flow next to --bulk-flows flat out ones
+auto contention_flows(Flow const& defaults, Options const& opts) -> FlowTable
+{
+    FlowTable flows;
+
+    auto critical     = defaults;
+    critical.rate     = static_cast<std::uint32_t>(opts.get_int("critical-rate", 1000));
+    critical.payload  = static_cast<std::uint16_t>(opts.get_int("critical-payload", 64));
+    critical.priority = static_cast<std::uint8_t>(opts.get_int("critical-prio", 6));
+    critical.dscp     = static_cast<std::uint8_t>(opts.get_int("critical-dscp", 46));
+    flows.push_back(critical);
+
+    for (long long i = 0; i < opts.get_int("bulk-flows", 2); ++i)
+    {
+        auto bulk     = defaults;
+        bulk.port     = static_cast<std::uint16_t>(defaults.port + 1 + i);
+        bulk.rate     = static_cast<std::uint32_t>(opts.get_int("bulk-rate", 0));
+        bulk.payload  = static_cast<std::uint16_t>(opts.get_int("bulk-payload", 1400));
+        bulk.priority = static_cast<std::uint8_t>(opts.get_int("bulk-prio", 0));
+        bulk.dscp     = static_cast<std::uint8_t>(opts.get_int("bulk-dscp", 8));
+        flows.push_back(bulk);
+    }
+    return flows;
+}
+
+/// One thread per flow, so bulk can't delay critical sends in user space;
+/// rate 0 sends as fast as the socket takes it
+auto send_flow(Flow const& flow, std::atomic<bool> const& running, ClassCounters& counters)
+    -> void
+{
+    auto const fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    exit_on_error(fd, Component::server, "socket");
+    auto const dest = bind_multicast_sender(
+        fd,
+        Component::server,
+        boost::asio::ip::address_v4(ntohl(flow.if_addr.s_addr)),
+        flow.if_name,
+        boost::asio::ip::address_v4(ntohl(flow.group.s_addr)),
+        flow.port,
+        false);
+    set_qos(fd, Component::server, flow.priority, flow.dscp);
+    connect_to(fd, Component::server, dest, false);
+
+    std::vector<char> buffer(std::max<std::size_t>(flow.payload, sizeof(PingPongHeader)), 0);
+    auto const period = flow.rate > 0 ? 1000000000 / flow.rate : 0;
+    auto next         = now_ns();
+    std::uint64_t seq = 0;
+    while (running.load(std::memory_order_relaxed))
+    {
+        if (period > 0)
+        {
+            auto const now = now_ns();
+            if (next > now)
+            {
+                std::this_thread::sleep_for(std::chrono::nanoseconds(next - now));
+            }
+            next += period;
+        }
+
+        PingPongHeader const hdr{seq, now_ns(), 0, 0};
+        std::memcpy(buffer.data(), &hdr, sizeof(hdr));
+        if (::send(fd, buffer.data(), buffer.size(), 0) < 0)
+        {
+            // ENOBUFS when the class's queue is full: exactly what bulk should hit
+            counters.errors.fetch_add(1, std::memory_order_relaxed);
+            if (period == 0)
+            {
+                std::this_thread::sleep_for(10us);
+            }
+            continue;
+        }
+        ++seq;
+        counters.sent.fetch_add(1, std::memory_order_relaxed);
+    }
+    ::close(fd);
+}
+
+struct ClassStats
+{
+    LatencyHistogram latency;
+    std::uint64_t received{0};
+    std::uint64_t lost{0};
+};
+
+/// Polls one socket per flow and accounts every datagram to its class
+auto receive_flows(
+    FlowTable const& flows,
+    std::chrono::duration<double> duration,
+    std::map<std::pair<int, int>, ClassStats>& stats) -> void
+{
+    std::vector<int> fds;
+    std::vector<pollfd> pfds;
+    for (auto const& flow : flows)
+    {
+        auto const fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+        exit_on_error(fd, Component::client, "socket");
+        bind_multicast_receiver(
+            fd,
+            Component::client,
+            boost::asio::ip::address_v4(ntohl(flow.if_addr.s_addr)),
+            flow.if_name,
+            boost::asio::ip::address_v4(ntohl(flow.group.s_addr)),
+            flow.port);
+        fds.push_back(fd);
+        pfds.push_back(pollfd{fd, POLLIN, 0});
+    }
+
+    std::vector<std::uint64_t> next_seq(flows.size(), 0);
+    std::vector<bool> started(flows.size(), false);
+    std::vector<char> buffer(65536);
+    auto const end = now_ns() + static_cast<std::uint64_t>(duration.count() * 1e9);
+    while (now_ns() < end)
+    {
+        auto const ready = ::poll(pfds.data(), pfds.size(), 100);
+        exit_on_error(ready < 0 && errno != EINTR ? -1 : 0, Component::client, "poll");
+        for (std::size_t i = 0; ready > 0 && i < pfds.size(); ++i)
+        {
+            if ((pfds[i].revents & POLLIN) == 0)
+            {
+                continue;
+            }
+            auto& s = stats[class_of(flows[i])];
+            for (;;)
+            {
+                auto const n = ::recv(fds[i], buffer.data(), buffer.size(), MSG_DONTWAIT);
+                auto const rx_ns = now_ns();
+                if (n < static_cast<ssize_t>(sizeof(PingPongHeader)))
+                {
+                    break;
+                }
+                PingPongHeader hdr;
+                std::memcpy(&hdr, buffer.data(), sizeof(hdr));
+                if (started[i] && hdr.id > next_seq[i])
+                {
+                    s.lost += hdr.id - next_seq[i];
+                }
+                started[i]  = true;
+                next_seq[i] = hdr.id + 1;
+                ++s.received;
+                s.latency.record(rx_ns > hdr.send_ns ? rx_ns - hdr.send_ns : 0);
+            }
+        }
+    }
+
+    for (auto const fd : fds)
+    {
+        ::close(fd);
+    }
+}
+
+} // namespace
+
+auto qos_contention(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void
+{
+    auto const role     = opts.get("role", "both");
+    auto const duration = std::chrono::duration<double>(opts.get_double("duration", 10.0));
+    exit_on_error(
+        role == "both" || role == "sender" || role == "receiver" ? 0 : -1,
+        Component::main,
+        "Unknown role " + role);
+
+    Flow defaults;
+    std::memset(&defaults, 0, sizeof(defaults));
+    address2in_addr(if_addr, defaults.if_addr);
+    address2in_addr(mc_addr, defaults.group);
+    defaults.port     = port;
+    defaults.role     = FlowRole::send;
+    defaults.priority = static_cast<std::uint8_t>(opts.get_int("priority", 0));
+    defaults.dscp     = static_cast<std::uint8_t>(opts.get_int("dscp", 0));
+    std::strncpy(defaults.if_name, if_name.c_str(), sizeof(defaults.if_name) - 1);
+
+    auto const flows = opts.has("flows") || opts.has("flow") ? load_flows(opts, defaults)
+                                                             : contention_flows(defaults, opts);
+    for (std::size_t i = 0; i < flows.size(); ++i)
+    {
+        info(Component::main, "flow " + std::to_string(i) + ": " + flow_to_str(flows[i]));
+    }
+
+    std::atomic<bool> running{true};
+    std::vector<ClassCounters> counters(flows.size());
+    std::vector<std::thread> senders;
+    if (role != "receiver")
+    {
+        auto const tuning = thread_tuning_from_options(opts, "server");
+        for (std::size_t i = 0; i < flows.size(); ++i)
+        {
+            senders.emplace_back([&, i] {
+                apply_thread_tuning(Component::server, tuning);
+                send_flow(flows[i], running, counters[i]);
+            });
+        }
+    }
+
+    std::map<std::pair<int, int>, ClassStats> stats;
+    if (role != "sender")
+    {
+        apply_thread_tuning(Component::client, thread_tuning_from_options(opts, "client"));
+        receive_flows(flows, duration, stats);
+    }
+    else
+    {
+        std::this_thread::sleep_for(duration);
+    }
+    running = false;
+    for (auto& t : senders)
+    {
+        t.join();
+    }
+
+    for (std::size_t i = 0; role != "receiver" && i < flows.size(); ++i)
+    {
+        std::stringstream ss;
+        ss << "flow " << i << " (" << class_to_str(class_of(flows[i])) << ") sent "
+           << format_rate(static_cast<double>(counters[i].sent.load()) / duration.count())
+           << ", " << counters[i].errors.load() << " send errors";
+        info(Component::server, ss.str());
+    }
+    for (auto const& [c, s] : stats)
+    {
+        std::stringstream ss;
+        ss << class_to_str(c) << ": " << s.received << " received, " << s.lost << " lost, "
+           << s.latency.summary();
+        info(Component::client, ss.str());
+    }
+}
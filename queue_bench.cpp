@@ -0,0 +1,158 @@
+#include "components.hpp"
+
+#include <atomic>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include "adaptive_wait.hpp"
+#include "logging.hpp"
+#include "mpmc_queue.hpp"
+#include "spsc_queue.hpp"
+#include "stats.hpp"
+#include "timing.hpp"
+
+namespace
+{
+
+struct BenchItem
+{
+    std::uint64_t enqueue_ns;
+    std::uint64_t seq;
+};
+
+struct alignas(cache_line_size) ConsumerStats
+{
+    std::uint64_t consumed{0};
+    LatencyHistogram latency;
+};
+
+/// Uncontended cost of a push immediately followed by a pop on one thread
+template <typename Queue> auto single_thread_ns(Queue& queue, std::uint64_t iterations) -> double
+{
+    BenchItem item{0, 0};
+    auto const start = now_ns();
+    for (std::uint64_t i = 0; i < iterations; ++i)
+    {
+        item.seq = i;
+        queue.try_push(item);
+        queue.try_pop(item);
+    }
+    return static_cast<double>(now_ns() - start) / static_cast<double>(iterations);
+}
+
+template <typename Queue>
+auto run_bench(
+    Queue& queue,
+    std::string const& kind,
+    std::size_t producers,
+    std::size_t consumers,
+    std::uint64_t items) -> void
+{
+    AdaptiveWaiter waiter;
+    std::atomic<std::uint64_t> remaining{items * producers};
+    std::vector<ConsumerStats> stats(consumers);
+    std::uint64_t full_spins = 0;
+
+    auto const start = now_ns();
+
+    std::vector<std::thread> threads;
+    for (std::size_t c = 0; c < consumers; ++c)
+    {
+        threads.emplace_back([&, c] {
+            auto& st = stats[c];
+            BenchItem item;
+            for (;;)
+            {
+                auto got = false;
+                waiter.wait([&] {
+                    got = queue.try_pop(item);
+                    return got || remaining.load(std::memory_order_relaxed) == 0;
+                });
+                if (!got)
+                {
+                    break;
+                }
+                st.latency.record(now_ns() - item.enqueue_ns);
+                ++st.consumed;
+                if (remaining.fetch_sub(1, std::memory_order_relaxed) == 1)
+                {
+                    waiter.notify_all();
+                }
+            }
+        });
+    }
+
+    std::vector<std::uint64_t> spins(producers, 0);
+    for (std::size_t p = 0; p < producers; ++p)
+    {
+        threads.emplace_back([&, p] {
+            for (std::uint64_t i = 0; i < items; ++i)
+            {
+                BenchItem const item{now_ns(), i};
+                while (!queue.try_push(item))
+                {
+                    ++spins[p];
+                    cpu_relax();
+                }
+                waiter.notify_one();
+            }
+        });
+    }
+
+    for (auto& t : threads)
+    {
+        t.join();
+    }
+    auto const elapsed_ns = now_ns() - start;
+
+    LatencyHistogram total;
+    for (auto const& st : stats)
+    {
+        total.merge(st.latency);
+    }
+    for (auto const s : spins)
+    {
+        full_spins += s;
+    }
+
+    std::stringstream ss;
+    ss << kind << " " << producers << "P/" << consumers << "C: "
+       << format_rate(static_cast<double>(total.count()) * 1e9 / static_cast<double>(elapsed_ns))
+       << ", full spins=" << full_spins << ", futex sleeps=" << waiter.sleeps();
+    info(Component::main, ss.str());
+    info(Component::main, kind + " enqueue->dequeue latency " + total.summary());
+}
+
+} // namespace
+
+auto queue_bench(Options const& opts) -> void
+{
+    auto const kind      = opts.get("queue", "spsc");
+    auto const depth     = static_cast<std::size_t>(opts.get_int("queue-depth", 4096));
+    auto const items     = static_cast<std::uint64_t>(opts.get_int("items", 1000000));
+    auto const producers = static_cast<std::size_t>(opts.get_int("producers", 1));
+    auto const consumers = static_cast<std::size_t>(opts.get_int("consumers", 1));
+
+    if (kind == "spsc")
+    {
+        exit_on_error(
+            (producers == 1 && consumers == 1) ? 0 : -1,
+            Component::main,
+            "spsc takes exactly one producer and one consumer");
+        SpscQueue<BenchItem> queue{depth};
+        std::stringstream ss;
+        ss << "spsc uncontended push+pop: " << single_thread_ns(queue, items) << "ns";
+        info(Component::main, ss.str());
+        run_bench(queue, kind, producers, consumers, items);
+    }
+    else
+    {
+        exit_on_error(kind == "mpmc" ? 0 : -1, Component::main, "--queue must be spsc or mpmc");
+        MpmcQueue<BenchItem> queue{depth};
+        std::stringstream ss;
+        ss << "mpmc uncontended push+pop: " << single_thread_ns(queue, items) << "ns";
+        info(Component::main, ss.str());
+        run_bench(queue, kind, producers, consumers, items);
+    }
+}
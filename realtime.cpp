@@ -0,0 +1,222 @@
+#include "realtime.hpp"
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+#ifdef __QNX__
+#include <sys/neutrino.h>
+#endif
+
+#include <cerrno>
+#include <charconv>
+#include <climits>
+#include <cstring>
+#include <sstream>
+
+#include "logging.hpp"
+
+auto ThreadTuning::to_str() const -> std::string
+{
+    std::stringstream ss;
+    ss << "cpus=";
+    if (cpus.empty())
+    {
+        ss << "any";
+    }
+    for (std::size_t i = 0; i < cpus.size(); ++i)
+    {
+        ss << (i == 0 ? "" : ",") << cpus[i];
+    }
+    ss << " sched=" << policy;
+    if (policy != "other")
+    {
+        ss << "/" << priority;
+    }
+    return ss.str();
+}
+
+namespace
+{
+
+#ifdef __QNX__
+// One bit per CPU in the runmask handed to ThreadCtl()
+auto constexpr max_cpus = static_cast<int>(sizeof(unsigned) * CHAR_BIT);
+#else
+auto constexpr max_cpus = CPU_SETSIZE;
+#endif
+
+} // namespace
+
+auto parse_cpu_list(std::string const& list, std::string const& option) -> std::vector<int>
+{
+    auto const number = [&](std::string const& text) {
+        int value         = 0;
+        auto const end    = text.data() + text.size();
+        auto const [p, e] = std::from_chars(text.data(), end, value);
+        exit_on_error(
+            e != std::errc{} || p != end || value < 0 ? -1 : 0,
+            Component::main,
+            option + " expects a list like 0-1,3, got \"" + list + "\"");
+        return value;
+    };
+
+    std::vector<int> cpus;
+    std::stringstream ss{list};
+    std::string item;
+    while (std::getline(ss, item, ','))
+    {
+        if (item.empty())
+        {
+            continue;
+        }
+        auto const dash  = item.find('-');
+        auto const first = number(item.substr(0, dash));
+        auto const last  = dash == std::string::npos ? first : number(item.substr(dash + 1));
+        // Checked before expanding, so 0-2147483647 neither loops forever nor
+        // fills memory
+        exit_on_error(
+            first > last ? -1 : 0,
+            Component::main,
+            option + " expects a list like 0-1,3, got \"" + list + "\"");
+        exit_on_error(
+            last >= max_cpus ? -1 : 0,
+            Component::main,
+            option + ": only CPUs 0-" + std::to_string(max_cpus - 1) + " can be set, got " +
+                std::to_string(last));
+        for (auto cpu = first; cpu <= last; ++cpu)
+        {
+            cpus.push_back(cpu);
+        }
+    }
+    return cpus;
+}
+
+auto thread_tuning_from_options(Options const& opts, std::string const& prefix) -> ThreadTuning
+{
+    ThreadTuning t;
+    t.cpus     = parse_cpu_list(opts.get(prefix + "-cpus"), "--" + prefix + "-cpus");
+    t.policy   = opts.get(prefix + "-sched", "other");
+    t.priority = static_cast<int>(opts.get_int(prefix + "-prio", t.policy == "other" ? 0 : 50));
+    exit_on_error(
+        (t.policy == "other" || t.policy == "fifo" || t.policy == "rr") ? 0 : -1,
+        Component::main,
+        "--" + prefix + "-sched must be other, fifo or rr");
+    return t;
+}
+
+auto apply_thread_tuning(Component c, ThreadTuning const& tuning) -> void
+{
+    if (!tuning.cpus.empty())
+    {
+#ifdef __QNX__
+        unsigned runmask = 0;
+        for (auto const cpu : tuning.cpus)
+        {
+            runmask |= 1U << cpu;
+        }
+        auto const err = ThreadCtl(_NTO_TCTL_RUNMASK, reinterpret_cast<void*>(runmask));
+#else
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (auto const cpu : tuning.cpus)
+        {
+            CPU_SET(cpu, &set);
+        }
+        // pid 0 is the calling thread, bionic has no pthread_setaffinity_np
+        auto const err = ::sched_setaffinity(0, sizeof(set), &set);
+#endif
+        exit_on_errno(err, c, "Could not set CPU affinity");
+    }
+
+    if (tuning.policy != "other")
+    {
+        sched_param param;
+        std::memset(&param, 0, sizeof(param));
+        param.sched_priority = tuning.priority;
+
+        auto const policy = tuning.policy == "fifo" ? SCHED_FIFO : SCHED_RR;
+        auto const err    = ::pthread_setschedparam(::pthread_self(), policy, &param);
+        exit_on_error(
+            err == 0 ? 0 : -1,
+            c,
+            "Could not set scheduling " + tuning.to_str() + ": " + strerror(err));
+    }
+
+    if (!tuning.is_default())
+    {
+        info(c, "Thread tuned: " + tuning.to_str());
+    }
+}
+
+auto lock_memory(Component c) -> void
+{
+    auto const err = ::mlockall(MCL_CURRENT | MCL_FUTURE);
+    exit_on_errno(err, c, "mlockall");
+    info(c, "Locked all current and future memory (mlockall)");
+}
+
+namespace
+{
+
+auto mapping_size(std::size_t bytes, bool huge_pages) -> std::size_t
+{
+    // Huge page mappings must be a whole number of (2MB) pages, keep the
+    // length the same when falling back so free_prefaulted() can recompute it
+    std::size_t constexpr huge_page_size = 2 * 1024 * 1024;
+    return huge_pages ? (bytes + huge_page_size - 1) / huge_page_size * huge_page_size : bytes;
+}
+
+} // namespace
+
+auto alloc_prefaulted(std::size_t const size, bool const huge_pages) -> void*
+{
+    auto const bytes = mapping_size(size, huge_pages);
+    void* p          = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    if (huge_pages)
+    {
+        p = ::mmap(
+            nullptr,
+            bytes,
+            PROT_READ | PROT_WRITE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,
+            -1,
+            0);
+        if (p == MAP_FAILED)
+        {
+            warn(Component::main, "No huge pages available, falling back to normal pages");
+        }
+    }
+#else
+    (void)huge_pages;
+#endif
+    if (p == MAP_FAILED)
+    {
+        p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    }
+    exit_on_error(p == MAP_FAILED ? -1 : 0, Component::main, "Could not map buffers");
+
+    // Write every page rather than rely on MAP_POPULATE, which QNX lacks
+    auto const page = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+    auto* bytes_p   = static_cast<volatile char*>(p);
+    for (std::size_t off = 0; off < bytes; off += page)
+    {
+        bytes_p[off] = 0;
+    }
+    return p;
+}
+
+auto free_prefaulted(void* p, std::size_t const size, bool const huge_pages) -> void
+{
+    ::munmap(p, mapping_size(size, huge_pages));
+}
+
+auto page_faults() -> long
+{
+    rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_minflt + usage.ru_majflt;
+}
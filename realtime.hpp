@@ -0,0 +1,44 @@
+#ifndef REALTIME_HPP_N3VY8EUX
+#define REALTIME_HPP_N3VY8EUX
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "components.hpp"
+#include "options.hpp"
+
+/// Placement and scheduling of one component thread.  Read from
+/// --<prefix>-cpus=0-1,3  --<prefix>-sched=other|fifo|rr  --<prefix>-prio=N
+struct ThreadTuning
+{
+    std::vector<int> cpus;
+    std::string policy{"other"};
+    int priority{0};
+
+    auto is_default() const -> bool { return cpus.empty() && policy == "other"; }
+    auto to_str() const -> std::string;
+};
+
+/// "0-1,3" as {0, 1, 3}.  Exits naming `option` when the list does not parse
+/// or names a CPU the affinity mask cannot hold.
+auto parse_cpu_list(std::string const& list, std::string const& option) -> std::vector<int>;
+
+auto thread_tuning_from_options(Options const& opts, std::string const& prefix) -> ThreadTuning;
+
+/// Applies `tuning` to the calling thread.  Exits on error, e.g. when
+/// SCHED_FIFO is requested without CAP_SYS_NICE.
+auto apply_thread_tuning(Component c, ThreadTuning const& tuning) -> void;
+
+/// mlockall(MCL_CURRENT | MCL_FUTURE)
+auto lock_memory(Component c) -> void;
+
+/// Anonymous mapping with every page already faulted in, optionally backed
+/// by huge pages (falls back to normal pages when none are reserved).
+auto alloc_prefaulted(std::size_t bytes, bool huge_pages) -> void*;
+auto free_prefaulted(void* p, std::size_t bytes, bool huge_pages) -> void;
+
+/// Minor + major page faults taken by the process so far
+auto page_faults() -> long;
+
+#endif /* end of include guard: REALTIME_HPP_N3VY8EUX */
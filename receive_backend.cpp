@@ -0,0 +1,199 @@
+#include "receive_backend.hpp"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#include <boost/asio/ip/address.hpp>
+
+#include "binding_functions.hpp"
+#include "logging.hpp"
+#include "timing.hpp"
+
+namespace
+{
+
+auto open_receiver(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> int
+{
+    auto const sock_fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    exit_on_error(sock_fd, Component::client, "Couldn't create socket");
+    if (opts.has("rcvbuf"))
+    {
+        int const rcvbuf = static_cast<int>(opts.get_int("rcvbuf", 0));
+        exit_on_error(
+            ::setsockopt(sock_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)),
+            Component::client,
+            "SO_RCVBUF");
+    }
+    bind_multicast_receiver(sock_fd, Component::client, if_addr, if_name, mc_addr, port);
+    return sock_fd;
+}
+
+auto wait_readable(int fd, int timeout_ms) -> bool
+{
+    pollfd pfd{fd, POLLIN, 0};
+    auto const n = ::poll(&pfd, 1, timeout_ms);
+    exit_on_error(n < 0 && errno != EINTR ? -1 : 0, Component::client, "poll");
+    return n > 0;
+}
+
+/// What multicast_client does, one recv per datagram
+class SocketBackend : public ReceiveBackend
+{
+public:
+    explicit SocketBackend(int sock_fd) : sock_fd_(sock_fd), buffer_(65536) {}
+    ~SocketBackend() override { ::close(sock_fd_); }
+
+    auto name() const -> char const* override { return "socket"; }
+
+    auto poll(DatagramHandler const& handler, int timeout_ms) -> int override
+    {
+        if (!wait_readable(sock_fd_, timeout_ms))
+        {
+            return 0;
+        }
+        int count = 0;
+        for (;;)
+        {
+            auto const n = ::recv(sock_fd_, buffer_.data(), buffer_.size(), MSG_DONTWAIT);
+            if (n < 0)
+            {
+                exit_on_errno(
+                    errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1,
+                    Component::client,
+                    "recv");
+                return count;
+            }
+            handler(Datagram{buffer_.data(), static_cast<std::size_t>(n), now_ns()});
+            ++count;
+        }
+    }
+
+private:
+    int sock_fd_;
+    std::vector<char> buffer_;
+};
+
+#ifdef __linux__
+/// Batched receive, one recvmmsg() per --batch datagrams
+class RecvmmsgBackend : public ReceiveBackend
+{
+public:
+    RecvmmsgBackend(int sock_fd, std::size_t batch, std::size_t buffer_size)
+        : sock_fd_(sock_fd),
+          buffer_size_(buffer_size),
+          buffers_(batch * buffer_size),
+          iovs_(batch),
+          msgs_(batch)
+    {
+        for (std::size_t i = 0; i < batch; ++i)
+        {
+            iovs_[i].iov_base = buffers_.data() + i * buffer_size_;
+            iovs_[i].iov_len  = buffer_size_;
+            std::memset(&msgs_[i], 0, sizeof(msgs_[i]));
+            msgs_[i].msg_hdr.msg_iov    = &iovs_[i];
+            msgs_[i].msg_hdr.msg_iovlen = 1;
+        }
+    }
+    ~RecvmmsgBackend() override { ::close(sock_fd_); }
+
+    auto name() const -> char const* override { return "recvmmsg"; }
+
+    auto poll(DatagramHandler const& handler, int timeout_ms) -> int override
+    {
+        if (!wait_readable(sock_fd_, timeout_ms))
+        {
+            return 0;
+        }
+        int count = 0;
+        for (;;)
+        {
+            // clang-format off
+            auto const n = ::recvmmsg(
+                sock_fd_,
+                msgs_.data(),
+                static_cast<unsigned>(msgs_.size()),
+                MSG_DONTWAIT,
+                nullptr
+            );
+            // clang-format on
+            if (n < 0)
+            {
+                exit_on_errno(
+                    errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1,
+                    Component::client,
+                    "recvmmsg");
+                return count;
+            }
+            auto const rx_ns = now_ns();
+            for (int i = 0; i < n; ++i)
+            {
+                handler(Datagram{
+                    static_cast<char const*>(iovs_[i].iov_base), msgs_[i].msg_len, rx_ns});
+            }
+            count += n;
+            if (static_cast<std::size_t>(n) < msgs_.size())
+            {
+                return count;
+            }
+        }
+    }
+
+private:
+    int sock_fd_;
+    std::size_t buffer_size_;
+    std::vector<char> buffers_;
+    std::vector<iovec> iovs_;
+    std::vector<mmsghdr> msgs_;
+};
+#endif
+
+} // namespace
+
+auto make_receive_backend(
+    std::string const& kind,
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> std::unique_ptr<ReceiveBackend>
+{
+    if (kind == "socket")
+    {
+        return std::make_unique<SocketBackend>(
+            open_receiver(if_addr, if_name, mc_addr, port, opts));
+    }
+    if (kind == "adaptive")
+    {
+        return make_adaptive_backend(open_receiver(if_addr, if_name, mc_addr, port, opts), opts);
+    }
+#ifdef __linux__
+    if (kind == "recvmmsg")
+    {
+        return std::make_unique<RecvmmsgBackend>(
+            open_receiver(if_addr, if_name, mc_addr, port, opts),
+            static_cast<std::size_t>(opts.get_int("batch", 64)),
+            static_cast<std::size_t>(opts.get_int("buffer-size", 2048)));
+    }
+    if (kind == "tpacket")
+    {
+        return make_tpacket_backend(if_name, mc_addr, port, opts);
+    }
+    if (kind == "xdp")
+    {
+        return make_xdp_backend(if_addr, if_name, mc_addr, port, opts);
+    }
+#endif
+    exit_on_error(-1, Component::client, "Unsupported receive backend " + kind);
+    return nullptr;
+}
@@ -0,0 +1,80 @@
+#ifndef RECEIVE_BACKEND_HPP_F2PZ7WQA
+#define RECEIVE_BACKEND_HPP_F2PZ7WQA
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "options.hpp"
+
+namespace boost::asio::ip
+{
+class address;
+}
+
+/// One received UDP payload.  `data` is only valid during the handler call:
+/// depending on the backend it points into a socket buffer, a UMEM frame or
+/// a packet ring block.
+struct Datagram
+{
+    char const* data;
+    std::size_t len;
+    std::uint64_t rx_ns;
+};
+
+using DatagramHandler = std::function<void(Datagram const&)>;
+
+/// Common consumer interface of every way this tool can receive the group
+class ReceiveBackend
+{
+public:
+    virtual ~ReceiveBackend() = default;
+
+    virtual auto name() const -> char const* = 0;
+
+    /// Waits up to `timeout_ms` for traffic and hands every datagram that is
+    /// ready to `handler`.  Returns the number of datagrams delivered.
+    virtual auto poll(DatagramHandler const& handler, int timeout_ms) -> int = 0;
+
+    /// Backend specific counters (kernel drops etc.) for the final report
+    virtual auto report() -> std::string { return {}; }
+
+    /// What the backend is doing right now, for the periodic reports
+    virtual auto status() const -> std::string { return {}; }
+};
+
+/// `kind` is one of "socket", "adaptive", "recvmmsg", "tpacket" or "xdp"
+/// (the last three are Linux only).  Every backend is set up on the same
+/// interface/group/port; --rcvbuf sizes the socket ones.  Exits on error.
+auto make_receive_backend(
+    std::string const& kind,
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> std::unique_ptr<ReceiveBackend>;
+
+/// Switches between blocking, batched and busy-polled reads of `sock_fd`
+/// with the load, see adaptive_receive.cpp
+auto make_adaptive_backend(int sock_fd, Options const& opts) -> std::unique_ptr<ReceiveBackend>;
+
+#ifdef __linux__
+/// AF_XDP backend, see xdp_backend.cpp
+auto make_xdp_backend(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> std::unique_ptr<ReceiveBackend>;
+
+/// AF_PACKET/TPACKET_V3 backend, see tpacket_backend.cpp
+auto make_tpacket_backend(
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> std::unique_ptr<ReceiveBackend>;
+#endif
+
+#endif /* end of include guard: RECEIVE_BACKEND_HPP_F2PZ7WQA */
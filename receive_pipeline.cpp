@@ -0,0 +1,259 @@
+#include "components.hpp"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/ip/address.hpp>
+
+#include "adaptive_wait.hpp"
+#include "binding_functions.hpp"
+#include "buffer_pool.hpp"
+#include "logging.hpp"
+#include "mpmc_queue.hpp"
+#include "realtime.hpp"
+#include "spsc_queue.hpp"
+#include "stats.hpp"
+#include "timing.hpp"
+
+// The receive thread only does recv + enqueue, everything else happens on
+// the workers.  If the workers fall behind the receive thread keeps draining
+// the socket and drops in userspace (counted) instead of letting the kernel
+// queue overflow.
+
+using namespace std::chrono_literals;
+
+namespace
+{
+
+struct alignas(cache_line_size) WorkerStats
+{
+    std::uint64_t processed{0};
+    LatencyHistogram latency;
+};
+
+auto busy_work(std::uint64_t ns) -> void
+{
+    auto const until = now_ns() + ns;
+    while (now_ns() < until)
+    {
+        cpu_relax();
+    }
+}
+
+/// recvmsg() that also picks up the kernel's drop counter (SO_RXQ_OVFL)
+auto receive_one(int sock_fd, char* buf, std::size_t len, std::uint32_t& kernel_drops)
+    -> ssize_t
+{
+    iovec iov{buf, len};
+    alignas(cmsghdr) char control[64];
+
+    msghdr msg;
+    std::memset(&msg, 0, sizeof(msg));
+    msg.msg_iov        = &iov;
+    msg.msg_iovlen     = 1;
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof(control);
+
+    auto const n = ::recvmsg(sock_fd, &msg, 0);
+#ifdef SO_RXQ_OVFL
+    for (auto* c = CMSG_FIRSTHDR(&msg); n >= 0 && c != nullptr; c = CMSG_NXTHDR(&msg, c))
+    {
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SO_RXQ_OVFL)
+        {
+            std::memcpy(&kernel_drops, CMSG_DATA(c), sizeof(kernel_drops));
+        }
+    }
+#else
+    (void)kernel_drops;
+#endif
+    return n;
+}
+
+template <typename Queue>
+auto run_pipeline(int sock_fd, Queue& queue, std::size_t worker_count, Options const& opts) -> void
+{
+    auto const duration = std::chrono::duration<double>(opts.get_double("duration", 10.0));
+    auto const work_ns  = static_cast<std::uint64_t>(opts.get_int("work-ns", 0));
+
+    auto const worker_tuning = thread_tuning_from_options(opts, "worker");
+
+    BufferPool pool{
+        static_cast<std::size_t>(opts.get_int("buffers", 8192)),
+        static_cast<std::size_t>(opts.get_int("buffer-size", 2048)),
+        opts.has("huge-pages")};
+    AdaptiveWaiter waiter;
+    std::atomic<bool> stop{false};
+    std::vector<WorkerStats> stats(worker_count);
+
+    std::vector<std::thread> workers;
+    for (std::size_t w = 0; w < worker_count; ++w)
+    {
+        workers.emplace_back([&, w] {
+            apply_thread_tuning(Component::client, worker_tuning);
+            auto& st = stats[w];
+            PacketDesc desc;
+            for (;;)
+            {
+                auto got = false;
+                waiter.wait([&] {
+                    got = queue.try_pop(desc);
+                    return got || stop.load(std::memory_order_relaxed);
+                });
+                // On shutdown drain whatever is left before leaving
+                if (!got && !queue.try_pop(desc))
+                {
+                    break;
+                }
+                st.latency.record(now_ns() - desc.rx_ns);
+                busy_work(work_ns);
+                pool.release(desc.handle);
+                ++st.processed;
+            }
+        });
+    }
+
+    std::uint64_t received     = 0;
+    std::uint64_t queue_full   = 0;
+    std::uint64_t pool_empty   = 0;
+    std::uint32_t kernel_drops = 0;
+    std::vector<char> scratch(pool.buffer_size());
+
+    auto const start = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - start < duration)
+    {
+        PacketDesc desc{0, 0, 0};
+        auto const have_buffer = pool.acquire(desc.handle);
+        auto* buf              = have_buffer ? pool.data(desc.handle) : scratch.data();
+
+        auto const n = receive_one(sock_fd, buf, pool.buffer_size(), kernel_drops);
+        if (n < 0)
+        {
+            if (have_buffer)
+            {
+                pool.release(desc.handle);
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                exit_on_errno(n, Component::client, "recvmsg");
+            }
+            continue;
+        }
+
+        ++received;
+        if (!have_buffer)
+        {
+            ++pool_empty;
+            continue;
+        }
+
+        desc.len   = static_cast<std::uint32_t>(n);
+        desc.rx_ns = now_ns();
+        if (!queue.try_push(desc))
+        {
+            ++queue_full;
+            pool.release(desc.handle);
+            continue;
+        }
+        waiter.notify_one();
+    }
+    auto const elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+    stop.store(true);
+    waiter.notify_all();
+    for (auto& t : workers)
+    {
+        t.join();
+    }
+
+    LatencyHistogram total;
+    std::uint64_t processed = 0;
+    for (std::size_t w = 0; w < worker_count; ++w)
+    {
+        std::stringstream ss;
+        ss << "Worker " << w << " processed " << stats[w].processed
+           << ", handoff latency " << stats[w].latency.summary();
+        info(Component::client, ss.str());
+        total.merge(stats[w].latency);
+        processed += stats[w].processed;
+    }
+
+    std::stringstream ss;
+    ss << "Received " << received << " ("
+       << format_rate(static_cast<double>(received) / elapsed.count()) << "), processed "
+       << processed << ", dropped in userspace: queue_full=" << queue_full
+       << " pool_empty=" << pool_empty << ", kernel drops=" << kernel_drops
+       << ", futex sleeps=" << waiter.sleeps();
+    info(Component::client, ss.str());
+    info(Component::client, "Handoff latency " + total.summary());
+}
+
+} // namespace
+
+auto receive_pipeline(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void
+{
+    auto const workers = static_cast<std::size_t>(opts.get_int("workers", 1));
+    auto const depth   = static_cast<std::size_t>(opts.get_int("queue-depth", 4096));
+    auto const kind    = opts.get("queue", workers > 1 ? "mpmc" : "spsc");
+    exit_on_error(
+        (kind == "mpmc" || (kind == "spsc" && workers == 1)) ? 0 : -1,
+        Component::client,
+        "--queue must be mpmc, or spsc with a single worker");
+
+    apply_thread_tuning(Component::client, thread_tuning_from_options(opts, "client"));
+
+    int sock_fd = 0;
+    {
+        sock_fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+        exit_on_error(sock_fd, Component::client, "Couldn't create socket");
+    }
+
+    bind_multicast_receiver(sock_fd, Component::client, if_addr, if_name, mc_addr, port);
+
+    {
+        struct timeval tv;
+        tv.tv_sec      = 0;
+        tv.tv_usec     = 100000;
+        auto const err = setsockopt(sock_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        exit_on_error(err, Component::client, "Cannot set timeout");
+    }
+#ifdef SO_RXQ_OVFL
+    {
+        int const opt  = 1;
+        auto const err = setsockopt(sock_fd, SOL_SOCKET, SO_RXQ_OVFL, &opt, sizeof(opt));
+        exit_on_error(err, Component::client, "Cannot enable SO_RXQ_OVFL");
+    }
+#endif
+
+    {
+        std::stringstream ss;
+        ss << "Handing off to " << workers << " worker(s) through a " << kind << " queue of "
+           << depth;
+        info(Component::client, ss.str());
+    }
+
+    if (kind == "spsc")
+    {
+        SpscQueue<PacketDesc> queue{depth};
+        run_pipeline(sock_fd, queue, workers, opts);
+    }
+    else
+    {
+        MpmcQueue<PacketDesc> queue{depth};
+        run_pipeline(sock_fd, queue, workers, opts);
+    }
+
+    info(Component::client, "Closing");
+    close(sock_fd);
+}
@@ -0,0 +1,279 @@
+#ifndef REORDER_BUFFER_HPP_K7QD2WNA
+#define REORDER_BUFFER_HPP_K7QD2WNA
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "spsc_queue.hpp"
+#include "stats.hpp"
+
+struct ReorderStats
+{
+    std::uint64_t delivered{0};
+    std::uint64_t reordered{0};  ///< arrived after a higher number
+    std::uint64_t skipped{0};    ///< sequence numbers given up on after the delay
+    std::uint64_t late{0};       ///< arrived after their number was delivered or skipped
+    std::uint64_t duplicates{0}; ///< already waiting in the buffer
+    std::uint64_t oversized{0};  ///< longer than a slot, dropped
+    std::uint64_t forced{0};     ///< gaps skipped early for a datagram too far ahead
+    std::size_t max_held{0};
+    LatencyHistogram hold_ns;    ///< arrival to delivery, in-order arrivals included
+};
+
+/// Puts datagrams back into sequence order while holding none of them longer
+/// than `max_delay_ns`.  Slots are a preallocated power-of-two array indexed
+/// by `seq & mask`, so insert and release are O(1) per datagram with no
+/// allocation after construction.  A missing number is skipped once the
+/// datagram that has been waiting longest reaches the delay; arrival order
+/// is kept in a ring next to the slots to find that datagram without a scan.
+/// The stream starts wherever the receiver joined it: nothing is delivered
+/// until the first datagram has waited out the delay, in case an earlier
+/// one is still on its way.
+/// Single threaded: the receive loop calls insert() and release().
+class ReorderBuffer
+{
+public:
+    /// `slots` is rounded up to a power of two and bounds how far ahead of
+    /// the next expected number a datagram can be
+    ReorderBuffer(std::size_t slots, std::size_t slot_size, std::uint64_t max_delay_ns)
+        : mask_(round_up_pow2(slots) - 1),
+          slot_size_(slot_size),
+          max_delay_ns_(max_delay_ns),
+          slots_(mask_ + 1),
+          storage_((mask_ + 1) * slot_size_),
+          arrivals_(2 * (mask_ + 1))
+    {
+    }
+
+    ReorderBuffer(ReorderBuffer const&)                    = delete;
+    auto operator=(ReorderBuffer const&) -> ReorderBuffer& = delete;
+
+    /// Takes a copy of the datagram; returns false when it was dropped
+    /// (late, duplicate or oversized).  A datagram more than the buffer
+    /// size ahead first releases, skipping gaps, whatever is in the way.
+    template <typename Deliver>
+    auto insert(
+        std::uint64_t seq,
+        char const* data,
+        std::size_t len,
+        std::uint64_t now,
+        Deliver&& deliver) -> bool;
+
+    /// Delivers everything that is in order, and skips the gap in front of
+    /// anything that has waited `max_delay_ns`.  deliver(seq, data, len).
+    template <typename Deliver> auto release(std::uint64_t now, Deliver&& deliver) -> void;
+
+    /// Delivers whatever is left, skipping all gaps, e.g. at the end of a run
+    template <typename Deliver> auto flush(std::uint64_t now, Deliver&& deliver) -> void;
+
+    /// When release() next has something to do if nothing else arrives,
+    /// zero when nothing is waiting
+    auto next_deadline() -> std::uint64_t;
+
+    auto held() const -> std::size_t { return held_; }
+    auto next_seq() const -> std::uint64_t { return next_; }
+    auto stats() const -> ReorderStats const& { return stats_; }
+
+    /// Bytes preallocated for slots, payloads and the arrival ring
+    auto memory_bytes() const -> std::size_t
+    {
+        return slots_.size() * sizeof(Slot) + storage_.size() +
+               arrivals_.size() * sizeof(std::uint64_t);
+    }
+
+private:
+    struct Slot
+    {
+        std::uint64_t seq;
+        std::uint64_t arrival_ns;
+        std::uint32_t len;
+        bool used;
+    };
+
+    auto slot(std::uint64_t seq) -> Slot& { return slots_[seq & mask_]; }
+    auto payload(std::uint64_t seq) -> char*
+    {
+        return storage_.data() + (seq & mask_) * slot_size_;
+    }
+
+    template <typename Deliver>
+    auto deliver_in_order(std::uint64_t now, Deliver& deliver) -> void;
+    template <typename Deliver>
+    auto skip_gap(std::uint64_t now, Deliver& deliver) -> void;
+    auto oldest_arrival() -> Slot const*;
+
+    std::size_t mask_;
+    std::size_t slot_size_;
+    std::uint64_t max_delay_ns_;
+    std::vector<Slot> slots_;
+    std::vector<char> storage_;
+
+    // Sequence numbers in arrival order, popped lazily once delivered.  Held
+    // numbers span at most the slot count and so do delivered ones still
+    // queued behind the oldest held one, hence twice the slots.
+    std::vector<std::uint64_t> arrivals_;
+    std::size_t arrivals_head_{0};
+    std::size_t arrivals_tail_{0};
+
+    std::uint64_t next_{0};
+    std::uint64_t highest_{0};
+    std::uint64_t settle_until_{0};
+    bool started_{false};
+    std::size_t held_{0};
+    ReorderStats stats_;
+};
+
+template <typename Deliver>
+auto ReorderBuffer::insert(
+    std::uint64_t const seq,
+    char const* data,
+    std::size_t const len,
+    std::uint64_t const now,
+    Deliver&& deliver) -> bool
+{
+    if (len > slot_size_)
+    {
+        ++stats_.oversized;
+        return false;
+    }
+    if (!started_)
+    {
+        next_         = seq;
+        highest_      = seq;
+        settle_until_ = now + max_delay_ns_;
+        started_      = true;
+    }
+    if (seq < next_ && now < settle_until_ && highest_ - seq <= mask_)
+    {
+        // Still settling and this is an earlier start
+        next_ = seq;
+    }
+    if (seq < highest_)
+    {
+        ++stats_.reordered;
+    }
+    if (seq < next_)
+    {
+        ++stats_.late;
+        return false;
+    }
+    while (seq > next_ + mask_)
+    {
+        ++stats_.forced;
+        settle_until_ = 0;
+        if (held_ == 0)
+        {
+            // Nothing held in the way, jump rather than count up to it
+            stats_.skipped += seq - mask_ - next_;
+            next_ = seq - mask_;
+            break;
+        }
+        skip_gap(now, deliver);
+    }
+
+    auto& s = slot(seq);
+    if (s.used)
+    {
+        ++stats_.duplicates;
+        return false;
+    }
+    s        = Slot{seq, now, static_cast<std::uint32_t>(len), true};
+    highest_ = std::max(highest_, seq);
+    std::memcpy(payload(seq), data, len);
+    oldest_arrival(); // drops delivered numbers from the front first
+    arrivals_[arrivals_tail_++ % arrivals_.size()] = seq;
+    ++held_;
+    stats_.max_held = std::max(stats_.max_held, held_);
+    return true;
+}
+
+template <typename Deliver>
+auto ReorderBuffer::release(std::uint64_t const now, Deliver&& deliver) -> void
+{
+    deliver_in_order(now, deliver);
+    for (auto const* oldest = oldest_arrival(); oldest != nullptr; oldest = oldest_arrival())
+    {
+        if (now - oldest->arrival_ns < max_delay_ns_)
+        {
+            break;
+        }
+        skip_gap(now, deliver);
+    }
+}
+
+template <typename Deliver>
+auto ReorderBuffer::flush(std::uint64_t const now, Deliver&& deliver) -> void
+{
+    deliver_in_order(now, deliver);
+    while (held_ > 0)
+    {
+        skip_gap(now, deliver);
+    }
+}
+
+inline auto ReorderBuffer::next_deadline() -> std::uint64_t
+{
+    auto const* oldest = oldest_arrival();
+    return oldest == nullptr ? 0 : oldest->arrival_ns + max_delay_ns_;
+}
+
+template <typename Deliver>
+auto ReorderBuffer::deliver_in_order(std::uint64_t const now, Deliver& deliver) -> void
+{
+    if (now < settle_until_)
+    {
+        return;
+    }
+    for (;;)
+    {
+        auto& s = slot(next_);
+        if (!s.used || s.seq != next_)
+        {
+            return;
+        }
+        deliver(s.seq, static_cast<char const*>(payload(next_)), std::size_t{s.len});
+        stats_.hold_ns.record(now - s.arrival_ns);
+        ++stats_.delivered;
+        s.used = false;
+        --held_;
+        ++next_;
+    }
+}
+
+/// Gives up on `next_` and everything missing up to the next held datagram
+template <typename Deliver>
+auto ReorderBuffer::skip_gap(std::uint64_t const now, Deliver& deliver) -> void
+{
+    if (held_ == 0)
+    {
+        // Nothing to wait for behind the gap, only room to make
+        ++stats_.skipped;
+        ++next_;
+        return;
+    }
+    while (!slot(next_).used || slot(next_).seq != next_)
+    {
+        ++stats_.skipped;
+        ++next_;
+    }
+    deliver_in_order(now, deliver);
+}
+
+inline auto ReorderBuffer::oldest_arrival() -> Slot const*
+{
+    while (arrivals_head_ != arrivals_tail_)
+    {
+        auto const seq = arrivals_[arrivals_head_ % arrivals_.size()];
+        if (seq >= next_)
+        {
+            return &slot(seq);
+        }
+        ++arrivals_head_;
+    }
+    return nullptr;
+}
+
+#endif /* end of include guard: REORDER_BUFFER_HPP_K7QD2WNA */
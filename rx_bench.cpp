@@ -0,0 +1,91 @@
+#include "components.hpp"
+
+#include <sys/resource.h>
+
+#include <sstream>
+
+#include <boost/asio/ip/address.hpp>
+
+#include "logging.hpp"
+#include "receive_backend.hpp"
+#include "stats.hpp"
+
+using namespace std::chrono_literals;
+
+namespace
+{
+
+auto cpu_ns() -> std::uint64_t
+{
+    rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    auto const to_ns = [](timeval const& tv) {
+        return static_cast<std::uint64_t>(tv.tv_sec) * 1000000000 +
+               static_cast<std::uint64_t>(tv.tv_usec) * 1000;
+    };
+    return to_ns(usage.ru_utime) + to_ns(usage.ru_stime);
+}
+
+} // namespace
+
+auto rx_bench(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void
+{
+    auto const kind     = opts.get("backend", "socket");
+    auto const duration = std::chrono::duration<double>(opts.get_double("duration", 10.0));
+    auto backend        = make_receive_backend(kind, if_addr, if_name, mc_addr, port, opts);
+
+    std::uint64_t packets = 0;
+    std::uint64_t bytes   = 0;
+    std::uint64_t polls   = 0;
+    auto const handler    = [&](Datagram const& d) {
+        ++packets;
+        bytes += d.len;
+    };
+
+    auto const cpu_start = cpu_ns();
+    auto const start     = std::chrono::steady_clock::now();
+    auto next_report     = start + 1s;
+    auto last_packets    = packets;
+    while (std::chrono::steady_clock::now() - start < duration)
+    {
+        backend->poll(handler, 100);
+        ++polls;
+
+        if (std::chrono::steady_clock::now() >= next_report)
+        {
+            next_report += 1s;
+            std::stringstream ss;
+            ss << backend->name() << ": " << format_rate(static_cast<double>(packets - last_packets));
+            auto const status = backend->status();
+            if (!status.empty())
+            {
+                ss << " (" << status << ")";
+            }
+            info(Component::client, ss.str());
+            last_packets = packets;
+        }
+    }
+    auto const elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+    auto const cpu     = cpu_ns() - cpu_start;
+
+    std::stringstream ss;
+    ss << backend->name() << " total: " << packets << " datagrams, " << bytes << " bytes, "
+       << format_rate(static_cast<double>(packets) / elapsed.count()) << ", "
+       << static_cast<double>(packets) / static_cast<double>(polls) << " per poll";
+    if (packets > 0)
+    {
+        ss << ", CPU " << format_ns(cpu / packets) << "/datagram";
+    }
+    info(Component::client, ss.str());
+
+    auto const extra = backend->report();
+    if (!extra.empty())
+    {
+        info(Component::client, std::string{backend->name()} + ": " + extra);
+    }
+}
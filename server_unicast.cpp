@@ -1,120 +1,142 @@
 #include "components.hpp"
 
-#include <chrono>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
 #include <condition_variable>
+#include <cstring>
 #include <sstream>
+#include <vector>
 
 #include <boost/asio/ip/address.hpp>
 
-#include "logging.hpp"
 #include "binding_functions.hpp"
-
+#include "logging.hpp"
+#include "ping_pong.hpp"
 
 // Playing with code from:
 // https://www.geeksforgeeks.org/udp-server-client-implementation-c/
 
-
-using namespace std::chrono_literals;
-
 auto unicast_server(
     boost::asio::ip::address const& if_addr,
     std::string const& if_name,
     boost::asio::ip::address const& mc_addr,
-    int port,
-    bool& server_started,
-    std::mutex& server_started_mutex,
-    std::condition_variable& server_started_cv) -> void
+    short unsigned int port,
+    std::string const& transport,
+    Options const& opts,
+    std::mutex& component_ready,
+    bool& server_ready,
+    std::condition_variable& server_ready_cv) -> void
 {
-    struct sockaddr_in serv_addr
+    auto const multicast = transport == "multicast";
+    auto const idle_s    = opts.get_int("server-idle", 10);
+
+    // Unicast: one socket, connected to the client on its first request.
+    // Multicast: requests arrive on the group at `port`, replies go to the
+    // group at `port + 1` from a socket connected there.
+    int rx_fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    exit_on_error(rx_fd, Component::server, "socket");
+    int tx_fd = rx_fd;
+    if (multicast)
     {
-        0
-    }, client_addr{0};
-    int server_fd = 0;
+        bind_multicast_receiver(rx_fd, Component::server, if_addr, if_name, mc_addr, port);
 
-    {
-        server_fd = ::socket(AF_INET, SOCK_DGRAM, 0);
-        exit_on_error(server_fd, Component::server, "socket");
+        tx_fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+        exit_on_error(tx_fd, Component::server, "socket");
+        auto const group = bind_multicast_sender(
+            tx_fd, Component::server, if_addr, if_name, mc_addr, port + 1);
+        connect_to(tx_fd, Component::server, group);
     }
-
+    else
     {
-        int const opt = 1; // Positive value for re-use
-        // clang-format off
-        auto const err = ::setsockopt(
-            server_fd, SOL_SOCKET,
-            SO_REUSEADDR | SO_REUSEPORT,
-            &opt,
-            sizeof(opt)
-        );
-        // clang-format on
-        exit_on_error(err, Component::server, "setsockopt could not specify REUSEADDR");
+        bind_unicast(rx_fd, Component::server, if_addr, if_name, port);
     }
 
-    // bind socket
     {
-        // set up addresses
-        serv_addr.sin_family = AF_INET;
-        address2in_addr(if_addr, serv_addr.sin_addr.s_addr);
-        serv_addr.sin_port = ::htons(port);
-
-        std::stringstream ss;
-        ss << "Binding to " << ::inet_ntoa(serv_addr.sin_addr) << ":"
-           << ::ntohs(serv_addr.sin_port);
-        info(Component::server, ss.str());
-
-        // clang-format off
-        auto const err = ::bind(
-            server_fd,
-            reinterpret_cast<struct sockaddr*>(&serv_addr),
-            sizeof(serv_addr)
-        );
-        // clang-format on
-        exit_on_error(err, Component::server, "bind error");
+        std::unique_lock<std::mutex> lk(component_ready);
+        server_ready = true;
+        server_ready_cv.notify_all();
+        info(Component::server, "Notifying that " + transport + " echo service is bound");
     }
 
+    std::vector<char> buffer(65536);
+    auto connected       = multicast;
+    std::uint64_t served = 0;
+    long long idle       = 0;
+    auto done            = false;
+    while (!done)
     {
-        std::unique_lock<std::mutex> lk(server_started_mutex);
-        server_started = true;
-        server_started_cv.notify_all();
+        pollfd pfd{rx_fd, POLLIN, 0};
+        auto const ready = ::poll(&pfd, 1, 1000);
+        exit_on_error(ready < 0 && errno != EINTR ? -1 : 0, Component::server, "poll");
+        if (ready <= 0)
+        {
+            if (served > 0 && ++idle >= idle_s)
+            {
+                warn(Component::server, "No requests for " + std::to_string(idle) + "s");
+                break;
+            }
+            continue;
+        }
+        idle = 0;
+
+        for (;;)
+        {
+            sockaddr_in client_addr;
+            auto len = static_cast<socklen_t>(sizeof(client_addr));
+            // clang-format off
+            auto const n = ::recvfrom(
+                rx_fd,
+                buffer.data(),
+                buffer.size(),
+                MSG_DONTWAIT,
+                reinterpret_cast<struct sockaddr*>(&client_addr),
+                &len
+            );
+            // clang-format on
+            if (n < 0)
+            {
+                // ECONNREFUSED: an earlier reply hit a closed port
+                exit_on_errno(
+                    errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ||
+                            errno == ECONNREFUSED
+                        ? 0
+                        : -1,
+                    Component::server,
+                    "recvfrom");
+                break;
+            }
+            if (!connected)
+            {
+                connect_to(tx_fd, Component::server, client_addr);
+                connected = true;
+            }
+
+            auto const sent = ::send(tx_fd, buffer.data(), static_cast<std::size_t>(n), 0);
+            exit_on_errno(sent < 0 && errno != ECONNREFUSED ? -1 : 0, Component::server, "send");
+            ++served;
+
+            PingPongHeader hdr;
+            if (static_cast<std::size_t>(n) >= sizeof(hdr))
+            {
+                std::memcpy(&hdr, buffer.data(), sizeof(hdr));
+                if ((hdr.flags & ping_pong_stop) != 0)
+                {
+                    done = true;
+                    break;
+                }
+            }
+        }
     }
 
-    auto len = static_cast<socklen_t>(sizeof(client_addr));
+    std::stringstream ss;
+    ss << "Echoed " << served << " " << transport << " requests, closing";
+    info(Component::server, ss.str());
+    if (tx_fd != rx_fd)
     {
-        std::array<char, 1024> buffer = {0};
-        // clang-format off
-        auto const n = ::recvfrom(
-            server_fd,
-            reinterpret_cast<char *>(buffer.data()),
-            buffer.size()-1,
-            MSG_WAITALL,
-            reinterpret_cast<struct sockaddr *>(&client_addr),
-            reinterpret_cast<socklen_t*>(&len)
-        );
-        // clang-format on
-        buffer[n] = '\0';
-
-        std::stringstream ss;
-        ss << "Read: " << buffer.data();
-        info(Component::server, ss.str());
+        ::close(tx_fd);
     }
-
-    {
-        std::string hello;
-        hello = "hello from server (1)";
-        // clang-format off
-        auto const err = ::sendto(
-            server_fd,
-            hello.c_str(),
-            hello.size(),
-            MSG_CONFIRM,
-            reinterpret_cast<const struct sockaddr *>(&client_addr),
-            sizeof(client_addr)
-        );
-        // clang-format on
-        exit_on_error(err, Component::server, "Could not send hello message");
-        info(Component::server, "Hello message sent");
-        std::this_thread::sleep_for(500ms);
-    }
-
-    info(Component::server, "Closing");
-    close(server_fd);
+    ::close(rx_fd);
 }
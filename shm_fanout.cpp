@@ -0,0 +1,194 @@
+#include "components.hpp"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <thread>
+
+#include <boost/asio/ip/address.hpp>
+
+#include "binding_functions.hpp"
+#include "logging.hpp"
+#include "shm_ring.hpp"
+#include "timing.hpp"
+
+using namespace std::chrono_literals;
+
+auto shm_publisher(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void
+{
+    auto const name      = opts.get("shm-name", "bind-test");
+    auto const slots     = static_cast<std::uint32_t>(opts.get_int("shm-slots", 4096));
+    auto const slot_size = static_cast<std::uint32_t>(opts.get_int("shm-slot-size", 2048));
+    auto const duration  = std::chrono::duration<double>(opts.get_double("duration", 10.0));
+
+    int sock_fd = 0;
+    {
+        sock_fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+        exit_on_error(sock_fd, Component::client, "Couldn't create socket");
+    }
+
+    bind_multicast_receiver(sock_fd, Component::client, if_addr, if_name, mc_addr, port);
+
+    {
+        // Wake up regularly to look for slow consumers even when idle
+        struct timeval tv;
+        tv.tv_sec      = 0;
+        tv.tv_usec     = 100000;
+        auto const err = setsockopt(sock_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        exit_on_error(err, Component::client, "Cannot set timeout");
+    }
+
+    auto ring = ShmRing::create(name, slots, slot_size);
+
+    // A consumer more than 3/4 of the ring behind is about to be lapped
+    auto const slow_threshold = static_cast<std::uint64_t>(slots) * 3 / 4;
+
+    auto const start        = std::chrono::steady_clock::now();
+    auto next_report        = start + 1s;
+    std::uint64_t received  = 0;
+    std::uint64_t bytes     = 0;
+    std::uint64_t truncated = 0;
+
+    iovec iov{};
+    msghdr msg{};
+    msg.msg_iov    = &iov;
+    msg.msg_iovlen = 1;
+    while (std::chrono::steady_clock::now() - start < duration)
+    {
+        iov.iov_base = ring.claim();
+        iov.iov_len  = slot_size;
+        auto const n = ::recvmsg(sock_fd, &msg, 0);
+        if (n >= 0)
+        {
+            // Published cut to the slot size, as a consumer would have read
+            // it with a buffer that small; counted so it does not go unseen
+            truncated += (msg.msg_flags & MSG_TRUNC) != 0 ? 1 : 0;
+            ring.publish(static_cast<std::uint32_t>(n), now_ns());
+            ++received;
+            bytes += static_cast<std::uint64_t>(n);
+        }
+        else if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+        {
+            exit_on_errno(n, Component::client, "recv");
+        }
+
+        auto const now = std::chrono::steady_clock::now();
+        if (now >= next_report)
+        {
+            next_report += 1s;
+
+            std::stringstream ss;
+            ss << "Published " << received << " datagrams (" << bytes << " bytes)";
+            info(Component::client, ss.str());
+            if (truncated > 0)
+            {
+                ss.str("");
+                ss << "Truncated " << truncated << " datagrams longer than --shm-slot-size "
+                   << slot_size;
+                warn(Component::client, ss.str());
+            }
+
+            std::uint64_t lag = 0;
+            auto const slow   = ring.slowest_consumer(slow_threshold, lag);
+            if (slow >= 0)
+            {
+                auto const& c = ring.header().consumers[slow];
+                ss.str("");
+                ss << "Slow consumer pid=" << c.pid.load() << " lag=" << lag << "/" << slots
+                   << " overruns=" << c.overruns.load();
+                warn(Component::client, ss.str());
+            }
+        }
+    }
+
+    info(Component::client, "Closing");
+    close(sock_fd);
+}
+
+auto shm_consumer(Options const& opts) -> void
+{
+    auto const name     = opts.get("shm-name", "bind-test");
+    auto const duration = std::chrono::duration<double>(opts.get_double("duration", 10.0));
+    auto const verbose  = opts.has("verbose");
+
+    auto ring     = ShmRing::attach(name);
+    auto const id = ring.register_consumer();
+    {
+        std::stringstream ss;
+        ss << "Attached to \"" << name << "\" as consumer " << id;
+        info(Component::consumer, ss.str());
+    }
+
+    std::uint64_t received = 0;
+    std::uint64_t bytes    = 0;
+    std::uint64_t overruns = 0;
+    std::uint64_t lat_sum  = 0;
+    unsigned idle          = 0;
+
+    auto const start = std::chrono::steady_clock::now();
+    auto next_report = start + 1s;
+
+    while (std::chrono::steady_clock::now() - start < duration)
+    {
+        std::uint32_t len   = 0;
+        std::uint64_t rx_ns = 0;
+
+        auto const r = ring.read(id, [&](char const* data, std::uint32_t l, std::uint64_t ts) {
+            len   = l;
+            rx_ns = ts;
+            if (verbose)
+            {
+                info(Component::consumer, "Read: " + std::string(data, l));
+            }
+        });
+
+        switch (r)
+        {
+            case ShmRing::ReadResult::ok:
+                idle = 0;
+                ++received;
+                bytes += len;
+                lat_sum += now_ns() - rx_ns;
+                break;
+            case ShmRing::ReadResult::overrun:
+                ++overruns;
+                break;
+            case ShmRing::ReadResult::empty:
+                // Spin briefly, then back off so an idle consumer costs nothing
+                if (++idle >= 128)
+                {
+                    std::this_thread::sleep_for(50us);
+                }
+                else if (idle >= 64)
+                {
+                    std::this_thread::yield();
+                }
+                break;
+        }
+
+        auto const now = std::chrono::steady_clock::now();
+        if (now >= next_report)
+        {
+            next_report += 1s;
+            std::stringstream ss;
+            ss << "Read " << received << " datagrams (" << bytes << " bytes)"
+               << ", overruns=" << overruns;
+            if (received > 0)
+            {
+                ss << ", mean ring latency=" << lat_sum / received << "ns";
+            }
+            info(Component::consumer, ss.str());
+        }
+    }
+
+    ring.unregister_consumer(id);
+    info(Component::consumer, "Closing");
+}
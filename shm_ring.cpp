@@ -0,0 +1,234 @@
+#include "shm_ring.hpp"
+
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <sstream>
+
+#include "logging.hpp"
+
+auto open_shm_segment(std::string const& name, int flags) -> int
+{
+#ifdef __ANDROID__
+    // Bionic has no shm_open, a tmpfs-backed file gives the same mapping
+    auto const path = "/data/local/tmp/" + name;
+    return ::open(path.c_str(), flags, 0660);
+#else
+    return ::shm_open(("/" + name).c_str(), flags, 0660);
+#endif
+}
+
+auto unlink_shm_segment(std::string const& name) -> void
+{
+#ifdef __ANDROID__
+    ::unlink(("/data/local/tmp/" + name).c_str());
+#else
+    ::shm_unlink(("/" + name).c_str());
+#endif
+}
+
+namespace
+{
+
+auto round_up(std::size_t v, std::size_t to) -> std::size_t { return (v + to - 1) / to * to; }
+
+/// A consumer killed before unregister_consumer() would hold its slot for
+/// good: frees the slot once its process is gone.  True if the slot is free.
+auto reclaim_if_gone(ShmConsumerSlot& c) -> bool
+{
+    auto pid = c.pid.load(std::memory_order_relaxed);
+    if (pid != 0 && ::kill(pid, 0) == -1 && errno == ESRCH)
+    {
+        // Loses to anyone who already freed or took it over, which is fine
+        c.pid.compare_exchange_strong(pid, 0);
+        pid = c.pid.load(std::memory_order_relaxed);
+    }
+    return pid == 0;
+}
+
+} // namespace
+
+ShmRing::ShmRing(std::string name, void* base, std::size_t size, bool owner)
+    : name_(std::move(name)),
+      base_(base),
+      size_(size),
+      owner_(owner),
+      header_(static_cast<ShmRingHeader*>(base)),
+      stride_(round_up(sizeof(ShmSlotHeader) + header_->slot_size, cache_line_size))
+{
+}
+
+ShmRing::ShmRing(ShmRing&& other) noexcept
+    : name_(std::move(other.name_)),
+      base_(other.base_),
+      size_(other.size_),
+      owner_(other.owner_),
+      header_(other.header_),
+      stride_(other.stride_)
+{
+    other.base_  = nullptr;
+    other.owner_ = false;
+}
+
+ShmRing::~ShmRing()
+{
+    if (base_ != nullptr)
+    {
+        ::munmap(base_, size_);
+    }
+    if (owner_)
+    {
+        unlink_shm_segment(name_);
+    }
+}
+
+auto ShmRing::create(std::string const& name, std::uint32_t slot_count, std::uint32_t slot_size)
+    -> ShmRing
+{
+    exit_on_error(
+        (slot_count != 0 && (slot_count & (slot_count - 1)) == 0) ? 0 : -1,
+        Component::client,
+        "Shared memory slot count must be a power of two");
+
+    auto const stride = round_up(sizeof(ShmSlotHeader) + slot_size, cache_line_size);
+    auto const size   = round_up(sizeof(ShmRingHeader), cache_line_size) + stride * slot_count;
+
+    unlink_shm_segment(name);
+    auto const fd = open_shm_segment(name, O_CREAT | O_EXCL | O_RDWR);
+    exit_on_error(fd, Component::client, "Could not create shared memory " + name);
+
+    auto const err = ::ftruncate(fd, static_cast<off_t>(size));
+    exit_on_error(err, Component::client, "Could not size shared memory " + name);
+
+    auto* base = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    exit_on_error(base == MAP_FAILED ? -1 : 0, Component::client, "Could not map " + name);
+
+    // The segment is zero filled, atomics start out as zero as well
+    auto* header       = new (base) ShmRingHeader{};
+    header->slot_count = slot_count;
+    header->slot_size  = slot_size;
+    header->head.store(0, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    header->magic = ShmRingHeader::magic_value;
+
+    std::stringstream ss;
+    ss << "Created shared memory ring \"" << name << "\" slots=" << slot_count
+       << " slot_size=" << slot_size << " bytes=" << size;
+    info(Component::client, ss.str());
+
+    return ShmRing{name, base, size, true};
+}
+
+auto ShmRing::attach(std::string const& name) -> ShmRing
+{
+    auto const fd = open_shm_segment(name, O_RDWR);
+    exit_on_error(fd, Component::consumer, "Could not open shared memory " + name);
+
+    struct stat st;
+    auto const err = ::fstat(fd, &st);
+    exit_on_error(err, Component::consumer, "Could not stat shared memory " + name);
+
+    auto const size = static_cast<std::size_t>(st.st_size);
+    auto* base      = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    exit_on_error(base == MAP_FAILED ? -1 : 0, Component::consumer, "Could not map " + name);
+
+    auto const* header = static_cast<ShmRingHeader const*>(base);
+    exit_on_error(
+        header->magic == ShmRingHeader::magic_value ? 0 : -1,
+        Component::consumer,
+        name + " is not a bind-test ring");
+
+    return ShmRing{name, base, size, false};
+}
+
+auto ShmRing::slot(std::uint64_t const seq) const -> ShmSlotHeader*
+{
+    auto* first = static_cast<char*>(base_) + round_up(sizeof(ShmRingHeader), cache_line_size);
+    return reinterpret_cast<ShmSlotHeader*>(
+        first + stride_ * (seq & (header_->slot_count - 1)));
+}
+
+auto ShmRing::claim() -> char*
+{
+    auto const seq = header_->head.load(std::memory_order_relaxed);
+    auto* s        = slot(seq);
+    s->seq.store(2 * seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    return reinterpret_cast<char*>(s + 1);
+}
+
+auto ShmRing::publish(std::uint32_t const len, std::uint64_t const rx_ns) -> void
+{
+    auto const seq = header_->head.load(std::memory_order_relaxed);
+    auto* s        = slot(seq);
+    s->len         = len;
+    s->rx_ns       = rx_ns;
+    s->seq.store(2 * seq + 2, std::memory_order_release);
+    header_->head.store(seq + 1, std::memory_order_release);
+}
+
+auto ShmRing::slowest_consumer(std::uint64_t const threshold, std::uint64_t& lag) const -> int
+{
+    auto const head = header_->head.load(std::memory_order_relaxed);
+    int slowest     = -1;
+    lag             = 0;
+    for (std::size_t i = 0; i < ShmRingHeader::max_consumers; ++i)
+    {
+        auto& c = header_->consumers[i];
+        if (reclaim_if_gone(c))
+        {
+            continue;
+        }
+        auto const cursor = c.cursor.load(std::memory_order_relaxed);
+        auto const l      = head > cursor ? head - cursor : 0;
+        if (l > threshold && l > lag)
+        {
+            lag     = l;
+            slowest = static_cast<int>(i);
+        }
+    }
+    return slowest;
+}
+
+auto ShmRing::register_consumer() -> int
+{
+    auto const pid = static_cast<std::int32_t>(::getpid());
+    for (std::size_t i = 0; i < ShmRingHeader::max_consumers; ++i)
+    {
+        auto& c               = header_->consumers[i];
+        std::int32_t expected = 0;
+        if (reclaim_if_gone(c) && c.pid.compare_exchange_strong(expected, pid))
+        {
+            c.overruns.store(0, std::memory_order_relaxed);
+            // New consumers start at the live edge
+            auto const head = header_->head.load(std::memory_order_acquire);
+            c.cursor.store(head, std::memory_order_release);
+            return static_cast<int>(i);
+        }
+    }
+    exit_on_error(-1, Component::consumer, "No free consumer slot in " + name_);
+    return -1;
+}
+
+auto ShmRing::unregister_consumer(int const id) -> void
+{
+    header_->consumers[id].pid.store(0, std::memory_order_release);
+}
+
+auto ShmRing::skip_to_oldest(ShmConsumerSlot& c, std::uint64_t const head) -> void
+{
+    // Leave one slot of headroom, the producer may be writing the oldest one
+    auto const slots  = header_->slot_count;
+    auto const oldest = head > slots ? head - slots + 1 : 0;
+    auto const cursor = c.cursor.load(std::memory_order_relaxed);
+    c.cursor.store(oldest > cursor ? oldest : cursor + 1, std::memory_order_release);
+    c.overruns.fetch_add(1, std::memory_order_relaxed);
+}
@@ -0,0 +1,148 @@
+#ifndef SHM_RING_HPP_W7NC2KZE
+#define SHM_RING_HPP_W7NC2KZE
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "types.hpp"
+
+// Single-producer/multi-consumer broadcast ring in POSIX shared memory.
+//
+// One receiver owns the multicast socket and receives straight into ring
+// slots; every local consumer maps the same segment and walks it with its
+// own cursor.  Slots carry a sequence word (odd while being
+// written) so a consumer can read a datagram in place and afterwards check
+// that the producer did not lap it in the meantime.
+
+/// shm_open() of "/<name>", or a file in /data/local/tmp on Android where
+/// Bionic has no shm_open()
+auto open_shm_segment(std::string const& name, int flags) -> int;
+auto unlink_shm_segment(std::string const& name) -> void;
+
+struct alignas(cache_line_size) ShmConsumerSlot
+{
+    std::atomic<std::uint64_t> cursor{0};
+    std::atomic<std::uint64_t> overruns{0};
+    std::atomic<std::int32_t> pid{0};
+};
+
+struct ShmRingHeader
+{
+    static std::uint32_t constexpr magic_value = 0x42545352; // "BTSR"
+    static std::size_t constexpr max_consumers = 16;
+
+    std::uint32_t magic;
+    std::uint32_t slot_count; // power of two
+    std::uint32_t slot_size;  // payload bytes per slot
+    std::uint32_t reserved;
+
+    alignas(cache_line_size) std::atomic<std::uint64_t> head; // next sequence to write
+    alignas(cache_line_size) ShmConsumerSlot consumers[max_consumers];
+};
+
+struct ShmSlotHeader
+{
+    std::atomic<std::uint64_t> seq; // 2*n+1 while writing n, 2*n+2 once published
+    std::uint32_t len;
+    std::uint32_t reserved;
+    std::uint64_t rx_ns;
+};
+
+class ShmRing
+{
+public:
+    /// Creates (producer) or attaches to (consumer) the named segment.  Exits on error.
+    static auto create(std::string const& name, std::uint32_t slot_count, std::uint32_t slot_size)
+        -> ShmRing;
+    static auto attach(std::string const& name) -> ShmRing;
+
+    ShmRing(ShmRing&& other) noexcept;
+    ShmRing(ShmRing const&)                    = delete;
+    auto operator=(ShmRing const&) -> ShmRing& = delete;
+    auto operator=(ShmRing&&) -> ShmRing&      = delete;
+    ~ShmRing();
+
+    auto header() const -> ShmRingHeader& { return *header_; }
+    auto slot_count() const -> std::uint32_t { return header_->slot_count; }
+    auto slot_size() const -> std::uint32_t { return header_->slot_size; }
+
+    // Producer side.  claim() hands out the payload area of the next slot so
+    // the socket can receive directly into shared memory; publish() makes it
+    // visible to the consumers.
+    auto claim() -> char*;
+    auto publish(std::uint32_t len, std::uint64_t rx_ns) -> void;
+
+    /// Returns the index of the slowest registered consumer lagging by more
+    /// than `threshold` slots, or -1.  Slots of consumers whose process has
+    /// died are freed on the way, register_consumer() does the same.
+    auto slowest_consumer(std::uint64_t threshold, std::uint64_t& lag) const -> int;
+
+    // Consumer side
+    auto register_consumer() -> int;
+    auto unregister_consumer(int id) -> void;
+
+    enum class ReadResult
+    {
+        empty,
+        ok,
+        overrun
+    };
+
+    /// Reads the next datagram for consumer `id` in place.  `fn(data, len,
+    /// rx_ns)` runs against the shared slot; if the producer overwrote the
+    /// slot while `fn` ran the result is `overrun` and the cursor is moved
+    /// to the oldest datagram still in the ring.
+    template <typename Fn> auto read(int id, Fn&& fn) -> ReadResult;
+
+private:
+    ShmRing(std::string name, void* base, std::size_t size, bool owner);
+
+    auto slot(std::uint64_t seq) const -> ShmSlotHeader*;
+    auto skip_to_oldest(ShmConsumerSlot& c, std::uint64_t head) -> void;
+
+    std::string name_;
+    void* base_{nullptr};
+    std::size_t size_{0};
+    bool owner_{false};
+    ShmRingHeader* header_{nullptr};
+    std::size_t stride_{0};
+};
+
+template <typename Fn> auto ShmRing::read(int const id, Fn&& fn) -> ReadResult
+{
+    auto& c         = header_->consumers[id];
+    auto const seq  = c.cursor.load(std::memory_order_relaxed);
+    auto const head = header_->head.load(std::memory_order_acquire);
+    if (seq >= head)
+    {
+        return ReadResult::empty;
+    }
+    if (head - seq > header_->slot_count)
+    {
+        skip_to_oldest(c, head);
+        return ReadResult::overrun;
+    }
+
+    auto* s           = slot(seq);
+    auto const before = s->seq.load(std::memory_order_acquire);
+    if (before != 2 * seq + 2)
+    {
+        skip_to_oldest(c, header_->head.load(std::memory_order_acquire));
+        return ReadResult::overrun;
+    }
+
+    fn(reinterpret_cast<char const*>(s + 1), s->len, s->rx_ns);
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (s->seq.load(std::memory_order_relaxed) != before)
+    {
+        skip_to_oldest(c, header_->head.load(std::memory_order_acquire));
+        return ReadResult::overrun;
+    }
+    c.cursor.store(seq + 1, std::memory_order_release);
+    return ReadResult::ok;
+}
+
+#endif /* end of include guard: SHM_RING_HPP_W7NC2KZE */
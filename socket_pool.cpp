@@ -0,0 +1,190 @@
+#include "socket_pool.hpp"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "binding_functions.hpp"
+#include "timing.hpp"
+
+namespace
+{
+
+/// Records the first failure of `s`: closes the socket and keeps the reason
+auto failed(PooledSocket& s, char const* what) -> void
+{
+    s.error = std::string{what} + ": " + strerror(errno);
+    ::close(s.fd);
+    s.fd = -1;
+}
+
+} // namespace
+
+auto prepare_receiver(PooledSocket& s) -> void
+{
+    auto const start = now_ns();
+    s.error.clear();
+    s.joined = false;
+
+    s.fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    ++s.syscalls;
+    if (s.fd < 0)
+    {
+        s.error = std::string{"socket: "} + strerror(errno);
+        return;
+    }
+
+    int const opt = 1;
+    ++s.syscalls;
+    if (::setsockopt(s.fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt)) < 0)
+    {
+        return failed(s, "SO_REUSEADDR");
+    }
+    ++s.syscalls;
+    if (::setsockopt(s.fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0)
+    {
+        return failed(s, "SO_REUSEPORT");
+    }
+    if (s.target.rcvbuf > 0)
+    {
+        ++s.syscalls;
+        auto const& rcvbuf = s.target.rcvbuf;
+        if (::setsockopt(s.fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)) < 0)
+        {
+            return failed(s, "SO_RCVBUF");
+        }
+    }
+    ++s.syscalls;
+    if (bind_to_device(s.fd, s.target.if_name) < 0)
+    {
+        return failed(s, "SO_BINDTODEVICE");
+    }
+
+    in_addr mc_if_addr;
+    address2in_addr(s.target.if_addr, mc_if_addr);
+    ++s.syscalls;
+    if (::setsockopt(s.fd, IPPROTO_IP, IP_MULTICAST_IF, &mc_if_addr, sizeof(mc_if_addr)) < 0)
+    {
+        return failed(s, "IP_MULTICAST_IF");
+    }
+
+    sockaddr_in group;
+    std::memset(&group, 0, sizeof(group));
+    group.sin_family = AF_INET;
+    address2in_addr(s.target.group, group.sin_addr);
+    group.sin_port = htons(s.target.port);
+    ++s.syscalls;
+    if (::bind(s.fd, reinterpret_cast<sockaddr*>(&group), sizeof(group)) < 0)
+    {
+        return failed(s, "bind");
+    }
+    s.setup_ns += now_ns() - start;
+}
+
+SocketPool::SocketPool(std::vector<PoolTarget> const& targets) : sockets_(targets.size())
+{
+    for (std::size_t i = 0; i < targets.size(); ++i)
+    {
+        auto& s  = sockets_[i];
+        s.target = targets[i];
+        // The interface index lookup happens here, once, and not per join
+        s.req = make_ip_req(s.target.group, s.target.if_addr, s.target.if_name);
+#ifndef __QNX__
+        ++s.syscalls;
+#endif
+        prepare_receiver(s);
+    }
+}
+
+SocketPool::~SocketPool()
+{
+    for (auto& s : sockets_)
+    {
+        if (s.fd >= 0)
+        {
+            ::close(s.fd);
+        }
+    }
+}
+
+auto SocketPool::join_all() -> std::size_t
+{
+    std::size_t failures = 0;
+    for (std::size_t i = 0; i < sockets_.size(); ++i)
+    {
+        if (sockets_[i].fd >= 0 && !sockets_[i].joined && join(i) < 0)
+        {
+            ++failures;
+        }
+    }
+    return failures;
+}
+
+auto SocketPool::join(std::size_t i) -> int
+{
+    auto& s          = sockets_[i];
+    auto const start = now_ns();
+    auto const err   = ::setsockopt(s.fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &s.req, sizeof(s.req));
+    ++s.syscalls;
+    s.setup_ns += now_ns() - start;
+    if (err < 0)
+    {
+        s.error = std::string{"IP_ADD_MEMBERSHIP: "} + strerror(errno);
+        return err;
+    }
+    s.joined = true;
+    return 0;
+}
+
+auto SocketPool::leave(std::size_t i) -> int
+{
+    auto& s        = sockets_[i];
+    auto const err = ::setsockopt(s.fd, IPPROTO_IP, IP_DROP_MEMBERSHIP, &s.req, sizeof(s.req));
+    if (err == 0)
+    {
+        s.joined = false;
+    }
+    return err;
+}
+
+auto SocketPool::rebuild(std::size_t i) -> void
+{
+    auto& s          = sockets_[i];
+    auto const start = now_ns();
+    s.syscalls       = 0;
+    if (s.fd >= 0)
+    {
+        ::close(s.fd);
+        ++s.syscalls;
+        s.fd = -1;
+    }
+    s.req = make_ip_req(s.target.group, s.target.if_addr, s.target.if_name);
+#ifndef __QNX__
+    ++s.syscalls; // the interface index ioctl
+#endif
+    prepare_receiver(s);
+    if (s.fd >= 0)
+    {
+        join(i);
+    }
+    s.setup_ns = now_ns() - start;
+}
+
+auto SocketPool::close(std::size_t i) -> void
+{
+    auto& s = sockets_[i];
+    if (s.fd >= 0)
+    {
+        ::close(s.fd);
+        s.fd     = -1;
+        s.joined = false;
+    }
+}
+
+auto SocketPool::activate(std::size_t i) -> PooledSocket const*
+{
+    sockets_[i].activated_ns = now_ns();
+    return active_.exchange(&sockets_[i], std::memory_order_acq_rel);
+}
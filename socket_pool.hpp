@@ -0,0 +1,94 @@
+#ifndef SOCKET_POOL_HPP_H4XW9CTB
+#define SOCKET_POOL_HPP_H4XW9CTB
+
+#include <netinet/in.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <boost/asio/ip/address.hpp>
+
+#include "types.hpp"
+
+/// Where a pooled socket receives: the group and port on one interface
+struct PoolTarget
+{
+    std::string if_name;
+    boost::asio::ip::address if_addr;
+    boost::asio::ip::address group;
+    short unsigned int port;
+    int rcvbuf; ///< SO_RCVBUF when non-zero
+};
+
+struct PooledSocket
+{
+    int fd{-1};
+    PoolTarget target;
+    IP_REQ req; ///< built once, so a join is one setsockopt
+    bool joined{false};
+    std::string error;             ///< why the socket is not usable, empty when it is
+    std::uint32_t syscalls{0};     ///< spent setting it up, join included
+    std::uint64_t setup_ns{0};     ///< time those took
+    std::uint64_t activated_ns{0}; ///< now_ns() of the last activate()
+};
+
+/// The receiver setup sequence of bind_multicast_receiver() short of the
+/// join (socket, SO_REUSE*, [SO_RCVBUF,] SO_BINDTODEVICE, IP_MULTICAST_IF,
+/// bind to the group) without the logging, counting syscalls into `s`.  A failure is
+/// left in `s.error` with the socket closed, nothing exits.
+auto prepare_receiver(PooledSocket& s) -> void;
+
+/// Receive sockets for a known set of interfaces and groups, all created
+/// and bound ahead of time so switching between them costs at most a join.
+/// One socket is the active one; activate() swaps it with a single atomic
+/// store that receive threads pick up through active().  The pool itself
+/// is set up and reconfigured from one control thread.
+class SocketPool
+{
+public:
+    explicit SocketPool(std::vector<PoolTarget> const& targets);
+    ~SocketPool();
+
+    SocketPool(SocketPool const&)                    = delete;
+    auto operator=(SocketPool const&) -> SocketPool& = delete;
+
+    /// IP_ADD_MEMBERSHIP for every usable socket that is not joined yet, in
+    /// one pass with nothing else in between.  Returns how many failed.
+    auto join_all() -> std::size_t;
+
+    /// One membership change on socket `i`, 0 or the setsockopt error
+    auto join(std::size_t i) -> int;
+    auto leave(std::size_t i) -> int;
+
+    /// Closes socket `i` and sets it up from scratch, join included, the way
+    /// a receiver without a pool has to.  `i` must not be the active one.
+    auto rebuild(std::size_t i) -> void;
+
+    /// Closes socket `i` for good (until a rebuild()), not the active one
+    auto close(std::size_t i) -> void;
+
+    /// Makes socket `i` the active one, returns the previously active
+    /// socket or null
+    auto activate(std::size_t i) -> PooledSocket const*;
+
+    auto active() const -> PooledSocket const*
+    {
+        return active_.load(std::memory_order_acquire);
+    }
+
+    auto operator[](std::size_t i) const -> PooledSocket const& { return sockets_[i]; }
+    auto size() const -> std::size_t { return sockets_.size(); }
+    auto index_of(PooledSocket const* s) const -> std::size_t
+    {
+        return static_cast<std::size_t>(s - sockets_.data());
+    }
+
+private:
+    std::vector<PooledSocket> sockets_; ///< never resized, receivers hold pointers
+    std::atomic<PooledSocket*> active_{nullptr};
+};
+
+#endif /* end of include guard: SOCKET_POOL_HPP_H4XW9CTB */
@@ -0,0 +1,90 @@
+#ifndef SPSC_QUEUE_HPP_R5TGZ1XN
+#define SPSC_QUEUE_HPP_R5TGZ1XN
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+#include "types.hpp"
+
+/// Bounded single-producer/single-consumer queue.  Head and tail live on
+/// their own cache lines, and each side keeps a private copy of the other
+/// side's index so the shared line is only touched when the cached value
+/// says the queue looks full/empty.
+template <typename T> class SpscQueue
+{
+public:
+    /// `capacity` is rounded up to a power of two
+    explicit SpscQueue(std::size_t capacity);
+
+    auto try_push(T const& value) -> bool;
+    auto try_pop(T& value) -> bool;
+
+    auto capacity() const -> std::size_t { return mask_ + 1; }
+    auto size_approx() const -> std::size_t
+    {
+        return tail_.load(std::memory_order_relaxed) - head_.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::vector<T> slots_;
+    std::size_t mask_;
+
+    // Consumer
+    alignas(cache_line_size) std::atomic<std::size_t> head_{0};
+    std::size_t cached_tail_{0};
+
+    // Producer
+    alignas(cache_line_size) std::atomic<std::size_t> tail_{0};
+    std::size_t cached_head_{0};
+};
+
+inline auto round_up_pow2(std::size_t v) -> std::size_t
+{
+    std::size_t p = 1;
+    while (p < v)
+    {
+        p <<= 1;
+    }
+    return p;
+}
+
+template <typename T>
+SpscQueue<T>::SpscQueue(std::size_t const capacity)
+    : slots_(round_up_pow2(capacity)), mask_(slots_.size() - 1)
+{
+}
+
+template <typename T> auto SpscQueue<T>::try_push(T const& value) -> bool
+{
+    auto const tail = tail_.load(std::memory_order_relaxed);
+    if (tail - cached_head_ > mask_)
+    {
+        cached_head_ = head_.load(std::memory_order_acquire);
+        if (tail - cached_head_ > mask_)
+        {
+            return false;
+        }
+    }
+    slots_[tail & mask_] = value;
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+}
+
+template <typename T> auto SpscQueue<T>::try_pop(T& value) -> bool
+{
+    auto const head = head_.load(std::memory_order_relaxed);
+    if (head == cached_tail_)
+    {
+        cached_tail_ = tail_.load(std::memory_order_acquire);
+        if (head == cached_tail_)
+        {
+            return false;
+        }
+    }
+    value = slots_[head & mask_];
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+}
+
+#endif /* end of include guard: SPSC_QUEUE_HPP_R5TGZ1XN */
@@ -0,0 +1,136 @@
+#include "stats.hpp"
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+
+auto LatencyHistogram::bucket_index(std::uint64_t const value) -> std::size_t
+{
+    if (value < sub_bucket_count)
+    {
+        return static_cast<std::size_t>(value);
+    }
+    auto const msb   = 63 - static_cast<std::size_t>(__builtin_clzll(value));
+    auto const shift = msb - sub_bucket_bits;
+    return sub_bucket_count * shift + static_cast<std::size_t>(value >> shift);
+}
+
+auto LatencyHistogram::bucket_lower(std::size_t const index) -> std::uint64_t
+{
+    if (index < sub_bucket_count)
+    {
+        return index;
+    }
+    auto const shift = index / sub_bucket_count - 1;
+    auto const top   = index % sub_bucket_count + sub_bucket_count;
+    return static_cast<std::uint64_t>(top) << shift;
+}
+
+auto LatencyHistogram::record(std::uint64_t const value) -> void
+{
+    ++buckets_[bucket_index(value)];
+    ++count_;
+    sum_ += value;
+    min_ = std::min(min_, value);
+    max_ = std::max(max_, value);
+}
+
+auto LatencyHistogram::record(std::uint64_t const value, std::uint64_t const count) -> void
+{
+    if (count == 0)
+    {
+        return;
+    }
+    buckets_[bucket_index(value)] += count;
+    count_ += count;
+    sum_ += value * count;
+    min_ = std::min(min_, value);
+    max_ = std::max(max_, value);
+}
+
+auto LatencyHistogram::merge(LatencyHistogram const& other) -> void
+{
+    for (std::size_t i = 0; i < bucket_count; ++i)
+    {
+        buckets_[i] += other.buckets_[i];
+    }
+    count_ += other.count_;
+    sum_ += other.sum_;
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+}
+
+auto LatencyHistogram::reset() -> void
+{
+    *this = LatencyHistogram{};
+}
+
+auto LatencyHistogram::percentile(double const p) const -> std::uint64_t
+{
+    if (count_ == 0)
+    {
+        return 0;
+    }
+    auto const target  = static_cast<std::uint64_t>(static_cast<double>(count_) * p / 100.0);
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < bucket_count; ++i)
+    {
+        seen += buckets_[i];
+        if (seen > target)
+        {
+            return std::min(max_, bucket_lower(i + 1) - 1);
+        }
+    }
+    return max_;
+}
+
+auto LatencyHistogram::summary() const -> std::string
+{
+    std::stringstream ss;
+    ss << "n=" << count_ << " min=" << format_ns(min()) << " p50=" << format_ns(percentile(50))
+       << " p90=" << format_ns(percentile(90)) << " p99=" << format_ns(percentile(99))
+       << " p99.9=" << format_ns(percentile(99.9)) << " max=" << format_ns(max_);
+    return ss.str();
+}
+
+auto format_ns(std::uint64_t const ns) -> std::string
+{
+    std::stringstream ss;
+    ss << std::setprecision(3);
+    if (ns < 1000)
+    {
+        ss << ns << "ns";
+    }
+    else if (ns < 1000000)
+    {
+        ss << static_cast<double>(ns) / 1e3 << "us";
+    }
+    else if (ns < 1000000000)
+    {
+        ss << static_cast<double>(ns) / 1e6 << "ms";
+    }
+    else
+    {
+        ss << static_cast<double>(ns) / 1e9 << "s";
+    }
+    return ss.str();
+}
+
+auto format_rate(double const per_second) -> std::string
+{
+    std::stringstream ss;
+    ss << std::setprecision(3);
+    if (per_second >= 1e6)
+    {
+        ss << per_second / 1e6 << "M/s";
+    }
+    else if (per_second >= 1e3)
+    {
+        ss << per_second / 1e3 << "k/s";
+    }
+    else
+    {
+        ss << per_second << "/s";
+    }
+    return ss.str();
+}
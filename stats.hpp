@@ -0,0 +1,55 @@
+#ifndef STATS_HPP_L2XQ9DWA
+#define STATS_HPP_L2XQ9DWA
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/// Log-linear latency histogram: 32 linear sub-buckets per power of two, so
+/// any recorded value is reported within ~3%.  Recording is a couple of
+/// instructions and never allocates, it's safe on the data path.  Not
+/// thread safe, keep one per thread and merge() afterwards.
+class LatencyHistogram
+{
+public:
+    static std::size_t constexpr sub_bucket_bits  = 5;
+    static std::size_t constexpr sub_bucket_count = std::size_t{1} << sub_bucket_bits;
+    static std::size_t constexpr bucket_count     = sub_bucket_count * (64 - sub_bucket_bits + 1);
+
+    auto record(std::uint64_t value) -> void;
+    /// `count` samples of the same value, e.g. to rebuild a histogram from
+    /// bucket counts kept elsewhere
+    auto record(std::uint64_t value, std::uint64_t count) -> void;
+    auto merge(LatencyHistogram const& other) -> void;
+    auto reset() -> void;
+
+    auto count() const -> std::uint64_t { return count_; }
+    auto min() const -> std::uint64_t { return count_ == 0 ? 0 : min_; }
+    auto max() const -> std::uint64_t { return max_; }
+    auto mean() const -> std::uint64_t { return count_ == 0 ? 0 : sum_ / count_; }
+
+    /// Value at percentile `p` (0-100), the upper edge of the containing bucket
+    auto percentile(double p) const -> std::uint64_t;
+
+    /// "n=... min=... p50=... p90=... p99=... p99.9=... max=..."
+    auto summary() const -> std::string;
+
+    static auto bucket_index(std::uint64_t value) -> std::size_t;
+    static auto bucket_lower(std::size_t index) -> std::uint64_t;
+
+private:
+    std::array<std::uint64_t, bucket_count> buckets_{};
+    std::uint64_t count_{0};
+    std::uint64_t sum_{0};
+    std::uint64_t min_{~std::uint64_t{0}};
+    std::uint64_t max_{0};
+};
+
+/// Formats nanoseconds with a sensible unit, e.g. "850ns", "12.4us", "3.10ms"
+auto format_ns(std::uint64_t ns) -> std::string;
+
+/// Formats a per-second rate, e.g. "1.25M/s"
+auto format_rate(double per_second) -> std::string;
+
+#endif /* end of include guard: STATS_HPP_L2XQ9DWA */
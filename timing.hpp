@@ -0,0 +1,26 @@
+#ifndef TIMING_HPP_J4RBV0QC
+#define TIMING_HPP_J4RBV0QC
+
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+
+/// Monotonic nanoseconds.  steady_clock is CLOCK_MONOTONIC on our targets,
+/// so values are comparable between processes on the same host.
+inline auto now_ns() -> std::uint64_t
+{
+    return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                          std::chrono::steady_clock::now().time_since_epoch())
+                                          .count());
+}
+
+/// CPU time of the calling thread, user plus system
+inline auto thread_cpu_ns() -> std::uint64_t
+{
+    timespec ts;
+    ::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return static_cast<std::uint64_t>(ts.tv_sec) * 1000000000 +
+           static_cast<std::uint64_t>(ts.tv_nsec);
+}
+
+#endif /* end of include guard: TIMING_HPP_J4RBV0QC */
@@ -0,0 +1,232 @@
+#include "receive_backend.hpp"
+
+#ifdef __linux__
+
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+
+#include <boost/asio/ip/address.hpp>
+
+#include "logging.hpp"
+#include "timing.hpp"
+
+// AF_PACKET receive path with a TPACKET_V3 ring.  The kernel fills whole
+// blocks of frames in a mapping shared with us and a classic BPF filter
+// keeps only the group/port, so we wake up once per block rather than once
+// per datagram.  This sees what the interface delivers regardless of
+// IP_ADD_MEMBERSHIP or SO_BINDTODEVICE: the NIC is put in all-multicast
+// mode through PACKET_ADD_MEMBERSHIP instead of joining the group.
+//
+// SOCK_DGRAM packet sockets strip the link layer, so both the filter and
+// the parser start at the IP header.
+
+namespace
+{
+
+class TpacketBackend : public ReceiveBackend
+{
+public:
+    TpacketBackend(
+        std::string const& if_name,
+        boost::asio::ip::address const& mc_addr,
+        short unsigned int port,
+        Options const& opts);
+    ~TpacketBackend() override;
+
+    auto name() const -> char const* override { return "tpacket"; }
+    auto poll(DatagramHandler const& handler, int timeout_ms) -> int override;
+    auto report() -> std::string override;
+
+private:
+    auto attach_filter(std::uint32_t group, std::uint16_t port) -> void;
+    auto block(unsigned index) const -> tpacket_block_desc*
+    {
+        return reinterpret_cast<tpacket_block_desc*>(ring_ + index * req_.tp_block_size);
+    }
+
+    int fd_{-1};
+    tpacket_req3 req_;
+    char* ring_{nullptr};
+    std::size_t ring_len_{0};
+    unsigned current_{0};
+    std::uint64_t blocks_{0};
+};
+
+TpacketBackend::TpacketBackend(
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts)
+{
+    auto const ifindex = ::if_nametoindex(if_name.c_str());
+    exit_on_error(ifindex == 0 ? -1 : 0, Component::client, "Unknown interface " + if_name);
+
+    // Protocol 0 receives nothing until bind(), so no unfiltered frames
+    // sneak into the ring before the filter is attached
+    fd_ = ::socket(AF_PACKET, SOCK_DGRAM, 0);
+    exit_on_errno(fd_, Component::client, "AF_PACKET socket");
+
+    attach_filter(mc_addr.to_v4().to_uint(), port);
+
+    int const version = TPACKET_V3;
+    auto err = ::setsockopt(fd_, SOL_PACKET, PACKET_VERSION, &version, sizeof(version));
+    exit_on_error(err, Component::client, "PACKET_VERSION TPACKET_V3");
+
+    auto const block_size = static_cast<unsigned>(opts.get_int("tpacket-block-size", 1 << 20));
+    auto const block_nr   = static_cast<unsigned>(opts.get_int("tpacket-blocks", 16));
+    auto const frame_size = 2048U;
+    std::memset(&req_, 0, sizeof(req_));
+    req_.tp_block_size = block_size;
+    req_.tp_block_nr   = block_nr;
+    req_.tp_frame_size = frame_size;
+    req_.tp_frame_nr   = block_size / frame_size * block_nr;
+    // A partially filled block is handed over after this long anyway
+    req_.tp_retire_blk_tov = static_cast<unsigned>(opts.get_int("tpacket-timeout-ms", 1));
+    err = ::setsockopt(fd_, SOL_PACKET, PACKET_RX_RING, &req_, sizeof(req_));
+    exit_on_errno(err, Component::client, "PACKET_RX_RING");
+
+    ring_len_ = std::size_t{block_size} * block_nr;
+    // clang-format off
+    auto* ring = ::mmap(
+        nullptr,
+        ring_len_,
+        PROT_READ | PROT_WRITE,
+        MAP_SHARED,
+        fd_,
+        0
+    );
+    // clang-format on
+    exit_on_error(ring == MAP_FAILED ? -1 : 0, Component::client, "Could not map packet ring");
+    ring_ = static_cast<char*>(ring);
+
+    if (!opts.has("tpacket-no-allmulti"))
+    {
+        packet_mreq mreq;
+        std::memset(&mreq, 0, sizeof(mreq));
+        mreq.mr_ifindex = static_cast<int>(ifindex);
+        mreq.mr_type    = PACKET_MR_ALLMULTI;
+        err = ::setsockopt(fd_, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq));
+        exit_on_error(err, Component::client, "PACKET_MR_ALLMULTI");
+    }
+
+    sockaddr_ll sll;
+    std::memset(&sll, 0, sizeof(sll));
+    sll.sll_family   = AF_PACKET;
+    sll.sll_protocol = htons(ETH_P_IP);
+    sll.sll_ifindex  = static_cast<int>(ifindex);
+    err              = ::bind(fd_, reinterpret_cast<sockaddr*>(&sll), sizeof(sll));
+    exit_on_errno(err, Component::client, "AF_PACKET bind");
+
+    std::stringstream ss;
+    ss << "TPACKET_V3 ring on " << if_name << ": " << block_nr << " blocks of " << block_size
+       << " bytes, filtering " << mc_addr << ":" << port;
+    info(Component::client, ss.str());
+}
+
+TpacketBackend::~TpacketBackend()
+{
+    ::munmap(ring_, ring_len_);
+    ::close(fd_);
+}
+
+auto TpacketBackend::attach_filter(std::uint32_t const group, std::uint16_t const port) -> void
+{
+    // Classic BPF loads are network order, compare against host values
+    // clang-format off
+    sock_filter code[] = {
+        BPF_STMT(BPF_LDX | BPF_B | BPF_MSH, 0),                 // X = IP header length
+        BPF_STMT(BPF_LD | BPF_B | BPF_ABS, 9),                  // protocol
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, IPPROTO_UDP, 0, 6),
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 16),                 // destination
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, group, 0, 4),
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 6),                  // fragment offset
+        BPF_JUMP(BPF_JMP | BPF_JSET | BPF_K, 0x1fff, 2, 0),
+        BPF_STMT(BPF_LD | BPF_H | BPF_IND, 2),                  // UDP destination port
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, port, 1, 0),
+        BPF_STMT(BPF_RET | BPF_K, 0),
+        BPF_STMT(BPF_RET | BPF_K, 0xffff),
+    };
+    // clang-format on
+
+    sock_fprog prog;
+    prog.len    = sizeof(code) / sizeof(code[0]);
+    prog.filter = code;
+    auto const err = ::setsockopt(fd_, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog));
+    exit_on_errno(err, Component::client, "SO_ATTACH_FILTER");
+}
+
+auto TpacketBackend::poll(DatagramHandler const& handler, int timeout_ms) -> int
+{
+    auto* bd     = block(current_);
+    auto& status = reinterpret_cast<std::atomic<std::uint32_t>&>(bd->hdr.bh1.block_status);
+    if ((status.load(std::memory_order_acquire) & TP_STATUS_USER) == 0)
+    {
+        pollfd pfd{fd_, POLLIN | POLLERR, 0};
+        if (::poll(&pfd, 1, timeout_ms) <= 0 ||
+            (status.load(std::memory_order_acquire) & TP_STATUS_USER) == 0)
+        {
+            return 0;
+        }
+    }
+
+    auto const rx_ns = now_ns();
+    auto const count = static_cast<int>(bd->hdr.bh1.num_pkts);
+    auto* pkt        = reinterpret_cast<char*>(bd) + bd->hdr.bh1.offset_to_first_pkt;
+    for (int i = 0; i < count; ++i)
+    {
+        auto const* hdr = reinterpret_cast<tpacket3_hdr const*>(pkt);
+        auto const* ip  = reinterpret_cast<unsigned char const*>(pkt + hdr->tp_net);
+        auto const ihl  = static_cast<std::size_t>(ip[0] & 0x0f) * 4;
+
+        std::uint16_t udp_len = 0;
+        std::memcpy(&udp_len, ip + ihl + 4, sizeof(udp_len));
+        auto const captured = hdr->tp_snaplen > ihl + 8 ? hdr->tp_snaplen - ihl - 8 : 0;
+        auto const payload  = std::min<std::size_t>(ntohs(udp_len) - 8U, captured);
+        handler(Datagram{reinterpret_cast<char const*>(ip + ihl + 8), payload, rx_ns});
+
+        pkt += hdr->tp_next_offset;
+    }
+
+    status.store(TP_STATUS_KERNEL, std::memory_order_release);
+    current_ = (current_ + 1) % req_.tp_block_nr;
+    ++blocks_;
+    return count;
+}
+
+auto TpacketBackend::report() -> std::string
+{
+    tpacket_stats_v3 st;
+    socklen_t len  = sizeof(st);
+    auto const err = ::getsockopt(fd_, SOL_PACKET, PACKET_STATISTICS, &st, &len);
+    exit_on_error(err, Component::client, "PACKET_STATISTICS");
+
+    std::stringstream ss;
+    ss << "blocks=" << blocks_ << " kernel drops=" << st.tp_drops
+       << " queue freezes=" << st.tp_freeze_q_cnt;
+    return ss.str();
+}
+
+} // namespace
+
+auto make_tpacket_backend(
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> std::unique_ptr<ReceiveBackend>
+{
+    return std::make_unique<TpacketBackend>(if_name, mc_addr, port, opts);
+}
+
+#endif
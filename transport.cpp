@@ -0,0 +1,186 @@
+#include "transport.hpp"
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+
+#include <boost/asio/ip/address.hpp>
+
+#include "adaptive_wait.hpp"
+#include "binding_functions.hpp"
+#include "buffer_pool.hpp"
+#include "logging.hpp"
+#include "spsc_queue.hpp"
+#include "timing.hpp"
+#include "tx_backpressure.hpp"
+
+namespace
+{
+
+class SocketTransport : public Transport
+{
+public:
+    explicit SocketTransport(int sock_fd, std::unique_ptr<TxBackpressure> pressure = nullptr)
+        : sock_fd_(sock_fd), pressure_(std::move(pressure))
+    {
+    }
+    ~SocketTransport() override { ::close(sock_fd_); }
+
+    auto name() const -> char const* override { return "socket"; }
+
+    auto send(char const* data, std::size_t len) -> ssize_t override
+    {
+        if (pressure_)
+        {
+            return pressure_->send(data, len) ? static_cast<ssize_t>(len) : 0;
+        }
+        return ::send(sock_fd_, data, len, 0);
+    }
+
+    auto receive(char* data, std::size_t len, int timeout_ms) -> ssize_t override
+    {
+        pollfd pfd{sock_fd_, POLLIN, 0};
+        auto const ready = ::poll(&pfd, 1, timeout_ms);
+        if (ready <= 0)
+        {
+            errno = ready == 0 ? EAGAIN : errno;
+            return -1;
+        }
+        return ::recv(sock_fd_, data, len, MSG_DONTWAIT);
+    }
+
+    auto report() const -> std::string override
+    {
+        return pressure_ ? "transmit backpressure: " + pressure_->summary() : std::string{};
+    }
+
+private:
+    int sock_fd_;
+    std::unique_ptr<TxBackpressure> pressure_;
+};
+
+/// What both ends of the memory transport share: datagrams are copied into
+/// a BufferPool slot and handed over by index through an SPSC ring
+struct MemoryRing
+{
+    MemoryRing(std::size_t slots, std::size_t slot_size, bool huge_pages)
+        : pool(slots, slot_size, huge_pages), queue(slots)
+    {
+    }
+
+    BufferPool pool;
+    SpscQueue<PacketDesc> queue;
+    AdaptiveWaiter waiter;
+};
+
+class MemoryTransport : public Transport
+{
+public:
+    explicit MemoryTransport(std::shared_ptr<MemoryRing> ring) : ring_(std::move(ring)) {}
+
+    auto name() const -> char const* override { return "memory"; }
+
+    auto send(char const* data, std::size_t len) -> ssize_t override
+    {
+        if (len > ring_->pool.buffer_size())
+        {
+            errno = EMSGSIZE;
+            return -1;
+        }
+        std::uint32_t handle;
+        if (!ring_->pool.acquire(handle))
+        {
+            errno = ENOBUFS;
+            return -1;
+        }
+        std::memcpy(ring_->pool.data(handle), data, len);
+        // As many ring slots as buffers, a buffer in hand always fits
+        ring_->queue.try_push(PacketDesc{handle, static_cast<std::uint32_t>(len), now_ns()});
+        ring_->waiter.notify_one();
+        return static_cast<ssize_t>(len);
+    }
+
+    auto receive(char* data, std::size_t len, int timeout_ms) -> ssize_t override
+    {
+        PacketDesc desc;
+        auto const deadline = now_ns() + static_cast<std::uint64_t>(timeout_ms) * 1000000;
+        auto got            = ring_->queue.try_pop(desc);
+        if (!got && timeout_ms > 0)
+        {
+            got = ring_->waiter.wait_until(deadline, [&] { return ring_->queue.try_pop(desc); });
+        }
+        if (!got)
+        {
+            errno = EAGAIN;
+            return -1;
+        }
+        auto const n = std::min<std::size_t>(desc.len, len);
+        std::memcpy(data, ring_->pool.data(desc.handle), n);
+        ring_->pool.release(desc.handle);
+        return static_cast<ssize_t>(n);
+    }
+
+private:
+    std::shared_ptr<MemoryRing> ring_;
+};
+
+} // namespace
+
+auto make_transport(
+    std::string const& kind,
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> TransportPair
+{
+    if (kind == "memory")
+    {
+        auto const slots     = static_cast<std::size_t>(opts.get_int("transport-slots", 1024));
+        auto const slot_size = static_cast<std::size_t>(opts.get_int("transport-slot-size", 2048));
+        auto ring = std::make_shared<MemoryRing>(slots, slot_size, opts.has("huge-pages"));
+
+        std::stringstream ss;
+        ss << "In-memory transport, " << slots << " slots of " << slot_size << " bytes";
+        info(Component::main, ss.str());
+        return {std::make_unique<MemoryTransport>(ring), std::make_unique<MemoryTransport>(ring)};
+    }
+    exit_on_error(kind == "socket" ? 0 : -1, Component::main, "Unknown transport " + kind);
+
+    auto const send_fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    exit_on_error(send_fd, Component::server, "socket");
+    auto const dest =
+        bind_multicast_sender(send_fd, Component::server, if_addr, if_name, mc_addr, port);
+    set_qos(
+        send_fd,
+        Component::server,
+        static_cast<int>(opts.get_int("priority", 0)),
+        static_cast<int>(opts.get_int("dscp", 0)));
+    connect_to(send_fd, Component::server, dest);
+    std::unique_ptr<TxBackpressure> pressure;
+    if (opts.has("tx-policy"))
+    {
+        pressure = std::make_unique<TxBackpressure>(send_fd, Component::server, if_name, opts);
+    }
+
+    auto const recv_fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    exit_on_error(recv_fd, Component::client, "socket");
+    if (opts.has("rcvbuf"))
+    {
+        int const rcvbuf = static_cast<int>(opts.get_int("rcvbuf", 0));
+        exit_on_error(
+            ::setsockopt(recv_fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf)),
+            Component::client,
+            "SO_RCVBUF");
+    }
+    bind_multicast_receiver(recv_fd, Component::client, if_addr, if_name, mc_addr, port);
+
+    return {
+        std::make_unique<SocketTransport>(send_fd, std::move(pressure)),
+        std::make_unique<SocketTransport>(recv_fd)};
+}
@@ -0,0 +1,60 @@
+#ifndef TRANSPORT_HPP_N6DH3QXW
+#define TRANSPORT_HPP_N6DH3QXW
+
+#include <sys/types.h>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include "options.hpp"
+
+namespace boost::asio::ip
+{
+class address;
+}
+
+/// One end of the path between the multicast server and client.  The socket
+/// transport is the real thing; the memory transport replaces the kernel by
+/// a lock-free ring between the two threads, so the same components can be
+/// run deterministically and their own per-datagram cost measured alone.
+/// Calls follow the socket ones: bytes or -1 with errno set.
+class Transport
+{
+public:
+    virtual ~Transport() = default;
+
+    virtual auto name() const -> char const* = 0;
+
+    /// One datagram to the group; ENOBUFS when the memory ring is full.
+    /// 0 when --tx-policy=shed dropped it under transmit pressure.
+    virtual auto send(char const* data, std::size_t len) -> ssize_t = 0;
+
+    /// Waits up to `timeout_ms` for one datagram, EAGAIN when none came.
+    /// Longer datagrams are truncated to `len`, like recv().
+    virtual auto receive(char* data, std::size_t len, int timeout_ms) -> ssize_t = 0;
+
+    /// Transport specific counters for the final log, empty if none
+    virtual auto report() const -> std::string { return {}; }
+};
+
+/// Sender and receiver end of one group
+struct TransportPair
+{
+    std::unique_ptr<Transport> sender;
+    std::unique_ptr<Transport> receiver;
+};
+
+/// `kind` is "socket" (a bound multicast sender and receiver on the
+/// interface) or "memory" (--transport-slots, --transport-slot-size).  With
+/// --tx-policy the socket sender goes through TxBackpressure and backs off
+/// or sheds when the queues fill up instead of failing.  Exits on error.
+auto make_transport(
+    std::string const& kind,
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> TransportPair;
+
+#endif /* end of include guard: TRANSPORT_HPP_N6DH3QXW */
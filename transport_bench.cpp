@@ -0,0 +1,187 @@
+#include "components.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/ip/address.hpp>
+
+#include "crc32c.hpp"
+#include "integrity.hpp"
+#include "logging.hpp"
+#include "realtime.hpp"
+#include "stats.hpp"
+#include "timing.hpp"
+#include "transport.hpp"
+
+// The same send/receive loop over the socket and the memory transport.  With
+// the kernel out of the picture what is left is our own per-datagram cost;
+// the difference between the two is what the kernel adds.
+
+namespace
+{
+
+struct BenchResult
+{
+    std::uint64_t sent{0};
+    std::uint64_t received{0};
+    std::uint64_t send_errors{0}; ///< ENOBUFS/EAGAIN
+    std::uint64_t damaged{0};     ///< failed integrity_check(), with --integrity
+    std::uint64_t send_cpu_ns{0};
+    std::uint64_t receive_cpu_ns{0};
+    std::uint64_t elapsed_ns{0};
+};
+
+auto per_datagram(std::uint64_t cpu_ns, std::uint64_t count) -> std::uint64_t
+{
+    return count == 0 ? 0 : cpu_ns / count;
+}
+
+/// Sender and receiver take turns, one --batch at a time, and only their
+/// own turn is timed: neither side's CPU time includes waiting for the other.
+/// With --integrity both turns include building and checking the CRC32C.
+auto run_bench(
+    std::string const& kind,
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> BenchResult
+{
+    auto const count   = static_cast<std::uint64_t>(opts.get_int("count", 1000000));
+    auto const payload = static_cast<std::size_t>(opts.get_int("payload", 64));
+    auto const batch   = static_cast<std::uint64_t>(std::max(1LL, opts.get_int("batch", 256)));
+    auto const checked = opts.has("integrity");
+    exit_on_error(
+        payload >= sizeof(std::uint64_t) ? 0 : -1, Component::main, "--payload must hold a seq");
+    auto transports = make_transport(kind, if_addr, if_name, mc_addr, port, opts);
+    auto const batches = (count + batch - 1) / batch;
+
+    BenchResult result;
+    std::atomic<std::uint64_t> batches_sent{0};
+    std::atomic<std::uint64_t> batches_received{0};
+    auto const wait_for = [](std::atomic<std::uint64_t> const& counter, std::uint64_t value) {
+        while (counter.load(std::memory_order_acquire) < value)
+        {
+            std::this_thread::yield();
+        }
+    };
+
+    auto const client_tuning = thread_tuning_from_options(opts, "client");
+    auto receiver            = std::thread([&] {
+        apply_thread_tuning(Component::client, client_tuning);
+        std::vector<char> buffer(65536);
+        for (std::uint64_t b = 0; b < batches; ++b)
+        {
+            wait_for(batches_sent, b + 1);
+            auto const expected = std::min(batch, count - b * batch);
+            auto const cpu      = thread_cpu_ns();
+            // What the kernel dropped never shows up, a short timeout ends the batch
+            for (std::uint64_t i = 0; i < expected; ++i)
+            {
+                auto const n = transports.receiver->receive(buffer.data(), buffer.size(), 20);
+                if (n < 0)
+                {
+                    break;
+                }
+                ++result.received;
+                std::uint64_t seq = 0;
+                if (checked &&
+                    integrity_check(buffer.data(), static_cast<std::size_t>(n), seq) !=
+                        IntegrityResult::ok)
+                {
+                    ++result.damaged;
+                }
+            }
+            result.receive_cpu_ns += thread_cpu_ns() - cpu;
+            batches_received.store(b + 1, std::memory_order_release);
+        }
+    });
+
+    apply_thread_tuning(Component::server, thread_tuning_from_options(opts, "server"));
+    std::vector<char> buffer(checked ? sizeof(IntegrityHeader) + payload : payload, 0);
+    auto const start = now_ns();
+    std::uint64_t seq = 0;
+    for (std::uint64_t b = 0; b < batches; ++b)
+    {
+        wait_for(batches_received, b);
+        auto const cpu = thread_cpu_ns();
+        for (auto const end = std::min(seq + batch, count); seq < end; ++seq)
+        {
+            if (checked)
+            {
+                integrity_fill(buffer.data(), payload, seq);
+            }
+            else
+            {
+                std::memcpy(buffer.data(), &seq, sizeof(seq));
+            }
+            if (transports.sender->send(buffer.data(), buffer.size()) < 0)
+            {
+                // A batch fits the ring, only the kernel can refuse
+                exit_on_errno(
+                    errno == ENOBUFS || errno == EAGAIN ? 0 : -1,
+                    Component::server,
+                    "send");
+                ++result.send_errors;
+                continue;
+            }
+            ++result.sent;
+        }
+        result.send_cpu_ns += thread_cpu_ns() - cpu;
+        batches_sent.store(b + 1, std::memory_order_release);
+    }
+    receiver.join();
+    result.elapsed_ns = now_ns() - start;
+
+    std::stringstream ss;
+    ss << kind << ": " << result.sent << " sent, " << result.received << " received ("
+       << result.sent - result.received << " lost, " << result.send_errors << " send errors";
+    if (checked)
+    {
+        ss << ", " << result.damaged << " damaged, CRC32C " << crc32c_implementation();
+    }
+    ss << ") in "
+       << format_ns(result.elapsed_ns) << " of batches of " << batch
+       << "; CPU per datagram: send " << format_ns(per_datagram(result.send_cpu_ns, result.sent))
+       << ", receive " << format_ns(per_datagram(result.receive_cpu_ns, result.received));
+    info(Component::main, ss.str());
+    return result;
+}
+
+} // namespace
+
+auto transport_bench(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void
+{
+    auto const kind = opts.get("transport", "both");
+    if (kind != "both")
+    {
+        run_bench(kind, if_addr, if_name, mc_addr, port, opts);
+        return;
+    }
+
+    auto const memory = run_bench("memory", if_addr, if_name, mc_addr, port, opts);
+    auto const socket = run_bench("socket", if_addr, if_name, mc_addr, port, opts);
+
+    // Userspace cost is what the memory run measured; the rest is the kernel's
+    auto const kernel = [](std::uint64_t with, std::uint64_t without) {
+        return with > without ? with - without : 0;
+    };
+    auto const user_send    = per_datagram(memory.send_cpu_ns, memory.sent);
+    auto const user_receive = per_datagram(memory.receive_cpu_ns, memory.received);
+    std::stringstream ss;
+    ss << "userspace " << format_ns(user_send) << " send + " << format_ns(user_receive)
+       << " receive per datagram, the kernel adds "
+       << format_ns(kernel(per_datagram(socket.send_cpu_ns, socket.sent), user_send)) << " + "
+       << format_ns(kernel(per_datagram(socket.receive_cpu_ns, socket.received), user_receive));
+    info(Component::main, ss.str());
+}
@@ -0,0 +1,341 @@
+#include "tx_backpressure.hpp"
+
+#include <fcntl.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/gen_stats.h>
+#include <linux/netlink.h>
+#include <linux/pkt_sched.h>
+#include <linux/rtnetlink.h>
+#include <linux/sockios.h>
+#endif
+
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <thread>
+
+#include "adaptive_wait.hpp"
+#include "logging.hpp"
+#include "timing.hpp"
+
+namespace
+{
+
+auto parse_policy(std::string const& name) -> PressurePolicy
+{
+    if (name == "shed")
+    {
+        return PressurePolicy::shed;
+    }
+    if (name == "adapt")
+    {
+        return PressurePolicy::adapt;
+    }
+    exit_on_error(name == "backoff" ? 0 : -1, Component::main, "Unknown --tx-policy " + name);
+    return PressurePolicy::backoff;
+}
+
+// Below this the adapt policy stops cutting, some traffic always gets out
+double constexpr min_rate = 100;
+
+} // namespace
+
+auto policy_to_str(PressurePolicy const policy) -> char const*
+{
+    switch (policy)
+    {
+        case PressurePolicy::backoff:
+            return "backoff";
+        case PressurePolicy::shed:
+            return "shed";
+        case PressurePolicy::adapt:
+            return "adapt";
+    }
+    return "?";
+}
+
+TxBackpressure::TxBackpressure(
+    int const fd,
+    Component const c,
+    std::string const& if_name,
+    Options const& opts)
+    : fd_(fd), c_(c), if_index_(::if_nametoindex(if_name.c_str()))
+{
+    auto const flags = ::fcntl(fd_, F_GETFL, 0);
+    exit_on_error(::fcntl(fd_, F_SETFL, flags | O_NONBLOCK), c_, "O_NONBLOCK");
+
+    int sndbuf           = 0;
+    socklen_t sndbuf_len = sizeof(sndbuf);
+    ::getsockopt(fd_, SOL_SOCKET, SO_SNDBUF, &sndbuf, &sndbuf_len);
+
+    policy_         = parse_policy(opts.get("tx-policy", "backoff"));
+    outq_high_      = static_cast<int>(opts.get_int("tx-outq-high", sndbuf / 2));
+    qdisc_high_     = static_cast<long>(opts.get_int("tx-qdisc-high", 1000));
+    check_ns_       = static_cast<std::uint64_t>(opts.get_int("tx-check-us", 100)) * 1000;
+    backoff_max_ns_ = static_cast<std::uint64_t>(opts.get_int("tx-backoff-max-us", 1000)) * 1000;
+    max_rate_       = opts.get_double("tx-rate", 0);
+    rate_           = max_rate_;
+    start_ns_       = now_ns();
+
+#ifdef __linux__
+    netlink_fd_ = ::socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (netlink_fd_ < 0 || if_index_ == 0)
+    {
+        warn(c_, "No qdisc backlog for " + if_name + ", watching the socket queue only");
+    }
+#endif
+
+    std::stringstream ss;
+    ss << "Transmit backpressure: policy " << policy_to_str(policy_) << ", outq high "
+       << outq_high_ << " of " << sndbuf << " bytes, qdisc high " << qdisc_high_ << " packets";
+    info(c_, ss.str());
+}
+
+TxBackpressure::~TxBackpressure()
+{
+    if (netlink_fd_ >= 0)
+    {
+        ::close(netlink_fd_);
+    }
+}
+
+auto TxBackpressure::send(void const* data, std::size_t len) -> bool
+{
+    for (;;)
+    {
+        auto now = now_ns();
+        if (policy_ == PressurePolicy::adapt && rate_ > 0)
+        {
+            pace(now);
+            now = now_ns();
+        }
+        if (now >= next_check_ns_)
+        {
+            pressure_      = under_pressure(now);
+            next_check_ns_ = now + check_ns_;
+        }
+
+        if (!pressure_)
+        {
+            auto const n = ::send(fd_, data, len, 0);
+            if (n >= 0)
+            {
+                ++counters_.sent;
+                backoff_ns_ = 0;
+                return true;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK)
+            {
+                ++counters_.would_block;
+            }
+            else if (errno == ENOBUFS)
+            {
+                ++counters_.no_buffers;
+            }
+            else
+            {
+                exit_on_errno(-1, c_, "send");
+            }
+        }
+
+        if (policy_ == PressurePolicy::shed)
+        {
+            // Stays shedding until the next queue check says otherwise
+            pressure_ = true;
+            ++counters_.shed;
+            return false;
+        }
+        if (policy_ == PressurePolicy::adapt)
+        {
+            on_pressure();
+            if (rate_ > min_rate)
+            {
+                next_check_ns_ = 0;
+                continue;
+            }
+        }
+
+        ++counters_.backoffs;
+        backoff_ns_ = std::min(std::max(backoff_ns_ * 2, std::uint64_t{1000}), backoff_max_ns_);
+        std::this_thread::sleep_for(std::chrono::nanoseconds(backoff_ns_));
+        next_check_ns_ = 0;
+    }
+}
+
+auto TxBackpressure::outq() const -> int
+{
+#ifdef __linux__
+    int queued = 0;
+    if (::ioctl(fd_, SIOCOUTQ, &queued) == 0)
+    {
+        return queued;
+    }
+#endif
+    return -1;
+}
+
+auto TxBackpressure::qdisc_backlog() -> long
+{
+#ifdef __linux__
+    if (netlink_fd_ < 0 || if_index_ == 0)
+    {
+        return -1;
+    }
+
+    struct
+    {
+        nlmsghdr header;
+        tcmsg tc;
+    } request{};
+    // A get of the root qdisc, newer kernels answer it only with NLM_F_ECHO
+    request.header.nlmsg_len   = NLMSG_LENGTH(sizeof(tcmsg));
+    request.header.nlmsg_type  = RTM_GETQDISC;
+    request.header.nlmsg_flags = NLM_F_REQUEST | NLM_F_ECHO;
+    request.header.nlmsg_seq   = ++netlink_seq_;
+    request.tc.tcm_family      = AF_UNSPEC;
+    request.tc.tcm_ifindex     = static_cast<int>(if_index_);
+    request.tc.tcm_parent      = TC_H_ROOT;
+    if (::send(netlink_fd_, &request, request.header.nlmsg_len, MSG_DONTWAIT) < 0)
+    {
+        return -1;
+    }
+
+    // Only the root qdisc of our device (mq and friends report their
+    // children's sum there), not a dump of every device.  The kernel answers
+    // before send() returns, so the receive never has to wait; an answer to
+    // an older request that was given up on is skipped.
+    long backlog = -1;
+    std::array<char, 16384> buffer;
+    for (;;)
+    {
+        auto len = static_cast<int>(
+            ::recv(netlink_fd_, buffer.data(), buffer.size(), MSG_DONTWAIT));
+        if (len <= 0)
+        {
+            return backlog;
+        }
+        for (auto* msg = reinterpret_cast<nlmsghdr*>(buffer.data()); NLMSG_OK(msg, len);
+             msg       = NLMSG_NEXT(msg, len))
+        {
+            if (msg->nlmsg_seq != netlink_seq_)
+            {
+                continue;
+            }
+            auto const* tc = static_cast<tcmsg const*>(NLMSG_DATA(msg));
+            if (msg->nlmsg_type != RTM_NEWQDISC)
+            {
+                return backlog;
+            }
+
+            auto attr_len = static_cast<int>(TCA_PAYLOAD(msg));
+            for (auto* attr = TCA_RTA(tc); RTA_OK(attr, attr_len); attr = RTA_NEXT(attr, attr_len))
+            {
+                if (attr->rta_type != TCA_STATS2)
+                {
+                    continue;
+                }
+                auto nested_len = static_cast<int>(RTA_PAYLOAD(attr));
+                for (auto* stats = static_cast<rtattr*>(RTA_DATA(attr)); RTA_OK(stats, nested_len);
+                     stats       = RTA_NEXT(stats, nested_len))
+                {
+                    if (stats->rta_type == TCA_STATS_QUEUE)
+                    {
+                        gnet_stats_queue queue;
+                        std::memcpy(&queue, RTA_DATA(stats), sizeof(queue));
+                        backlog = static_cast<long>(queue.qlen);
+                    }
+                }
+            }
+            return backlog;
+        }
+    }
+#else
+    return -1;
+#endif
+}
+
+auto TxBackpressure::summary() const -> std::string
+{
+    std::stringstream ss;
+    ss << "sent " << counters_.sent << ", shed " << counters_.shed << ", EAGAIN "
+       << counters_.would_block << ", ENOBUFS " << counters_.no_buffers << ", outq high "
+       << counters_.outq_high << ", qdisc high " << counters_.qdisc_high << ", backoffs "
+       << counters_.backoffs << ", rate cuts " << counters_.rate_cuts;
+    return ss.str();
+}
+
+auto TxBackpressure::under_pressure(std::uint64_t const now) -> bool
+{
+    auto const queued = outq();
+    if (queued > outq_high_)
+    {
+        ++counters_.outq_high;
+        return true;
+    }
+
+    // A netlink round trip costs more than the ioctl, look at the qdisc a
+    // tenth as often
+    if (++checks_ % 10 == 0 && qdisc_backlog() > qdisc_high_)
+    {
+        ++counters_.qdisc_high;
+        return true;
+    }
+
+    // Additive increase: a fixed 5% of the ceiling per millisecond without
+    // pressure, up to the ceiling and no further
+    if (policy_ == PressurePolicy::adapt && rate_ > 0 && now - last_cut_ns_ >= 1000000)
+    {
+        rate_        = std::min(max_rate_, rate_ + max_rate_ / 20);
+        last_cut_ns_ = now;
+    }
+    return false;
+}
+
+auto TxBackpressure::on_pressure() -> void
+{
+    // Multiplicative decrease, at most once per millisecond so one burst of
+    // full queues does not take the rate down to the floor
+    auto const now = now_ns();
+    if (now - last_cut_ns_ < 1000000)
+    {
+        return;
+    }
+    if (rate_ <= 0)
+    {
+        // Unlimited so far: the rate actually achieved becomes the ceiling,
+        // and we start from half of it
+        auto const elapsed  = static_cast<double>(now - start_ns_) / 1e9;
+        auto const achieved = elapsed > 0 ? static_cast<double>(counters_.sent) / elapsed : 0.0;
+        max_rate_           = std::max(achieved, 2 * min_rate);
+        rate_               = max_rate_;
+    }
+    rate_        = std::max(min_rate, rate_ / 2);
+    last_cut_ns_ = now;
+    ++counters_.rate_cuts;
+}
+
+auto TxBackpressure::pace(std::uint64_t const now) -> void
+{
+    auto const interval = static_cast<std::uint64_t>(1e9 / rate_);
+    // After an idle period start afresh instead of bursting to catch up
+    if (next_send_ns_ + 1000000 < now)
+    {
+        next_send_ns_ = now;
+    }
+    if (next_send_ns_ > now + 50000)
+    {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(next_send_ns_ - now));
+    }
+    while (now_ns() < next_send_ns_)
+    {
+        cpu_relax();
+    }
+    next_send_ns_ += interval;
+}
@@ -0,0 +1,100 @@
+#ifndef TX_BACKPRESSURE_HPP_K7RM2QXE
+#define TX_BACKPRESSURE_HPP_K7RM2QXE
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#include "components.hpp"
+#include "options.hpp"
+
+/// What a sender does when the socket or the device queue is full
+enum class PressurePolicy
+{
+    backoff, ///< sleep with exponential backoff, then try again
+    shed,    ///< drop the datagram and carry on
+    adapt    ///< halve the send rate, grow it back while the queues stay short
+};
+
+struct PressureCounters
+{
+    std::uint64_t sent{0};
+    std::uint64_t shed{0};
+    std::uint64_t would_block{0}; ///< EAGAIN/EWOULDBLOCK from send()
+    std::uint64_t no_buffers{0};  ///< ENOBUFS from send()
+    std::uint64_t outq_high{0};   ///< SIOCOUTQ above --tx-outq-high
+    std::uint64_t qdisc_high{0};  ///< qdisc backlog above --tx-qdisc-high
+    std::uint64_t backoffs{0};
+    std::uint64_t rate_cuts{0};
+};
+
+/// Non-blocking send() on a connected UDP socket that survives overload.
+/// Before sending it samples the socket send queue (SIOCOUTQ) and the root
+/// qdisc backlog of `if_name` (rtnetlink), and a send() failing with
+/// EAGAIN/ENOBUFS is taken as pressure too.  Pressure is handled by policy
+/// instead of exiting, every event is counted.  Options:
+/// --tx-policy=backoff|shed|adapt  --tx-outq-high=<bytes> (half of SO_SNDBUF)
+/// --tx-qdisc-high=<packets>  --tx-backoff-max-us  --tx-check-us
+/// --tx-rate=<datagrams/s> (starting rate and ceiling for adapt, 0 = unlimited
+/// until the first cut, then the rate reached until then)
+/// The queue depths are Linux only, elsewhere only send() errors count.
+class TxBackpressure
+{
+public:
+    TxBackpressure(int fd, Component c, std::string const& if_name, Options const& opts);
+    ~TxBackpressure();
+
+    TxBackpressure(TxBackpressure const&)                    = delete;
+    auto operator=(TxBackpressure const&) -> TxBackpressure& = delete;
+
+    /// Returns false when the datagram was shed
+    auto send(void const* data, std::size_t len) -> bool;
+
+    auto counters() const -> PressureCounters const& { return counters_; }
+    auto policy() const -> PressurePolicy { return policy_; }
+
+    /// Current adapt rate in datagrams/s, 0 when unlimited
+    auto rate() const -> double { return rate_; }
+
+    /// Bytes in the socket send queue, -1 if unknown
+    auto outq() const -> int;
+
+    /// Packets queued in the root qdisc of the interface, -1 if unknown
+    auto qdisc_backlog() -> long;
+
+    /// One line of counters for the log
+    auto summary() const -> std::string;
+
+private:
+    auto under_pressure(std::uint64_t now) -> bool;
+    auto on_pressure() -> void;
+    auto pace(std::uint64_t now) -> void;
+
+    int fd_;
+    Component c_;
+    unsigned if_index_{0};
+    int netlink_fd_{-1};
+    std::uint32_t netlink_seq_{0};
+
+    PressurePolicy policy_{PressurePolicy::backoff};
+    int outq_high_{0};
+    long qdisc_high_{0};
+    std::uint64_t check_ns_{0};
+    std::uint64_t backoff_max_ns_{0};
+    std::uint64_t backoff_ns_{0};
+
+    double rate_{0};
+    double max_rate_{0};
+    std::uint64_t next_send_ns_{0};
+    std::uint64_t next_check_ns_{0};
+    std::uint64_t last_cut_ns_{0};
+    std::uint64_t start_ns_{0};
+    std::uint64_t checks_{0};
+    bool pressure_{false};
+
+    PressureCounters counters_;
+};
+
+auto policy_to_str(PressurePolicy policy) -> char const*;
+
+#endif /* end of include guard: TX_BACKPRESSURE_HPP_K7RM2QXE */
@@ -0,0 +1,109 @@
+#include "components.hpp"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/ip/address.hpp>
+
+#include "adaptive_wait.hpp"
+#include "binding_functions.hpp"
+#include "logging.hpp"
+#include "stats.hpp"
+#include "timing.hpp"
+#include "tx_backpressure.hpp"
+
+// Overload test for the transmit path: offers --rate datagrams/s (0 = as fast
+// as the loop goes) to the group through TxBackpressure and shows, once a
+// second, how the send queue, the qdisc and the chosen policy react.
+
+auto tx_pressure(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void
+{
+    auto const duration = std::chrono::duration<double>(opts.get_double("duration", 10.0));
+    auto const offered  = opts.get_double("rate", 0);
+    auto const payload  = static_cast<std::size_t>(opts.get_int("payload", 1200));
+
+    auto const fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    exit_on_error(fd, Component::server, "socket");
+    if (opts.has("sndbuf"))
+    {
+        // A small send buffer makes the socket queue the first to fill up
+        int const sndbuf = static_cast<int>(opts.get_int("sndbuf", 0));
+        exit_on_error(
+            ::setsockopt(fd, SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf)),
+            Component::server,
+            "SO_SNDBUF");
+    }
+    auto const dest = bind_multicast_sender(fd, Component::server, if_addr, if_name, mc_addr, port);
+    connect_to(fd, Component::server, dest);
+
+    TxBackpressure sender(fd, Component::server, if_name, opts);
+
+    std::vector<char> buffer(std::max(payload, sizeof(std::uint64_t)), 0);
+    std::uint64_t seq = 0;
+
+    auto const interval = offered > 0 ? static_cast<std::uint64_t>(1e9 / offered) : 0;
+    auto const start    = now_ns();
+    auto const end      = start + static_cast<std::uint64_t>(duration.count() * 1e9);
+    auto next_send      = start;
+    auto next_report    = start + 1000000000;
+    auto last           = sender.counters();
+    while (now_ns() < end)
+    {
+        if (interval > 0)
+        {
+            // Sleep through long gaps, spin politely through the last bit
+            auto const now = now_ns();
+            if (next_send > now + 50000)
+            {
+                std::this_thread::sleep_for(std::chrono::nanoseconds(next_send - now - 50000));
+            }
+            while (now_ns() < next_send)
+            {
+                cpu_relax();
+            }
+            next_send += interval;
+        }
+
+        std::memcpy(buffer.data(), &seq, sizeof(seq));
+        ++seq;
+        sender.send(buffer.data(), buffer.size());
+
+        auto const now = now_ns();
+        if (now >= next_report)
+        {
+            next_report += 1000000000;
+            auto const& c = sender.counters();
+            std::stringstream ss;
+            ss << "sent " << format_rate(static_cast<double>(c.sent - last.sent)) << ", shed "
+               << format_rate(static_cast<double>(c.shed - last.shed)) << ", outq "
+               << sender.outq() << " bytes, qdisc " << sender.qdisc_backlog() << " packets";
+            if (sender.policy() == PressurePolicy::adapt)
+            {
+                ss << ", rate " << (sender.rate() > 0 ? format_rate(sender.rate()) : "unlimited");
+            }
+            info(Component::server, ss.str());
+            last = c;
+        }
+    }
+    auto const elapsed = static_cast<double>(now_ns() - start) / 1e9;
+
+    std::stringstream ss;
+    ss << policy_to_str(sender.policy()) << ": offered "
+       << format_rate(static_cast<double>(seq) / elapsed) << ", delivered "
+       << format_rate(static_cast<double>(sender.counters().sent) / elapsed) << ", "
+       << sender.summary();
+    info(Component::server, ss.str());
+
+    ::close(fd);
+}
@@ -0,0 +1,328 @@
+#include "components.hpp"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/ip/address.hpp>
+
+#include "binding_functions.hpp"
+#include "flow_config.hpp"
+#include "logging.hpp"
+#include "realtime.hpp"
+#include "stats.hpp"
+#include "types.hpp"
+
+// Transmit scaling: the send flows are sharded over N threads, each of which
+// owns its sockets (set up like multicast_server's) and its payload buffers.
+// Nothing mutable is shared on the send path, each thread publishes its
+// counters on its own cache line, so what stops scaling is the kernel.
+
+namespace
+{
+
+struct alignas(cache_line_size) SenderCounters
+{
+    std::atomic<std::uint64_t> datagrams{0};
+    std::atomic<std::uint64_t> bytes{0};
+    std::atomic<std::uint64_t> errors{0};
+};
+
+/// One sending thread's share of the flow table
+class SenderShard
+{
+public:
+    SenderShard(FlowTable const& flows, std::size_t batch) : flows_(flows), batch_(batch)
+    {
+        for (auto const& flow : flows_)
+        {
+            auto const fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+            exit_on_error(fd, Component::server, "socket");
+            auto const dest = bind_multicast_sender(
+                fd,
+                Component::server,
+                boost::asio::ip::address_v4(ntohl(flow.if_addr.s_addr)),
+                flow.if_name,
+                boost::asio::ip::address_v4(ntohl(flow.group.s_addr)),
+                flow.port,
+                false);
+            set_qos(fd, Component::server, flow.priority, flow.dscp);
+            connect_to(fd, Component::server, dest, false);
+            fds_.push_back(fd);
+        }
+
+        // Every datagram of a batch gets its own buffer, the first 8 bytes
+        // are rewritten with a sequence number
+        std::size_t largest = sizeof(std::uint64_t);
+        for (auto const& flow : flows_)
+        {
+            largest = std::max<std::size_t>(largest, flow.payload);
+        }
+        buffers_.assign(batch_ * largest, 0);
+        iovs_.resize(batch_);
+#ifdef __linux__
+        msgs_.resize(batch_);
+#endif
+        for (std::size_t i = 0; i < batch_; ++i)
+        {
+            iovs_[i].iov_base = buffers_.data() + i * largest;
+#ifdef __linux__
+            std::memset(&msgs_[i], 0, sizeof(msgs_[i]));
+            msgs_[i].msg_hdr.msg_iov    = &iovs_[i];
+            msgs_[i].msg_hdr.msg_iovlen = 1;
+#endif
+        }
+    }
+
+    ~SenderShard()
+    {
+        for (auto const fd : fds_)
+        {
+            ::close(fd);
+        }
+    }
+
+    SenderShard(SenderShard const&)                    = delete;
+    auto operator=(SenderShard const&) -> SenderShard& = delete;
+
+    auto run(std::atomic<bool> const& running, SenderCounters& counters) -> void
+    {
+        std::uint64_t datagrams = 0;
+        std::uint64_t bytes     = 0;
+        std::uint64_t errors    = 0;
+        std::uint64_t seq       = 0;
+        std::size_t next        = 0;
+        while (running.load(std::memory_order_relaxed))
+        {
+            auto const f    = next++ % flows_.size();
+            auto const size = std::max<std::size_t>(flows_[f].payload, sizeof(seq));
+            for (std::size_t i = 0; i < batch_; ++i)
+            {
+                std::memcpy(iovs_[i].iov_base, &seq, sizeof(seq));
+                iovs_[i].iov_len = size;
+                ++seq;
+            }
+
+            auto const sent = send_batch(fds_[f]);
+            if (sent < 0)
+            {
+                // ENOBUFS/EAGAIN: the qdisc or the device queue is full
+                ++errors;
+            }
+            else
+            {
+                datagrams += static_cast<std::uint64_t>(sent);
+                bytes += static_cast<std::uint64_t>(sent) * size;
+            }
+
+            // Publish now and then, not per datagram
+            if ((next & 0xff) == 0)
+            {
+                counters.datagrams.store(datagrams, std::memory_order_relaxed);
+                counters.bytes.store(bytes, std::memory_order_relaxed);
+                counters.errors.store(errors, std::memory_order_relaxed);
+            }
+        }
+        counters.datagrams.store(datagrams, std::memory_order_relaxed);
+        counters.bytes.store(bytes, std::memory_order_relaxed);
+        counters.errors.store(errors, std::memory_order_relaxed);
+    }
+
+private:
+    auto send_batch(int fd) -> int
+    {
+#ifdef __linux__
+        if (batch_ > 1)
+        {
+            return ::sendmmsg(fd, msgs_.data(), static_cast<unsigned>(batch_), 0);
+        }
+#endif
+        auto const n = ::send(fd, iovs_[0].iov_base, iovs_[0].iov_len, 0);
+        return n < 0 ? -1 : 1;
+    }
+
+    FlowTable flows_;
+    std::size_t batch_;
+    std::vector<int> fds_;
+    std::vector<char> buffers_;
+    std::vector<iovec> iovs_;
+#ifdef __linux__
+    std::vector<mmsghdr> msgs_;
+#endif
+};
+
+struct StepResult
+{
+    std::size_t threads;
+    double total_pps;
+    double total_bps;
+    std::vector<double> per_thread_pps;
+    std::uint64_t errors;
+};
+
+auto run_step(
+    FlowTable const& flows,
+    std::size_t threads,
+    std::size_t batch,
+    ThreadTuning const& tuning,
+    std::chrono::duration<double> duration) -> StepResult
+{
+    // Flow i goes to thread i % threads, each thread gets at least one
+    std::vector<FlowTable> shards(threads);
+    for (std::size_t i = 0; i < std::max(flows.size(), threads); ++i)
+    {
+        shards[i % threads].push_back(flows[i % flows.size()]);
+    }
+
+    std::vector<std::unique_ptr<SenderShard>> senders;
+    for (auto const& shard : shards)
+    {
+        senders.push_back(std::make_unique<SenderShard>(shard, batch));
+    }
+    std::vector<SenderCounters> counters(threads);
+    std::atomic<bool> running{true};
+
+    std::vector<std::thread> workers;
+    auto const start = std::chrono::steady_clock::now();
+    for (std::size_t t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&, t] {
+            // One CPU per thread from --worker-cpus, round robin
+            auto own = tuning;
+            if (!own.cpus.empty())
+            {
+                own.cpus = {tuning.cpus[t % tuning.cpus.size()]};
+            }
+            apply_thread_tuning(Component::server, own);
+            senders[t]->run(running, counters[t]);
+        });
+    }
+    std::this_thread::sleep_for(duration);
+    running = false;
+    for (auto& w : workers)
+    {
+        w.join();
+    }
+    auto const elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start);
+
+    StepResult result{threads, 0, 0, {}, 0};
+    for (auto const& c : counters)
+    {
+        auto const pps = static_cast<double>(c.datagrams.load()) / elapsed.count();
+        result.per_thread_pps.push_back(pps);
+        result.total_pps += pps;
+        result.total_bps += static_cast<double>(c.bytes.load()) * 8 / elapsed.count();
+        result.errors += c.errors.load();
+    }
+    return result;
+}
+
+} // namespace
+
+auto tx_scale(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void
+{
+    auto const batch    = static_cast<std::size_t>(std::max(1LL, opts.get_int("batch", 1)));
+    auto const duration = std::chrono::duration<double>(opts.get_double("step-duration", 3.0));
+    auto const tuning   = thread_tuning_from_options(opts, "worker");
+
+    // --threads=1,2,4 or up to the number of CPUs in powers of two
+    std::vector<std::size_t> steps;
+    if (opts.has("threads"))
+    {
+        for (auto const t : parse_cpu_list(opts.get("threads"), "--threads"))
+        {
+            steps.push_back(static_cast<std::size_t>(std::max(1, t)));
+        }
+    }
+    else
+    {
+        auto const cpus = std::max(1U, std::thread::hardware_concurrency());
+        for (std::size_t t = 1; t <= cpus; t *= 2)
+        {
+            steps.push_back(t);
+        }
+    }
+
+    Flow defaults;
+    std::memset(&defaults, 0, sizeof(defaults));
+    address2in_addr(if_addr, defaults.if_addr);
+    address2in_addr(mc_addr, defaults.group);
+    defaults.port     = port;
+    defaults.payload  = static_cast<std::uint16_t>(opts.get_int("payload", 64));
+    defaults.role     = FlowRole::send;
+    defaults.priority = static_cast<std::uint8_t>(opts.get_int("priority", 0));
+    defaults.dscp     = static_cast<std::uint8_t>(opts.get_int("dscp", 0));
+    std::strncpy(defaults.if_name, if_name.c_str(), sizeof(defaults.if_name) - 1);
+
+    // Only send flows are scaled, a receive flow from --flows or --flow is
+    // left out rather than quietly sent to
+    FlowTable flows;
+    for (auto const& flow : load_flows(opts, defaults))
+    {
+        if (flow.role == FlowRole::send)
+        {
+            flows.push_back(flow);
+        }
+        else
+        {
+            warn(Component::main, "Not a send flow, skipped: " + flow_to_str(flow));
+        }
+    }
+    exit_on_error(flows.empty() ? -1 : 0, Component::main, "No send flows");
+
+    // --groups=G repeats every flow on the next G - 1 groups
+    auto const groups = std::max(1LL, opts.get_int("groups", 1));
+    FlowTable const base = flows;
+    for (long long g = 1; g < groups; ++g)
+    {
+        for (auto flow : base)
+        {
+            flow.group.s_addr = htonl(ntohl(flow.group.s_addr) + static_cast<std::uint32_t>(g));
+            flows.push_back(flow);
+        }
+    }
+
+    {
+        std::stringstream ss;
+        ss << "Scaling " << flows.size() << " flows over";
+        for (auto const t : steps)
+        {
+            ss << " " << t;
+        }
+        ss << " threads, batch " << batch << ", " << duration.count() << "s per step";
+        info(Component::main, ss.str());
+    }
+
+    double single = 0;
+    for (auto const threads : steps)
+    {
+        auto const r = run_step(flows, threads, batch, tuning, duration);
+        if (single == 0)
+        {
+            single = r.total_pps / static_cast<double>(r.threads);
+        }
+
+        std::stringstream ss;
+        ss << r.threads << " threads: " << format_rate(r.total_pps) << " "
+           << r.total_bps / 1e9 << " Gbit/s, efficiency "
+           << static_cast<int>(100 * r.total_pps / (single * static_cast<double>(r.threads)))
+           << "%, " << r.errors << " send errors, per thread";
+        for (auto const pps : r.per_thread_pps)
+        {
+            ss << " " << format_rate(pps);
+        }
+        info(Component::main, ss.str());
+    }
+}
@@ -4,10 +4,15 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 
+#include <cstddef>
+
 #ifdef __QNX__
     using IP_REQ = ip_mreq;
 #else
     using IP_REQ = ip_mreqn;
 #endif
 
+/// Used to pad anything shared between threads or processes
+static std::size_t constexpr cache_line_size = 64;
+
 #endif /* end of include guard: TYPES_HPP_XBALFVI4 */
@@ -0,0 +1,472 @@
+#include "components.hpp"
+
+#include "logging.hpp"
+
+#ifdef __linux__
+
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/ip/address.hpp>
+
+#include "binding_functions.hpp"
+#include "realtime.hpp"
+#include "stats.hpp"
+#include "timing.hpp"
+#include "types.hpp"
+
+// Thousands of subscribers on a handful of threads.  A virtual client is
+// what multicast_client does on a thread of its own, written as a step
+// function over a non-blocking socket: epoll says which clients can make
+// progress and the shard thread resumes just those.  (C++20 coroutines would
+// read nicer but the QNX and Android toolchains build this as C++17.)
+
+using namespace std::chrono_literals;
+
+namespace
+{
+
+/// How a virtual client's socket is set up, cycled through per client with
+/// --bind=device,group,any
+enum class Binding
+{
+    device, ///< like multicast_client: SO_BINDTODEVICE, join, bind to the group
+    group,  ///< join and bind to the group, no SO_BINDTODEVICE
+    any,    ///< join and bind to INADDR_ANY:port
+};
+
+auto binding_from_str(std::string const& s) -> Binding
+{
+    if (s == "group")
+    {
+        return Binding::group;
+    }
+    if (s == "any")
+    {
+        return Binding::any;
+    }
+    exit_on_error(s == "device" ? 0 : -1, Component::main, "Unknown binding " + s);
+    return Binding::device;
+}
+
+auto binding_to_str(Binding b) -> char const*
+{
+    switch (b)
+    {
+        case Binding::device: return "device";
+        case Binding::group: return "group";
+        case Binding::any: return "any";
+    }
+    return "?";
+}
+
+enum class VcState : std::uint8_t
+{
+    receiving,
+    done,
+};
+
+/// Kept small on purpose, this is the userspace cost per subscriber
+struct VirtualClient
+{
+    int fd{-1};
+    std::uint32_t group{0}; ///< network order
+    std::uint32_t received{0};
+    Binding binding{Binding::device};
+    VcState state{VcState::receiving};
+};
+
+/// Clients resumed by one thread, with its own epoll set
+struct alignas(cache_line_size) Shard
+{
+    int epoll_fd{-1};
+    std::vector<VirtualClient*> clients;
+    std::atomic<std::uint64_t> datagrams{0};
+    std::atomic<std::uint64_t> bytes{0};
+};
+
+auto open_virtual_client(
+    VirtualClient& vc,
+    IP_REQ req,
+    std::string const& if_name,
+    short unsigned int port) -> int
+{
+    vc.fd = ::socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (vc.fd < 0)
+    {
+        return -1;
+    }
+
+    // Everyone shares the port
+    int const opt = 1;
+    auto err      = ::setsockopt(vc.fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (err == 0)
+    {
+        err = ::setsockopt(vc.fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
+    }
+    if (err == 0 && vc.binding == Binding::device)
+    {
+        err = bind_to_device(vc.fd, if_name);
+    }
+    req.imr_multiaddr.s_addr = vc.group;
+    if (err == 0)
+    {
+        err = ::setsockopt(vc.fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &req, sizeof(req));
+    }
+
+    sockaddr_in addr;
+    std::memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = vc.binding == Binding::any ? htonl(INADDR_ANY) : vc.group;
+    addr.sin_port        = htons(port);
+    if (err == 0)
+    {
+        err = ::bind(vc.fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr));
+    }
+    if (err < 0)
+    {
+        auto const errno_b = errno;
+        ::close(vc.fd);
+        vc.fd = -1;
+        errno = errno_b;
+    }
+    return err;
+}
+
+/// One resumption: drain what is queued, leave the group once --messages
+/// have arrived.  `buffer` belongs to the shard, clients don't own one.
+auto step(VirtualClient& vc, Shard& shard, std::vector<char>& buffer, std::uint32_t messages)
+    -> void
+{
+    std::uint64_t datagrams = 0;
+    std::uint64_t bytes     = 0;
+    while (vc.state == VcState::receiving)
+    {
+        auto const n = ::recv(vc.fd, buffer.data(), buffer.size(), 0);
+        if (n < 0)
+        {
+            exit_on_errno(
+                errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR ? 0 : -1,
+                Component::client,
+                "recv");
+            break;
+        }
+        ++vc.received;
+        ++datagrams;
+        bytes += static_cast<std::uint64_t>(n);
+        if (messages != 0 && vc.received >= messages)
+        {
+            // Closing drops the membership and the epoll registration
+            ::close(vc.fd);
+            vc.fd    = -1;
+            vc.state = VcState::done;
+        }
+    }
+    shard.datagrams.fetch_add(datagrams, std::memory_order_relaxed);
+    shard.bytes.fetch_add(bytes, std::memory_order_relaxed);
+}
+
+auto resident_bytes() -> std::uint64_t
+{
+    std::ifstream statm{"/proc/self/statm"};
+    std::uint64_t size     = 0;
+    std::uint64_t resident = 0;
+    statm >> size >> resident;
+    return resident * static_cast<std::uint64_t>(::sysconf(_SC_PAGESIZE));
+}
+
+/// Kernel slab memory, system wide.  Socket, inode and membership structures
+/// live there, so the delta over setting up the clients is their kernel cost.
+auto kernel_slab_bytes() -> std::uint64_t
+{
+    std::ifstream meminfo{"/proc/meminfo"};
+    std::string key;
+    std::uint64_t kib = 0;
+    std::string unit;
+    while (meminfo >> key >> kib)
+    {
+        std::getline(meminfo, unit);
+        if (key == "Slab:")
+        {
+            return kib * 1024;
+        }
+    }
+    return 0;
+}
+
+auto raise_fd_limit(std::size_t wanted) -> void
+{
+    rlimit lim;
+    ::getrlimit(RLIMIT_NOFILE, &lim);
+    if (lim.rlim_cur >= wanted)
+    {
+        return;
+    }
+    lim.rlim_cur = std::min<rlim_t>(lim.rlim_max, wanted);
+    ::setrlimit(RLIMIT_NOFILE, &lim);
+    if (lim.rlim_cur < wanted)
+    {
+        std::stringstream ss;
+        ss << "RLIMIT_NOFILE hard limit is " << lim.rlim_max << ", not all " << wanted
+           << " sockets will open";
+        warn(Component::main, ss.str());
+    }
+}
+
+/// --rate datagrams/s spread round robin over the groups
+auto send_to_groups(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    std::uint32_t groups,
+    double rate,
+    std::atomic<bool> const& running) -> void
+{
+    auto const sock_fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+    exit_on_error(sock_fd, Component::server, "socket");
+    auto dest = bind_multicast_sender(sock_fd, Component::server, if_addr, if_name, mc_addr, port);
+
+    auto const first = mc_addr.to_v4().to_uint();
+
+    std::array<char, 64> payload{};
+    auto const period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1.0 / rate));
+    auto next         = std::chrono::steady_clock::now();
+    std::uint32_t i   = 0;
+    while (running.load(std::memory_order_relaxed))
+    {
+        std::this_thread::sleep_until(next);
+        next += period;
+        dest.sin_addr.s_addr = htonl(first + i++ % groups);
+        // clang-format off
+        ::sendto(
+            sock_fd,
+            payload.data(),
+            payload.size(),
+            0,
+            reinterpret_cast<struct sockaddr const*>(&dest),
+            sizeof(dest)
+        );
+        // clang-format on
+    }
+    ::close(sock_fd);
+}
+
+auto cpu_times() -> std::pair<std::uint64_t, std::uint64_t>
+{
+    rusage usage;
+    ::getrusage(RUSAGE_SELF, &usage);
+    auto const to_ns = [](timeval const& tv) {
+        return static_cast<std::uint64_t>(tv.tv_sec) * 1000000000 +
+               static_cast<std::uint64_t>(tv.tv_usec) * 1000;
+    };
+    return {to_ns(usage.ru_utime), to_ns(usage.ru_stime)};
+}
+
+} // namespace
+
+auto virtual_clients(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> void
+{
+    auto const count    = static_cast<std::size_t>(std::max(1LL, opts.get_int("clients", 1000)));
+    auto const threads  = static_cast<std::size_t>(std::max(1LL, opts.get_int("threads", 2)));
+    auto const groups   = static_cast<std::uint32_t>(std::max(1LL, opts.get_int("groups", 1)));
+    auto const messages = static_cast<std::uint32_t>(opts.get_int("messages", 0));
+    auto const rate     = opts.get_double("rate", 0.0);
+    auto const duration = std::chrono::duration<double>(opts.get_double("duration", 10.0));
+    auto const tuning   = thread_tuning_from_options(opts, "worker");
+
+    std::vector<Binding> bindings;
+    {
+        std::stringstream list{opts.get("bind", "device")};
+        std::string item;
+        while (std::getline(list, item, ','))
+        {
+            bindings.push_back(binding_from_str(item));
+        }
+    }
+    exit_on_error(bindings.empty() ? -1 : 0, Component::main, "--bind is empty");
+
+    raise_fd_limit(count + threads + 64);
+
+    // The interface part of the membership request is the same for everyone
+    auto const req   = make_ip_req(mc_addr, if_addr, if_name);
+    auto const first = mc_addr.to_v4().to_uint();
+
+    std::vector<std::unique_ptr<Shard>> shards;
+    for (std::size_t t = 0; t < threads; ++t)
+    {
+        shards.push_back(std::make_unique<Shard>());
+        shards.back()->epoll_fd = ::epoll_create1(EPOLL_CLOEXEC);
+        exit_on_error(shards.back()->epoll_fd, Component::main, "epoll_create1");
+    }
+
+    auto const rss_before    = resident_bytes();
+    auto const kernel_before = kernel_slab_bytes();
+    auto const setup_start   = now_ns();
+
+    std::vector<VirtualClient> clients(count);
+    std::size_t opened = 0;
+    for (std::size_t i = 0; i < count; ++i)
+    {
+        auto& vc   = clients[i];
+        vc.group   = htonl(first + static_cast<std::uint32_t>(i % groups));
+        vc.binding = bindings[i % bindings.size()];
+        if (open_virtual_client(vc, req, if_name, port) < 0)
+        {
+            std::stringstream ss;
+            ss << "Virtual client " << i << " (" << binding_to_str(vc.binding)
+               << "): " << strerror(errno) << ", continuing with " << opened;
+            warn(Component::client, ss.str());
+            break;
+        }
+
+        auto& shard = *shards[i % threads];
+        epoll_event ev;
+        ev.events   = EPOLLIN;
+        ev.data.ptr = &vc;
+        auto const err = ::epoll_ctl(shard.epoll_fd, EPOLL_CTL_ADD, vc.fd, &ev);
+        exit_on_error(err, Component::client, "epoll_ctl");
+        shard.clients.push_back(&vc);
+        ++opened;
+    }
+
+    auto const setup_ns     = now_ns() - setup_start;
+    auto const rss_after    = resident_bytes();
+    auto const kernel_after = kernel_slab_bytes();
+    {
+        auto const per = [opened](std::uint64_t before, std::uint64_t after) {
+            return opened == 0 || after < before ? 0 : (after - before) / opened;
+        };
+        std::stringstream ss;
+        ss << opened << " virtual clients on " << threads << " threads, " << groups
+           << " groups: setup " << format_ns(opened == 0 ? 0 : setup_ns / opened)
+           << "/client, RSS " << per(rss_before, rss_after) << " B/client (sizeof "
+           << sizeof(VirtualClient) << "), kernel slab " << per(kernel_before, kernel_after)
+           << " B/client";
+        info(Component::client, ss.str());
+    }
+
+    std::atomic<bool> running{true};
+    std::thread sender;
+    if (rate > 0)
+    {
+        sender = std::thread([&] {
+            send_to_groups(if_addr, if_name, mc_addr, port, groups, rate, running);
+        });
+    }
+
+    auto const cpu_start = cpu_times();
+    std::vector<std::thread> workers;
+    for (auto& shard : shards)
+    {
+        workers.emplace_back([&, s = shard.get()] {
+            apply_thread_tuning(Component::client, tuning);
+            std::vector<char> buffer(65536);
+            std::array<epoll_event, 256> events;
+            while (running.load(std::memory_order_relaxed))
+            {
+                auto const n = ::epoll_wait(s->epoll_fd, events.data(), events.size(), 100);
+                exit_on_error(
+                    n < 0 && errno != EINTR ? -1 : 0, Component::client, "epoll_wait");
+                for (int i = 0; i < n; ++i)
+                {
+                    step(*static_cast<VirtualClient*>(events[i].data.ptr), *s, buffer, messages);
+                }
+            }
+        });
+    }
+
+    auto const total = [&shards] {
+        std::uint64_t sum = 0;
+        for (auto const& s : shards)
+        {
+            sum += s->datagrams.load(std::memory_order_relaxed);
+        }
+        return sum;
+    };
+
+    auto const start = std::chrono::steady_clock::now();
+    auto last        = total();
+    while (std::chrono::steady_clock::now() - start < duration)
+    {
+        std::this_thread::sleep_for(1s);
+        auto const now = total();
+        info(Component::client, "delivered " + format_rate(static_cast<double>(now - last)));
+        last = now;
+    }
+    running = false;
+    for (auto& w : workers)
+    {
+        w.join();
+    }
+    if (sender.joinable())
+    {
+        sender.join();
+    }
+    auto const cpu_end = cpu_times();
+
+    std::uint64_t bytes = 0;
+    std::uint32_t least = ~std::uint32_t{0};
+    std::uint32_t most  = 0;
+    std::size_t done    = 0;
+    for (auto const& s : shards)
+    {
+        bytes += s->bytes.load(std::memory_order_relaxed);
+        ::close(s->epoll_fd);
+    }
+    for (std::size_t i = 0; i < opened; ++i)
+    {
+        least = std::min(least, clients[i].received);
+        most  = std::max(most, clients[i].received);
+        done += clients[i].state == VcState::done ? 1 : 0;
+        if (clients[i].fd >= 0)
+        {
+            ::close(clients[i].fd);
+        }
+    }
+
+    auto const delivered = total();
+    std::stringstream ss;
+    ss << "Delivered " << delivered << " datagrams (" << bytes << " bytes), per client min "
+       << (opened == 0 ? 0 : least) << " max " << most << ", " << done << " left after --messages";
+    if (delivered > 0)
+    {
+        ss << ", CPU user " << format_ns((cpu_end.first - cpu_start.first) / delivered)
+           << " sys " << format_ns((cpu_end.second - cpu_start.second) / delivered)
+           << " per delivered datagram";
+    }
+    info(Component::client, ss.str());
+}
+
+#else
+
+auto virtual_clients(
+    boost::asio::ip::address const& /* if_addr */,
+    std::string const& /* if_name */,
+    boost::asio::ip::address const& /* mc_addr */,
+    short unsigned int /* port */,
+    Options const& /* opts */) -> void
+{
+    exit_on_error(-1, Component::main, "virtual-clients needs epoll (Linux/Android)");
+}
+
+#endif
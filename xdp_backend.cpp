@@ -0,0 +1,459 @@
+#include "receive_backend.hpp"
+
+#ifdef __linux__
+
+#include <linux/bpf.h>
+#include <linux/if_ether.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <vector>
+
+#include <boost/asio/ip/address.hpp>
+
+#include "binding_functions.hpp"
+#include "logging.hpp"
+#include "timing.hpp"
+
+// AF_XDP receive path.  A small XDP program, assembled below so we don't
+// need clang/libbpf on the targets, matches IPv4/UDP to the group and port
+// and redirects it into an XSKMAP; everything else is passed on to the
+// stack untouched.  Frames land in a UMEM shared with userspace and are
+// parsed here, so the only syscall on the data path is poll() when idle.
+//
+// Generic (SKB) mode is the default so this works on veth in a network
+// namespace; --xdp-mode=native asks for driver mode.  One socket serves one
+// RX queue (--xdp-queue), which is all a veth has.
+
+#ifndef AF_XDP
+#define AF_XDP 44
+#endif
+#ifndef SOL_XDP
+#define SOL_XDP 283
+#endif
+
+namespace
+{
+
+auto sys_bpf(int cmd, bpf_attr& attr) -> int
+{
+    return static_cast<int>(::syscall(__NR_bpf, cmd, &attr, sizeof(attr)));
+}
+
+auto insn(std::uint8_t code, std::uint8_t dst, std::uint8_t src, std::int16_t off, std::int32_t imm)
+    -> bpf_insn
+{
+    bpf_insn i;
+    std::memset(&i, 0, sizeof(i));
+    i.code    = code;
+    i.dst_reg = dst & 0xf;
+    i.src_reg = src & 0xf;
+    i.off     = off;
+    i.imm     = imm;
+    return i;
+}
+
+/// The filter/redirect program.  Only plain 20 byte IPv4 headers are
+/// matched, anything with options goes to the stack.
+auto build_program(int xsk_map_fd, std::uint32_t group_be, std::uint16_t port_be)
+    -> std::vector<bpf_insn>
+{
+    std::uint8_t constexpr r0 = 0, r1 = 1, r2 = 2, r3 = 3, r4 = 4, r5 = 5, r6 = 6;
+    std::int16_t constexpr l2 = ETH_HLEN, l3 = 20, l4 = 8;
+
+    std::vector<bpf_insn> prog;
+    std::vector<std::size_t> to_pass;
+    auto emit = [&](bpf_insn i) { prog.push_back(i); };
+    auto jne_pass_imm = [&](std::uint8_t reg, std::int32_t imm) {
+        to_pass.push_back(prog.size());
+        emit(insn(BPF_JMP | BPF_JNE | BPF_K, reg, 0, 0, imm));
+    };
+    auto jne_pass_r0 = [&](std::uint8_t reg) {
+        to_pass.push_back(prog.size());
+        emit(insn(BPF_JMP | BPF_JNE | BPF_X, reg, r0, 0, 0));
+    };
+
+    // r6 = ctx, r2 = data, r3 = data_end
+    emit(insn(BPF_ALU64 | BPF_MOV | BPF_X, r6, r1, 0, 0));
+    emit(insn(BPF_LDX | BPF_MEM | BPF_W, r2, r1, offsetof(xdp_md, data), 0));
+    emit(insn(BPF_LDX | BPF_MEM | BPF_W, r3, r1, offsetof(xdp_md, data_end), 0));
+
+    // Bounds check for everything read below
+    emit(insn(BPF_ALU64 | BPF_MOV | BPF_X, r4, r2, 0, 0));
+    emit(insn(BPF_ALU64 | BPF_ADD | BPF_K, r4, 0, 0, l2 + l3 + l4));
+    to_pass.push_back(prog.size());
+    emit(insn(BPF_JMP | BPF_JGT | BPF_X, r4, r3, 0, 0));
+
+    // Loads are host endian, compare against the wire bytes read the same way
+    emit(insn(BPF_LDX | BPF_MEM | BPF_H, r5, r2, 12, 0));
+    jne_pass_imm(r5, htons(ETH_P_IP));
+    emit(insn(BPF_LDX | BPF_MEM | BPF_B, r5, r2, l2, 0));
+    jne_pass_imm(r5, 0x45);
+    emit(insn(BPF_LDX | BPF_MEM | BPF_B, r5, r2, l2 + 9, 0));
+    jne_pass_imm(r5, IPPROTO_UDP);
+
+    // 32 bit moves zero extend, so the group can be compared as a register
+    emit(insn(BPF_LDX | BPF_MEM | BPF_W, r5, r2, l2 + 16, 0));
+    emit(insn(BPF_ALU | BPF_MOV | BPF_K, r0, 0, 0, static_cast<std::int32_t>(group_be)));
+    jne_pass_r0(r5);
+    emit(insn(BPF_LDX | BPF_MEM | BPF_H, r5, r2, l2 + l3 + 2, 0));
+    emit(insn(BPF_ALU | BPF_MOV | BPF_K, r0, 0, 0, port_be));
+    jne_pass_r0(r5);
+
+    // return bpf_redirect_map(&xsks, ctx->rx_queue_index, XDP_PASS)
+    emit(insn(BPF_LD | BPF_DW | BPF_IMM, r1, BPF_PSEUDO_MAP_FD, 0, xsk_map_fd));
+    emit(insn(0, 0, 0, 0, 0));
+    emit(insn(BPF_LDX | BPF_MEM | BPF_W, r2, r6, offsetof(xdp_md, rx_queue_index), 0));
+    emit(insn(BPF_ALU64 | BPF_MOV | BPF_K, r3, 0, 0, XDP_PASS));
+    emit(insn(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map));
+    emit(insn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0));
+
+    auto const pass = prog.size();
+    emit(insn(BPF_ALU64 | BPF_MOV | BPF_K, r0, 0, 0, XDP_PASS));
+    emit(insn(BPF_JMP | BPF_EXIT, 0, 0, 0, 0));
+
+    for (auto const at : to_pass)
+    {
+        prog[at].off = static_cast<std::int16_t>(pass - at - 1);
+    }
+    return prog;
+}
+
+/// Producer/consumer ring shared with the kernel
+template <typename T> struct XskRing
+{
+    std::atomic<std::uint32_t>* producer{nullptr};
+    std::atomic<std::uint32_t>* consumer{nullptr};
+    T* entries{nullptr};
+    std::uint32_t mask{0};
+    void* map{nullptr};
+    std::size_t map_len{0};
+};
+
+template <typename T>
+auto map_ring(int fd, xdp_ring_offset const& off, std::uint32_t size, off_t pgoff, XskRing<T>& ring)
+    -> void
+{
+    ring.map_len = off.desc + size * sizeof(T);
+    // clang-format off
+    ring.map = ::mmap(
+        nullptr,
+        ring.map_len,
+        PROT_READ | PROT_WRITE,
+        MAP_SHARED | MAP_POPULATE,
+        fd,
+        pgoff
+    );
+    // clang-format on
+    exit_on_error(ring.map == MAP_FAILED ? -1 : 0, Component::client, "Could not map XDP ring");
+
+    auto* base    = static_cast<char*>(ring.map);
+    ring.producer = reinterpret_cast<std::atomic<std::uint32_t>*>(base + off.producer);
+    ring.consumer = reinterpret_cast<std::atomic<std::uint32_t>*>(base + off.consumer);
+    ring.entries  = reinterpret_cast<T*>(base + off.desc);
+    ring.mask     = size - 1;
+}
+
+class XdpBackend : public ReceiveBackend
+{
+public:
+    XdpBackend(
+        boost::asio::ip::address const& if_addr,
+        std::string const& if_name,
+        boost::asio::ip::address const& mc_addr,
+        short unsigned int port,
+        Options const& opts);
+    ~XdpBackend() override;
+
+    auto name() const -> char const* override { return "xdp"; }
+    auto poll(DatagramHandler const& handler, int timeout_ms) -> int override;
+    auto report() -> std::string override;
+
+private:
+    auto load_program(std::uint32_t group_be, std::uint16_t port_be) -> void;
+    auto setup_socket(std::uint32_t queue_id, bool zero_copy) -> void;
+
+    static std::uint32_t constexpr frame_size = 2048;
+    static std::uint32_t constexpr ring_size  = 2048;
+    /// Receive only: every frame is in the fill ring, with the kernel or in
+    /// the RX ring, so the UMEM holds exactly what the fill ring does
+    static std::uint32_t constexpr frame_count = ring_size;
+
+    std::uint32_t ifindex_{0};
+    int membership_fd_{-1};
+    int map_fd_{-1};
+    int prog_fd_{-1};
+    int link_fd_{-1};
+    int xsk_fd_{-1};
+    std::uint32_t xdp_flags_{XDP_FLAGS_SKB_MODE};
+
+    char* umem_{nullptr};
+    XskRing<xdp_desc> rx_;
+    XskRing<std::uint64_t> fill_;
+    XskRing<std::uint64_t> completion_;
+};
+
+XdpBackend::XdpBackend(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts)
+{
+    ifindex_ = ::if_nametoindex(if_name.c_str());
+    exit_on_error(ifindex_ == 0 ? -1 : 0, Component::client, "Unknown interface " + if_name);
+
+    auto const mode = opts.get("xdp-mode", "skb");
+    exit_on_error(
+        (mode == "skb" || mode == "native") ? 0 : -1,
+        Component::client,
+        "--xdp-mode must be skb or native");
+    xdp_flags_ = mode == "skb" ? XDP_FLAGS_SKB_MODE : XDP_FLAGS_DRV_MODE;
+
+    // XDP sees frames before IP, but the NIC still has to accept the group's
+    // MAC.  Keep an ordinary membership open for that.
+    {
+        membership_fd_ = ::socket(AF_INET, SOCK_DGRAM, 0);
+        exit_on_error(membership_fd_, Component::client, "Couldn't create socket");
+        auto const req = make_ip_req(mc_addr, if_addr, if_name);
+        auto const err =
+            ::setsockopt(membership_fd_, IPPROTO_IP, IP_ADD_MEMBERSHIP, &req, sizeof(req));
+        exit_on_error(err, Component::client, "Add membership error");
+    }
+
+    // Kernels before 5.11 charge BPF maps against RLIMIT_MEMLOCK
+    rlimit const unlimited{RLIM_INFINITY, RLIM_INFINITY};
+    ::setrlimit(RLIMIT_MEMLOCK, &unlimited);
+
+    std::uint32_t group_be = 0;
+    auto const group       = mc_addr.to_v4().to_bytes();
+    std::memcpy(&group_be, group.data(), sizeof(group_be));
+    load_program(group_be, htons(port));
+
+    setup_socket(
+        static_cast<std::uint32_t>(opts.get_int("xdp-queue", 0)), opts.has("xdp-zero-copy"));
+
+    std::stringstream ss;
+    ss << "AF_XDP socket on " << if_name << " queue " << opts.get_int("xdp-queue", 0) << " ("
+       << mode << " mode), redirecting " << mc_addr << ":" << port;
+    info(Component::client, ss.str());
+}
+
+XdpBackend::~XdpBackend()
+{
+    // Closing the link detaches the program
+    for (auto const fd : {link_fd_, xsk_fd_, prog_fd_, map_fd_, membership_fd_})
+    {
+        if (fd >= 0)
+        {
+            ::close(fd);
+        }
+    }
+    ::munmap(rx_.map, rx_.map_len);
+    ::munmap(fill_.map, fill_.map_len);
+    ::munmap(completion_.map, completion_.map_len);
+    ::munmap(umem_, std::size_t{frame_size} * frame_count);
+}
+
+auto XdpBackend::load_program(std::uint32_t group_be, std::uint16_t port_be) -> void
+{
+    {
+        bpf_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.map_type    = BPF_MAP_TYPE_XSKMAP;
+        attr.key_size    = sizeof(std::uint32_t);
+        attr.value_size  = sizeof(std::uint32_t);
+        attr.max_entries = 64;
+        map_fd_          = sys_bpf(BPF_MAP_CREATE, attr);
+        exit_on_errno(map_fd_, Component::client, "Could not create XSKMAP");
+    }
+
+    {
+        auto const prog = build_program(map_fd_, group_be, port_be);
+        std::vector<char> log(64 * 1024, '\0');
+        char const license[] = "GPL";
+
+        bpf_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.prog_type = BPF_PROG_TYPE_XDP;
+        attr.insns     = reinterpret_cast<std::uint64_t>(prog.data());
+        attr.insn_cnt  = static_cast<std::uint32_t>(prog.size());
+        attr.license   = reinterpret_cast<std::uint64_t>(license);
+        attr.log_buf   = reinterpret_cast<std::uint64_t>(log.data());
+        attr.log_size  = static_cast<std::uint32_t>(log.size());
+        attr.log_level = 1;
+        prog_fd_       = sys_bpf(BPF_PROG_LOAD, attr);
+        exit_on_error(
+            prog_fd_,
+            Component::client,
+            std::string{"XDP program rejected: "} + strerror(errno) + "\n" + log.data());
+    }
+
+    {
+        bpf_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.link_create.prog_fd        = static_cast<std::uint32_t>(prog_fd_);
+        attr.link_create.target_ifindex = ifindex_;
+        attr.link_create.attach_type    = BPF_XDP;
+        attr.link_create.flags          = xdp_flags_;
+        link_fd_                        = sys_bpf(BPF_LINK_CREATE, attr);
+        exit_on_errno(
+            link_fd_,
+            Component::client,
+            "Could not attach XDP program (needs Linux 5.9+)");
+    }
+}
+
+auto XdpBackend::setup_socket(std::uint32_t const queue_id, bool const zero_copy) -> void
+{
+    xsk_fd_ = ::socket(AF_XDP, SOCK_RAW, 0);
+    exit_on_errno(xsk_fd_, Component::client, "AF_XDP socket");
+
+    auto const umem_len = std::size_t{frame_size} * frame_count;
+    // clang-format off
+    auto* umem = ::mmap(
+        nullptr,
+        umem_len,
+        PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE,
+        -1,
+        0
+    );
+    // clang-format on
+    exit_on_error(umem == MAP_FAILED ? -1 : 0, Component::client, "Could not map UMEM");
+    umem_ = static_cast<char*>(umem);
+
+    xdp_umem_reg reg;
+    std::memset(&reg, 0, sizeof(reg));
+    reg.addr       = reinterpret_cast<std::uint64_t>(umem_);
+    reg.len        = umem_len;
+    reg.chunk_size = frame_size;
+    auto err       = ::setsockopt(xsk_fd_, SOL_XDP, XDP_UMEM_REG, &reg, sizeof(reg));
+    exit_on_errno(err, Component::client, "XDP_UMEM_REG");
+
+    auto const size = ring_size;
+    err             = ::setsockopt(xsk_fd_, SOL_XDP, XDP_UMEM_FILL_RING, &size, sizeof(size));
+    exit_on_error(err, Component::client, "XDP_UMEM_FILL_RING");
+    err = ::setsockopt(xsk_fd_, SOL_XDP, XDP_UMEM_COMPLETION_RING, &size, sizeof(size));
+    exit_on_error(err, Component::client, "XDP_UMEM_COMPLETION_RING");
+    err = ::setsockopt(xsk_fd_, SOL_XDP, XDP_RX_RING, &size, sizeof(size));
+    exit_on_error(err, Component::client, "XDP_RX_RING");
+
+    xdp_mmap_offsets off;
+    socklen_t off_len = sizeof(off);
+    err               = ::getsockopt(xsk_fd_, SOL_XDP, XDP_MMAP_OFFSETS, &off, &off_len);
+    exit_on_error(err, Component::client, "XDP_MMAP_OFFSETS");
+
+    map_ring(xsk_fd_, off.rx, size, XDP_PGOFF_RX_RING, rx_);
+    map_ring(xsk_fd_, off.fr, size, XDP_UMEM_PGOFF_FILL_RING, fill_);
+    map_ring(xsk_fd_, off.cr, size, XDP_UMEM_PGOFF_COMPLETION_RING, completion_);
+
+    // Hand the kernel the whole UMEM.  Nothing sends from it, so there is no
+    // point in frames the fill ring cannot hold.
+    for (std::uint32_t i = 0; i < frame_count; ++i)
+    {
+        fill_.entries[i] = std::uint64_t{i} * frame_size;
+    }
+    fill_.producer->store(frame_count, std::memory_order_release);
+
+    sockaddr_xdp sxdp;
+    std::memset(&sxdp, 0, sizeof(sxdp));
+    sxdp.sxdp_family   = AF_XDP;
+    sxdp.sxdp_ifindex  = ifindex_;
+    sxdp.sxdp_queue_id = queue_id;
+    sxdp.sxdp_flags    = zero_copy ? XDP_ZEROCOPY : XDP_COPY;
+    err = ::bind(xsk_fd_, reinterpret_cast<sockaddr*>(&sxdp), sizeof(sxdp));
+    exit_on_errno(err, Component::client, "AF_XDP bind");
+
+    bpf_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    auto const key   = queue_id;
+    auto const value = static_cast<std::uint32_t>(xsk_fd_);
+    attr.map_fd      = static_cast<std::uint32_t>(map_fd_);
+    attr.key         = reinterpret_cast<std::uint64_t>(&key);
+    attr.value       = reinterpret_cast<std::uint64_t>(&value);
+    err              = sys_bpf(BPF_MAP_UPDATE_ELEM, attr);
+    exit_on_errno(err, Component::client, "XSKMAP update");
+}
+
+auto XdpBackend::poll(DatagramHandler const& handler, int timeout_ms) -> int
+{
+    auto const cons = rx_.consumer->load(std::memory_order_relaxed);
+    auto prod       = rx_.producer->load(std::memory_order_acquire);
+    if (prod == cons)
+    {
+        pollfd pfd{xsk_fd_, POLLIN, 0};
+        if (::poll(&pfd, 1, timeout_ms) <= 0)
+        {
+            return 0;
+        }
+        prod = rx_.producer->load(std::memory_order_acquire);
+    }
+
+    auto const rx_ns = now_ns();
+    auto fill_prod   = fill_.producer->load(std::memory_order_relaxed);
+    int count        = 0;
+    for (auto i = cons; i != prod; ++i)
+    {
+        auto const& desc = rx_.entries[i & rx_.mask];
+        auto const* f    = umem_ + desc.addr;
+
+        // The program only redirects IPv4/UDP with a 20 byte header
+        std::size_t constexpr hdr = ETH_HLEN + 20 + 8;
+        if (desc.len >= hdr)
+        {
+            std::uint16_t udp_len = 0;
+            std::memcpy(&udp_len, f + ETH_HLEN + 20 + 4, sizeof(udp_len));
+            auto const payload = std::min<std::size_t>(ntohs(udp_len) - 8U, desc.len - hdr);
+            handler(Datagram{f + hdr, payload, rx_ns});
+            ++count;
+        }
+
+        // Recycle the frame.  There are only as many frames as fill ring
+        // entries, so there is always room for what we just consumed.
+        fill_.entries[fill_prod & fill_.mask] = desc.addr - desc.addr % frame_size;
+        ++fill_prod;
+    }
+    fill_.producer->store(fill_prod, std::memory_order_release);
+    rx_.consumer->store(prod, std::memory_order_release);
+    return count;
+}
+
+auto XdpBackend::report() -> std::string
+{
+    xdp_statistics st;
+    socklen_t len  = sizeof(st);
+    auto const err = ::getsockopt(xsk_fd_, SOL_XDP, XDP_STATISTICS, &st, &len);
+    exit_on_error(err, Component::client, "XDP_STATISTICS");
+
+    std::stringstream ss;
+    ss << "rx dropped=" << st.rx_dropped << " rx ring full=" << st.rx_ring_full
+       << " fill ring empty=" << st.rx_fill_ring_empty_descs;
+    return ss.str();
+}
+
+} // namespace
+
+auto make_xdp_backend(
+    boost::asio::ip::address const& if_addr,
+    std::string const& if_name,
+    boost::asio::ip::address const& mc_addr,
+    short unsigned int port,
+    Options const& opts) -> std::unique_ptr<ReceiveBackend>
+{
+    return std::make_unique<XdpBackend>(if_addr, if_name, mc_addr, port, opts);
+}
+
+#endif